@@ -0,0 +1,46 @@
+#ifndef _ADC_CAPTURE_H_
+#define _ADC_CAPTURE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Continuous capture of one ADC input into two ping-pong buffers.
+//
+// The ADC runs free at the requested rate and two chained DMA channels
+// fill the buffers in turn, so the CPU only gets an interrupt per block.
+// Only available on the RP2040, elsewhere begin() fails and no blocks are
+// ever produced.
+class AdcCapture {
+public:
+  static constexpr size_t BLOCK_SIZE = 256;
+
+private:
+  const int PIN;
+  const uint32_t SAMPLE_RATE_HZ;
+
+  uint16_t buffers_[2][BLOCK_SIZE];
+  int channels_[2] = {-1, -1};
+
+  volatile uint32_t blocksCaptured_ = 0;
+  uint32_t blocksRead_ = 0;
+  uint32_t overruns_ = 0;
+
+  static AdcCapture *instance_;
+  static void onDmaComplete();
+
+public:
+  AdcCapture(int pin, uint32_t sampleRateHz);
+
+  bool begin();
+
+  // Next full block of BLOCK_SIZE samples, or nullptr if none is ready.
+  // The block stays valid until the DMA comes back to it, one block time
+  // later.
+  const uint16_t *nextBlock();
+
+  uint32_t sampleRate() const { return SAMPLE_RATE_HZ; }
+  // Blocks lost because they were not read in time
+  uint32_t overruns() const { return overruns_; }
+};
+
+#endif
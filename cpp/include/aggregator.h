@@ -0,0 +1,55 @@
+#ifndef _AGGREGATOR_H_
+#define _AGGREGATOR_H_
+
+#include <measurements.h>
+#include <sensorReading.h>
+
+#include <cstdint>
+
+// Turns slow-moving measurements into one record per time window instead of
+// one value per GPS fix.
+//
+// Every fresh sensor reading goes through add(). Measurements with a window
+// keep running statistics (Welford's method, so memory is constant and the
+// variance stays accurate) and are left out of the per-fix records by
+// rawOnly(). When a window is over, takeClosed() hands out an aggregate
+// reading: the mean as the measurement itself, plus the GROUP_AGGREGATE
+// statistics. Measurements without a window are stored raw as before.
+//
+// A window starts with its first reading and holds those taken until
+// windowMs later, so closed windows are taken before adding the next
+// reading.
+class WindowedAggregator {
+private:
+  struct Window {
+    uint32_t windowMs = 0; // 0 if the measurement is stored raw
+    uint32_t startMs = 0;
+    uint32_t count = 0;
+    double mean = 0;
+    double m2 = 0; // sum of squared differences from the mean
+    double min = 0;
+    double max = 0;
+  };
+
+  Window windows_[MEASUREMENT_COUNT];
+  uint32_t aggregated_ = 0; // bit n is set if measurement n has a window
+
+  void emit(MeasurementId id, uint32_t nowMs, SensorReading &aggregate);
+
+public:
+  // Aggregates the measurement over windows of windowMs, 0 stores it raw
+  void setWindow(MeasurementId id, uint32_t windowMs);
+  bool enabled() const { return aggregated_ != 0; }
+
+  void add(const SensorReading &reading, uint32_t nowMs);
+
+  // The reading without the measurements that are aggregated
+  SensorReading rawOnly(const SensorReading &reading) const;
+
+  // Takes out one window that is over, or any open window if flush is set,
+  // e.g. at the end of a trip. Returns false once there are none left.
+  bool takeClosed(uint32_t nowMs, SensorReading &aggregate,
+                  bool flush = false);
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _BATCH_SIZER_H_
+#define _BATCH_SIZER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Picks the number of records per upload request, additive increase /
+// multiplicative decrease on the measured latency and throughput.
+//
+// A batch that comes back within TARGET_LATENCY_MS, at a throughput no
+// worse than half the recent average, grows the size by STEP. A slow batch
+// shrinks it by a quarter and a failed one halves it.
+class BatchSizer {
+  const int STEP;
+  const int MAX_SIZE;
+  const uint32_t TARGET_LATENCY_MS;
+
+  int size_;
+  uint32_t averageBytesPerSecond_ = 0;
+
+public:
+  BatchSizer(int initialSize, int maxSize, uint32_t targetLatencyMs);
+
+  int size() const { return size_; }
+  // Clamped to [1, MAX_SIZE]
+  void setSize(int size);
+
+  // records is how many were actually sent, less than size() when the data
+  // or the memory ceiling ran out first
+  void onSuccess(int records, size_t bytes, uint32_t latencyMs);
+  void onFailure();
+
+  uint32_t averageBytesPerSecond() const { return averageBytesPerSecond_; }
+};
+
+#endif
@@ -1,10 +1,26 @@
 #ifndef _BIKESENSE_H_
 #define _BIKESENSE_H_
 
+#include <aggregator.h>
+#include <batchSizer.h>
+#include <channel.h>
+#include <chunkedRequest.h>
+#include <coreLock.h>
 #include <elapsedMillis.h>
+#include <httpSession.h>
+#include <instrumentation.h>
 #include <interfaces.h>
+#include <logger.h>
+#include <ringBuffer.h>
 #include <sensorReading.h>
+#include <sensorScheduler.h>
+#include <trajectory.h>
+#include <wakeTimer.h>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -13,6 +29,53 @@
 
 typedef std::unordered_map<std::string, std::string> StringMap;
 
+enum UploadMode {
+  BATCHED_UPLOAD,  // one POST per UPLOAD_BATCH_SIZE records
+  STREAMED_UPLOAD, // the whole trip in one chunked POST
+};
+
+// Messages from the collecting core to the uploader core
+enum UploadCommandType {
+  UPLOAD_START,   // records of the backlog follow, a trip of their own
+  UPLOAD_CURRENT, // records stored since the last upload follow, they go to
+                  // the trip of the ride that ended at this dock
+  UPLOAD_RECORD,  // one JSON record
+  UPLOAD_END,     // no more records
+  UPLOAD_NOTHING, // nothing stored, no upload this time
+};
+
+struct UploadCommand {
+  static constexpr size_t MAX_RECORD_SIZE = 896;
+
+  UploadCommandType type;
+  uint16_t length;
+  char data[MAX_RECORD_SIZE];
+};
+
+static_assert(maxSerializedRecordSize() <= UploadCommand::MAX_RECORD_SIZE,
+              "a serialized record must fit in one upload command");
+
+// Messages from the uploader core to the collecting core, which owns storage
+enum UploaderEventType {
+  UPLOADER_WIFI_CONNECTED, // ready to upload, asks for records
+  UPLOADER_DONE,           // records made it to the server
+  UPLOADER_FAILED,         // upload aborted, remaining records are discarded
+};
+
+struct UploaderEvent {
+  UploaderEventType type;
+};
+
+// Progress of the collecting core in feeding an upload
+enum FeedState {
+  FEED_IDLE,
+  FEED_RECORDS,
+  FEED_END,
+  FEED_WAITING,
+};
+
+typedef std::function<bool(std::string_view &record)> RecordSource;
+
 enum BikeSenseStates {
   IDLE,
   COLLECTING_DATA,
@@ -23,10 +86,35 @@ enum BikeSenseStates {
 
 class BikeSense {
 private:
+  static constexpr size_t SAMPLE_QUEUE_SIZE = 32;
+  static constexpr size_t DRAIN_BATCH_SIZE = 8;
+  static constexpr size_t LOG_DRAIN_BATCH_SIZE = 8;
+  static constexpr size_t LOG_LINE_SIZE = 128;
+  const uint32_t DRAIN_INTERVAL_MS = 5000;
+  // How often the drainer on core 1 looks for samples and logs
+  const uint32_t DRAINER_INTERVAL_MS = 100;
+  const int LED_BLINK_INTERVAL_MS = 500;
+  // How often IDLE looks for WiFi going away, which starts a trip
+  const int IDLE_WIFI_CHECK_INTERVAL_MS = 5000;
+  // Longest sleep between loop iterations, bounds how late a lost GPS fix or
+  // logs from the other core are noticed
+  const uint32_t MAX_SLEEP_MS = 1000;
+  const int STATS_INTERVAL_MS = 60000;
+
   const int SENSOR_READ_INTERVAL_MS;
   const int WIFI_RETRY_INTERVAL_MS;
   const int HTTP_TIMEOUT_MS;
   const int UPLOAD_BATCH_SIZE;
+  const UploadMode UPLOAD_MODE;
+  // Memory ceiling for one batched upload request
+  const size_t MAX_UPLOAD_PAYLOAD_BYTES = 32 * 1024;
+  const int MAX_UPLOAD_BATCH_SIZE = 500;
+  const uint32_t TARGET_BATCH_LATENCY_MS = 2000;
+  const int MAX_BATCH_ATTEMPTS = 3;
+  const char *BATCH_SIZE_STATE = "batch_size";
+  const bool DUAL_CORE;
+  const int UPLOADER_CORE = 1;
+  bool compressUploads_;
 
   const std::string &API_TOKEN;
   const std::string &API_ENDPOINT;
@@ -35,44 +123,162 @@ private:
   const std::string &UNIT_CODE;
 
   BikeSenseStates state_ = IDLE;
+  elapsedMillis wifiRetryTimer_{(unsigned long)WIFI_RETRY_INTERVAL_MS};
+  elapsedMillis builtinLedTimer_;
+  bool builtinLedState_ = false;
+#if BIKESENSE_INSTRUMENTATION
+  elapsedMillis statsTimer_;
+#endif
 
   bool registered_ = false;
   int bikeId_ = -1;
   int unitId_ = -1;
 
   std::vector<SensorInterface *> sensors_;
+  SensorScheduler scheduler_;
+  WindowedAggregator aggregator_;
+  TrajectorySimplifier simplifier_;
   GpsInterface *gps_;
   DataStorageInterface *dataStorage_;
   LedInterface *led_;
 
+  HttpSession session_;
   HTTPClient http_;
+  ChunkedRequest streamRequest_;
   WiFiMulti multi_;
+  std::string payload_;
+  std::string compressedPayload_;
+  BatchSizer batchSizer_;
 
-  void setup();
-  SensorReading readSensors() const;
+  // Samples waiting to be persisted, filled by saveData and emptied by
+  // drainSamples. Storages that don't keep the binary layout get the
+  // records as they were taken instead, through records_.
+  SpscRing<EncodedRecord, SAMPLE_QUEUE_SIZE> samples_;
+  std::unique_ptr<SpscRing<DataRecord, SAMPLE_QUEUE_SIZE>> records_;
+  EncodedRecord drainBuffer_[DRAIN_BATCH_SIZE];
+  elapsedMillis drainTimer_;
+  uint32_t reportedDrops_ = 0;
+  // Held by whichever core is using the storage
+  CoreLock storageLock_;
+  // Set once runDrainer took over the storage writes from the main loop
+  std::atomic<bool> drainerStarted_{false};
+
+  LogEntry logBuffer_[LOG_DRAIN_BATCH_SIZE];
+  uint32_t reportedLogDrops_ = 0;
+
+  Channel<UploadCommand> uploadCommands_;
+  Channel<UploaderEvent> uploaderEvents_;
+
+  // Collecting core side of a dual-core upload
+  FeedState feedState_ = FEED_IDLE;
+  elapsedMillis sealTimer_{(unsigned long)WIFI_RETRY_INTERVAL_MS};
+  bool feedAborted_ = false;
+  UploadCommand feedCommand_;
+  RecordBatch feedBatch_;
+  size_t feedIndex_ = 0;
+
+  // Uploader core side of a dual-core upload
+  elapsedMillis uploaderWifiTimer_{(unsigned long)WIFI_RETRY_INTERVAL_MS};
+  UploadCommand command_;
+  bool endReceived_ = false;
+  // Trip of the ride that ended at this dock, everything stored while docked
+  // is added to it. -1 until registered and once WiFi is lost.
+  int rideTripId_ = -1;
+  // Trip of a segment of the ride that failed to upload, it's first in the
+  // backlog and still goes to that trip
+  int leftoverTripId_ = -1;
 
   inline bool checkWifi();
 
+  void drainLogs();
+  void sleepUntilDue();
+
+  void beginRequest(const std::string &endpoint);
+  void logConnectionStats();
+
   int registerAndGetID(std::string payload, std::string endpoint);
   int registerTripAndGetID();
 
   bool uploadAllSensorData();
-  int uploadData(const std::vector<std::string> &readings);
+  bool uploadSegment();
+  void saveCheckpoint(const UploadCheckpoint &checkpoint);
+  bool uploadBatches(UploadCheckpoint &checkpoint);
+  int fillPayload(int maxRecords);
+  int postBatch(int tripId, uint32_t seq);
+  bool streamTripData(int tripId);
+  int streamRecords(int tripId, const RecordSource &nextRecord);
+  int postPayload();
   int saveData(const SensorReading sensorData, const SensorReading gpsData,
-               const std::string timestamp);
+               uint64_t timestampMs);
+  // Stores the fix if it's a keeper, see TrajectorySimplifier
+  void saveFix(const SensorReading sensorData, const SensorReading gpsData,
+               uint64_t timestampMs);
+  // Stores the aggregates whose window is over, or all of them on flush
+  void saveAggregates(bool flush = false);
+  // Stores everything held back, at the end of a trip
+  void flushPending();
+  size_t queuedSamples() const;
+  uint32_t droppedSamples() const;
+  void drainSamples(bool force = false);
+  void syncStorage();
+
+#if BIKESENSE_INSTRUMENTATION
+  InstrumentCounters counters() const;
+  void logStats();
+  void writeTripSummary(std::string &out) const;
+  void postTripSummary(const UploadCheckpoint &checkpoint);
+#endif
+
+  void postEvent(UploaderEventType type);
+  void serviceUploader();
+  void startFeeding();
+  void feedRecords();
+  bool uploadQueuedRecords(bool currentRide);
 
 public:
+  // Defaults of the constructor, BikeSenseBuilder builds with these
+  static constexpr WiFiMode_t DEFAULT_WIFI_MODE = WIFI_STA;
+  static constexpr int DEFAULT_SENSOR_READ_INTERVAL_MS = 1000;
+  static constexpr int DEFAULT_WIFI_RETRY_INTERVAL_MS = 30000;
+  // Covers a TLS handshake on the RP2040 and a busy server, like
+  // HTTPClient's own default
+  static constexpr int DEFAULT_HTTP_TIMEOUT_MS = 5000;
+  static constexpr int DEFAULT_UPLOAD_BATCH_SIZE = 10;
+
   BikeSense(std::vector<SensorInterface *> sensors, GpsInterface *gps,
             DataStorageInterface *dataStorage, LedInterface *led,
             const StringMap &networks, const std::string &bikeCode,
             const std::string &unitCode, const std::string &apiAuthToken,
             const std::string &apiEndpoint,
-            const WiFiMode_t wifi_mode = WIFI_STA,
-            const int sensor_read_interval_ms = 1000,
-            const int wifi_retry_interval_ms = 30000,
-            const int http_timeout_ms = 1000, const int upload_batch_size = 10);
+            const WiFiMode_t wifi_mode = DEFAULT_WIFI_MODE,
+            const int sensor_read_interval_ms = DEFAULT_SENSOR_READ_INTERVAL_MS,
+            const int wifi_retry_interval_ms = DEFAULT_WIFI_RETRY_INTERVAL_MS,
+            const int http_timeout_ms = DEFAULT_HTTP_TIMEOUT_MS,
+            const int upload_batch_size = DEFAULT_UPLOAD_BATCH_SIZE,
+            const UploadMode upload_mode = BATCHED_UPLOAD,
+            const bool compress_uploads = false, const bool dual_core = false,
+            const DropPolicy drop_policy = DROP_OLDEST,
+            const WindowedAggregator &aggregator = WindowedAggregator(),
+            const float trajectory_tolerance_m = 0);
 
+  // Runs the device. In dual-core mode this is the collecting side and
+  // runUploader must be called from the other core.
   void run();
+  // run() is setup() followed by step() forever, hosts that drive the loop
+  // themselves call them directly. A step sleeps until something is due
+  // unless the state changed.
+  void setup();
+  void step();
+  // Owns WiFi and HTTP in dual-core mode, never returns
+  void runUploader();
+  // One iteration of runUploader, for hosts that drive it themselves
+  void stepUploader();
+  // Writes samples and logs to storage from core 1 when it isn't the
+  // uploader, so an SD card stall never holds up the GPS UART. Never
+  // returns.
+  void runDrainer();
+  // One iteration of runDrainer, for hosts that drive it themselves
+  void stepDrainer();
 };
 
 class BikeSenseBuilder {
@@ -88,6 +294,12 @@ private:
   DataStorageInterface *dataStorage_;
   LedInterface *led_;
   StringMap networks_;
+  UploadMode uploadMode_ = BATCHED_UPLOAD;
+  bool compressUploads_ = false;
+  bool dualCore_ = false;
+  DropPolicy dropPolicy_ = DROP_OLDEST;
+  WindowedAggregator aggregator_;
+  float trajectoryToleranceM_ = 0;
 
 public:
   BikeSenseBuilder();
@@ -105,6 +317,17 @@ public:
   BikeSenseBuilder &addNetwork(const std::string &ssid,
                                const std::string &password);
 
+  BikeSenseBuilder &withUploadMode(UploadMode mode);
+  BikeSenseBuilder &withCompression(bool enabled);
+  BikeSenseBuilder &withDualCore(bool enabled);
+  BikeSenseBuilder &withDropPolicy(DropPolicy policy);
+  // Stores the measurement as mean, min, max and standard deviation over
+  // windows of windowMs instead of with every GPS fix
+  BikeSenseBuilder &withAggregation(MeasurementId id, uint32_t windowMs);
+  // Drops fixes that stay within toleranceM of the path through the kept
+  // ones, folding their sensor readings into those. 0 keeps every fix.
+  BikeSenseBuilder &withTrajectoryTolerance(float toleranceM);
+
   BikeSense build();
 };
 
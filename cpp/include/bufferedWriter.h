@@ -0,0 +1,69 @@
+#ifndef _BUFFERED_WRITER_H_
+#define _BUFFERED_WRITER_H_
+
+#include <SD.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// When buffered data is pushed to the card and the directory entry updated
+struct FlushPolicy {
+  size_t maxPendingBytes = 4096;     // sync after this many unsynced bytes
+  unsigned long maxPendingMs = 5000; // sync when the oldest unsynced write
+                                     // is older than this
+};
+
+struct WriterStats {
+  uint32_t bytesRequested = 0; // bytes handed to write()
+  uint32_t blockWrites = 0;    // writes issued to the file
+  uint32_t bytesWritten = 0;   // bytes issued to the file
+  uint32_t syncs = 0;          // directory updates (File::flush)
+};
+
+// Keeps a file open in append mode and only hands it whole 512-byte blocks
+// aligned to the card's sectors, so a sample costs a memcpy instead of an
+// open/write/close cycle with a directory update.
+class BufferedWriter {
+public:
+  static constexpr size_t SECTOR_SIZE = 512;
+
+private:
+  File file_;
+  const char *path_ = nullptr;
+  FlushPolicy policy_;
+  WriterStats stats_;
+
+  uint8_t buffer_[SECTOR_SIZE];
+  size_t used_ = 0;
+  size_t blockEnd_ = SECTOR_SIZE;
+
+  size_t fileSize_ = 0;
+  size_t pendingBytes_ = 0;
+  unsigned long firstPendingMs_ = 0;
+
+  bool writeBlock();
+
+public:
+  BufferedWriter(FlushPolicy policy = FlushPolicy());
+
+  bool open(const char *path);
+  void close();
+  bool isOpen() const;
+
+  bool write(const uint8_t *data, size_t length);
+  bool write(const char *data, size_t length);
+
+  // Writes the buffered bytes and updates the directory entry. Everything
+  // written before a successful sync survives a power loss.
+  bool sync();
+  // Syncs if the oldest unsynced write is older than maxPendingMs. Called
+  // regularly, so data written just before the writes stop doesn't wait
+  // for the next one.
+  bool poll();
+
+  // Size of the file including bytes still in the buffer
+  size_t size() const;
+  const WriterStats &stats() const;
+};
+
+#endif
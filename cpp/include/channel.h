@@ -0,0 +1,81 @@
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include <cstddef>
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <pico/util/queue.h>
+#else
+#include <Arduino.h>
+#include <deque>
+#include <mutex>
+#endif
+
+// Bounded FIFO of fixed-size messages between the two cores. Items are
+// copied in and out, so nothing is shared between the sides.
+//
+// On the RP2040 this is the SDK's spin-lock protected queue, on the host
+// the same interface is backed by a mutex and blocks through
+// waitForOtherCore, so both loops can run as the host's two cores.
+template <typename T> class Channel {
+#ifdef ARDUINO_ARCH_RP2040
+  queue_t queue_;
+
+public:
+  Channel(unsigned capacity) { queue_init(&queue_, sizeof(T), capacity); }
+  ~Channel() { queue_free(&queue_); }
+
+  bool trySend(const T &item) { return queue_try_add(&queue_, &item); }
+  void send(const T &item) { queue_add_blocking(&queue_, &item); }
+
+  bool tryReceive(T &item) { return queue_try_remove(&queue_, &item); }
+  void receive(T &item) { queue_remove_blocking(&queue_, &item); }
+
+#else
+  const size_t CAPACITY;
+  std::deque<T> items_;
+  std::mutex mutex_;
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return items_.size();
+  }
+
+public:
+  Channel(unsigned capacity) : CAPACITY(capacity) {}
+
+  bool trySend(const T &item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (items_.size() == CAPACITY) {
+      return false;
+    }
+    items_.push_back(item);
+    return true;
+  }
+
+  void send(const T &item) {
+    waitForOtherCore([this] { return size() < CAPACITY; });
+    trySend(item);
+  }
+
+  bool tryReceive(T &item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (items_.empty()) {
+      return false;
+    }
+    item = items_.front();
+    items_.pop_front();
+    return true;
+  }
+
+  void receive(T &item) {
+    waitForOtherCore([this] { return size() > 0; });
+    tryReceive(item);
+  }
+#endif
+
+  Channel(const Channel &) = delete;
+  Channel &operator=(const Channel &) = delete;
+};
+
+#endif
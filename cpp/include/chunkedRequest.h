@@ -0,0 +1,61 @@
+#ifndef _CHUNKED_REQUEST_H_
+#define _CHUNKED_REQUEST_H_
+
+#include <httpSession.h>
+
+#include <string>
+#include <string_view>
+
+// Minimal HTTP/1.1 POST with a chunked body, for payloads whose size isn't
+// known up front. Body bytes are gathered into a fixed buffer and sent one
+// chunk at a time, so memory use doesn't depend on the payload size. The
+// request goes over the session's keep-alive connection.
+//
+// Errors are reported with the HTTPClient error codes (HTTPC_ERROR_*) so
+// they can be turned into text with HTTPClient::errorToString.
+class ChunkedRequest {
+public:
+  static constexpr size_t CHUNK_SIZE = 1024;
+
+private:
+  HttpSession &session_;
+
+  std::string path_;
+  std::string headers_;
+  std::string response_;
+
+  char chunk_[CHUNK_SIZE];
+  size_t used_ = 0;
+  size_t bytesSent_ = 0;
+  bool failed_ = false;
+  bool inProgress_ = false;
+
+  bool sendChunk();
+  bool readBody(long length);
+  int readResponse();
+
+public:
+  ChunkedRequest(HttpSession &session);
+
+  // Starts a request to an API path such as "/trip/upload_data"
+  void begin(const std::string &apiPath);
+  void addHeader(const std::string &name, const std::string &value);
+
+  // Connects and sends the request line and headers
+  int startPost();
+
+  bool write(const char *data, size_t length);
+  bool write(std::string_view data);
+
+  // Sends the last chunk and waits for the status line
+  int finish();
+  // Drops the connection if the request did not complete
+  void end();
+
+  // Bytes of body sent so far, excluding chunk framing
+  size_t bytesSent() const;
+  // Start of the response body, for error reporting
+  const std::string &response() const;
+};
+
+#endif
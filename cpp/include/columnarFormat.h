@@ -0,0 +1,134 @@
+#ifndef _COLUMNAR_FORMAT_H_
+#define _COLUMNAR_FORMAT_H_
+
+#include <recordFormat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bits appended most significant first, the last byte padded with zeros
+class BitWriter {
+private:
+  std::vector<uint8_t> bytes_;
+  uint8_t freeBits_ = 0; // unused low bits of the last byte
+
+public:
+  void write(uint64_t value, int nBits);
+  void writeBit(bool bit) { write(bit, 1); }
+  // LEB128, 7 bits per byte with the high bit set on all but the last
+  void writeVarint(uint64_t value);
+
+  const std::vector<uint8_t> &bytes() const { return bytes_; }
+  void clear() {
+    bytes_.clear();
+    freeBits_ = 0;
+  }
+};
+
+class BitReader {
+private:
+  const uint8_t *data_;
+  size_t sizeBits_;
+  size_t positionBits_ = 0;
+  bool failed_ = false;
+
+public:
+  BitReader(const uint8_t *data, size_t size)
+      : data_(data), sizeBits_(size * 8) {}
+
+  // Reading past the end returns zeros and sets failed()
+  uint64_t read(int nBits);
+  bool readBit() { return read(1); }
+  uint64_t readVarint();
+
+  // For decoders that find the bits make no sense
+  void fail() {
+    failed_ = true;
+    positionBits_ = sizeBits_;
+  }
+  bool failed() const { return failed_; }
+};
+
+// Trip data as blocks of samples stored column by column, so consecutive
+// values of the same measurement sit next to each other and mostly encode
+// as a few bits of change.
+//
+// The file starts with a header describing the schema:
+//   magic "BSC1" | version u8 | field count u8 | block samples u8 |
+//   per field: as in the BinaryRecordFormat header
+//
+// Followed by blocks, each decodable on its own:
+//   sample count u8 | payload size u16 | payload
+//
+// The payload holds one column after the other, each as a varint byte
+// length followed by its bits:
+//   timestamps:  the first in 64 bits, then the delta-of-delta in ms
+//   presence:    the first mask in 32 bits, then 0 if unchanged or
+//                1 and the new mask
+//   per field:   only samples where it is present, each as the value
+//                followed by the age, 0 if unchanged or 1 and 8 bits
+//
+// Latitude, longitude and altitude are XOR-coded as doubles holding their
+// fixed-point value, whose low mantissa bits are always zero, floats are
+// XOR-coded as 32 bits and the other integer fields as 0 if unchanged or 1
+// and the zigzag varint of the change. Every column starts over at each
+// block, values decode to exactly what the row format stores.
+class ColumnarRecordFormat {
+public:
+  static constexpr uint8_t VERSION = 1;
+  static constexpr size_t MAGIC_SIZE = 4;
+  static constexpr size_t BLOCK_SAMPLES = 64;
+  static constexpr size_t BLOCK_HEADER_SIZE = 3;
+  static constexpr size_t COLUMN_COUNT = 2 + MEASUREMENT_COUNT;
+
+  static const std::vector<uint8_t> &header();
+
+  // Reads a block header, false if it is malformed
+  static bool blockInfo(const uint8_t *in, size_t &samples,
+                        size_t &payloadSize);
+  // Appends the samples of a block payload to records, in the binary
+  // layout. False if the payload is malformed, records is left as it was.
+  static bool decodeBlock(const uint8_t *payload, size_t payloadSize,
+                          size_t samples, std::vector<EncodedRecord> &records);
+};
+
+static_assert(ColumnarRecordFormat::BLOCK_SAMPLES <= UINT8_MAX,
+              "sample count is a byte");
+
+// Collects records into the columns of the next block
+class ColumnarEncoder {
+private:
+  struct XorState {
+    uint64_t previous = 0;
+    int leading = -1; // window of the last meaningful bits, -1 if none
+    int trailing = 0;
+  };
+
+  struct FieldState {
+    bool started = false;
+    uint32_t previousRaw = 0;
+    XorState xored;
+    uint8_t previousAge = 0;
+  };
+
+  BitWriter columns_[ColumnarRecordFormat::COLUMN_COUNT];
+  FieldState fields_[MEASUREMENT_COUNT];
+  size_t samples_ = 0;
+  uint64_t previousTimestamp_ = 0;
+  int64_t previousDelta_ = 0;
+  uint32_t previousMask_ = 0;
+
+  static void writeXor(BitWriter &out, XorState &state, uint64_t bits,
+                       int width);
+
+public:
+  // Takes a record in the binary layout, true once the block is full
+  bool add(const uint8_t *record);
+  size_t samples() const { return samples_; }
+
+  // Appends the block to out and starts the next one
+  void finishBlock(std::vector<uint8_t> &out);
+};
+
+#endif
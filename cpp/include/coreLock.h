@@ -0,0 +1,49 @@
+#ifndef _CORE_LOCK_H_
+#define _CORE_LOCK_H_
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <pico/mutex.h>
+#else
+#include <Arduino.h>
+#include <atomic>
+#include <thread>
+#endif
+
+// Recursive lock for state both cores touch, such as the SD card. Works with
+// std::lock_guard.
+//
+// On the RP2040 this is the SDK's recursive mutex, on the host the cores
+// take turns, so waiting through waitForOtherCore lets the owner go on.
+class CoreLock {
+#ifdef ARDUINO_ARCH_RP2040
+  recursive_mutex_t mutex_;
+
+public:
+  CoreLock() { recursive_mutex_init(&mutex_); }
+
+  void lock() { recursive_mutex_enter_blocking(&mutex_); }
+  void unlock() { recursive_mutex_exit(&mutex_); }
+
+#else
+  std::atomic<std::thread::id> owner_{};
+  unsigned depth_ = 0;
+
+public:
+  void lock() {
+    const std::thread::id self = std::this_thread::get_id();
+    if (owner_ != self) {
+      waitForOtherCore([this] { return owner_ == std::thread::id(); });
+      owner_ = self;
+    }
+    depth_++;
+  }
+
+  void unlock() {
+    if (--depth_ == 0) {
+      owner_ = std::thread::id();
+    }
+  }
+#endif
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _DATA_RECORD_H_
+#define _DATA_RECORD_H_
+
+#include <sensorReading.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// One sample as it is handed to the data storage
+struct DataRecord {
+  uint64_t timestampMs; // since the Unix epoch, UTC
+  SensorReading gpsData;
+  SensorReading sensorData;
+};
+
+// Longest text formatJsonNumber can produce
+constexpr size_t MAX_JSON_NUMBER_SIZE = 24;
+
+// Upper bound on the length of a serialized record
+constexpr size_t maxSerializedRecordSize() {
+  size_t size = sizeof("{\"timestamp\":\"YYYY-MM-DDTHH:MM:SSZ\"") - 1 +
+                sizeof(",\"gps_data\":{}") - 1 +
+                sizeof(",\"aggregate\":{}") - 1 + sizeof("}") - 1;
+  for (const auto &info : MEASUREMENTS) {
+    size_t keyLength = 0;
+    while (info.key[keyLength] != '\0') {
+      keyLength++;
+    }
+    // ,"key":value
+    size += keyLength + 4 + MAX_JSON_NUMBER_SIZE;
+  }
+  return size;
+}
+
+// Writes value the way ArduinoJson 7 serializes a double, returns the
+// length. out must hold MAX_JSON_NUMBER_SIZE bytes, no terminator is added.
+size_t formatJsonNumber(double value, char *out);
+
+// Serializes a record into the JSON object the API expects, without
+// allocating. Returns the length written, or 0 if it does not fit in size.
+size_t serializeRecord(const DataRecord &record, char *out, size_t size);
+std::string serializeRecord(const DataRecord &record);
+
+#endif
@@ -7,11 +7,13 @@
 
 class Gps : public GpsInterface {
 private:
-  const int MAX_READING_AGE_MS = 5000;
+  const uint32_t MAX_READING_AGE_MS = 5000;
+  // Size of the UART's interrupt-fed receive ring, a second of NMEA at
+  // 9600 baud is under 1000 bytes
+  const size_t RX_BUFFER_SIZE = 1024;
 
   TinyGPSPlus gps_;
-  char buffer_[1000];
-  char bufferIndex_ = 0;
+  uint32_t overruns_ = 0;
 
 public:
   void setup() override;
@@ -20,7 +22,13 @@ public:
   bool isUpdated() override;
   bool isOld() override;
   SensorReading read() override;
-  std::string timeString() override;
+  uint64_t timestampMs() override;
+
+  // Sentences parsed and rejected since boot
+  uint32_t sentences() const { return gps_.passedChecksum(); }
+  uint32_t checksumFailures() const override { return gps_.failedChecksum(); }
+  // Times the receive ring filled up and bytes were lost
+  uint32_t overruns() const override { return overruns_; }
 };
 
 #endif // !_GPS_H_
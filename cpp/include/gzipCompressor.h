@@ -0,0 +1,66 @@
+#ifndef _GZIP_COMPRESSOR_H_
+#define _GZIP_COMPRESSOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Receives compressed bytes, returns false to abort
+typedef std::function<bool(const char *data, size_t length)> ByteSink;
+
+// Streaming gzip (RFC 1952) compressor with a fixed memory footprint.
+//
+// Uses LZ77 over a 4 KiB window with a single-probe hash table and encodes
+// everything as one deflate block with the fixed Huffman codes. That keeps
+// it small and fast enough for the M0+ while still removing most of the
+// repetition in the JSON records (keys, timestamps, coordinates).
+class GzipCompressor {
+public:
+  static constexpr size_t WINDOW_SIZE = 4096;
+  static constexpr size_t HASH_BITS = 10;
+
+private:
+  static constexpr size_t BUFFER_SIZE = 2 * WINDOW_SIZE;
+  static constexpr size_t MIN_MATCH = 3;
+  static constexpr size_t MAX_MATCH = 258;
+  static constexpr size_t OUT_BUFFER_SIZE = 256;
+
+  ByteSink sink_;
+
+  uint8_t buffer_[BUFFER_SIZE];
+  uint16_t head_[1 << HASH_BITS]; // last position + 1 for each hash
+  size_t fill_ = 0;
+  size_t pos_ = 0;
+
+  uint32_t bitBuffer_ = 0;
+  int bitCount_ = 0;
+  char out_[OUT_BUFFER_SIZE];
+  size_t outUsed_ = 0;
+
+  uint32_t crc_ = 0;
+  uint32_t inputSize_ = 0;
+  size_t outputSize_ = 0;
+  bool failed_ = false;
+
+  void compress(bool flush);
+  void slide();
+
+  void putByte(uint8_t byte);
+  void putBits(uint32_t value, int nBits);
+  void putHuffman(uint32_t code, int nBits);
+  void putLiteral(uint8_t literal);
+  void putMatch(size_t length, size_t distance);
+  void flushOut();
+
+public:
+  GzipCompressor(ByteSink sink);
+
+  bool write(const char *data, size_t length);
+  // Ends the stream, no more writes are allowed afterwards
+  bool finish();
+
+  uint32_t inputSize() const;
+  size_t outputSize() const;
+};
+
+#endif
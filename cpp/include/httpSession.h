@@ -0,0 +1,73 @@
+#ifndef _HTTP_SESSION_H_
+#define _HTTP_SESSION_H_
+
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+
+#include <string>
+
+struct ConnectionStats {
+  uint32_t requests = 0;
+  uint32_t connects = 0;  // TCP connections opened, with a TLS handshake
+                          // for https
+  uint32_t connectMs = 0; // time spent opening them
+};
+
+// Counts every connection opened through the client, including the ones
+// HTTPClient opens on its own when it finds the connection closed
+template <typename Client> class CountingClient : public Client {
+  ConnectionStats &stats_;
+
+public:
+  CountingClient(ConnectionStats &stats) : stats_(stats) {}
+
+  int connect(const char *host, uint16_t port) override {
+    unsigned long startMs = millis();
+    int connected = Client::connect(host, port);
+    stats_.connects++;
+    stats_.connectMs += millis() - startMs;
+    return connected;
+  }
+};
+
+// One keep-alive connection to the API server, shared by every request of
+// an upload. It is only reopened when the server closes it. For https the
+// TLS session is cached, so reopening resumes it instead of doing a full
+// handshake.
+class HttpSession {
+  const int TIMEOUT_MS;
+
+  ConnectionStats stats_;
+  CountingClient<WiFiClient> plainClient_;
+  CountingClient<WiFiClientSecure> secureClient_;
+  Session tlsSession_;
+  WiFiClient *client_ = &plainClient_;
+
+  std::string host_;
+  uint16_t port_ = 80;
+  std::string basePath_;
+
+public:
+  HttpSession(int timeoutMs);
+
+  // Takes the scheme, host, port and path prefix from the API base URL
+  bool begin(const std::string &baseUrl);
+
+  // Reuses the open connection or opens a new one, counts as one request
+  bool connect();
+  void close();
+
+  WiFiClient &client() { return *client_; }
+  const std::string &host() const { return host_; }
+  // Value of the Host header, with the port unless it's the scheme's default
+  std::string hostHeader() const;
+  // Path on the server for an API path such as "/trip/register"
+  std::string path(const std::string &apiPath) const {
+    return basePath_ + apiPath;
+  }
+
+  const ConnectionStats &stats() const { return stats_; }
+  void resetStats() { stats_ = ConnectionStats(); }
+};
+
+#endif
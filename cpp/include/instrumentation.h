@@ -0,0 +1,166 @@
+#ifndef _INSTRUMENTATION_H_
+#define _INSTRUMENTATION_H_
+
+#include <Arduino.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <hardware/timer.h>
+#endif
+
+// Timing of the hot paths. Build with -DBIKESENSE_INSTRUMENTATION=0 to
+// compile every probe out, arguments included.
+#ifndef BIKESENSE_INSTRUMENTATION
+#define BIKESENSE_INSTRUMENTATION 1
+#endif
+
+#if BIKESENSE_INSTRUMENTATION
+// Times from here to TIMING_STOP, or to the end of the scope
+#define TIMING_START(timing, histogram) ScopedTiming timing(histogram)
+#define TIMING_STOP(timing) timing.stop()
+#define INSTRUMENT(statement)                                                  \
+  do {                                                                         \
+    statement;                                                                 \
+  } while (0)
+#else
+#define TIMING_START(timing, histogram)                                        \
+  do {                                                                         \
+  } while (0)
+#define TIMING_STOP(timing)                                                    \
+  do {                                                                         \
+  } while (0)
+#define INSTRUMENT(statement)                                                  \
+  do {                                                                         \
+  } while (0)
+#endif
+
+// The RP2040's free-running microsecond timer, a single register read
+inline uint32_t timerUs() {
+#ifdef ARDUINO_ARCH_RP2040
+  return time_us_32();
+#else
+  return micros();
+#endif
+}
+
+// Durations in power-of-two buckets: bucket 0 counts 0 us, bucket b counts
+// [2^(b-1), 2^b) us and the last one everything longer. Recording is a few
+// adds, percentiles are only known to the bucket.
+class LatencyHistogram {
+public:
+  static constexpr size_t BUCKETS = 24; // the last one starts at ~4.2 s
+
+private:
+  uint32_t buckets_[BUCKETS] = {};
+  uint32_t count_ = 0;
+  uint64_t totalUs_ = 0;
+  uint32_t maxUs_ = 0;
+
+public:
+  void record(uint32_t us) {
+    size_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+    if (bucket >= BUCKETS) {
+      bucket = BUCKETS - 1;
+    }
+    buckets_[bucket]++;
+    count_++;
+    totalUs_ += us;
+    if (us > maxUs_) {
+      maxUs_ = us;
+    }
+  }
+
+  uint32_t count() const { return count_; }
+  uint32_t meanUs() const { return count_ > 0 ? totalUs_ / count_ : 0; }
+  uint32_t maxUs() const { return maxUs_; }
+  uint64_t totalUs() const { return totalUs_; }
+  // Upper end of the bucket holding the given percentile
+  uint32_t percentileUs(uint32_t percent) const;
+  void reset() { *this = LatencyHistogram(); }
+};
+
+class ScopedTiming {
+private:
+  LatencyHistogram *histogram_;
+  const uint32_t startUs_;
+
+public:
+  ScopedTiming(LatencyHistogram &histogram)
+      : histogram_(&histogram), startUs_(timerUs()) {}
+  ~ScopedTiming() { stop(); }
+
+  void stop() {
+    if (histogram_ != nullptr) {
+      histogram_->record(timerUs() - startUs_);
+      histogram_ = nullptr;
+    }
+  }
+};
+
+enum TimingPoint : uint8_t {
+  TIMING_GPS_UPDATE,
+  TIMING_SAVE_DATA,
+  TIMING_STORE,
+  TIMING_UPLOAD_BATCH,
+  TIMING_IDLE, // sleeping until the next deadline or interrupt
+  TIMING_POINT_COUNT,
+};
+
+// Counters kept by their owners, read when the stats are reported
+struct InstrumentCounters {
+  uint32_t droppedSamples = 0;
+  uint32_t droppedLogs = 0;
+  uint32_t gpsChecksumFailures = 0;
+  uint32_t gpsOverruns = 0;
+};
+
+// Histograms are only written by the core that runs the timed code, so
+// there are no locks. A report taken while the other core records may be
+// off by one sample.
+class Instruments {
+public:
+  static constexpr size_t MAX_STATES = 8;
+  static constexpr size_t MAX_SENSORS = 8;
+
+private:
+  LatencyHistogram loops_[MAX_STATES];
+  LatencyHistogram timings_[TIMING_POINT_COUNT];
+  LatencyHistogram sensorReads_[MAX_SENSORS];
+  uint32_t heapPeak_ = 0;
+  InstrumentCounters baseline_;
+
+  InstrumentCounters since(const InstrumentCounters &counters) const;
+
+public:
+  LatencyHistogram &loop(size_t state) {
+    return loops_[state < MAX_STATES ? state : MAX_STATES - 1];
+  }
+  LatencyHistogram &timing(TimingPoint point) { return timings_[point]; }
+  LatencyHistogram &sensorRead(size_t index) {
+    return sensorReads_[index < MAX_SENSORS ? index : MAX_SENSORS - 1];
+  }
+
+  // Share of the time spent in loop iterations rather than asleep, in
+  // hundredths of a percent
+  uint32_t activeBasisPoints() const;
+
+  // Heap use is sampled where the big buffers are alive, not continuously
+  void sampleHeap();
+
+  // Starts a new reporting period, counters are reported relative to these
+  void reset(const InstrumentCounters &counters);
+
+  // stateNames names the loop histograms, one per state
+  void log(const InstrumentCounters &counters, const char *const *stateNames,
+           size_t stateCount) const;
+  // Appends {"trip_summary":{...}} with every histogram that has samples
+  void writeSummary(const InstrumentCounters &counters,
+                    const char *const *stateNames, size_t stateCount,
+                    std::string &out) const;
+};
+
+Instruments &instruments();
+
+#endif
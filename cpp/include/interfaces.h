@@ -1,15 +1,28 @@
 #ifndef _INTERFACES_H_
 #define _INTERFACES_H_
 
+#include <dataRecord.h>
+#include <logger.h>
+#include <recordFormat.h>
 #include <sensorReading.h>
 
 #include <Arduino.h>
+#include <string_view>
 #include <vector>
 
 class SensorInterface {
 public:
   virtual void setup() = 0;
   virtual SensorReading read() = 0;
+
+  // Called on every loop iteration, for sensors that need to do work
+  // between reads. Must not block.
+  virtual void update() {}
+
+  // How often the sensor should be read
+  virtual uint32_t periodMs() const { return 1000; }
+  // How late a read may start before it counts as missed
+  virtual uint32_t deadlineMs() const { return periodMs() / 2; }
 };
 
 class GpsInterface : public SensorInterface {
@@ -18,26 +31,88 @@ public:
   virtual bool isValid() = 0;
   virtual bool isOld() = 0;
   virtual bool isUpdated() = 0;
-  virtual std::string timeString() = 0;
+  // Time of the current fix in milliseconds since the Unix epoch, advanced
+  // by the time elapsed since the fix was received
+  virtual uint64_t timestampMs() = 0;
+  // Receiver health, for receivers that keep count
+  virtual uint32_t checksumFailures() const { return 0; }
+  virtual uint32_t overruns() const { return 0; }
 };
 
-typedef std::optional<std::vector<std::string>> retrievedData;
+// Views into the storage's read buffer, valid until the next call to
+// nextBatch or closeCursor
+typedef std::vector<std::string_view> RecordBatch;
+
+// Progress of a batched upload, kept in storage so an upload cut short by a
+// reboot picks up where it stopped instead of sending the trip again
+struct UploadCheckpoint {
+  int tripId = -1;
+  uint32_t seq = 1;    // Batch-Seq of the next batch
+  uint32_t offset = 0; // cursor position after the last acknowledged batch
+  int pending = 0;     // records in the batch being sent, 0 if none
+};
 
 class DataStorageInterface {
 public:
   virtual bool setup() = 0;
 
-  virtual retrievedData retrieve(int batchSize) = 0;
-  virtual bool store(const std::string data) = 0;
+  // Closes what was stored so far into a segment of its own for upload,
+  // records stored afterwards go to the next one
+  virtual bool seal() { return sync(); }
+
+  // Starts reading the oldest segment waiting for upload, false if there is
+  // none
+  virtual bool openCursor() = 0;
+  // Hands out up to batchSize JSON records, false once all were read
+  virtual bool nextBatch(int batchSize, RecordBatch &batch) = 0;
+  virtual void closeCursor() = 0;
+
+  // Where the next unread record starts, to resume reading after a reboot.
+  // Storages that can't seek only resume from the beginning.
+  virtual size_t cursorPosition() { return 0; }
+  virtual bool seekCursor(size_t position) { return position == 0; }
+
+  virtual bool store(const DataRecord &record) = 0;
+  // Whether storeEncoded keeps the binary layout as it is. Otherwise records
+  // are handed to store() as they were taken, the layout rounds values.
+  virtual bool keepsEncoded() const { return false; }
+  // Stores a batch of records already in the binary layout
+  virtual bool storeEncoded(const EncodedRecord *records, size_t count) {
+    bool stored = true;
+    for (size_t i = 0; i < count; i++) {
+      stored &= store(BinaryRecordFormat::decode(records[i].bytes));
+    }
+    return stored;
+  }
+  // Deletes the segment last opened for reading once it made it to the
+  // server, the ones after it are left for the next openCursor
   virtual bool clear() = 0;
 
-  virtual bool logInfo(const std::string message) = 0;
-  virtual bool logInfo(const std::string message,
-                       const std::string timestamp) = 0;
+  // Upload progress of the segment last opened for reading. Storages that
+  // can't keep it have every segment uploaded from the start.
+  virtual bool saveProgress(const UploadCheckpoint &checkpoint) {
+    return false;
+  }
+  virtual bool loadProgress(UploadCheckpoint &checkpoint) { return false; }
+
+  // Makes everything stored so far durable, for storages that buffer writes
+  virtual bool sync() { return true; }
+  // Called from the main loop, syncs what was buffered for too long
+  virtual bool poll() { return true; }
+
+  // Small named values that have to survive a reboot, such as upload
+  // tuning. Storages that can't keep them report failure.
+  virtual bool saveState(const std::string &name, const std::string &value) {
+    return false;
+  }
+  virtual bool loadState(const std::string &name, std::string &value) {
+    return false;
+  }
 
-  virtual bool logError(const std::string message) = 0;
-  virtual bool logError(const std::string message,
-                        const std::string timestamp) = 0;
+  // Keeps drained log entries, storages without a log drop them
+  virtual bool storeLogs(const LogEntry *entries, size_t count) {
+    return true;
+  }
 };
 
 class LedInterface {
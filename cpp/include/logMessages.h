@@ -0,0 +1,139 @@
+#ifndef _LOG_MESSAGES_H_
+#define _LOG_MESSAGES_H_
+
+#include <cstdint>
+
+// Every message the device can log. Entries only carry the id and their
+// arguments, the text is looked up when the entry is printed. The table is
+// also written at the start of the log file, so the host tool can expand
+// logs from any firmware version. Only append new entries at the end.
+enum LogMessage : uint16_t {
+  LOG_ENTRIES_DROPPED,
+  LOG_REGISTERING_DEVICE,
+  LOG_REGISTERING,
+  LOG_POST_CODE,
+  LOG_REGISTER_FAILED,
+  LOG_HTTP_ERROR,
+  LOG_SERVER_RESPONSE,
+  LOG_CONNECTION_STATS,
+  LOG_STORE_FAILED,
+  LOG_SAMPLES_DROPPED,
+  LOG_WIFI_SETTLE,
+  LOG_HEALTH_CHECK,
+  LOG_CURSOR_FAILED,
+  LOG_UPLOAD_RESUMED,
+  LOG_CHECKPOINT_MISMATCH,
+  LOG_CHECKPOINT_SAVE_FAILED,
+  LOG_REGISTERING_TRIP,
+  LOG_TRIP_REGISTER_FAILED,
+  LOG_TRIP_REGISTERED,
+  LOG_BATCHED_UPLOAD_START,
+  LOG_GZIP_REJECTED,
+  LOG_GZIP_REJECTED_NEXT,
+  LOG_BATCH_RETRY,
+  LOG_BATCH_FAILED,
+  LOG_BATCH_UPLOADED,
+  LOG_STREAMED_UPLOAD_START,
+  LOG_STREAM_FAILED,
+  LOG_STREAM_UPLOADED,
+  LOG_QUEUE_UPLOADED,
+  LOG_COMPRESSED,
+  LOG_UPLOAD_SUCCEEDED,
+  LOG_UPLOAD_FAILED,
+  LOG_UPLOAD_KEPT,
+  LOG_RECORD_TOO_LARGE,
+  LOG_WIFI_CONNECTED,
+  LOG_UPLOAD_ENDPOINT,
+  LOG_TRIP_STARTED,
+  LOG_GPS_LOST,
+  LOG_GPS_ACQUIRED,
+  LOG_REBOOTING,
+  LOG_SEAL_FAILED,
+  LOG_RECORD_TOO_LONG,
+  LOG_SEGMENT_OPENED,
+  LOG_SEGMENT_UNREADABLE,
+  LOG_SEGMENT_LIMIT,
+  LOG_MANIFEST_FAILED,
+  LOG_TIMING_STATS,
+  LOG_COUNTER_STATS,
+  LOG_HEAP_PEAK,
+  LOG_SUMMARY_FAILED,
+  LOG_ACTIVE_TIME,
+  LOG_BLOCK_CORRUPT,
+  LOG_BLOCK_TRUNCATED,
+  LOG_SEGMENT_ADOPTED,
+  LOG_SEGMENT_FILE_UNKNOWN,
+  LOG_MESSAGE_COUNT,
+};
+
+struct LogMessageInfo {
+  LogMessage id;
+  // Only %d, %u and %s, at most one %s
+  const char *format;
+};
+
+constexpr LogMessageInfo LOG_MESSAGES[LOG_MESSAGE_COUNT] = {
+    {LOG_ENTRIES_DROPPED, "Log queue overflowed, %u entries dropped"},
+    {LOG_REGISTERING_DEVICE, "Trying to register bike and sensor unit"},
+    {LOG_REGISTERING, "Registering at %s"},
+    {LOG_POST_CODE, "Post code: %d (attempt %u)"},
+    {LOG_REGISTER_FAILED, "Failed to register %s"},
+    {LOG_HTTP_ERROR, "HTTP error %d: %s"},
+    {LOG_SERVER_RESPONSE, "Server response: %s"},
+    {LOG_CONNECTION_STATS,
+     "Upload made %u requests over %u connections, %u ms connecting"},
+    {LOG_STORE_FAILED, "Failed to store %u samples"},
+    {LOG_SAMPLES_DROPPED, "Sample queue overflowed, %u samples dropped"},
+    {LOG_WIFI_SETTLE, "Sleeping for wifi shenanigans"},
+    {LOG_HEALTH_CHECK, "Health check returned %d"},
+    {LOG_CURSOR_FAILED, "Failed to open stored data for reading"},
+    {LOG_UPLOAD_RESUMED, "Resuming upload of trip %d at batch %u"},
+    {LOG_CHECKPOINT_MISMATCH,
+     "Upload checkpoint doesn't match stored data, starting over"},
+    {LOG_CHECKPOINT_SAVE_FAILED, "Failed to save upload checkpoint"},
+    {LOG_REGISTERING_TRIP, "Trying to register trip"},
+    {LOG_TRIP_REGISTER_FAILED, "Failed to register trip, aborting upload"},
+    {LOG_TRIP_REGISTERED, "Trip registered with id: %d"},
+    {LOG_BATCHED_UPLOAD_START,
+     "Starting Bulk Data Upload, %u records per batch"},
+    {LOG_GZIP_REJECTED, "Server rejected gzip, sending uncompressed"},
+    {LOG_GZIP_REJECTED_NEXT,
+     "Server rejected gzip, next upload will be uncompressed"},
+    {LOG_BATCH_RETRY, "Batch %u failed with %d, retrying"},
+    {LOG_BATCH_FAILED, "HTTP post failed at batch %u"},
+    {LOG_BATCH_UPLOADED, "Batch %u uploaded, %u records, %u bytes in %u ms"},
+    {LOG_STREAMED_UPLOAD_START, "Starting Streamed Data Upload"},
+    {LOG_STREAM_FAILED, "Streamed upload failed after %u bytes"},
+    {LOG_STREAM_UPLOADED, "Uploaded %u bytes in %u ms"},
+    {LOG_QUEUE_UPLOADED, "Uploaded %u bytes"},
+    {LOG_COMPRESSED, "Compressed %u bytes to %u"},
+    {LOG_UPLOAD_SUCCEEDED, "Data upload successful, clearing storage"},
+    {LOG_UPLOAD_FAILED, "Failed to upload data, going into error mode"},
+    {LOG_UPLOAD_KEPT, "Data upload failed, keeping data for the next one"},
+    {LOG_RECORD_TOO_LARGE, "Skipping record too large for the upload queue"},
+    {LOG_WIFI_CONNECTED, "Connected to WiFi: %s"},
+    {LOG_UPLOAD_ENDPOINT, "Uploading data to %s"},
+    {LOG_TRIP_STARTED, "Starting data collection for new trip"},
+    {LOG_GPS_LOST, "GPS signal lost"},
+    {LOG_GPS_ACQUIRED, "GPS signal acquired, resuming data collection"},
+    {LOG_REBOOTING, "Rebooting device due to error..."},
+    {LOG_SEAL_FAILED, "Failed to set data file aside for upload"},
+    {LOG_RECORD_TOO_LONG, "Skipping record longer than the read buffer"},
+    {LOG_SEGMENT_OPENED, "Reading segment %u, %u records"},
+    {LOG_SEGMENT_UNREADABLE, "Dropping unreadable segment %u"},
+    {LOG_SEGMENT_LIMIT, "Too many segments, appending to segment %u"},
+    {LOG_MANIFEST_FAILED, "Failed to write the segment manifest"},
+    {LOG_TIMING_STATS, "%s: %u calls, mean %u us, p99 under %u us, max %u us"},
+    {LOG_COUNTER_STATS,
+     "Dropped samples %u, dropped logs %u, GPS checksum failures %u, GPS "
+     "overruns %u"},
+    {LOG_HEAP_PEAK, "Heap peak %u bytes"},
+    {LOG_SUMMARY_FAILED, "Failed to upload the trip summary: %d"},
+    {LOG_ACTIVE_TIME, "Active %u.%u%u%% of the time, %u wakeups"},
+    {LOG_BLOCK_CORRUPT, "Corrupt block at offset %u of segment %u"},
+    {LOG_BLOCK_TRUNCATED, "Dropping %u bytes of a cut-off block in segment %u"},
+    {LOG_SEGMENT_ADOPTED, "Segment %u was missing from the manifest"},
+    {LOG_SEGMENT_FILE_UNKNOWN, "Keeping %s, not a segment of a known format"},
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef _LOGGER_H_
+#define _LOGGER_H_
+
+#include <logMessages.h>
+#include <ringBuffer.h>
+
+#include <Arduino.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifndef ARDUINO_ARCH_RP2040
+#include <mutex>
+#endif
+
+enum LogLevel : uint8_t {
+  LOG_LEVEL_DEBUG,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_ERROR,
+  LOG_LEVEL_NONE,
+};
+
+// Entries below this level are compiled out, arguments included
+#ifndef BIKESENSE_LOG_LEVEL
+#define BIKESENSE_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_AT(level, ...)                                                     \
+  do {                                                                         \
+    if ((level) >= BIKESENSE_LOG_LEVEL) {                                      \
+      logger().log((level), __VA_ARGS__);                                      \
+    }                                                                          \
+  } while (0)
+
+#define LOGD(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOGI(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOGE(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// One log line before formatting. Also the on-card layout, little-endian:
+//   time u32 (millis) | message u16 | level u8 | argument count u8 |
+//   4 x argument u32 | text, NUL terminated
+struct LogEntry {
+  static constexpr size_t MAX_ARGS = 4;
+  static constexpr size_t TEXT_SIZE = 40;
+
+  uint32_t timeMs;
+  uint16_t message;
+  uint8_t level;
+  uint8_t argCount;
+  uint32_t args[MAX_ARGS];
+  char text[TEXT_SIZE];
+};
+
+static_assert(sizeof(LogEntry) == 64, "log entries are written as is");
+
+inline void addLogArg(LogEntry &entry, const char *text) {
+  strncpy(entry.text, text, LogEntry::TEXT_SIZE - 1);
+  entry.text[LogEntry::TEXT_SIZE - 1] = '\0';
+}
+
+inline void addLogArg(LogEntry &entry, const std::string &text) {
+  addLogArg(entry, text.c_str());
+}
+
+template <typename T> inline void addLogArg(LogEntry &entry, T value) {
+  static_assert(std::is_integral<T>::value || std::is_enum<T>::value,
+                "log arguments are integers and at most one string");
+  if (entry.argCount < LogEntry::MAX_ARGS) {
+    entry.args[entry.argCount++] = static_cast<uint32_t>(value);
+  }
+}
+
+template <typename T> constexpr bool isLogText() {
+  return std::is_convertible<T, const char *>::value ||
+         std::is_same<T, std::string>::value;
+}
+
+// Logging only copies a few words into a per-core queue, formatting and
+// writing happen later in drain() on the collecting core. A full queue drops
+// its oldest entries, it never waits.
+class Logger {
+public:
+  static constexpr size_t QUEUE_SIZE = 32;
+  static constexpr uint8_t FILE_VERSION = 1;
+
+private:
+  // Each core is the only producer of its own queue
+  SpscRing<LogEntry, QUEUE_SIZE> queues_[2];
+#ifndef ARDUINO_ARCH_RP2040
+  std::mutex pushMutex_;
+#endif
+
+  void push(const LogEntry &entry);
+
+public:
+  template <typename... Args>
+  void log(LogLevel level, LogMessage message, const Args &...args) {
+    static_assert((0 + ... + isLogText<Args>()) <= 1,
+                  "a log entry holds at most one string");
+
+    LogEntry entry = {};
+    entry.timeMs = millis();
+    entry.message = message;
+    entry.level = level;
+    (addLogArg(entry, args), ...);
+    push(entry);
+  }
+
+  // Consumer side, only one core may call it. Returns the number of entries
+  // copied out.
+  size_t drain(LogEntry *entries, size_t maxEntries);
+  uint32_t dropped() const;
+
+  // Written at the start of the log file:
+  //   magic "BSL1" | version u8 | entry size u8 | message count u16 |
+  //   per message: format length u8 | format
+  static const std::vector<uint8_t> &fileHeader();
+};
+
+Logger &logger();
+
+// Expands an entry into "[time] [LEVEL] text", returns the length written
+size_t formatLogEntry(const LogEntry &entry, char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef _MEASUREMENTS_H_
+#define _MEASUREMENTS_H_
+
+#include <cstdint>
+
+// Every measurement the device can report. The numeric value is stable and
+// is written into binary data files, so only append new entries at the end.
+enum MeasurementId : uint8_t {
+  LATITUDE,
+  LONGITUDE,
+  ALTITUDE,
+  SPEED,
+  COURSE,
+  SATELLITES_IN_USE,
+  HDOP,
+  FIX_TYPE,
+  VDOP,
+  PDOP,
+  CARBON_MONOXIDE_LEVEL,
+  POLUTION_PARTICLES_PPM,
+  NOISE_LEVEL,
+  LUMINOSITY,
+  UV_LEVEL,
+  TEMPERATURE,
+  HUMIDITY,
+  AGGREGATE_COUNT,
+  AGGREGATE_MIN,
+  AGGREGATE_MAX,
+  AGGREGATE_STDDEV,
+  AGGREGATE_WINDOW,
+  MEASUREMENT_COUNT,
+};
+
+// Where the measurement lives in the JSON record the API expects
+enum MeasurementGroup : uint8_t {
+  GROUP_SENSOR,
+  GROUP_GPS,
+  // Statistics of the one sensor measurement in an aggregate record, whose
+  // value is the mean over the window
+  GROUP_AGGREGATE,
+};
+
+// Storage type of a measurement inside a binary record
+enum FieldType : uint8_t {
+  FIELD_U8,
+  FIELD_U16,
+  FIELD_I32,
+  FIELD_F32,
+};
+
+struct MeasurementInfo {
+  MeasurementId id;
+  const char *key;
+  const char *unit;
+  MeasurementGroup group;
+  FieldType type;
+  int8_t scale; // stored value = round(value / 10^scale)
+};
+
+constexpr MeasurementInfo MEASUREMENTS[MEASUREMENT_COUNT] = {
+    {LATITUDE, "latitude", "deg", GROUP_GPS, FIELD_I32, -7},
+    {LONGITUDE, "longitude", "deg", GROUP_GPS, FIELD_I32, -7},
+    {ALTITUDE, "altitude", "m", GROUP_GPS, FIELD_I32, -2},
+    {SPEED, "speed", "km/h", GROUP_GPS, FIELD_U16, -2},
+    {COURSE, "course", "deg", GROUP_GPS, FIELD_U16, -2},
+    {SATELLITES_IN_USE, "satellites_in_use", "", GROUP_GPS, FIELD_U8, 0},
+    {HDOP, "hdop", "", GROUP_GPS, FIELD_U16, -2},
+    {FIX_TYPE, "fix_type", "", GROUP_GPS, FIELD_U8, 0},
+    {VDOP, "vdop", "", GROUP_GPS, FIELD_U16, -2},
+    {PDOP, "pdop", "", GROUP_GPS, FIELD_U16, -2},
+    {CARBON_MONOXIDE_LEVEL, "carbon_monoxide_level", "ppm", GROUP_SENSOR,
+     FIELD_F32, 0},
+    {POLUTION_PARTICLES_PPM, "polution_particles_ppm", "ppm", GROUP_SENSOR,
+     FIELD_F32, 0},
+    {NOISE_LEVEL, "noise_level", "dB", GROUP_SENSOR, FIELD_F32, 0},
+    {LUMINOSITY, "luminosity", "lm", GROUP_SENSOR, FIELD_U16, 0},
+    {UV_LEVEL, "uv_level", "UV index", GROUP_SENSOR, FIELD_U16, -2},
+    {TEMPERATURE, "temperature", "C", GROUP_SENSOR, FIELD_F32, 0},
+    {HUMIDITY, "humidity", "%", GROUP_SENSOR, FIELD_F32, 0},
+    {AGGREGATE_COUNT, "count", "", GROUP_AGGREGATE, FIELD_U16, 0},
+    {AGGREGATE_MIN, "min", "", GROUP_AGGREGATE, FIELD_F32, 0},
+    {AGGREGATE_MAX, "max", "", GROUP_AGGREGATE, FIELD_F32, 0},
+    {AGGREGATE_STDDEV, "stddev", "", GROUP_AGGREGATE, FIELD_F32, 0},
+    {AGGREGATE_WINDOW, "window", "s", GROUP_AGGREGATE, FIELD_U16, -1},
+};
+
+constexpr int fieldSize(FieldType type) {
+  return type == FIELD_U8 ? 1 : type == FIELD_U16 ? 2 : 4;
+}
+
+#endif
@@ -15,17 +15,20 @@ class MockGps : public GpsInterface {
 public:
   void setup() override;
   SensorReading read() override;
-  std::string timeString() override;
+  uint64_t timestampMs() override;
 };
 
 class MockDataStorage : public DataStorageInterface {
 private:
   std::vector<std::string> readings_;
+  size_t cursor_ = 0;
 
 public:
   bool setup() override;
-  bool store(const std::string reading) override;
-  retrievedData retrieve(int batchSize) override;
+  bool store(const DataRecord &record) override;
+  bool openCursor() override;
+  bool nextBatch(int batchSize, RecordBatch &batch) override;
+  void closeCursor() override;
 };
 
 #endif
@@ -1,21 +1,33 @@
 #ifndef _NOISE_H_
 #define _NOISE_H_
 
+#include <adcCapture.h>
 #include <interfaces.h>
+#include <noiseDsp.h>
 
 class NoiseSensor : public SensorInterface {
   // TODO: Needs calibration
   const int PIN = 26;
-  const int ADC_BIAS = 0;
-  const int noiseDBReference = 0;
-  const int noiseADCReference = 1;
+  // dB SPL of a signal with an RMS of one ADC count
+  const int32_t CALIBRATION_CENTI_DB = 0;
 
-  const int mvAvgWindowSize = 10;
-  int mvAvgAccumulator = 0;
+  const uint32_t SAMPLE_RATE_HZ = 16000;
+  const uint32_t LEQ_WINDOW_MS;
+
+  AdcCapture capture_;
+  LeqMeter leq_;
+
+  bool hasLevel_ = false;
+  int32_t levelCentiDb_ = 0;
 
 public:
+  // The reported level is the Leq over the last leqWindowMs
+  NoiseSensor(uint32_t leqWindowMs = 250);
+
   void setup() override;
+  void update() override;
   SensorReading read() override;
+  uint32_t periodMs() const override { return LEQ_WINDOW_MS; }
 };
 
 #endif
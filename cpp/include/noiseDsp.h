@@ -0,0 +1,39 @@
+#ifndef _NOISE_DSP_H_
+#define _NOISE_DSP_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-point noise level arithmetic. Nothing here touches the hardware, so
+// it can be run on the host against synthetic signals.
+
+// Sum of squared deviations from the block's mean, i.e. the AC energy of
+// the block in ADC counts squared
+uint64_t blockEnergy(const uint16_t *samples, size_t count);
+
+// log2(x) in Q16.16, x must be non-zero
+int32_t log2Q16(uint64_t x);
+
+// 10 * log10(energy / samples) in hundredths of a dB, which is the RMS level
+// relative to one ADC count
+int32_t energyToCentiDb(uint64_t energy, uint32_t samples);
+
+// Equivalent continuous level (Leq) over a window of a fixed number of
+// samples, fed one block at a time
+class LeqMeter {
+  const uint32_t WINDOW_SAMPLES;
+
+  uint64_t energy_ = 0;
+  uint32_t samples_ = 0;
+
+public:
+  LeqMeter(uint32_t windowSamples) : WINDOW_SAMPLES(windowSamples) {}
+
+  void addBlock(const uint16_t *samples, size_t count);
+  bool windowComplete() const { return samples_ >= WINDOW_SAMPLES; }
+
+  // Level of the current window, starts a new one. Silence reads as 0.
+  int32_t takeLeqCentiDb();
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef _RECORD_FORMAT_H_
+#define _RECORD_FORMAT_H_
+
+#include <dataRecord.h>
+#include <measurements.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compact binary layout for the data file.
+//
+// The file starts with a header describing the schema:
+//   magic "BSR1" | version u8 | field count u8 | record size u16
+//   per field: id u8 | group u8 | type u8 | scale i8 |
+//              key length u8 | key | unit length u8 | unit
+//
+// Followed by fixed-size rows, all integers little-endian:
+//   timestamp u64 (milliseconds since epoch) | presence mask u32 |
+//   one slot per GPS and sensor measurement, in header order, sized by its
+//   field type |
+//   one age u8 per GPS and sensor measurement, in header order, in units of
+//   AGE_UNIT_MS
+//
+// A row whose mask has a GROUP_AGGREGATE measurement is sparse: only the
+// measurements in its mask get a slot and then an age, in header order, and
+// the rest of the row is zero. The aggregator stores a single sensor
+// measurement with its statistics, further ones are left out if they don't
+// fit.
+//
+// Version 3 rows had a slot for every measurement.
+
+// Where each measurement's slot and age sit in a row, 0 if it has none
+struct RowLayout {
+  uint8_t slot[MEASUREMENT_COUNT];
+  uint8_t age[MEASUREMENT_COUNT];
+  uint8_t size; // bytes used by the timestamp, mask, slots and ages
+};
+
+class BinaryRecordFormat {
+public:
+  static constexpr uint8_t VERSION = 4;
+  static constexpr uint32_t AGE_UNIT_MS = 100;
+  static constexpr size_t MAGIC_SIZE = 4;
+  static constexpr size_t ROW_HEADER_SIZE =
+      sizeof(uint64_t) + sizeof(uint32_t);
+
+  static constexpr size_t recordSize() {
+    size_t size = ROW_HEADER_SIZE;
+    for (const auto &info : MEASUREMENTS) {
+      if (info.group != GROUP_AGGREGATE) {
+        size += fieldSize(info.type) + sizeof(uint8_t);
+      }
+    }
+    return size;
+  }
+
+  static constexpr uint32_t aggregateMask() {
+    uint32_t mask = 0;
+    for (const auto &info : MEASUREMENTS) {
+      if (info.group == GROUP_AGGREGATE) {
+        mask |= 1UL << info.id;
+      }
+    }
+    return mask;
+  }
+
+  static constexpr bool isSparse(uint32_t mask) {
+    return (mask & aggregateMask()) != 0;
+  }
+
+  static RowLayout layout(uint32_t mask);
+
+  static const std::vector<uint8_t> &header();
+  // The per-field part of the header, shared with the columnar format
+  static void appendFields(std::vector<uint8_t> &out);
+
+  static void encode(const DataRecord &record, uint8_t *out);
+  static DataRecord decode(const uint8_t *in);
+};
+
+static_assert(MEASUREMENT_COUNT <= 32, "presence mask is 32 bits wide");
+static_assert(BinaryRecordFormat::recordSize() <= UINT8_MAX,
+              "row offsets are a byte");
+
+// A record already in the binary layout, cheap to copy around
+struct EncodedRecord {
+  uint8_t bytes[BinaryRecordFormat::recordSize()];
+};
+
+#endif
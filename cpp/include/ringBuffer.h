@@ -0,0 +1,108 @@
+#ifndef _RING_BUFFER_H_
+#define _RING_BUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// What to do with a new item when the ring is full
+enum DropPolicy {
+  DROP_NEWEST, // reject the new item
+  DROP_OLDEST, // overwrite the oldest unread item
+};
+
+// Bounded single-producer/single-consumer ring of trivially copyable items.
+//
+// push() is wait-free: it never loops and never waits on the consumer. With
+// DROP_OLDEST the producer advances the read index itself with a single
+// compare-and-swap; the consumer detects that with its own compare-and-swap
+// and throws away the copy it made of the overwritten slot.
+//
+// The counters are only written by the producer, so they are plain atomic
+// loads and stores. The M0+ has no exclusive access instructions, so the
+// compare-and-swap goes through the SDK's atomic helpers (a hardware spin
+// lock held for a few instructions).
+template <typename T, size_t CAPACITY> class SpscRing {
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0,
+                "capacity must be a power of two");
+
+  static constexpr size_t MASK = CAPACITY - 1;
+
+  const DropPolicy POLICY;
+
+  T slots_[CAPACITY];
+  std::atomic<size_t> head_{0}; // next slot to write, only the producer
+                                // moves it
+  std::atomic<size_t> tail_{0}; // next slot to read
+
+  std::atomic<uint32_t> pushed_{0};
+  std::atomic<uint32_t> dropped_{0};
+  std::atomic<uint32_t> highWater_{0};
+
+  static void increment(std::atomic<uint32_t> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+
+public:
+  SpscRing(DropPolicy policy = DROP_OLDEST) : POLICY(policy) {}
+
+  // Producer side. Returns false if an item had to be dropped.
+  bool push(const T &item) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    bool dropped = false;
+
+    if (head - tail == CAPACITY) {
+      if (POLICY == DROP_NEWEST) {
+        increment(dropped_);
+        return false;
+      }
+
+      // If this fails the consumer just freed a slot
+      if (tail_.compare_exchange_strong(tail, tail + 1,
+                                        std::memory_order_acq_rel)) {
+        increment(dropped_);
+        dropped = true;
+      }
+    }
+
+    slots_[head & MASK] = item;
+    head_.store(head + 1, std::memory_order_release);
+    increment(pushed_);
+
+    const uint32_t fill = head + 1 - tail_.load(std::memory_order_relaxed);
+    if (fill > highWater_.load(std::memory_order_relaxed)) {
+      highWater_.store(fill, std::memory_order_relaxed);
+    }
+
+    return !dropped;
+  }
+
+  // Consumer side. Returns false if the ring is empty.
+  bool pop(T &item) {
+    size_t tail = tail_.load(std::memory_order_acquire);
+    while (tail != head_.load(std::memory_order_acquire)) {
+      item = slots_[tail & MASK];
+      if (tail_.compare_exchange_strong(tail, tail + 1,
+                                        std::memory_order_acq_rel)) {
+        return true;
+      }
+      // The producer overwrote this slot, tail now holds the new index
+    }
+    return false;
+  }
+
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_acquire);
+  }
+
+  uint32_t pushed() const { return pushed_.load(std::memory_order_relaxed); }
+  uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  uint32_t highWater() const {
+    return highWater_.load(std::memory_order_relaxed);
+  }
+};
+
+#endif
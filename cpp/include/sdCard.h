@@ -4,8 +4,39 @@
 #include <SD.h>
 #include <SPI.h>
 
+#include "bufferedWriter.h"
+#include "columnarFormat.h"
 #include "interfaces.h"
 
+#include <string>
+#include <vector>
+
+enum StorageFormat {
+  JSON_LINES,     // one JSON object per line
+  BINARY_RECORDS, // schema header followed by fixed-size records
+  // schema header followed by blocks of records stored column by column,
+  // several times smaller than BINARY_RECORDS
+  COLUMNAR_BLOCKS,
+};
+
+enum SegmentState : uint8_t {
+  SEGMENT_OPEN,      // records are being appended
+  SEGMENT_SEALED,    // waiting for upload
+  SEGMENT_UPLOADING, // has a trip on the server, progress is valid
+};
+
+// One data file of the segmented layout. A segment is uploaded as one trip
+// and deleted on its own once it made it to the server.
+struct Segment {
+  uint32_t id;
+  SegmentState state;
+  uint32_t records;
+  UploadCheckpoint progress;
+  // What the file was written as, older firmware or another build may have
+  // left segments of a format other than the one written now
+  StorageFormat format;
+};
+
 class SDCard : public DataStorageInterface {
 private:
   const int MISO_ = 16;
@@ -13,28 +44,103 @@ private:
   const int CS_ = 17;
   const int SCK_ = 18;
 
-  const char *DATAFILE = "Bikesense.txt";
-  const char *LOGFILE = "Bikesense_Logs.txt";
+  const StorageFormat FORMAT;
+
+  // Files of a different schema are kept as Bikesense_old<N> for the host
+  // decoder
+  const char *OLD_DATAFILE_PREFIX = "Bikesense_old";
+  const char *SEGMENT_PREFIX = "Bikesense_seg";
+  const char *LOGFILE = "Bikesense_Logs.bin";
+  const char *MANIFEST = "Bikesense_manifest.txt";
+
+  const size_t LOGFILE_MAX_SIZE = 1000000; // 1MB
+  static constexpr size_t MAX_STATE_SIZE = 64;
+  static constexpr size_t MAX_SEGMENTS = 32;
+  static constexpr size_t MAX_MANIFEST_SIZE = 64 * MAX_SEGMENTS;
 
-  const int LOGFILE_MAX_SIZE = 1000000; // 1MB
+  // Oldest first, the last one is always the open segment
+  std::vector<Segment> segments_;
+  uint32_t nextSegmentId_ = 1;
+  std::string openPath_;
+  uint32_t cursorSegment_ = 0; // segment last opened for reading, 0 if none
+  StorageFormat cursorFormat_ = JSON_LINES;
 
-  size_t lastReadPosition_ = 0;
+  static constexpr size_t READ_BUFFER_SIZE = 4096;
 
-  bool log(const std::string message);
+  File readFile_;
+  bool cursorOpen_ = false;
+  char readBuffer_[READ_BUFFER_SIZE];
+  size_t readStart_ = 0;
+  size_t readEnd_ = 0;
+  bool discardLine_ = false;
+
+  BufferedWriter dataWriter_;
+  BufferedWriter logWriter_;
+
+  // Columnar blocks being written and read. Reading decodes a whole block,
+  // the cursor position is the block's offset shifted left by
+  // POSITION_INDEX_BITS plus the index of the next record in it, which
+  // leaves 16 MB per segment.
+  static constexpr int POSITION_INDEX_BITS = 8;
+  ColumnarEncoder encoder_;
+  std::vector<uint8_t> blockBuffer_;
+  std::vector<EncodedRecord> decoded_;
+  size_t decodedNext_ = 0;
+  size_t decodedStart_ = 0; // file offset of the decoded block
+
+  bool setupLogFile();
+  bool setupBinaryDataFile(const char *path);
+  bool moveAside(const char *path, StorageFormat format);
+  bool hasCurrentHeader(File &f, StorageFormat format);
+  static const std::vector<uint8_t> &fileHeader(StorageFormat format);
+
+  std::string segmentPath(const Segment &segment) const;
+  bool loadManifest();
+  void adoptSegmentFiles();
+  bool writeManifest();
+  bool openSegment();
+  static size_t emptySegmentSize(StorageFormat format);
+  Segment *cursorSegment();
+
+  bool writeFileAtomically(const std::string &path, const std::string &data);
+  bool readFile(const std::string &path, std::string &data, size_t maxSize);
+  std::string stateFile(const std::string &name) const;
+  bool fillReadBuffer();
+  bool nextBinaryBatch(int batchSize, RecordBatch &batch);
+
+  bool storeColumnar(const uint8_t *record);
+  bool writeBlock();
+  uint32_t scanBlocks(File &f, size_t &end);
+  bool readBlock();
+  bool nextColumnarBatch(int batchSize, RecordBatch &batch);
 
 public:
+  SDCard(StorageFormat format = JSON_LINES,
+         FlushPolicy flushPolicy = FlushPolicy());
+
   bool setup() override;
 
-  retrievedData retrieve(int batchSize) override;
-  bool store(const std::string data) override;
+  bool seal() override;
+  bool openCursor() override;
+  bool nextBatch(int batchSize, RecordBatch &batch) override;
+  void closeCursor() override;
+  size_t cursorPosition() override;
+  bool seekCursor(size_t position) override;
+
+  bool store(const DataRecord &record) override;
+  bool keepsEncoded() const override { return FORMAT != JSON_LINES; }
+  bool storeEncoded(const EncodedRecord *records, size_t count) override;
   bool clear() override;
+  bool sync() override;
+  bool poll() override;
+
+  bool saveProgress(const UploadCheckpoint &checkpoint) override;
+  bool loadProgress(UploadCheckpoint &checkpoint) override;
 
-  bool logInfo(const std::string message) override;
-  bool logInfo(const std::string message, const std::string timestamp) override;
+  bool saveState(const std::string &name, const std::string &value) override;
+  bool loadState(const std::string &name, std::string &value) override;
 
-  bool logError(const std::string message) override;
-  bool logError(const std::string message,
-                const std::string timestamp) override;
+  bool storeLogs(const LogEntry *entries, size_t count) override;
 };
 
 #endif
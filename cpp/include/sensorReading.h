@@ -1,28 +1,49 @@
 #ifndef _SENSOR_H_
 #define _SENSOR_H_
 
+#include <measurements.h>
+
+#include <cstdint>
 #include <optional>
-#include <string>
-#include <unordered_map>
 
+// A set of measurements taken at the same time. Each measurement has a fixed
+// slot indexed by its MeasurementId, so building and merging readings never
+// allocates. Key strings are only looked up from MEASUREMENTS when a reading
+// is serialized.
 class SensorReading {
 private:
-  std::unordered_map<std::string, double> measurements_;
+  double values_[MEASUREMENT_COUNT] = {};
+  uint16_t ageMs_[MEASUREMENT_COUNT] = {};
+  uint32_t present_ = 0;
 
 public:
-  // Constructor to initialize with sensor type and measurements
-  SensorReading();
-  SensorReading(std::unordered_map<std::string, double> measurements);
-
-  SensorReading &addMeasurement(const std::string &measurementName,
-                                double value);
-
-  // Getter functions all measurements
-  const std::unordered_map<std::string, double> &getMeasurements() const;
+  SensorReading() = default;
+
+  SensorReading &addMeasurement(MeasurementId id, double value) {
+    values_[id] = value;
+    ageMs_[id] = 0;
+    present_ |= 1UL << id;
+    return *this;
+  }
+
+  // Sets how long ago every present measurement was taken, saturating at
+  // UINT16_MAX
+  void setAge(uint32_t ageMs);
+  void setAge(MeasurementId id, uint32_t ageMs) {
+    ageMs_[id] = ageMs > UINT16_MAX ? UINT16_MAX : ageMs;
+  }
+  uint16_t age(MeasurementId id) const { return ageMs_[id]; }
+
+  bool has(MeasurementId id) const { return present_ & (1UL << id); }
+  bool empty() const { return present_ == 0; }
+  // Bit n is set when measurement n is present
+  uint32_t presence() const { return present_; }
+
+  // Only meaningful if has(id)
+  double value(MeasurementId id) const { return values_[id]; }
 
   // Getter function for a specific measurement
-  std::optional<double>
-  getMeasurement(const std::string &measurementName) const;
+  std::optional<double> getMeasurement(MeasurementId id) const;
 
   // Overloaded operators for merging sensor readings
   SensorReading operator+(const SensorReading &other) const;
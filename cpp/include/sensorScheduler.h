@@ -0,0 +1,55 @@
+#ifndef _SENSOR_SCHEDULER_H_
+#define _SENSOR_SCHEDULER_H_
+
+#include <interfaces.h>
+#include <sensorReading.h>
+
+#include <cstdint>
+#include <vector>
+
+// Source of the current time in milliseconds, millis() on the device
+typedef unsigned long (*Clock)();
+
+// Samples every sensor on its own period without blocking the loop.
+//
+// poll() is meant to be called on every loop iteration. It lets each sensor
+// do a bit of non-blocking work and reads at most one sensor whose period
+// has elapsed, the one with the earliest deadline. The latest reading of
+// every sensor is kept and snapshot() merges them into one record.
+class SensorScheduler {
+  struct Channel {
+    SensorInterface *sensor;
+    uint32_t periodMs;
+    uint32_t deadlineMs;
+    uint32_t nextDueMs = 0;
+    uint32_t lastReadMs = 0;
+    bool hasReading = false;
+    SensorReading latest;
+  };
+
+  const Clock CLOCK;
+
+  std::vector<Channel> channels_;
+  uint32_t deadlineMisses_ = 0;
+
+public:
+  SensorScheduler(const std::vector<SensorInterface *> &sensors,
+                  Clock clock = millis);
+
+  // Makes every sensor due now
+  void start();
+  // Returns the reading just taken, or nullptr if no sensor was due. It
+  // stays valid until the next poll().
+  const SensorReading *poll();
+  // Time until poll() has a sensor to read, 0 if one is due already
+  uint32_t msUntilDue() const;
+
+  // Latest value of every sensor with its age. A sensor that has not been
+  // read for longer than its period plus deadline is left out.
+  SensorReading snapshot() const;
+
+  // Number of reads that started later than the sensor's deadline
+  uint32_t deadlineMisses() const { return deadlineMisses_; }
+};
+
+#endif
@@ -16,6 +16,8 @@ class TempHumiditySensor : public SensorInterface {
 
   void setup();
   SensorReading read();
+  // The DHT22 cannot be read more often than every 2s
+  uint32_t periodMs() const { return 2000; }
 };
 
 #endif
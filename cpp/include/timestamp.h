@@ -0,0 +1,25 @@
+#ifndef _TIMESTAMP_H_
+#define _TIMESTAMP_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Timestamps travel through the device as milliseconds since the Unix epoch
+// (UTC) and are only turned into text when a record is serialized.
+
+// Size of the buffer formatIso8601 needs, including the terminator
+constexpr size_t ISO8601_SIZE = sizeof("YYYY-MM-DDTHH:MM:SSZ");
+
+// Days since 1970-01-01 for a proleptic Gregorian date, month is 1-based
+int32_t daysFromCivil(int year, unsigned month, unsigned day);
+void civilFromDays(int32_t days, int &year, unsigned &month, unsigned &day);
+
+uint64_t epochMsFromCivil(int year, unsigned month, unsigned day,
+                          unsigned hour, unsigned minute, unsigned second,
+                          unsigned millisecond = 0);
+
+// Writes "YYYY-MM-DDTHH:MM:SSZ", milliseconds are truncated. out must hold
+// ISO8601_SIZE bytes. Returns the length written.
+size_t formatIso8601(uint64_t epochMs, char *out);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef _TRAJECTORY_H_
+#define _TRAJECTORY_H_
+
+#include <dataRecord.h>
+#include <measurements.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Drops GPS fixes that add nothing to the shape of the ride, like the ones
+// taken while waiting at a traffic light or riding in a straight line.
+//
+// Opening-window simplification: starting from the last kept fix (the
+// anchor), each new fix becomes the candidate end of a straight segment as
+// long as every fix since the anchor stays within the tolerance of it. When
+// one doesn't, or MAX_WINDOW fixes have gone by, the previous candidate is
+// kept and becomes the new anchor. Fixes are held back until then, so
+// records come out at most MAX_WINDOW fixes late.
+//
+// Sensor values of the dropped fixes are not lost: the kept fix carries the
+// mean of every reading taken since the anchor, the energy mean for levels
+// in dB.
+class TrajectorySimplifier {
+public:
+  static constexpr size_t MAX_WINDOW = 30;
+
+private:
+  // Metres east and north of the anchor
+  struct Point {
+    float x;
+    float y;
+  };
+
+  // Readings folded into the candidate
+  struct Fold {
+    uint32_t count = 0;
+    double sum = 0; // of the values, or of their energies for dB
+    uint64_t readMs = 0; // when the latest one was taken
+  };
+
+  const float TOLERANCE_M;
+
+  bool hasAnchor_ = false;
+  double anchorLatitude_ = 0;
+  double anchorLongitude_ = 0;
+  double metresPerDegreeLongitude_ = 0;
+
+  // Fixes since the anchor, the last one is the candidate
+  Point window_[MAX_WINDOW];
+  size_t windowSize_ = 0;
+  DataRecord candidate_;
+  Fold folds_[MEASUREMENT_COUNT];
+
+  void setAnchor(const SensorReading &gps);
+  Point project(const SensorReading &gps) const;
+  bool fits(Point end) const;
+  void fold(const DataRecord &fix);
+  void take(DataRecord &kept);
+
+public:
+  // A tolerance of 0 keeps every fix
+  TrajectorySimplifier(float toleranceM = 0) : TOLERANCE_M(toleranceM) {}
+
+  bool enabled() const { return TOLERANCE_M > 0; }
+
+  // Takes the next fix. Returns true with a fix to store in kept, which is
+  // never the one just added unless it's the first of a trip.
+  bool add(const DataRecord &fix, DataRecord &kept);
+
+  // Hands out the held back fix at the end of a trip, the next fix starts
+  // a new one. Returns false if there is none.
+  bool flush(DataRecord &kept);
+};
+
+// Distance in metres from p to the segment between a and b, on a plane
+// tangent at a. Good enough for the few hundred metres between fixes.
+float distanceToSegmentM(double latitude, double longitude, double aLatitude,
+                         double aLongitude, double bLatitude,
+                         double bLongitude);
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef _UBX_GPS_H_
+#define _UBX_GPS_H_
+
+#include <interfaces.h>
+#include <sensorReading.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Incremental parser for u-blox UBX frames:
+//   0xB5 0x62 | class u8 | id u8 | length u16 | payload | ck_a | ck_b
+// Bytes are fed one at a time straight from the UART. Frames with a bad
+// checksum or a payload larger than MAX_PAYLOAD are dropped and counted.
+class UbxParser {
+public:
+  static constexpr size_t MAX_PAYLOAD = 100;
+
+private:
+  enum State {
+    SYNC_1,
+    SYNC_2,
+    CLASS,
+    ID,
+    LENGTH_1,
+    LENGTH_2,
+    PAYLOAD,
+    CHECKSUM_A,
+    CHECKSUM_B,
+  };
+
+  State state_ = SYNC_1;
+  uint8_t class_ = 0;
+  uint8_t id_ = 0;
+  uint16_t length_ = 0;
+  uint16_t received_ = 0;
+  uint8_t ckA_ = 0;
+  uint8_t ckB_ = 0;
+  uint8_t payload_[MAX_PAYLOAD];
+
+  uint32_t frames_ = 0;
+  uint32_t checksumFailures_ = 0;
+  uint32_t oversized_ = 0;
+
+  void checksum(uint8_t byte);
+
+public:
+  // Returns true when byte completes a valid frame, which stays available
+  // until the next call
+  bool feed(uint8_t byte);
+
+  uint8_t messageClass() const { return class_; }
+  uint8_t messageId() const { return id_; }
+  const uint8_t *payload() const { return payload_; }
+  uint16_t length() const { return length_; }
+
+  uint32_t frames() const { return frames_; }
+  uint32_t checksumFailures() const { return checksumFailures_; }
+  uint32_t oversized() const { return oversized_; }
+};
+
+// Fields of UBX-NAV-PVT and UBX-NAV-DOP the device reports, in the units
+// the receiver sends them
+struct UbxNavSolution {
+  uint16_t year = 0;
+  uint8_t month = 0, day = 0, hour = 0, minute = 0, second = 0;
+  bool dateValid = false;
+  bool timeValid = false;
+  int32_t nano = 0; // ns, -1e9 to 1e9
+
+  uint8_t fixType = 0; // 0 none, 2 2D, 3 3D
+  bool fixOk = false;
+  uint8_t satellites = 0;
+  int32_t longitude = 0; // 1e-7 deg
+  int32_t latitude = 0;  // 1e-7 deg
+  int32_t heightMsl = 0; // mm
+  int32_t groundSpeed = 0; // mm/s
+  int32_t heading = 0;     // 1e-5 deg
+  uint16_t pdop = 0;       // 0.01
+
+  bool hasDop = false;
+  uint16_t hdop = 0; // 0.01
+  uint16_t vdop = 0; // 0.01
+};
+
+// Decode a NAV-PVT or NAV-DOP payload into solution. Returns false for
+// other messages or a payload that is too short.
+bool decodeUbxNav(uint8_t messageClass, uint8_t messageId,
+                  const uint8_t *payload, size_t length,
+                  UbxNavSolution &solution);
+
+// GPS using the UBX binary protocol instead of NMEA. The receiver is
+// switched to BAUD_RATE and asked for NAV-PVT and NAV-DOP at
+// NAV_RATE_HZ, NMEA output is turned off. Needs a u-blox 7 or newer
+// receiver, NAV-PVT does not exist on older ones.
+class UbxGps : public GpsInterface {
+private:
+  const int MAX_READING_AGE_MS = 5000;
+  const uint32_t DEFAULT_BAUD_RATE = 9600;
+  const uint32_t BAUD_RATE = 115200;
+  const uint16_t NAV_RATE_HZ;
+  const size_t RX_BUFFER_SIZE = 1024;
+
+  UbxParser parser_;
+  UbxNavSolution solution_;
+  unsigned long lastSolutionMs_ = 0;
+  bool hasSolution_ = false;
+  bool updated_ = false;
+  uint32_t overruns_ = 0;
+
+  void sendCommand(uint8_t messageClass, uint8_t messageId,
+                   const uint8_t *payload, uint16_t length);
+
+public:
+  // 5 to 10 Hz is a sensible range, 10 Hz is the limit of most receivers.
+  // Rates outside 1 to 1000 Hz are clamped.
+  UbxGps(uint16_t navRateHz = 5);
+
+  void setup() override;
+  void update() override;
+  bool isValid() override;
+  bool isUpdated() override;
+  bool isOld() override;
+  SensorReading read() override;
+  uint64_t timestampMs() override;
+
+  uint32_t frames() const { return parser_.frames(); }
+  uint32_t checksumFailures() const override {
+    return parser_.checksumFailures();
+  }
+  uint32_t overruns() const override { return overruns_; }
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _WAKE_TIMER_H_
+#define _WAKE_TIMER_H_
+
+#include <cstdint>
+
+// Collects the deadlines of everything the loop waits on and sleeps until
+// the earliest one. Interrupts end the sleep early: UART RX from the GPS,
+// the ADC's DMA blocks and the other core's queue notifications, so the
+// caller just runs its loop again and asks for a new wait.
+class WakeTimer {
+private:
+  uint32_t waitMs_;
+
+public:
+  WakeTimer(uint32_t maxWaitMs) : waitMs_(maxWaitMs) {}
+
+  // Something has to happen inMs from now, 0 if it's due already
+  void due(uint32_t inMs) {
+    if (inMs < waitMs_) {
+      waitMs_ = inMs;
+    }
+  }
+
+  // Something has to happen once elapsedMs reaches intervalMs
+  void dueAfter(uint32_t elapsedMs, uint32_t intervalMs) {
+    due(elapsedMs < intervalMs ? intervalMs - elapsedMs : 0);
+  }
+
+  uint32_t waitMs() const { return waitMs_; }
+
+  // Sleeps for waitMs() or until an interrupt, whichever comes first
+  void sleep() const;
+};
+
+#endif
@@ -0,0 +1,312 @@
+#include "Arduino.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+HardwareSerial Serial(stdout);
+HardwareSerial Serial1(nullptr);
+HardwareSerial Serial2(nullptr);
+RP2040 rp2040;
+
+static std::atomic<uint64_t> nowUs{0};
+static uint64_t idleUs = 0;
+static std::multimap<uint64_t, std::function<void()>> interrupts;
+
+// Core 0 is the thread that started the program, it moves the clock and
+// takes the interrupts. Core 1 is a thread of its own, but the two take
+// turns: core 1 only runs while core 0 waits, until it has to wait too.
+// What each core waits for is kept here so the other can tell when it's
+// ready to go on.
+static const std::thread::id core0 = std::this_thread::get_id();
+static std::mutex coreMutex;
+static std::condition_variable turnTaken;
+static std::thread core1;
+static int turn = 0;
+static bool core1Active = false;
+static bool core1Stopping = false;
+static std::function<bool()> core1Ready; // null while core 1 runs
+static uint64_t core1WakeUs = UINT64_MAX;  // if it waits for the clock
+
+static void advanceTo(uint64_t targetUs);
+
+// Runs core 1 for as long as it's ready, core 0 waits meanwhile
+static void runCore1() {
+  std::unique_lock<std::mutex> lock(coreMutex);
+  while (core1Active && core1Ready && core1Ready()) {
+    core1Ready = nullptr;
+    core1WakeUs = UINT64_MAX;
+    turn = 1;
+    turnTaken.notify_all();
+    turnTaken.wait(lock, [] { return turn == 0; });
+  }
+}
+
+// Gives the turn back to core 0 until ready() holds
+static void core1Wait(std::function<bool()> ready, uint64_t wakeUs) {
+  std::unique_lock<std::mutex> lock(coreMutex);
+  core1Ready = std::move(ready);
+  core1WakeUs = wakeUs;
+  turn = 0;
+  turnTaken.notify_all();
+  turnTaken.wait(lock, [] { return turn == 1; });
+}
+
+void startCore1(std::function<void()> loop) {
+  core1Active = true;
+  core1Stopping = false;
+  core1Ready = [] { return true; };
+  core1 = std::thread([loop]() {
+    {
+      std::unique_lock<std::mutex> lock(coreMutex);
+      turnTaken.wait(lock, [] { return turn == 1; });
+    }
+    while (!core1Stopping) {
+      loop();
+    }
+    std::lock_guard<std::mutex> lock(coreMutex);
+    core1Active = false;
+    turn = 0;
+    turnTaken.notify_all();
+  });
+  runCore1();
+}
+
+bool stopCore1() {
+  core1Stopping = true;
+  runCore1();
+  if (core1Active) {
+    return false;
+  }
+  if (core1.joinable()) {
+    core1.join();
+  }
+  return true;
+}
+
+void waitForOtherCore(const std::function<bool()> &ready) {
+  if (std::this_thread::get_id() != core0) {
+    core1Wait(ready, UINT64_MAX);
+    return;
+  }
+
+  while (!ready()) {
+    runCore1();
+    if (ready()) {
+      break;
+    }
+    if (!core1Active || core1WakeUs == UINT64_MAX) {
+      fprintf(stderr, "both cores wait for each other\n");
+      abort();
+    }
+    // Core 1 has to get further before this can go on
+    advanceTo(core1WakeUs);
+  }
+}
+
+static void setNow(uint64_t us) { nowUs = std::max<uint64_t>(nowUs, us); }
+
+// Moves the clock to targetUs, running the interrupts and core 1 as they
+// come due on the way
+static void advanceTo(uint64_t targetUs) {
+  if (std::this_thread::get_id() != core0) {
+    core1Wait([targetUs] { return nowUs >= targetUs; }, targetUs);
+    return;
+  }
+
+  runCore1();
+  while (true) {
+    const uint64_t interruptUs =
+        interrupts.empty() ? UINT64_MAX : interrupts.begin()->first;
+    const uint64_t nextUs = std::min({interruptUs, core1WakeUs, targetUs});
+    setNow(nextUs);
+    if (interruptUs == nextUs && interruptUs <= targetUs) {
+      std::function<void()> handler = std::move(interrupts.begin()->second);
+      interrupts.erase(interrupts.begin());
+      handler();
+    }
+    runCore1();
+    if (nextUs >= targetUs && (interrupts.empty() ||
+                               interrupts.begin()->first > targetUs)) {
+      break;
+    }
+  }
+}
+
+void String::toLowerCase() {
+  for (char &c : s_) {
+    c = tolower(static_cast<unsigned char>(c));
+  }
+}
+
+void String::trim() {
+  const size_t start = s_.find_first_not_of(" \t\r\n");
+  const size_t end = s_.find_last_not_of(" \t\r\n");
+  s_ = start == std::string::npos ? "" : s_.substr(start, end - start + 1);
+}
+
+bool String::startsWith(const char *prefix) const {
+  return s_.compare(0, strlen(prefix), prefix) == 0;
+}
+
+int String::indexOf(const char *s) const {
+  const size_t index = s_.find(s);
+  return index == std::string::npos ? -1 : index;
+}
+
+int String::indexOf(char c) const {
+  const size_t index = s_.find(c);
+  return index == std::string::npos ? -1 : index;
+}
+
+String String::substring(unsigned int from) const {
+  return from < s_.size() ? String(s_.substr(from)) : String();
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (n < size && write(buffer[n]) == 1) {
+    n++;
+  }
+  return n;
+}
+
+size_t Print::printf(const char *format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (length < 0) {
+    return 0;
+  }
+  return write(line, std::min<size_t>(length, sizeof(line) - 1));
+}
+
+int Stream::timedRead() {
+  const int c = read();
+  return c >= 0 || !waitForData() ? c : read();
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t n = 0;
+  int c;
+  while (n < length && (c = timedRead()) >= 0) {
+    buffer[n++] = c;
+  }
+  return n;
+}
+
+String Stream::readStringUntil(char terminator) {
+  String line;
+  int c;
+  while ((c = timedRead()) >= 0 && c != terminator) {
+    line += static_cast<char>(c);
+  }
+  return line;
+}
+
+bool HardwareSerial::overflow() {
+  bool overflow = overflow_;
+  overflow_ = false;
+  return overflow;
+}
+
+int HardwareSerial::available() { return rx_.size() - rxRead_; }
+
+int HardwareSerial::read() {
+  if (rxRead_ == rx_.size()) {
+    return -1;
+  }
+  int c = static_cast<uint8_t>(rx_[rxRead_++]);
+  if (rxRead_ == rx_.size()) {
+    rx_.clear();
+    rxRead_ = 0;
+  }
+  return c;
+}
+
+int HardwareSerial::peek() {
+  return rxRead_ == rx_.size() ? -1 : static_cast<uint8_t>(rx_[rxRead_]);
+}
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  if (out_ != nullptr) {
+    fwrite(buffer, 1, size, out_);
+  }
+  return size;
+}
+
+void HardwareSerial::flush() {
+  if (out_ != nullptr) {
+    fflush(out_);
+  }
+}
+
+size_t HardwareSerial::inject(const char *data, size_t length) {
+  const size_t room = fifoSize_ - available();
+  if (length > room) {
+    overflow_ = true;
+    length = room;
+  }
+  rx_.append(data, length);
+  return length;
+}
+
+unsigned long millis() { return nowUs / 1000; }
+
+unsigned long micros() { return nowUs; }
+
+void delay(unsigned long ms) { advanceTo(nowUs + ms * 1000ULL); }
+
+void delayMicroseconds(unsigned int us) { advanceTo(nowUs + us); }
+
+void sleep_ms(uint32_t ms) { advanceTo(nowUs + ms * 1000ULL); }
+
+void sleep_us(uint64_t us) { advanceTo(nowUs + us); }
+
+void advanceMicros(uint64_t us) { advanceTo(nowUs + us); }
+
+void scheduleInterrupt(uint64_t atUs, std::function<void()> handler) {
+  interrupts.emplace(atUs, std::move(handler));
+}
+
+void clearInterrupts() { interrupts.clear(); }
+
+bool waitForInterrupt(uint64_t us) {
+  const uint64_t startUs = nowUs;
+  const uint64_t timeoutUs = nowUs + us;
+  bool timedOut = true;
+  if (!interrupts.empty() && interrupts.begin()->first <= timeoutUs) {
+    // Wake with the first interrupt, along with any due at the same time
+    advanceTo(std::max<uint64_t>(nowUs, interrupts.begin()->first));
+    timedOut = false;
+  } else {
+    advanceTo(timeoutUs);
+  }
+  idleUs += nowUs - startUs;
+  return timedOut;
+}
+
+uint64_t idleMicros() { return idleUs; }
+
+void pinMode(pin_size_t pin, uint8_t mode) {}
+
+void digitalWrite(pin_size_t pin, uint8_t value) {}
+
+int digitalRead(pin_size_t pin) { return LOW; }
+
+int analogRead(pin_size_t pin) { return 0; }
+
+void analogReadResolution(int bits) {}
+
+void RP2040::reboot() {
+  fflush(stdout);
+  fprintf(stderr, "rp2040.reboot() called at %lu ms\n", millis());
+  exit(EXIT_FAILURE);
+}
@@ -0,0 +1,242 @@
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+// Stand-in for the parts of the Arduino core BikeSense uses, so the firmware
+// builds and runs on the host (env:native). Time is virtual: it only moves
+// in delay(), sleep_ms(), waitForInterrupt() and advanceMicros(), so runs are
+// reproducible and waiting costs nothing.
+
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+typedef uint8_t byte;
+typedef unsigned int uint;
+typedef uint8_t pin_size_t;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define LED_BUILTIN 64
+
+#define PI 3.1415926535897932384626433832795
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define radians(deg) ((deg) * DEG_TO_RAD)
+#define degrees(rad) ((rad) * RAD_TO_DEG)
+#define sq(x) ((x) * (x))
+
+using std::isnan;
+
+class String {
+private:
+  std::string s_;
+
+public:
+  String() = default;
+  String(const char *s) : s_(s ? s : "") {}
+  String(const std::string &s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int value) : s_(std::to_string(value)) {}
+  String(unsigned int value) : s_(std::to_string(value)) {}
+  String(long value) : s_(std::to_string(value)) {}
+  String(unsigned long value) : s_(std::to_string(value)) {}
+
+  const char *c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.size(); }
+  char operator[](unsigned int index) const { return s_[index]; }
+
+  bool concat(const char *s, size_t length) {
+    s_.append(s, length);
+    return true;
+  }
+  String &operator+=(const String &other) {
+    s_ += other.s_;
+    return *this;
+  }
+  String &operator+=(char c) {
+    s_ += c;
+    return *this;
+  }
+
+  // Like the Arduino core, a null pointer compares equal to ""
+  bool operator==(const char *s) const { return s_ == (s ? s : ""); }
+  bool operator!=(const char *s) const { return !(*this == s); }
+  bool operator==(const String &other) const { return s_ == other.s_; }
+  bool operator!=(const String &other) const { return s_ != other.s_; }
+
+  void toLowerCase();
+  void trim();
+  bool startsWith(const char *prefix) const;
+  int indexOf(const char *s) const;
+  int indexOf(char c) const;
+  String substring(unsigned int from) const;
+  long toInt() const { return atol(s_.c_str()); }
+};
+
+class Print {
+public:
+  virtual ~Print() = default;
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *buffer, size_t size) {
+    return write(reinterpret_cast<const uint8_t *>(buffer), size);
+  }
+  size_t write(const char *s) { return write(s, strlen(s)); }
+  virtual void flush() {}
+
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(int value) { return printf("%d", value); }
+  size_t print(unsigned int value) { return printf("%u", value); }
+  size_t print(long value) { return printf("%ld", value); }
+  size_t print(unsigned long value) { return printf("%lu", value); }
+  size_t print(double value, int digits = 2) {
+    return printf("%.*f", digits, value);
+  }
+
+  template <typename T> size_t println(const T &value) {
+    return print(value) + println();
+  }
+  size_t println() { return write("\r\n", 2); }
+
+  size_t printf(const char *format, ...)
+      __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+protected:
+  unsigned long timeout_ = 1000;
+
+  // Waits up to the timeout for more data, true if some arrived. Nothing
+  // arrives while a host thread waits, unless the stream knows when its
+  // next bytes are due.
+  virtual bool waitForData() { return false; }
+  int timedRead();
+
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long timeoutMs) { timeout_ = timeoutMs; }
+  size_t readBytes(char *buffer, size_t length);
+  size_t readBytes(uint8_t *buffer, size_t length) {
+    return readBytes(reinterpret_cast<char *>(buffer), length);
+  }
+  String readStringUntil(char terminator);
+};
+
+// Serial writes to a host stream, or nowhere. Received bytes are queued by
+// inject(), with the same bounded receive ring as the UART.
+class HardwareSerial : public Stream {
+private:
+  FILE *out_;
+  std::string rx_;
+  size_t rxRead_ = 0;
+  size_t fifoSize_ = 32;
+  bool overflow_ = false;
+
+public:
+  HardwareSerial(FILE *out) : out_(out) {}
+
+  void begin(unsigned long baud) {}
+  void end() {}
+  void setFIFOSize(size_t size) { fifoSize_ = size; }
+  // True once after bytes were lost to a full receive ring
+  bool overflow();
+  operator bool() const { return true; }
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  using Print::write;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  void flush() override;
+
+  // Host only
+  void setOutput(FILE *out) { out_ = out; }
+  // Queues bytes as if they came in over the wire, returns how many fit
+  size_t inject(const char *data, size_t length);
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+// Host only: moves the virtual clock, e.g. for time spent on the network
+void advanceMicros(uint64_t us);
+
+// Host only: interrupts on the virtual clock. The handler runs once the clock
+// reaches atUs, whatever is moving it.
+void scheduleInterrupt(uint64_t atUs, std::function<void()> handler);
+void clearInterrupts();
+// Host only: stands in for WFE, waits up to us for the next interrupt.
+// Returns true if the time ran out.
+bool waitForInterrupt(uint64_t us);
+// Host only: virtual time spent in waitForInterrupt
+uint64_t idleMicros();
+
+// Host only: core 1, running loop over and over on a thread of its own. The
+// cores take turns so runs stay reproducible: core 1 runs whenever core 0
+// waits, be it for the clock or for core 1, until it has to wait too. Only
+// the main thread, core 0, moves the clock.
+void startCore1(std::function<void()> loop);
+// Asks core 1 to stop after the current loop, true once it did. Core 0 has
+// to keep going until then, core 1 may be waiting for it.
+bool stopCore1();
+// Host only: blocks the calling core until ready() holds, letting the other
+// one run meanwhile. For the stand-ins of the inter-core queues.
+void waitForOtherCore(const std::function<bool()> &ready);
+
+void pinMode(pin_size_t pin, uint8_t mode);
+void digitalWrite(pin_size_t pin, uint8_t value);
+int digitalRead(pin_size_t pin);
+int analogRead(pin_size_t pin);
+void analogReadResolution(int bits);
+
+// Host only: bytes allocated with operator new, now and at most since the
+// last resetPeakHeap()
+size_t usedHeap();
+size_t peakHeap();
+void resetPeakHeap();
+// Host only: allocations made while one exists aren't counted, for the
+// stand-ins' own bookkeeping
+class UntrackedHeap {
+public:
+  UntrackedHeap();
+  ~UntrackedHeap();
+};
+
+// Only one core on the host, reboot() ends the program
+class RP2040 {
+public:
+  int cpuid() const { return 0; }
+  [[noreturn]] void reboot();
+  uint32_t getCycleCount() const { return micros() * 133; }
+  int getUsedHeap() const { return usedHeap(); }
+};
+
+extern RP2040 rp2040;
+
+#endif
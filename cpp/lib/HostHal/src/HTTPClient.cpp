@@ -0,0 +1,151 @@
+#include "HTTPClient.h"
+
+bool HTTPClient::begin(WiFiClient &client, const String &url) {
+  client_ = &client;
+  headers_.clear();
+  body_ = String();
+
+  const std::string text = url.c_str();
+  size_t hostStart = text.find("://");
+  if (hostStart == std::string::npos) {
+    return false;
+  }
+  hostStart += 3;
+  port_ = text.compare(0, 5, "https") == 0 ? 443 : 80;
+
+  const size_t pathStart = text.find('/', hostStart);
+  path_ = pathStart == std::string::npos ? "/" : text.substr(pathStart);
+  host_ = text.substr(hostStart, pathStart - hostStart);
+  const size_t portStart = host_.find(':');
+  if (portStart != std::string::npos) {
+    port_ = atoi(host_.c_str() + portStart + 1);
+    host_.resize(portStart);
+  }
+
+  return true;
+}
+
+void HTTPClient::end() {
+  if (client_ != nullptr && (!reuse_ || !keepAlive_)) {
+    client_->stop();
+  }
+  headers_.clear();
+}
+
+void HTTPClient::addHeader(const String &name, const String &value) {
+  headers_ += std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+}
+
+int HTTPClient::GET() { return sendRequest("GET", nullptr, 0); }
+
+int HTTPClient::POST(const uint8_t *payload, size_t size) {
+  return sendRequest("POST", payload, size);
+}
+
+int HTTPClient::POST(const char *payload) {
+  return POST(reinterpret_cast<const uint8_t *>(payload), strlen(payload));
+}
+
+int HTTPClient::POST(const String &payload) { return POST(payload.c_str()); }
+
+int HTTPClient::sendRequest(const char *method, const uint8_t *payload,
+                            size_t size) {
+  if (client_ == nullptr) {
+    return HTTPC_ERROR_NOT_CONNECTED;
+  }
+  body_ = String();
+
+  if (!client_->connected() && !client_->connect(host_.c_str(), port_)) {
+    return HTTPC_ERROR_CONNECTION_FAILED;
+  }
+
+  // Like the library, the port is left out only when it's 80 or 443
+  std::string host = host_;
+  if (port_ != 80 && port_ != 443) {
+    host += ":" + std::to_string(port_);
+  }
+  std::string head = std::string(method) + " " + path_ +
+                     " HTTP/1.1\r\nHost: " + host +
+                     "\r\nConnection: keep-alive\r\n" + headers_;
+  if (payload != nullptr) {
+    head += "Content-Length: " + std::to_string(size) + "\r\n";
+  }
+  head += "\r\n";
+
+  if (client_->write(head.data(), head.size()) != head.size()) {
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+  if (size > 0 && client_->write(payload, size) != size) {
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+
+  client_->setTimeout(timeoutMs_);
+  const int code = readResponse();
+  // Like the library, a failed exchange doesn't leave the connection open
+  if (code < 0) {
+    client_->stop();
+  }
+  return code;
+}
+
+int HTTPClient::readResponse() {
+  String statusLine = client_->readStringUntil('\n');
+  const char *status = strchr(statusLine.c_str(), ' ');
+  if (status == nullptr) {
+    return client_->connected() ? HTTPC_ERROR_READ_TIMEOUT
+                                : HTTPC_ERROR_CONNECTION_LOST;
+  }
+  const int code = atoi(status + 1);
+
+  long contentLength = -1;
+  keepAlive_ = true;
+  while (true) {
+    String header = client_->readStringUntil('\n');
+    if (header.length() <= 1) {
+      break;
+    }
+    header.toLowerCase();
+    if (header.startsWith("content-length:")) {
+      contentLength = header.substring(strlen("content-length:")).toInt();
+    } else if (header.startsWith("connection:") &&
+               header.indexOf("close") >= 0) {
+      keepAlive_ = false;
+    }
+  }
+
+  std::string body(contentLength > 0 ? contentLength : 0, '\0');
+  if (client_->readBytes(&body[0], body.size()) != body.size()) {
+    return HTTPC_ERROR_READ_TIMEOUT;
+  }
+  body_ = String(body);
+  return code;
+}
+
+String HTTPClient::errorToString(int error) {
+  switch (error) {
+  case HTTPC_ERROR_CONNECTION_FAILED:
+    return "connection failed";
+  case HTTPC_ERROR_SEND_HEADER_FAILED:
+    return "send header failed";
+  case HTTPC_ERROR_SEND_PAYLOAD_FAILED:
+    return "send payload failed";
+  case HTTPC_ERROR_NOT_CONNECTED:
+    return "not connected";
+  case HTTPC_ERROR_CONNECTION_LOST:
+    return "connection lost";
+  case HTTPC_ERROR_NO_STREAM:
+    return "no stream";
+  case HTTPC_ERROR_NO_HTTP_SERVER:
+    return "no HTTP server";
+  case HTTPC_ERROR_TOO_LESS_RAM:
+    return "too less ram";
+  case HTTPC_ERROR_ENCODING:
+    return "Transfer-Encoding not supported";
+  case HTTPC_ERROR_STREAM_WRITE:
+    return "Stream write error";
+  case HTTPC_ERROR_READ_TIMEOUT:
+    return "read Timeout";
+  default:
+    return String();
+  }
+}
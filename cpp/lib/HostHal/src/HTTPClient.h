@@ -0,0 +1,69 @@
+#ifndef _HOST_HTTP_CLIENT_H_
+#define _HOST_HTTP_CLIENT_H_
+
+// Stand-in for the ESP8266-style HTTPClient, speaking HTTP/1.1 over a
+// WiFiClient with the same error codes
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+#include <string>
+
+#define HTTPC_ERROR_CONNECTION_FAILED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+typedef enum {
+  HTTP_CODE_OK = 200,
+  HTTP_CODE_CREATED = 201,
+  HTTP_CODE_NO_CONTENT = 204,
+  HTTP_CODE_BAD_REQUEST = 400,
+  HTTP_CODE_UNAUTHORIZED = 401,
+  HTTP_CODE_NOT_FOUND = 404,
+  HTTP_CODE_PAYLOAD_TOO_LARGE = 413,
+  HTTP_CODE_UNSUPPORTED_MEDIA_TYPE = 415,
+  HTTP_CODE_INTERNAL_SERVER_ERROR = 500,
+  HTTP_CODE_SERVICE_UNAVAILABLE = 503,
+} t_http_codes;
+
+class HTTPClient {
+private:
+  WiFiClient *client_ = nullptr;
+  std::string host_;
+  uint16_t port_ = 80;
+  std::string path_;
+  std::string headers_;
+  bool reuse_ = true;
+  bool keepAlive_ = true;
+  uint16_t timeoutMs_ = 5000;
+  String body_;
+
+  int sendRequest(const char *method, const uint8_t *payload, size_t size);
+  int readResponse();
+
+public:
+  bool begin(WiFiClient &client, const String &url);
+  void end();
+
+  void setReuse(bool reuse) { reuse_ = reuse; }
+  void setTimeout(uint16_t timeoutMs) { timeoutMs_ = timeoutMs; }
+  void addHeader(const String &name, const String &value);
+
+  int GET();
+  int POST(const uint8_t *payload, size_t size);
+  int POST(const char *payload);
+  int POST(const String &payload);
+
+  String getString() { return body_; }
+  static String errorToString(int error);
+};
+
+#endif
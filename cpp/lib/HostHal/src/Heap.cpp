@@ -0,0 +1,82 @@
+// Counts what operator new hands out, so rp2040.getUsedHeap() has something
+// to report on the host. The firmware's big buffers are all C++ allocations.
+// What the stand-ins allocate for themselves, such as the server's copy of a
+// request, is left out with UntrackedHeap.
+
+#include "Arduino.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> usedBytes{0};
+static std::atomic<size_t> peakBytes{0};
+static thread_local int untrackedDepth = 0;
+
+// The counted size goes in front of every block, 0 if it isn't counted.
+// The header keeps the block's alignment.
+static constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+
+static void *allocate(size_t size) {
+  void *block = malloc(size + HEADER_SIZE);
+  if (block == nullptr) {
+    return nullptr;
+  }
+  const size_t counted = untrackedDepth > 0 ? 0 : size;
+  *static_cast<size_t *>(block) = counted;
+  if (counted == 0) {
+    return static_cast<char *>(block) + HEADER_SIZE;
+  }
+
+  const size_t used = usedBytes += counted;
+  size_t peak = peakBytes;
+  while (used > peak && !peakBytes.compare_exchange_weak(peak, used)) {
+  }
+  return static_cast<char *>(block) + HEADER_SIZE;
+}
+
+static void release(void *p) {
+  if (p == nullptr) {
+    return;
+  }
+  void *block = static_cast<char *>(p) - HEADER_SIZE;
+  usedBytes -= *static_cast<size_t *>(block);
+  free(block);
+}
+
+void *operator new(size_t size) {
+  void *p = allocate(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void *p) noexcept { release(p); }
+void operator delete[](void *p) noexcept { release(p); }
+void operator delete(void *p, size_t) noexcept { release(p); }
+void operator delete[](void *p, size_t) noexcept { release(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { release(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  release(p);
+}
+
+size_t usedHeap() { return usedBytes; }
+
+size_t peakHeap() { return peakBytes; }
+
+void resetPeakHeap() { peakBytes = usedBytes.load(); }
+
+UntrackedHeap::UntrackedHeap() { untrackedDepth++; }
+
+UntrackedHeap::~UntrackedHeap() { untrackedDepth--; }
@@ -0,0 +1,225 @@
+#include "SD.h"
+#include "SPI.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+SDClass SD;
+SPIClass SPI;
+
+struct File::Handle {
+  int fd;
+  std::string path;
+  std::string name;
+  size_t position = 0;
+  bool directory = false;
+  // Directory entries, listed by the first openNextFile
+  std::vector<std::string> entries;
+  bool listed = false;
+  size_t nextEntry = 0;
+
+  ~Handle() { ::close(fd); }
+};
+
+// Like the library, name() is the last part of the path
+File::File(int fd, const char *path) : handle_(new Handle{fd, path}) {
+  const char *slash = strrchr(path, '/');
+  handle_->name = slash == nullptr ? path : slash + 1;
+  struct stat info;
+  handle_->directory = fstat(fd, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+size_t File::write(uint8_t c) { return write(&c, 1); }
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+  if (!handle_) {
+    return 0;
+  }
+
+  ssize_t written = ::write(handle_->fd, buffer, SD.takeWriteBudget(size));
+  SD.stats().writes++;
+  if (written < 0) {
+    return 0;
+  }
+  SD.stats().bytesWritten += written;
+  handle_->position = this->size();
+  return written;
+}
+
+int File::available() { return handle_ ? size() - handle_->position : 0; }
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek() {
+  uint8_t c;
+  if (!handle_ || pread(handle_->fd, &c, 1, handle_->position) != 1) {
+    return -1;
+  }
+  return c;
+}
+
+int File::read(uint8_t *buffer, size_t size) {
+  if (!handle_) {
+    return -1;
+  }
+
+  ssize_t n = pread(handle_->fd, buffer, size, handle_->position);
+  SD.stats().reads++;
+  if (n < 0) {
+    return -1;
+  }
+  SD.stats().bytesRead += n;
+  handle_->position += n;
+  return n;
+}
+
+// Host writes are already visible to every reader, only the card's
+// directory update is counted and takes its time
+void File::flush() {
+  if (handle_) {
+    SD.stats().flushes++;
+    if (SD.flushStall() > 0) {
+      advanceMicros(SD.flushStall() * 1000ULL);
+    }
+  }
+}
+
+bool File::seek(uint32_t position, SeekMode mode) {
+  if (!handle_) {
+    return false;
+  }
+
+  size_t base = mode == SeekSet ? 0
+                : mode == SeekCur ? handle_->position
+                                  : size();
+  if (base + position > size()) {
+    return false;
+  }
+  handle_->position = base + position;
+  return true;
+}
+
+size_t File::position() const { return handle_ ? handle_->position : 0; }
+
+size_t File::size() const {
+  struct stat info;
+  if (!handle_ || fstat(handle_->fd, &info) != 0) {
+    return 0;
+  }
+  return info.st_size;
+}
+
+bool File::truncate(uint32_t size) {
+  if (!handle_ || ftruncate(handle_->fd, size) != 0) {
+    return false;
+  }
+  if (handle_->position > size) {
+    handle_->position = size;
+  }
+  return true;
+}
+
+const char *File::name() const { return handle_ ? handle_->name.c_str() : ""; }
+
+bool File::isDirectory() const { return handle_ && handle_->directory; }
+
+// Entries in name order, the card's own order isn't reproducible on a host
+File File::openNextFile(uint8_t mode) {
+  if (!handle_ || !handle_->directory) {
+    return File();
+  }
+
+  if (!handle_->listed) {
+    DIR *dir = opendir(SD.hostPath(handle_->path.c_str()).c_str());
+    if (dir != nullptr) {
+      while (const dirent *entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") != 0 &&
+            strcmp(entry->d_name, "..") != 0) {
+          handle_->entries.push_back(entry->d_name);
+        }
+      }
+      closedir(dir);
+    }
+    std::sort(handle_->entries.begin(), handle_->entries.end());
+    handle_->listed = true;
+  }
+
+  while (handle_->nextEntry < handle_->entries.size()) {
+    std::string path = handle_->path;
+    if (path.empty() || path.back() != '/') {
+      path += '/';
+    }
+    path += handle_->entries[handle_->nextEntry++];
+    File f = SD.open(path.c_str(), mode);
+    if (f) {
+      return f;
+    }
+  }
+  return File();
+}
+
+void File::rewindDirectory() {
+  if (handle_) {
+    handle_->entries.clear();
+    handle_->listed = false;
+    handle_->nextEntry = 0;
+  }
+}
+
+void File::close() { handle_.reset(); }
+
+size_t SDClass::takeWriteBudget(size_t size) {
+  if (writeBudget_ == UINT64_MAX) {
+    return size;
+  }
+  const size_t allowed = std::min<uint64_t>(size, writeBudget_);
+  writeBudget_ -= allowed;
+  return allowed;
+}
+
+bool SDClass::begin(pin_size_t csPin) {
+  return ::mkdir(root_.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+std::string SDClass::hostPath(const char *path) const {
+  return root_ + (path[0] == '/' ? "" : "/") + path;
+}
+
+File SDClass::open(const char *path, uint8_t mode) {
+  const int flags = mode == FILE_WRITE ? O_RDWR | O_CREAT | O_APPEND : O_RDONLY;
+  int fd = ::open(hostPath(path).c_str(), flags, 0644);
+  if (fd < 0) {
+    return File();
+  }
+
+  stats_.opens++;
+  return File(fd, path);
+}
+
+bool SDClass::exists(const char *path) {
+  return access(hostPath(path).c_str(), F_OK) == 0;
+}
+
+bool SDClass::remove(const char *path) {
+  return unlink(hostPath(path).c_str()) == 0;
+}
+
+bool SDClass::rename(const char *from, const char *to) {
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool SDClass::mkdir(const char *path) {
+  return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+bool SDClass::rmdir(const char *path) {
+  return ::rmdir(hostPath(path).c_str()) == 0;
+}
@@ -0,0 +1,101 @@
+#ifndef _HOST_SD_H_
+#define _HOST_SD_H_
+
+// Stand-in for the SD library, backed by a directory on the host. Every
+// operation is counted so benchmarks can report what the card would see.
+
+#include "Arduino.h"
+
+#include <memory>
+#include <string>
+
+#define FILE_READ 0
+#define FILE_WRITE 1
+
+enum SeekMode {
+  SeekSet,
+  SeekCur,
+  SeekEnd,
+};
+
+// Operations issued to the card since the last reset
+struct SdStats {
+  uint32_t opens = 0;
+  uint32_t writes = 0;
+  uint64_t bytesWritten = 0;
+  uint32_t reads = 0;
+  uint64_t bytesRead = 0;
+  uint32_t flushes = 0;
+};
+
+// Copies share the open file, like the handles of the real library. Files
+// opened with FILE_WRITE append every write to the end.
+class File : public Stream {
+private:
+  struct Handle;
+  std::shared_ptr<Handle> handle_;
+
+public:
+  File() = default;
+  File(int fd, const char *name);
+
+  operator bool() const { return handle_ != nullptr; }
+
+  using Print::write;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  int available() override;
+  int read() override;
+  int peek() override;
+  int read(uint8_t *buffer, size_t size);
+  void flush() override;
+
+  bool seek(uint32_t position, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  bool truncate(uint32_t size);
+  const char *name() const;
+  bool isDirectory() const;
+  // Opens the next entry of a directory, or returns a closed File after
+  // the last one
+  File openNextFile(uint8_t mode = FILE_READ);
+  void rewindDirectory();
+  void close();
+};
+
+class SDClass {
+private:
+  std::string root_ = "sdcard";
+  SdStats stats_;
+  uint32_t flushStallMs_ = 0;
+  uint64_t writeBudget_ = UINT64_MAX;
+
+public:
+  bool begin(pin_size_t csPin);
+
+  File open(const char *path, uint8_t mode = FILE_READ);
+  bool exists(const char *path);
+  bool remove(const char *path);
+  bool rename(const char *from, const char *to);
+  bool mkdir(const char *path);
+  bool rmdir(const char *path);
+
+  // Host only
+  void setRoot(const std::string &root) { root_ = root; }
+  std::string hostPath(const char *path) const;
+  SdStats &stats() { return stats_; }
+  void resetStats() { stats_ = SdStats(); }
+  // Every flush keeps the caller busy for this long, like a card doing its
+  // housekeeping
+  void setFlushStall(uint32_t ms) { flushStallMs_ = ms; }
+  uint32_t flushStall() const { return flushStallMs_; }
+  // Writes come up short once bytes more were written, like a card pulled
+  // out or full. UINT64_MAX never fails.
+  void failWritesAfter(uint64_t bytes) { writeBudget_ = bytes; }
+  // Takes up to size bytes from what failWritesAfter left, returns how many
+  size_t takeWriteBudget(size_t size);
+};
+
+extern SDClass SD;
+
+#endif
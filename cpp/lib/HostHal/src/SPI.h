@@ -0,0 +1,16 @@
+#ifndef _HOST_SPI_H_
+#define _HOST_SPI_H_
+
+#include "Arduino.h"
+
+class SPIClass {
+public:
+  bool setRX(pin_size_t pin) { return true; }
+  bool setTX(pin_size_t pin) { return true; }
+  bool setSCK(pin_size_t pin) { return true; }
+  bool setCS(pin_size_t pin) { return true; }
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef _HOST_WPROGRAM_H_
+#define _HOST_WPROGRAM_H_
+
+// Libraries that check ARDUINO >= 100 fall back to this pre-1.0 header
+#include "Arduino.h"
+
+#endif
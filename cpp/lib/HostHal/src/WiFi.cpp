@@ -0,0 +1,20 @@
+#include "WiFi.h"
+
+WiFiClass WiFi;
+
+wl_status_t WiFiClass::status() const {
+  return mode_ != WIFI_OFF && inRange_ && !ssid_.empty() ? WL_CONNECTED
+                                                         : WL_DISCONNECTED;
+}
+
+bool WiFiMulti::addAP(const char *ssid, const char *password) {
+  ssids_.push_back(ssid);
+  return true;
+}
+
+uint8_t WiFiMulti::run(uint32_t timeoutMs) {
+  if (WiFi.status() != WL_CONNECTED && !ssids_.empty()) {
+    WiFi.join(ssids_.front());
+  }
+  return WiFi.status();
+}
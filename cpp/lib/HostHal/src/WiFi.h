@@ -0,0 +1,55 @@
+#ifndef _HOST_WIFI_H_
+#define _HOST_WIFI_H_
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+#include <string>
+#include <vector>
+
+typedef enum {
+  WIFI_OFF,
+  WIFI_STA,
+  WIFI_AP,
+  WIFI_AP_STA,
+} WiFiMode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+// A known network is in range whenever setInRange(true) was called, e.g.
+// while the simulated bike is docked
+class WiFiClass {
+private:
+  WiFiMode_t mode_ = WIFI_OFF;
+  bool inRange_ = false;
+  std::string ssid_;
+
+public:
+  void mode(WiFiMode_t mode) { mode_ = mode; }
+  wl_status_t status() const;
+  String SSID() const { return String(ssid_.c_str()); }
+
+  // Host only
+  void setInRange(bool inRange) { inRange_ = inRange; }
+  void join(const std::string &ssid) { ssid_ = ssid; }
+};
+
+extern WiFiClass WiFi;
+
+class WiFiMulti {
+private:
+  std::vector<std::string> ssids_;
+
+public:
+  bool addAP(const char *ssid, const char *password);
+  uint8_t run(uint32_t timeoutMs = 10000);
+};
+
+#endif
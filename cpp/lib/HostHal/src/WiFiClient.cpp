@@ -0,0 +1,250 @@
+#include "WiFiClient.h"
+#include "WiFi.h"
+
+#include <algorithm>
+
+LoopbackServer loopbackServer;
+
+static size_t countOccurrences(const std::string &text, const char *needle) {
+  size_t count = 0;
+  for (size_t at = text.find(needle); at != std::string::npos;
+       at = text.find(needle, at + 1)) {
+    count++;
+  }
+  return count;
+}
+
+std::string LoopbackServer::handle(
+    const std::string &method, const std::string &path,
+    const std::map<std::string, std::string> &headers,
+    const std::string &body) {
+  int status = 404;
+  std::string answer = "{\"detail\":\"Not Found\"}";
+
+  auto header = [&headers](const char *name) {
+    auto it = headers.find(name);
+    return it == headers.end() ? std::string() : it->second;
+  };
+
+  if (onRequest) {
+    onRequest(path, headers, body);
+  }
+
+  if (path.find("/check_health") != std::string::npos) {
+    status = 200;
+    answer = "{\"status\":\"ok\"}";
+  } else if (path.find("/register") != std::string::npos) {
+    if (path.find("/trip/") != std::string::npos) {
+      stats.trips++;
+    }
+    status = 201;
+    answer = "{\"id\":" + std::to_string(nextId_++) + "}";
+  } else if (path.find("/trip/upload_data") != std::string::npos) {
+    const bool gzip = header("content-encoding") == "gzip";
+    stats.uploads++;
+    stats.bodyBytes += body.size();
+    if (gzip && !acceptGzip) {
+      status = 415;
+    } else {
+      status = uploadStatus;
+      if (!gzip && status < 300) {
+        stats.records += countOccurrences(body, "{\"timestamp\"");
+      }
+    }
+    answer = "{}";
+  }
+
+  const char *reason = status == 200   ? "OK"
+                       : status == 201 ? "Created"
+                       : status == 204 ? "No Content"
+                       : status == 304 ? "Not Modified"
+                       : status == 404 ? "Not Found"
+                       : status == 415 ? "Unsupported Media Type"
+                                       : "Error";
+  std::string response = "HTTP/1.1 " + std::to_string(status) + " " + reason +
+                         "\r\nContent-Type: application/json\r\n";
+  if (status == 204) {
+    // No body and no length
+    return response + "Connection: keep-alive\r\n\r\n";
+  }
+  if (status == 304) {
+    // The length of the body it would have, but no body
+    return response + "Content-Length: " + std::to_string(answer.size()) +
+           "\r\nConnection: keep-alive\r\n\r\n";
+  }
+  if (chunkedUploadAnswers &&
+      path.find("/trip/upload_data") != std::string::npos) {
+    // A byte per chunk, the most framing a client has to get through
+    response +=
+        "Transfer-Encoding: chunked\r\nConnection: keep-alive\r\n\r\n";
+    for (char c : answer) {
+      response += "1\r\n" + std::string(1, c) + "\r\n";
+    }
+    return response + "0\r\n\r\n";
+  }
+  return response + "Content-Length: " + std::to_string(answer.size()) +
+         "\r\nConnection: keep-alive\r\n\r\n" + answer;
+}
+
+void LoopbackServer::reset() {
+  stats = LoopbackStats();
+  nextId_ = 1;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+  stop();
+  if (WiFi.status() != WL_CONNECTED) {
+    return 0;
+  }
+
+  advanceMicros(loopbackServer.roundTripMs * 1000ULL);
+  loopbackServer.stats.connects++;
+  connected_ = true;
+  return 1;
+}
+
+uint8_t WiFiClient::connected() {
+  if (WiFi.status() != WL_CONNECTED) {
+    connected_ = false;
+  }
+  return connected_ || available() > 0;
+}
+
+void WiFiClient::stop() {
+  connected_ = false;
+  request_.clear();
+  response_.clear();
+  responseRead_ = 0;
+  responseDueUs_ = 0;
+}
+
+// Handles the request at the start of request_ once all of it arrived,
+// with either a Content-Length or a chunked body
+bool WiFiClient::handleRequest() {
+  const size_t headEnd = request_.find("\r\n\r\n");
+  if (headEnd == std::string::npos) {
+    return false;
+  }
+
+  size_t lineEnd = request_.find("\r\n");
+  const std::string requestLine = request_.substr(0, lineEnd);
+  const size_t methodEnd = requestLine.find(' ');
+  const size_t pathEnd = requestLine.find(' ', methodEnd + 1);
+  const std::string method = requestLine.substr(0, methodEnd);
+  const std::string path =
+      requestLine.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+
+  std::map<std::string, std::string> headers;
+  while (lineEnd < headEnd) {
+    const size_t start = lineEnd + 2;
+    lineEnd = request_.find("\r\n", start);
+    const size_t colon = request_.find(':', start);
+    if (colon == std::string::npos || colon > lineEnd) {
+      continue;
+    }
+    std::string name = request_.substr(start, colon - start);
+    for (char &c : name) {
+      c = tolower(static_cast<unsigned char>(c));
+    }
+    const size_t valueStart = request_.find_first_not_of(' ', colon + 1);
+    headers[name] = request_.substr(valueStart, lineEnd - valueStart);
+  }
+
+  std::string body;
+  size_t end = headEnd + 4;
+  if (headers["transfer-encoding"] == "chunked") {
+    // Only walk the chunks once the last one may have arrived, streamed
+    // uploads write thousands of them
+    const char *LAST_CHUNK = "0\r\n\r\n";
+    if (request_.size() < end + 5 ||
+        request_.compare(request_.size() - 5, 5, LAST_CHUNK) != 0) {
+      return false;
+    }
+    while (true) {
+      const size_t sizeEnd = request_.find("\r\n", end);
+      if (sizeEnd == std::string::npos) {
+        return false;
+      }
+      const size_t size = strtoul(request_.c_str() + end, nullptr, 16);
+      if (request_.size() < sizeEnd + 2 + size + 2) {
+        return false;
+      }
+      body.append(request_, sizeEnd + 2, size);
+      end = sizeEnd + 2 + size + 2;
+      if (size == 0) {
+        break;
+      }
+    }
+  } else {
+    const size_t length = atol(headers["content-length"].c_str());
+    if (request_.size() < end + length) {
+      return false;
+    }
+    body = request_.substr(end, length);
+    end += length;
+  }
+
+  loopbackServer.stats.requests++;
+  loopbackServer.stats.bytesReceived += end;
+  response_ += loopbackServer.handle(method, path, headers, body);
+  request_.erase(0, end);
+
+  advanceMicros(loopbackServer.roundTripMs * 1000ULL +
+                end * 1000000ULL / loopbackServer.bytesPerSecond);
+  responseDueUs_ = micros() + loopbackServer.replyDelayMs * 1000ULL;
+  return true;
+}
+
+// Answers still on their way show up when due, if that's within the timeout
+bool WiFiClient::waitForData() {
+  if (response_.size() == responseRead_ || responseDueUs_ <= micros()) {
+    return false;
+  }
+  const uint64_t timeoutUs = timeout_ * 1000ULL;
+  if (responseDueUs_ - micros() > timeoutUs) {
+    advanceMicros(timeoutUs);
+    return false;
+  }
+  advanceMicros(responseDueUs_ - micros());
+  return true;
+}
+
+size_t WiFiClient::write(uint8_t c) { return write(&c, 1); }
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size) {
+  if (!connected()) {
+    return 0;
+  }
+
+  // The server's side of the connection isn't the device's memory
+  UntrackedHeap untracked;
+  request_.append(reinterpret_cast<const char *>(buffer), size);
+  while (handleRequest()) {
+  }
+  return size;
+}
+
+int WiFiClient::available() {
+  return responseDueUs_ > micros() ? 0 : response_.size() - responseRead_;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::peek() {
+  return available() > 0 ? static_cast<uint8_t>(response_[responseRead_])
+                         : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size) {
+  const size_t n = std::min<size_t>(size, available());
+  memcpy(buffer, response_.data() + responseRead_, n);
+  responseRead_ += n;
+  if (responseRead_ == response_.size()) {
+    response_.clear();
+    responseRead_ = 0;
+  }
+  return n;
+}
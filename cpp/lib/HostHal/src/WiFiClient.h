@@ -0,0 +1,86 @@
+#ifndef _HOST_WIFI_CLIENT_H_
+#define _HOST_WIFI_CLIENT_H_
+
+#include "Arduino.h"
+
+#include <functional>
+#include <map>
+#include <string>
+
+// What the stand-in server received since the last reset
+struct LoopbackStats {
+  uint32_t connects = 0;
+  uint32_t requests = 0;
+  uint32_t trips = 0;         // requests to /trip/register
+  uint32_t uploads = 0;       // requests to /trip/upload_data
+  uint64_t bytesReceived = 0; // everything on the wire, framing included
+  uint64_t bodyBytes = 0;     // upload bodies as sent, compressed or not
+  uint32_t records = 0;       // records in uncompressed upload bodies
+};
+
+// In-process stand-in for the API server. Every WiFiClient talks to it, no
+// matter the host. Time on the wire is added to the virtual clock, so the
+// firmware sees realistic latencies.
+class LoopbackServer {
+private:
+  int nextId_ = 1;
+
+public:
+  uint32_t roundTripMs = 30;
+  uint32_t bytesPerSecond = 100 * 1024;
+  // Time the server takes to answer once a request arrived, on top of the
+  // round trip
+  uint32_t replyDelayMs = 0;
+  int uploadStatus = 201; // answer to uploads, e.g. 500 to test retries
+  bool acceptGzip = true;
+  // Upload answers with a chunked body instead of a Content-Length
+  bool chunkedUploadAnswers = false;
+  LoopbackStats stats;
+  // Sees every request before it's answered, for tests that check more than
+  // the stats
+  std::function<void(const std::string &path,
+                     const std::map<std::string, std::string> &headers,
+                     const std::string &body)>
+      onRequest;
+
+  // Builds the full response to one request
+  std::string handle(const std::string &method, const std::string &path,
+                     const std::map<std::string, std::string> &headers,
+                     const std::string &body);
+  void reset();
+};
+
+extern LoopbackServer loopbackServer;
+
+class WiFiClient : public Stream {
+private:
+  bool connected_ = false;
+  std::string request_;  // written, not yet a complete request
+  std::string response_; // answers not yet read
+  size_t responseRead_ = 0;
+  uint64_t responseDueUs_ = 0; // when the last answer can be read
+
+  bool handleRequest();
+
+protected:
+  bool waitForData() override;
+
+public:
+  virtual ~WiFiClient() = default;
+
+  virtual int connect(const char *host, uint16_t port);
+  virtual uint8_t connected();
+  virtual void stop();
+  void setNoDelay(bool noDelay) {}
+  operator bool() { return connected(); }
+
+  using Print::write;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  int available() override;
+  int read() override;
+  int peek() override;
+  int read(uint8_t *buffer, size_t size);
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _HOST_WIFI_CLIENT_SECURE_H_
+#define _HOST_WIFI_CLIENT_SECURE_H_
+
+#include "WiFiClient.h"
+
+// TLS is not simulated, the loopback server answers in plain text
+class Session {};
+
+class WiFiClientSecure : public WiFiClient {
+public:
+  void setInsecure() {}
+  void setSession(Session *session) {}
+};
+
+#endif
@@ -0,0 +1,349 @@
+#!/usr/bin/env python3
+"""Decode a binary BikeSense data file (Bikesense.bin) into JSON.
+
+The output is the same JSON array the device POSTs to /trip/upload_data.
+The schema is read from the file header, so files written by older
+firmware versions decode as long as the layout version matches.
+
+Columnar segments (.bsc) decode the same way. A block cut off by a reset
+is skipped with a warning, the blocks before it are complete.
+
+Aggregate records carry the statistics of their window in an "aggregate"
+object next to the mean. From version 4 on they are sparse rows holding only
+the measurements they have, other rows have no aggregate slots.
+
+With --ages every record also gets an "age_ms" object telling how long
+before the timestamp each measurement was taken (version 2 and later).
+
+Usage: decode_records.py Bikesense.bin [--lines] [--ages] [-o output.json]
+"""
+
+import argparse
+import datetime
+import json
+import struct
+import sys
+
+MAGIC = b"BSR1"
+VERSIONS = (1, 2, 3, 4)
+AGE_UNIT_MS = 100
+
+COLUMNAR_MAGIC = b"BSC1"
+COLUMNAR_VERSIONS = (1,)
+BLOCK_HEADER_SIZE = 3
+
+GROUP_GPS = 1
+GROUP_AGGREGATE = 2
+
+FIELD_U8, FIELD_U16, FIELD_I32, FIELD_F32 = range(4)
+FIELD_FORMATS = {FIELD_U8: "<B", FIELD_U16: "<H", FIELD_I32: "<i", FIELD_F32: "<f"}
+
+
+def read_string(data, offset):
+    length = data[offset]
+    return data[offset + 1 : offset + 1 + length].decode(), offset + 1 + length
+
+
+def read_header(data):
+    if data[:4] != MAGIC:
+        raise ValueError("not a BikeSense binary data file")
+
+    version, field_count, record_size = struct.unpack_from("<BBH", data, 4)
+    if version not in VERSIONS:
+        raise ValueError(f"unsupported format version {version}")
+
+    fields, offset = read_fields(data, 8, field_count)
+    return fields, version, record_size, offset
+
+
+def read_fields(data, offset, field_count):
+    fields = []
+    for _ in range(field_count):
+        field_id, group, field_type, scale = struct.unpack_from("<BBBb", data, offset)
+        key, offset = read_string(data, offset + 4)
+        unit, offset = read_string(data, offset)
+        fields.append(
+            {
+                "id": field_id,
+                "key": key,
+                "unit": unit,
+                "group": group,
+                "type": field_type,
+                "scale": scale,
+            }
+        )
+
+    return fields, offset
+
+
+def slotted_fields(fields, mask, version):
+    """Which fields have a slot in a row with this presence mask."""
+    if version < 4:
+        return [True] * len(fields)
+    # Rows of aggregate records only hold what their mask has, the others
+    # have no aggregate slots
+    sparse = any(
+        mask & (1 << field["id"])
+        for field in fields
+        if field["group"] == GROUP_AGGREGATE
+    )
+    return [
+        bool(mask & (1 << field["id"]))
+        if sparse
+        else field["group"] != GROUP_AGGREGATE
+        for field in fields
+    ]
+
+
+def decode_record(data, offset, fields, version, with_ages):
+    # Version 3 moved from seconds to milliseconds since the epoch
+    if version >= 3:
+        timestamp_ms, mask = struct.unpack_from("<QI", data, offset)
+        offset += 12
+    else:
+        timestamp, mask = struct.unpack_from("<II", data, offset)
+        timestamp_ms = timestamp * 1000
+        offset += 8
+    slotted = slotted_fields(fields, mask, version)
+    raws = [0] * len(fields)
+    for index, field in enumerate(fields):
+        if slotted[index]:
+            fmt = FIELD_FORMATS[field["type"]]
+            (raws[index],) = struct.unpack_from(fmt, data, offset)
+            offset += struct.calcsize(fmt)
+    ages = None
+    if version >= 2:
+        ages = [0] * len(fields)
+        for index in range(len(fields)):
+            if slotted[index]:
+                ages[index] = data[offset]
+                offset += 1
+
+    return build_record(timestamp_ms, mask, raws, ages, fields, with_ages)
+
+
+def build_record(timestamp_ms, mask, raws, ages, fields, with_ages):
+    record = {
+        "timestamp": datetime.datetime.fromtimestamp(
+            timestamp_ms // 1000, datetime.timezone.utc
+        ).strftime("%Y-%m-%dT%H:%M:%SZ")
+    }
+    gps = {}
+    aggregate = {}
+    ages_ms = {}
+
+    for index, (field, raw) in enumerate(zip(fields, raws)):
+        if not mask & (1 << field["id"]):
+            continue
+
+        value = raw
+        if field["type"] != FIELD_F32:
+            value = raw / 10.0 ** -field["scale"]
+        if field["group"] == GROUP_GPS:
+            target = gps
+        elif field["group"] == GROUP_AGGREGATE:
+            target = aggregate
+        else:
+            target = record
+        target[field["key"]] = value
+        if ages is not None:
+            ages_ms[field["key"]] = ages[index] * AGE_UNIT_MS
+
+    record["gps_data"] = gps
+    if aggregate:
+        record["aggregate"] = aggregate
+    if with_ages:
+        record["age_ms"] = ages_ms
+    return record
+
+
+class BitReader:
+    """Bits of a column, most significant first."""
+
+    def __init__(self, data):
+        self.data = data
+        self.position = 0
+
+    def read(self, n_bits):
+        if self.position + n_bits > len(self.data) * 8:
+            raise ValueError("column ends early")
+        value = 0
+        for _ in range(n_bits):
+            byte = self.data[self.position // 8]
+            value = (value << 1) | ((byte >> (7 - self.position % 8)) & 1)
+            self.position += 1
+        return value
+
+    def read_varint(self):
+        value = 0
+        for shift in range(0, 64, 7):
+            byte = self.read(8)
+            value |= (byte & 0x7F) << shift
+            if not byte & 0x80:
+                return value
+        raise ValueError("varint too long")
+
+    def read_xor(self, state, width):
+        """Gorilla XOR coding, state is [previous, leading, trailing]."""
+        if not self.read(1):
+            return state[0]
+        if self.read(1):
+            state[1] = self.read(5)
+            length = self.read(6) or 64
+            state[2] = width - state[1] - length
+            if state[2] < 0:
+                raise ValueError("bad XOR window")
+        elif state[1] is None:
+            raise ValueError("XOR window never sent")
+        state[0] ^= self.read(width - state[1] - state[2]) << state[2]
+        return state[0]
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_block(payload, samples, fields):
+    columns = []
+    offset = 0
+    for _ in range(2 + len(fields)):
+        size = 0
+        shift = 0
+        while True:
+            byte = payload[offset]
+            offset += 1
+            size |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                break
+        columns.append(payload[offset : offset + size])
+        offset += size
+    if offset != len(payload):
+        raise ValueError("columns don't fill the block")
+
+    bits = BitReader(columns[0])
+    timestamps = [bits.read(64)]
+    delta = 0
+    for _ in range(1, samples):
+        for width in (0, 7, 9, 12):
+            if not bits.read(1):
+                break
+        else:
+            width = 64
+        delta += unzigzag(bits.read(width))
+        timestamps.append((timestamps[-1] + delta) % (1 << 64))
+
+    bits = BitReader(columns[1])
+    masks = [bits.read(32)]
+    for _ in range(1, samples):
+        masks.append(bits.read(32) if bits.read(1) else masks[-1])
+
+    raws = [[0] * len(fields) for _ in range(samples)]
+    ages = [[0] * len(fields) for _ in range(samples)]
+    for index, field in enumerate(fields):
+        bits = BitReader(columns[2 + index])
+        xor_double = field["group"] == GROUP_GPS and field["type"] == FIELD_I32
+        width = 32 if field["type"] == FIELD_F32 else 64
+        state = None
+        age = 0
+        for sample in range(samples):
+            if not masks[sample] & (1 << field["id"]):
+                continue
+
+            if xor_double or field["type"] == FIELD_F32:
+                if state is None:
+                    state = [bits.read(width), None, 0]
+                else:
+                    bits.read_xor(state, width)
+                if xor_double:
+                    raw = int(struct.unpack("<d", struct.pack("<Q", state[0]))[0])
+                else:
+                    (raw,) = struct.unpack("<f", struct.pack("<I", state[0]))
+            else:
+                raw = 0 if state is None else state
+                if bits.read(1):
+                    raw += unzigzag(bits.read_varint())
+                state = raw
+            raws[sample][index] = raw
+
+            if bits.read(1):
+                age = bits.read(8)
+            ages[sample][index] = age
+
+    return zip(timestamps, masks, raws, ages)
+
+
+def decode_columnar_file(data, with_ages):
+    version, field_count, _ = struct.unpack_from("<BBB", data, 4)
+    if version not in COLUMNAR_VERSIONS:
+        raise ValueError(f"unsupported columnar format version {version}")
+    fields, offset = read_fields(data, 7, field_count)
+
+    records = []
+    while offset + BLOCK_HEADER_SIZE <= len(data):
+        samples, payload_size = struct.unpack_from("<BH", data, offset)
+        end = offset + BLOCK_HEADER_SIZE + payload_size
+        if end > len(data):
+            break
+        payload = data[offset + BLOCK_HEADER_SIZE : end]
+        for timestamp_ms, mask, raws, ages in decode_block(payload, samples, fields):
+            records.append(
+                build_record(timestamp_ms, mask, raws, ages, fields, with_ages)
+            )
+        offset = end
+
+    if offset != len(data):
+        print(
+            f"warning: ignoring a cut-off block of {len(data) - offset} bytes",
+            file=sys.stderr,
+        )
+
+    return records
+
+
+def decode_file(data, with_ages=False):
+    if data[:4] == COLUMNAR_MAGIC:
+        return decode_columnar_file(data, with_ages)
+
+    fields, version, record_size, offset = read_header(data)
+
+    records = []
+    while offset + record_size <= len(data):
+        records.append(decode_record(data, offset, fields, version, with_ages))
+        offset += record_size
+
+    if offset != len(data):
+        print(
+            f"warning: ignoring {len(data) - offset} trailing bytes",
+            file=sys.stderr,
+        )
+
+    return records
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("file", help="binary data file read from the SD card")
+    parser.add_argument(
+        "--lines", action="store_true", help="one JSON object per line"
+    )
+    parser.add_argument(
+        "--ages", action="store_true", help="include the age of each measurement"
+    )
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as f:
+        records = decode_file(f.read(), args.ages)
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    if args.lines:
+        for record in records:
+            out.write(json.dumps(record) + "\n")
+    else:
+        json.dump(records, out)
+        out.write("\n")
+
+
+if __name__ == "__main__":
+    main()
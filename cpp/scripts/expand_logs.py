@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Expand a binary BikeSense log file (Bikesense_Logs.bin) into text.
+
+The device only stores a message id and its arguments for every log line.
+The message formats are read from the file header, so logs written by any
+firmware version expand with the formats that firmware used.
+
+Usage: expand_logs.py Bikesense_Logs.bin [--level LEVEL] [-o output.txt]
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+MAGIC = b"BSL1"
+VERSIONS = (1,)
+LEVELS = ("DEBUG", "INFO", "ERROR")
+
+MAX_ARGS = 4
+ENTRY_FORMAT = f"<IHBB{MAX_ARGS}I"
+SPECIFIER = re.compile(r"%([dus%])")
+
+
+def read_header(data):
+    if data[:4] != MAGIC:
+        raise ValueError("not a BikeSense binary log file")
+
+    version, entry_size, message_count = struct.unpack_from("<BBH", data, 4)
+    if version not in VERSIONS:
+        raise ValueError(f"unsupported log version {version}")
+
+    offset = 8
+    formats = []
+    for _ in range(message_count):
+        length = data[offset]
+        formats.append(data[offset + 1 : offset + 1 + length].decode())
+        offset += 1 + length
+
+    return formats, entry_size, offset
+
+
+def expand_entry(data, offset, formats, entry_size):
+    time_ms, message, level, arg_count, *args = struct.unpack_from(
+        ENTRY_FORMAT, data, offset
+    )
+    text_offset = offset + struct.calcsize(ENTRY_FORMAT)
+    text = data[text_offset : offset + entry_size].split(b"\0")[0]
+    text = text.decode(errors="replace")
+    args = iter(args[:arg_count])
+
+    def substitute(match):
+        spec = match.group(1)
+        if spec == "%":
+            return "%"
+        if spec == "s":
+            return text
+        value = next(args, 0)
+        if spec == "d" and value >= 1 << 31:
+            value -= 1 << 32
+        return str(value)
+
+    if message < len(formats):
+        line = SPECIFIER.sub(substitute, formats[message])
+    else:
+        line = f"Unknown message {message}"
+
+    level_name = LEVELS[level] if level < len(LEVELS) else "?"
+    return level, f"[{time_ms}] [{level_name}] {line}"
+
+
+def expand_file(data, min_level=0):
+    formats, entry_size, offset = read_header(data)
+
+    lines = []
+    while offset + entry_size <= len(data):
+        level, line = expand_entry(data, offset, formats, entry_size)
+        if level >= min_level:
+            lines.append(line)
+        offset += entry_size
+
+    if offset != len(data):
+        print(
+            f"warning: ignoring {len(data) - offset} trailing bytes",
+            file=sys.stderr,
+        )
+
+    return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("file", help="binary log file read from the SD card")
+    parser.add_argument(
+        "--level",
+        choices=[level.lower() for level in LEVELS],
+        default="debug",
+        help="only show entries at this level and above",
+    )
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as f:
+        lines = expand_file(f.read(), LEVELS.index(args.level.upper()))
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    for line in lines:
+        out.write(line + "\n")
+
+
+if __name__ == "__main__":
+    main()
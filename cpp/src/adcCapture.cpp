@@ -0,0 +1,99 @@
+#include "adcCapture.h"
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <hardware/adc.h>
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#endif
+
+AdcCapture *AdcCapture::instance_ = nullptr;
+
+AdcCapture::AdcCapture(int pin, uint32_t sampleRateHz)
+    : PIN(pin), SAMPLE_RATE_HZ(sampleRateHz) {}
+
+#ifdef ARDUINO_ARCH_RP2040
+
+void AdcCapture::onDmaComplete() {
+  AdcCapture *capture = instance_;
+  if (capture == nullptr) {
+    return;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    const int channel = capture->channels_[i];
+    if (!dma_channel_get_irq0_status(channel)) {
+      continue;
+    }
+    dma_channel_acknowledge_irq0(channel);
+    // Rearm for when the other channel chains back to this one
+    dma_channel_set_write_addr(channel, capture->buffers_[i], false);
+    capture->blocksCaptured_++;
+  }
+}
+
+bool AdcCapture::begin() {
+  // There is only one ADC
+  if (instance_ != nullptr) {
+    return false;
+  }
+
+  adc_init();
+  adc_gpio_init(PIN);
+  adc_select_input(PIN - 26);
+  // Every conversion goes to the FIFO and raises a DMA request
+  adc_fifo_setup(true, true, 1, false, false);
+  adc_set_clkdiv((float)clock_get_hz(clk_adc) / SAMPLE_RATE_HZ - 1);
+
+  for (int i = 0; i < 2; i++) {
+    channels_[i] = dma_claim_unused_channel(false);
+    if (channels_[i] < 0) {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < 2; i++) {
+    dma_channel_config config = dma_channel_get_default_config(channels_[i]);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, DREQ_ADC);
+    channel_config_set_chain_to(&config, channels_[1 - i]);
+    dma_channel_configure(channels_[i], &config, buffers_[i], &adc_hw->fifo,
+                          BLOCK_SIZE, false);
+    dma_channel_set_irq0_enabled(channels_[i], true);
+  }
+
+  instance_ = this;
+  irq_add_shared_handler(DMA_IRQ_0, onDmaComplete,
+                         PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_0, true);
+
+  adc_fifo_drain();
+  dma_channel_start(channels_[0]);
+  adc_run(true);
+  return true;
+}
+
+#else
+
+void AdcCapture::onDmaComplete() {}
+
+bool AdcCapture::begin() { return false; }
+
+#endif
+
+const uint16_t *AdcCapture::nextBlock() {
+  const uint32_t captured = blocksCaptured_;
+  if (captured == blocksRead_) {
+    return nullptr;
+  }
+
+  // The buffer after the newest one is being written again already
+  if (captured - blocksRead_ > 1) {
+    overruns_ += captured - blocksRead_ - 1;
+    blocksRead_ = captured - 1;
+  }
+
+  return buffers_[blocksRead_++ % 2];
+}
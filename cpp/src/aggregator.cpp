@@ -0,0 +1,93 @@
+#include "aggregator.h"
+
+#include <cmath>
+
+void WindowedAggregator::setWindow(MeasurementId id, uint32_t windowMs) {
+  windows_[id] = Window();
+  windows_[id].windowMs = windowMs;
+  if (windowMs > 0) {
+    aggregated_ |= 1UL << id;
+  } else {
+    aggregated_ &= ~(1UL << id);
+  }
+}
+
+void WindowedAggregator::add(const SensorReading &reading, uint32_t nowMs) {
+  uint32_t remaining = reading.presence() & aggregated_;
+  for (int id = 0; remaining != 0; id++, remaining >>= 1) {
+    if (!(remaining & 1)) {
+      continue;
+    }
+
+    const double value = reading.value((MeasurementId)id);
+    if (std::isnan(value)) {
+      continue;
+    }
+
+    Window &window = windows_[id];
+    if (window.count == 0) {
+      window.startMs = nowMs;
+      window.min = value;
+      window.max = value;
+    }
+    window.count++;
+    const double delta = value - window.mean;
+    window.mean += delta / window.count;
+    window.m2 += delta * (value - window.mean);
+    window.min = std::fmin(window.min, value);
+    window.max = std::fmax(window.max, value);
+  }
+}
+
+SensorReading WindowedAggregator::rawOnly(const SensorReading &reading) const {
+  if ((reading.presence() & aggregated_) == 0) {
+    return reading;
+  }
+
+  SensorReading raw;
+  uint32_t remaining = reading.presence() & ~aggregated_;
+  for (int id = 0; remaining != 0; id++, remaining >>= 1) {
+    if (remaining & 1) {
+      raw.addMeasurement((MeasurementId)id, reading.value((MeasurementId)id));
+      raw.setAge((MeasurementId)id, reading.age((MeasurementId)id));
+    }
+  }
+  return raw;
+}
+
+void WindowedAggregator::emit(MeasurementId id, uint32_t nowMs,
+                              SensorReading &aggregate) {
+  Window &window = windows_[id];
+  // Population standard deviation, a single sample has none
+  const double stddev = std::sqrt(window.m2 / window.count);
+
+  aggregate = SensorReading()
+                  .addMeasurement(id, window.mean)
+                  .addMeasurement(AGGREGATE_COUNT, window.count)
+                  .addMeasurement(AGGREGATE_MIN, window.min)
+                  .addMeasurement(AGGREGATE_MAX, window.max)
+                  .addMeasurement(AGGREGATE_STDDEV, stddev)
+                  .addMeasurement(AGGREGATE_WINDOW,
+                                  (nowMs - window.startMs) / 1000.0);
+
+  const uint32_t windowMs = window.windowMs;
+  window = Window();
+  window.windowMs = windowMs;
+}
+
+bool WindowedAggregator::takeClosed(uint32_t nowMs, SensorReading &aggregate,
+                                    bool flush) {
+  uint32_t remaining = aggregated_;
+  for (int id = 0; remaining != 0; id++, remaining >>= 1) {
+    const Window &window = windows_[id];
+    if (!(remaining & 1) || window.count == 0) {
+      continue;
+    }
+
+    if (flush || nowMs - window.startMs >= window.windowMs) {
+      emit((MeasurementId)id, nowMs, aggregate);
+      return true;
+    }
+  }
+  return false;
+}
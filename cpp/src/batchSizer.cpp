@@ -0,0 +1,33 @@
+#include "batchSizer.h"
+
+BatchSizer::BatchSizer(int initialSize, int maxSize, uint32_t targetLatencyMs)
+    : STEP(initialSize > 0 ? initialSize : 1), MAX_SIZE(maxSize),
+      TARGET_LATENCY_MS(targetLatencyMs) {
+  setSize(initialSize);
+}
+
+void BatchSizer::setSize(int size) {
+  size_ = size < 1 ? 1 : size > MAX_SIZE ? MAX_SIZE : size;
+}
+
+void BatchSizer::onSuccess(int records, size_t bytes, uint32_t latencyMs) {
+  const uint32_t bytesPerSecond =
+      (uint64_t)bytes * 1000 / (latencyMs > 0 ? latencyMs : 1);
+  const bool slower = averageBytesPerSecond_ > 0 &&
+                      bytesPerSecond < averageBytesPerSecond_ / 2;
+
+  if (averageBytesPerSecond_ == 0) {
+    averageBytesPerSecond_ = bytesPerSecond;
+  } else {
+    averageBytesPerSecond_ = (3 * averageBytesPerSecond_ + bytesPerSecond) / 4;
+  }
+
+  if (latencyMs > TARGET_LATENCY_MS || slower) {
+    setSize(size_ - size_ / 4);
+  } else if (records >= size_) {
+    // Only grow past sizes that were actually tried
+    setSize(size_ + STEP);
+  }
+}
+
+void BatchSizer::onFailure() { setSize(size_ / 2); }
@@ -0,0 +1,740 @@
+// Host benchmarks for env:native, run with
+//   pio run -e native && .pio/build/native/program [options]
+//
+// Every stage runs the firmware's own code against the stand-ins in
+// lib/HostHal and reports host CPU time per operation, which is what
+// regresses when the code gets slower. Card and network activity are
+// reported as counts and bytes, time on the wire as virtual milliseconds.
+// Results go to a JSON file so runs can be compared between releases.
+// Codec round trips and the connections of each upload are checked on the
+// way, a failure fails the run.
+//
+// pio test -e native builds src with the tests in test/, which bring their
+// own main.
+
+#ifndef PIO_UNIT_TESTING
+
+#include <bikesense.h>
+#include <columnarFormat.h>
+#include <dataRecord.h>
+#include <gps.h>
+#include <mock.h>
+#include <recordFormat.h>
+#include <sdCard.h>
+#include <trajectory.h>
+
+#include <ArduinoJson.h>
+#include <SD.h>
+#include <WiFi.h>
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+
+typedef std::chrono::steady_clock WallClock;
+
+static const uint64_t RIDE_START_MS = 1714550400000ULL; // 2024-05-01 08:00Z
+
+struct BenchOptions {
+  int records = 20000;
+  int trips = 2;
+  int tripMinutes = 10;
+  int dockMinutes = 2;
+  std::string output = "benchmark_results.json";
+  std::filesystem::path workDir =
+      std::filesystem::temp_directory_path() / "bikesense-bench";
+  bool verbose = false;
+  std::string track; // binary data file to replay, a synthetic ride if empty
+};
+
+class NullLed : public LedInterface {
+public:
+  void setup() override {}
+  void setColor(byte r, byte g, byte b) override {}
+};
+
+static double elapsedNs(WallClock::time_point start) {
+  return std::chrono::duration<double, std::nano>(WallClock::now() - start)
+      .count();
+}
+
+// Keeps results alive so the compiler can't drop the measured work
+static volatile size_t sink;
+
+// A full record as the device takes it, moving a little every second
+static DataRecord sampleRecord(int i) {
+  DataRecord record;
+  record.timestampMs = RIDE_START_MS + i * 1000ULL;
+  record.gpsData.addMeasurement(LATITUDE, 41.1780 + i * 1e-5)
+      .addMeasurement(LONGITUDE, -8.5980 + i * 2e-5)
+      .addMeasurement(ALTITUDE, 120.5 + (i % 40) * 0.25)
+      .addMeasurement(SPEED, 18.2 + (i % 10) * 0.1)
+      .addMeasurement(COURSE, 87.5)
+      .addMeasurement(SATELLITES_IN_USE, 9)
+      .addMeasurement(HDOP, 0.9);
+  record.sensorData.addMeasurement(CARBON_MONOXIDE_LEVEL, 6)
+      .addMeasurement(POLUTION_PARTICLES_PPM, 7)
+      .addMeasurement(NOISE_LEVEL, 61.7 + (i % 7))
+      .addMeasurement(LUMINOSITY, 512 + i % 100)
+      .addMeasurement(UV_LEVEL, 3.25)
+      .addMeasurement(TEMPERATURE, 21.4)
+      .addMeasurement(HUMIDITY, 63.0);
+  return record;
+}
+
+static void freshCard(const BenchOptions &options, const char *name) {
+  const std::filesystem::path root = options.workDir / name;
+  std::filesystem::remove_all(root);
+  std::filesystem::create_directories(root);
+  SD.setRoot(root.string());
+  SD.resetStats();
+}
+
+static JsonObject addResult(JsonArray results, const char *name,
+                            size_t operations, double totalNs) {
+  JsonObject result = results.add<JsonObject>();
+  result["name"] = name;
+  result["operations"] = operations;
+  result["ns_per_op"] = operations > 0 ? totalNs / operations : 0;
+  return result;
+}
+
+static void benchSerialization(const BenchOptions &options,
+                               JsonArray results) {
+  const DataRecord record = sampleRecord(1);
+
+  char json[maxSerializedRecordSize()];
+  size_t bytes = 0;
+  WallClock::time_point start = WallClock::now();
+  for (int i = 0; i < options.records; i++) {
+    bytes += serializeRecord(record, json, sizeof(json));
+  }
+  JsonObject result =
+      addResult(results, "serialize_json", options.records, elapsedNs(start));
+  result["bytes_per_op"] = bytes / options.records;
+
+  EncodedRecord encoded;
+  start = WallClock::now();
+  for (int i = 0; i < options.records; i++) {
+    BinaryRecordFormat::encode(record, encoded.bytes);
+    sink = encoded.bytes[i % sizeof(encoded.bytes)];
+  }
+  result =
+      addResult(results, "encode_binary", options.records, elapsedNs(start));
+  result["bytes_per_op"] = sizeof(encoded.bytes);
+
+  start = WallClock::now();
+  for (int i = 0; i < options.records; i++) {
+    sink = BinaryRecordFormat::decode(encoded.bytes).timestampMs;
+  }
+  addResult(results, "decode_binary", options.records, elapsedNs(start));
+}
+
+static void addCardStats(JsonObject result, size_t records) {
+  const SdStats &stats = SD.stats();
+  result["card_writes"] = stats.writes;
+  result["card_reads"] = stats.reads;
+  result["card_flushes"] = stats.flushes;
+  result["card_bytes_written_per_record"] =
+      records > 0 ? (double)stats.bytesWritten / records : 0;
+  result["card_bytes_read_per_record"] =
+      records > 0 ? (double)stats.bytesRead / records : 0;
+}
+
+// Writes the records the way drainSamples does, then reads them back the
+// way an upload does
+static void benchStorage(const BenchOptions &options, JsonArray results,
+                         StorageFormat format, const char *writeName,
+                         const char *readName) {
+  const size_t BATCH = 8;
+  freshCard(options, writeName);
+  SDCard card(format);
+  if (!card.setup()) {
+    fprintf(stderr, "%s: card setup failed\n", writeName);
+    return;
+  }
+
+  std::vector<EncodedRecord> encoded(BATCH);
+  SD.resetStats();
+  double totalNs = 0;
+  for (int i = 0; i < options.records; i += BATCH) {
+    const size_t count = std::min<size_t>(BATCH, options.records - i);
+    for (size_t j = 0; j < count; j++) {
+      BinaryRecordFormat::encode(sampleRecord(i + j), encoded[j].bytes);
+    }
+    WallClock::time_point start = WallClock::now();
+    card.storeEncoded(encoded.data(), count);
+    totalNs += elapsedNs(start);
+  }
+  WallClock::time_point start = WallClock::now();
+  card.seal();
+  totalNs += elapsedNs(start);
+  addCardStats(addResult(results, writeName, options.records, totalNs),
+               options.records);
+
+  SD.resetStats();
+  start = WallClock::now();
+  size_t records = 0;
+  size_t bytes = 0;
+  RecordBatch batch;
+  if (card.openCursor()) {
+    while (card.nextBatch(50, batch)) {
+      for (const auto &record : batch) {
+        bytes += record.size();
+      }
+      records += batch.size();
+    }
+    card.closeCursor();
+  }
+  JsonObject result = addResult(results, readName, records, elapsedNs(start));
+  result["json_bytes_per_record"] = records > 0 ? bytes / records : 0;
+  addCardStats(result, records);
+  if (records != (size_t)options.records) {
+    fprintf(stderr, "%s: read %zu of %d records\n", readName, records,
+            options.records);
+  }
+}
+
+static void appendNmea(std::string &out, const char *body) {
+  uint8_t checksum = 0;
+  for (const char *c = body; *c != '\0'; c++) {
+    checksum ^= *c;
+  }
+  char sentence[128];
+  snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum);
+  out += sentence;
+}
+
+// GGA and RMC for the fix at the given second of the ride, heading east
+static std::string nmeaFix(uint32_t second) {
+  const double latitude = 41.1780 + second * 2e-6;
+  const double longitude = 8.5980 - second * 5e-5; // west
+  const uint32_t timeOfDay = (RIDE_START_MS / 1000 + second) % 86400;
+  const int hh = timeOfDay / 3600;
+  const int mm = timeOfDay / 60 % 60;
+  const int ss = timeOfDay % 60;
+
+  char lat[16];
+  char lng[16];
+  snprintf(lat, sizeof(lat), "%02d%07.4f", (int)latitude,
+           (latitude - (int)latitude) * 60);
+  snprintf(lng, sizeof(lng), "%03d%07.4f", (int)longitude,
+           (longitude - (int)longitude) * 60);
+
+  char body[112];
+  std::string out;
+  snprintf(body, sizeof(body),
+           "GPGGA,%02d%02d%02d.00,%s,N,%s,W,1,09,0.9,%.1f,M,50.1,M,,", hh,
+           mm, ss, lat, lng, 120.5 + (second % 40) * 0.25);
+  appendNmea(out, body);
+  snprintf(body, sizeof(body),
+           "GPRMC,%02d%02d%02d.00,A,%s,N,%s,W,9.8,87.5,010524,,,A", hh, mm,
+           ss, lat, lng);
+  appendNmea(out, body);
+  return out;
+}
+
+// A ride through town at 1 Hz: straight stretches, turns, a long bend and
+// two waits at traffic lights, with a metre or so of GPS noise
+static std::vector<DataRecord> syntheticTrack() {
+  struct Leg {
+    int seconds;
+    double speedMs;
+    double turnDegreesPerS;
+  };
+  const Leg LEGS[] = {
+      {240, 5.5, 0},    // straight
+      {45, 0, 0},       // traffic light
+      {8, 4, 11.25},    // right turn
+      {300, 6, 0},      // straight
+      {120, 5, 0.75},   // bend
+      {60, 0, 0},       // traffic light
+      {8, 4, -11.25},   // left turn
+      {300, 6.5, 0},    // straight
+      {180, 5.5, -0.5}, // bend
+  };
+  const double METRES_PER_DEGREE = 6371000.0 * M_PI / 180.0;
+
+  std::vector<DataRecord> track;
+  double x = 0;
+  double y = 0;
+  double heading = 90;
+  uint32_t seed = 12345;
+  auto noise = [&seed]() {
+    seed = seed * 1103515245 + 12345;
+    return ((seed >> 16) % 2001) / 1000.0 - 1.0;
+  };
+
+  for (const Leg &leg : LEGS) {
+    for (int s = 0; s < leg.seconds; s++) {
+      heading += leg.turnDegreesPerS;
+      x += leg.speedMs * std::sin(heading * M_PI / 180.0);
+      y += leg.speedMs * std::cos(heading * M_PI / 180.0);
+
+      const double latitude = 41.1780 + (y + noise()) / METRES_PER_DEGREE;
+      const double longitude =
+          -8.5980 + (x + noise()) /
+                        (METRES_PER_DEGREE * std::cos(41.178 * M_PI / 180));
+      DataRecord fix;
+      fix.timestampMs = RIDE_START_MS + track.size() * 1000ULL;
+      fix.gpsData.addMeasurement(LATITUDE, latitude)
+          .addMeasurement(LONGITUDE, longitude)
+          .addMeasurement(SPEED, leg.speedMs * 3.6);
+      fix.sensorData.addMeasurement(NOISE_LEVEL, 60 + 5 * noise())
+          .addMeasurement(CARBON_MONOXIDE_LEVEL, 6);
+      track.push_back(fix);
+    }
+  }
+  return track;
+}
+
+// Reads the fixes of a binary data file written by this firmware
+static bool loadTrack(const std::string &path, std::vector<DataRecord> &track) {
+  FILE *in = fopen(path.c_str(), "rb");
+  if (in == nullptr) {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    data.insert(data.end(), buffer, buffer + length);
+  }
+  fclose(in);
+
+  const std::vector<uint8_t> &header = BinaryRecordFormat::header();
+  if (data.size() < header.size() ||
+      !std::equal(header.begin(), header.end(), data.begin())) {
+    return false;
+  }
+  for (size_t offset = header.size();
+       offset + BinaryRecordFormat::recordSize() <= data.size();
+       offset += BinaryRecordFormat::recordSize()) {
+    DataRecord record = BinaryRecordFormat::decode(&data[offset]);
+    if (record.gpsData.has(LATITUDE) && record.gpsData.has(LONGITUDE)) {
+      track.push_back(record);
+    }
+  }
+  return true;
+}
+
+// Simplifies the track at a few tolerances and measures the largest
+// distance from a dropped fix to the path through the kept ones
+static void benchTrajectory(const BenchOptions &options, JsonArray results) {
+  std::vector<DataRecord> track;
+  if (options.track.empty()) {
+    track = syntheticTrack();
+  } else if (!loadTrack(options.track, track)) {
+    fprintf(stderr, "can't read track %s\n", options.track.c_str());
+    return;
+  }
+  if (track.empty()) {
+    return;
+  }
+
+  const float TOLERANCES_M[] = {2, 5, 10, 20};
+  for (float toleranceM : TOLERANCES_M) {
+    TrajectorySimplifier simplifier(toleranceM);
+    std::vector<DataRecord> kept;
+    DataRecord record;
+    WallClock::time_point start = WallClock::now();
+    for (const DataRecord &fix : track) {
+      if (simplifier.add(fix, record)) {
+        kept.push_back(record);
+      }
+    }
+    if (simplifier.flush(record)) {
+      kept.push_back(record);
+    }
+    const double ns = elapsedNs(start);
+
+    double maxErrorM = 0;
+    size_t segment = 0;
+    for (const DataRecord &fix : track) {
+      while (segment + 2 < kept.size() &&
+             kept[segment + 1].timestampMs <= fix.timestampMs) {
+        segment++;
+      }
+      const SensorReading &a = kept[segment].gpsData;
+      const SensorReading &b =
+          kept[std::min(segment + 1, kept.size() - 1)].gpsData;
+      maxErrorM = std::max<double>(
+          maxErrorM,
+          distanceToSegmentM(fix.gpsData.value(LATITUDE),
+                             fix.gpsData.value(LONGITUDE), a.value(LATITUDE),
+                             a.value(LONGITUDE), b.value(LATITUDE),
+                             b.value(LONGITUDE)));
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "trajectory_%gm", toleranceM);
+    JsonObject result = addResult(results, name, track.size(), ns);
+    result["tolerance_m"] = toleranceM;
+    result["fixes_kept"] = kept.size();
+    result["compression_ratio"] = (double)track.size() / kept.size();
+    result["max_error_m"] = maxErrorM;
+  }
+}
+
+// A record with random fields present, each either drifting slowly from
+// the previous record or jumping anywhere in its range
+static DataRecord randomRecord(uint32_t &seed, const DataRecord &previous) {
+  auto next = [&seed]() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  };
+
+  DataRecord record;
+  switch (next() % 8) {
+  case 0: // clock set, any time
+    record.timestampMs = next() * 1000ULL;
+    break;
+  case 1:
+    record.timestampMs = previous.timestampMs - next() % 5000;
+    break;
+  case 2: // late fix
+    record.timestampMs = previous.timestampMs + 1000 + next() % 300;
+    break;
+  default:
+    record.timestampMs = previous.timestampMs + 1000;
+    break;
+  }
+
+  for (const auto &info : MEASUREMENTS) {
+    if (next() % 5 == 0) {
+      continue;
+    }
+    const double unit = std::pow(10.0, info.scale);
+    const SensorReading &before =
+        info.group == GROUP_GPS ? previous.gpsData : previous.sensorData;
+    double value;
+    if (before.has(info.id) && next() % 4 != 0) {
+      value = before.value(info.id) + ((int)(next() % 21) - 10) * unit;
+    } else if (info.type == FIELD_F32) {
+      uint32_t bits = next();
+      float f;
+      memcpy(&f, &bits, sizeof(f));
+      value = std::isnan(f) ? 0 : f;
+    } else if (info.type == FIELD_I32) {
+      value = (int32_t)next() * unit;
+    } else {
+      value = next() % (info.type == FIELD_U8 ? 256 : 65536) * unit;
+    }
+
+    SensorReading &target =
+        info.group == GROUP_GPS ? record.gpsData : record.sensorData;
+    target.addMeasurement(info.id, value);
+    target.setAge(info.id, next() % 4 == 0 ? next() % 30000 : 0);
+  }
+  return record;
+}
+
+// Encodes rows into columnar blocks, the way SDCard stores them
+static std::vector<uint8_t>
+encodeColumnar(const std::vector<EncodedRecord> &rows) {
+  std::vector<uint8_t> blocks;
+  ColumnarEncoder encoder;
+  for (const EncodedRecord &row : rows) {
+    if (encoder.add(row.bytes)) {
+      encoder.finishBlock(blocks);
+    }
+  }
+  encoder.finishBlock(blocks);
+  return blocks;
+}
+
+// Decodes the complete blocks, false if one of them is malformed
+static bool decodeColumnar(const std::vector<uint8_t> &blocks,
+                           std::vector<EncodedRecord> &rows) {
+  size_t offset = 0;
+  size_t samples;
+  size_t payloadSize;
+  while (offset + ColumnarRecordFormat::BLOCK_HEADER_SIZE <= blocks.size()) {
+    const uint8_t *block = &blocks[offset];
+    offset += ColumnarRecordFormat::BLOCK_HEADER_SIZE;
+    if (!ColumnarRecordFormat::blockInfo(block, samples, payloadSize)) {
+      return false;
+    }
+    if (offset + payloadSize > blocks.size()) {
+      break; // cut off
+    }
+    if (!ColumnarRecordFormat::decodeBlock(&blocks[offset], payloadSize,
+                                           samples, rows)) {
+      return false;
+    }
+    offset += payloadSize;
+  }
+  return true;
+}
+
+// Times the columnar codec on random trips, then measures the size of a
+// realistic trip in both formats. Correctness is up to test_columnar.
+static void benchColumnar(const BenchOptions &options, JsonArray results) {
+  const int TRIPS = 200;
+  uint32_t seed = 2463534242;
+  size_t records = 0;
+  double encodeNs = 0;
+  double decodeNs = 0;
+
+  for (int trip = 0; trip < TRIPS; trip++) {
+    std::vector<EncodedRecord> rows(1 + seed % 300);
+    DataRecord record = sampleRecord(trip);
+    for (EncodedRecord &row : rows) {
+      record = randomRecord(seed, record);
+      BinaryRecordFormat::encode(record, row.bytes);
+    }
+    records += rows.size();
+
+    WallClock::time_point start = WallClock::now();
+    const std::vector<uint8_t> blocks = encodeColumnar(rows);
+    encodeNs += elapsedNs(start);
+
+    std::vector<EncodedRecord> decoded;
+    start = WallClock::now();
+    decodeColumnar(blocks, decoded);
+    decodeNs += elapsedNs(start);
+    sink = decoded.size();
+  }
+
+  addResult(results, "columnar_encode", records, encodeNs);
+  addResult(results, "columnar_decode", records, decodeNs);
+
+  std::vector<DataRecord> track;
+  if (options.track.empty() || !loadTrack(options.track, track)) {
+    track = syntheticTrack();
+  }
+  std::vector<EncodedRecord> rows(track.size());
+  for (size_t i = 0; i < track.size(); i++) {
+    BinaryRecordFormat::encode(track[i], rows[i].bytes);
+  }
+  const std::vector<uint8_t> blocks = encodeColumnar(rows);
+  JsonObject result = addResult(results, "columnar_trip", rows.size(), 0);
+  result["row_bytes_per_record"] = BinaryRecordFormat::recordSize();
+  result["columnar_bytes_per_record"] = (double)blocks.size() / rows.size();
+  result["compression_ratio"] =
+      (double)rows.size() * BinaryRecordFormat::recordSize() / blocks.size();
+}
+
+// Loop iterations driven by benchRide
+struct StepTotals {
+  double ns = 0;
+  size_t steps = 0;
+  size_t fixes = 0;            // GPS fixes sent, one record each
+  unsigned long elapsedMs = 0; // virtual time
+  unsigned long idleMs = 0;    // virtual time asleep until the next deadline
+};
+
+struct RideConfig {
+  const char *name;
+  UploadMode mode;
+  bool compress;
+  uint32_t aggregateWindowMs; // 0 stores the mock sensor raw
+  float trajectoryToleranceM;  // 0 keeps every fix
+  StorageFormat format;
+};
+
+// Rides with WiFi out of range, then docks until the trips are uploaded.
+// Single core, the upload blocks the loop like it does on the device.
+// False if a dock took more than the one keep-alive connection.
+static bool benchRide(const BenchOptions &options, JsonArray results,
+                      const RideConfig &config) {
+  freshCard(options, config.name);
+  loopbackServer.reset();
+  WiFi.setInRange(false);
+
+  BikeSenseBuilder builder;
+  builder.addSensor(new MockSensor())
+      .addGps(new Gps())
+      .addDataStorage(new SDCard(config.format))
+      .addLed(new NullLed())
+      .whoAmI("BSB1", "HOST")
+      .withApiConfig("HostToken", "http://localhost:8080/api/v1")
+      .withUploadMode(config.mode)
+      .withCompression(config.compress)
+      .addNetwork("bikenet", "Bike123!")
+      .withTrajectoryTolerance(config.trajectoryToleranceM);
+  if (config.aggregateWindowMs > 0) {
+    builder.withAggregation(CARBON_MONOXIDE_LEVEL, config.aggregateWindowMs)
+        .withAggregation(POLUTION_PARTICLES_PPM, config.aggregateWindowMs);
+  }
+  std::unique_ptr<BikeSense> device(new BikeSense(builder.build()));
+  device->setup();
+
+  // The receiver sends a fix every second, arriving like UART RX would:
+  // as an interrupt that wakes the loop
+  const unsigned long startMs = millis();
+  StepTotals *fixTotals = nullptr;
+  std::function<void()> sendFix = [&]() {
+    const std::string fix = nmeaFix((millis() - startMs) / 1000);
+    Serial1.inject(fix.data(), fix.size());
+    fixTotals->fixes++;
+    scheduleInterrupt(micros() + 1000000, sendFix);
+  };
+  scheduleInterrupt(micros(), sendFix);
+
+  auto stepUntil = [&](unsigned long endMs, StepTotals &totals) {
+    fixTotals = &totals;
+    const unsigned long stepsStartMs = millis();
+    const uint64_t idleStartUs = idleMicros();
+    while (millis() < endMs) {
+      WallClock::time_point start = WallClock::now();
+      device->step();
+      totals.ns += elapsedNs(start);
+      totals.steps++;
+    }
+    totals.elapsedMs += millis() - stepsStartMs;
+    totals.idleMs += (idleMicros() - idleStartUs) / 1000;
+  };
+
+  StepTotals ride;
+  StepTotals dock;
+  SdStats rideCard;
+  for (int trip = 0; trip < options.trips; trip++) {
+    WiFi.setInRange(false);
+    SD.resetStats();
+    stepUntil(millis() + options.tripMinutes * 60000UL, ride);
+    rideCard.writes += SD.stats().writes;
+    rideCard.bytesWritten += SD.stats().bytesWritten;
+    rideCard.flushes += SD.stats().flushes;
+
+    WiFi.setInRange(true);
+    stepUntil(millis() + options.dockMinutes * 60000UL, dock);
+  }
+  WiFi.setInRange(false);
+  clearInterrupts();
+
+  const LoopbackStats &server = loopbackServer.stats;
+  const size_t samples = ride.fixes;
+  JsonObject result = addResult(results, config.name, samples, ride.ns);
+  result["ns_per_step"] = ride.steps > 0 ? ride.ns / ride.steps : 0;
+  // Loop iterations per second of riding, what the tickless loop keeps low
+  result["wakeups_per_second"] =
+      ride.elapsedMs > 0 ? ride.steps * 1000.0 / ride.elapsedMs : 0;
+  // Host CPU time over ride time, only comparable between runs
+  result["host_active_percent"] =
+      ride.elapsedMs > 0 ? ride.ns / (ride.elapsedMs * 1e4) : 0;
+  result["card_writes"] = rideCard.writes;
+  result["card_flushes"] = rideCard.flushes;
+  result["card_bytes_written_per_record"] =
+      samples > 0 ? (double)rideCard.bytesWritten / samples : 0;
+  result["upload_ns_per_record"] = samples > 0 ? dock.ns / samples : 0;
+  // Time the loop was blocked on the network rather than asleep
+  result["upload_virtual_ms"] = dock.elapsedMs - dock.idleMs;
+  result["upload_requests"] = server.requests;
+  result["upload_connects"] = server.connects;
+  result["upload_wire_bytes_per_record"] =
+      samples > 0 ? (double)server.bytesReceived / samples : 0;
+  result["upload_body_bytes_per_record"] =
+      samples > 0 ? (double)server.bodyBytes / samples : 0;
+  if (!config.compress) {
+    // Only uncompressed bodies can be counted by the server
+    result["records_uploaded"] = server.records;
+  }
+
+  // Leaving WiFi range drops the connection, every dock opens a new one
+  if (server.connects != (uint32_t)options.trips) {
+    fprintf(stderr, "%s: %u connections for %d docks\n", config.name,
+            server.connects, options.trips);
+    return false;
+  }
+  return true;
+}
+
+static bool parseOptions(int argc, char **argv, BenchOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "--records" && hasValue) {
+      options.records = atoi(argv[++i]);
+    } else if (arg == "--trips" && hasValue) {
+      options.trips = atoi(argv[++i]);
+    } else if (arg == "--trip-minutes" && hasValue) {
+      options.tripMinutes = atoi(argv[++i]);
+    } else if (arg == "--dock-minutes" && hasValue) {
+      options.dockMinutes = atoi(argv[++i]);
+    } else if ((arg == "-o" || arg == "--output") && hasValue) {
+      options.output = argv[++i];
+    } else if (arg == "--workdir" && hasValue) {
+      options.workDir = argv[++i];
+    } else if (arg == "--track" && hasValue) {
+      options.track = argv[++i];
+    } else if (arg == "--verbose") {
+      options.verbose = true;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--records N] [--trips N] [--trip-minutes N] "
+              "[--dock-minutes N] [-o results.json] [--workdir DIR] "
+              "[--track Bikesense.bin] [--verbose]\n",
+              argv[0]);
+      return false;
+    }
+  }
+  return options.records > 0 && options.trips > 0;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 2;
+  }
+  // Device logs and serial output only slow the measurements down
+  if (!options.verbose) {
+    Serial.setOutput(nullptr);
+  }
+
+  JsonDocument doc;
+  doc["format"] = 1;
+  doc["records"] = options.records;
+  doc["record_size"] = BinaryRecordFormat::recordSize();
+  JsonArray results = doc["benchmarks"].to<JsonArray>();
+
+  benchSerialization(options, results);
+  benchStorage(options, results, BINARY_RECORDS, "store_binary",
+               "read_binary");
+  benchStorage(options, results, JSON_LINES, "store_json", "read_json");
+  benchStorage(options, results, COLUMNAR_BLOCKS, "store_columnar",
+               "read_columnar");
+  benchTrajectory(options, results);
+  benchColumnar(options, results);
+
+  const RideConfig RIDES[] = {
+      {"ride_batched", BATCHED_UPLOAD, false, 0, 0, BINARY_RECORDS},
+      {"ride_batched_gzip", BATCHED_UPLOAD, true, 0, 0, BINARY_RECORDS},
+      {"ride_streamed", STREAMED_UPLOAD, false, 0, 0, BINARY_RECORDS},
+      {"ride_streamed_gzip", STREAMED_UPLOAD, true, 0, 0, BINARY_RECORDS},
+      {"ride_aggregated", BATCHED_UPLOAD, false, 30000, 0, BINARY_RECORDS},
+      {"ride_simplified", BATCHED_UPLOAD, false, 0, 5, BINARY_RECORDS},
+      {"ride_columnar", BATCHED_UPLOAD, false, 0, 0, COLUMNAR_BLOCKS},
+  };
+  bool ridesOk = true;
+  for (const RideConfig &ride : RIDES) {
+    ridesOk &= benchRide(options, results, ride);
+  }
+
+  std::string json;
+  serializeJsonPretty(doc, json);
+  FILE *out = fopen(options.output.c_str(), "w");
+  if (out == nullptr) {
+    fprintf(stderr, "can't write %s\n", options.output.c_str());
+    return 1;
+  }
+  fwrite(json.data(), 1, json.size(), out);
+  fputc('\n', out);
+  fclose(out);
+
+  for (JsonObject result : results) {
+    printf("%-20s %12.0f ns/op\n", result["name"].as<const char *>(),
+           result["ns_per_op"].as<double>());
+  }
+  printf("results written to %s\n", options.output.c_str());
+
+  std::filesystem::remove_all(options.workDir);
+  return ridesOk ? 0 : 1;
+}
+
+#endif // PIO_UNIT_TESTING
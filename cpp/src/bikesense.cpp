@@ -1,11 +1,23 @@
 #include "bikesense.h"
 #include "elapsedMillis.h"
+#include "gzipCompressor.h"
 #include "interfaces.h"
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <algorithm>
+#include <iterator>
+#include <memory>
 #include <string>
 
+#if BIKESENSE_INSTRUMENTATION
+// Names of the loop latency histograms, in BikeSenseStates order
+static const char *const STATE_NAMES[] = {
+    "loop_idle",      "loop_collecting", "loop_no_gps",
+    "loop_uploading", "loop_error",
+};
+#endif
+
 BikeSenseBuilder::BikeSenseBuilder() {
   sensors_ = std::vector<SensorInterface *>();
   gps_ = nullptr;
@@ -54,9 +66,47 @@ BikeSenseBuilder &BikeSenseBuilder::addNetwork(const std::string &ssid,
   return *this;
 }
 
+BikeSenseBuilder &BikeSenseBuilder::withUploadMode(UploadMode mode) {
+  uploadMode_ = mode;
+  return *this;
+}
+
+BikeSenseBuilder &BikeSenseBuilder::withCompression(bool enabled) {
+  compressUploads_ = enabled;
+  return *this;
+}
+
+BikeSenseBuilder &BikeSenseBuilder::withDualCore(bool enabled) {
+  dualCore_ = enabled;
+  return *this;
+}
+
+BikeSenseBuilder &BikeSenseBuilder::withDropPolicy(DropPolicy policy) {
+  dropPolicy_ = policy;
+  return *this;
+}
+
+BikeSenseBuilder &BikeSenseBuilder::withAggregation(MeasurementId id,
+                                                    uint32_t windowMs) {
+  aggregator_.setWindow(id, windowMs);
+  return *this;
+}
+
+BikeSenseBuilder &BikeSenseBuilder::withTrajectoryTolerance(float toleranceM) {
+  trajectoryToleranceM_ = toleranceM;
+  return *this;
+}
+
 BikeSense BikeSenseBuilder::build() {
   return BikeSense(sensors_, gps_, dataStorage_, led_, networks_, bikeCode_,
-                   unitCode_, apiAuthToken_, apiEndpoint_);
+                   unitCode_, apiAuthToken_, apiEndpoint_,
+                   BikeSense::DEFAULT_WIFI_MODE,
+                   BikeSense::DEFAULT_SENSOR_READ_INTERVAL_MS,
+                   BikeSense::DEFAULT_WIFI_RETRY_INTERVAL_MS,
+                   BikeSense::DEFAULT_HTTP_TIMEOUT_MS,
+                   BikeSense::DEFAULT_UPLOAD_BATCH_SIZE, uploadMode_,
+                   compressUploads_, dualCore_, dropPolicy_, aggregator_,
+                   trajectoryToleranceM_);
 }
 
 BikeSense::BikeSense(std::vector<SensorInterface *> sensors, GpsInterface *gps,
@@ -67,75 +117,151 @@ BikeSense::BikeSense(std::vector<SensorInterface *> sensors, GpsInterface *gps,
                      const std::string &apiEndpoint, const WiFiMode_t wifi_mode,
                      const int sensor_read_interval_ms,
                      const int wifi_retry_interval_ms,
-                     const int http_timeout_ms, const int upload_batch_size)
-    : sensors_(sensors), gps_(gps), dataStorage_(dataStorage), led_(led),
-      SENSOR_READ_INTERVAL_MS(sensor_read_interval_ms),
+                     const int http_timeout_ms, const int upload_batch_size,
+                     const UploadMode upload_mode, const bool compress_uploads,
+                     const bool dual_core, const DropPolicy drop_policy,
+                     const WindowedAggregator &aggregator,
+                     const float trajectory_tolerance_m)
+    : SENSOR_READ_INTERVAL_MS(sensor_read_interval_ms),
       WIFI_RETRY_INTERVAL_MS(wifi_retry_interval_ms),
       HTTP_TIMEOUT_MS(http_timeout_ms), UPLOAD_BATCH_SIZE(upload_batch_size),
-      API_TOKEN(apiAuthToken), API_ENDPOINT(apiEndpoint), BIKE_CODE(bikeCode),
-      UNIT_CODE(unitCode) {
+      UPLOAD_MODE(upload_mode), DUAL_CORE(dual_core),
+      compressUploads_(compress_uploads), API_TOKEN(apiAuthToken),
+      API_ENDPOINT(apiEndpoint), BIKE_CODE(bikeCode), UNIT_CODE(unitCode),
+      sensors_(sensors), scheduler_(sensors), aggregator_(aggregator),
+      simplifier_(trajectory_tolerance_m), gps_(gps),
+      dataStorage_(dataStorage), led_(led), session_(http_timeout_ms),
+      streamRequest_(session_),
+      batchSizer_(upload_batch_size, MAX_UPLOAD_BATCH_SIZE,
+                  TARGET_BATCH_LATENCY_MS),
+      samples_(drop_policy), uploadCommands_(4), uploaderEvents_(8) {
 
   WiFi.mode(wifi_mode);
   for (const auto &[ssid, password] : networks) {
     multi_.addAP(ssid.c_str(), password.c_str());
   }
 
-  http_.setInsecure();
+  // Requests share the session's connection and keep it open afterwards
+  session_.begin(API_ENDPOINT);
+  http_.setReuse(true);
+  http_.setTimeout(http_timeout_ms);
+
+  if (!dataStorage_->keepsEncoded()) {
+    records_.reset(new SpscRing<DataRecord, SAMPLE_QUEUE_SIZE>(drop_policy));
+  }
 }
 
 void BikeSense::setup() {
   gps_->setup();
-  if (!dataStorage_->setup()) {
-    Serial.println("Failed to setup data storage");
-    this->state_ = ERROR;
+  {
+    std::lock_guard<CoreLock> lock(storageLock_);
+    if (!dataStorage_->setup()) {
+      Serial.println("Failed to setup data storage");
+      this->state_ = ERROR;
+    }
+
+    // Start from the batch size that worked last time
+    std::string batchSize;
+    if (dataStorage_->loadState(BATCH_SIZE_STATE, batchSize)) {
+      batchSizer_.setSize(atoi(batchSize.c_str()));
+    }
   }
 
   for (auto sensor : sensors_) {
     sensor->setup();
   }
+  scheduler_.start();
 }
 
-SensorReading BikeSense::readSensors() const {
-  SensorReading readings;
+inline bool BikeSense::checkWifi() { return multi_.run() == WL_CONNECTED; }
 
-  for (auto sensor : sensors_) {
-    readings += (sensor->read());
+void BikeSense::drainLogs() {
+  // Both cores log, only the core holding the storage may write them
+  std::lock_guard<CoreLock> lock(storageLock_);
+  size_t count;
+  do {
+    count = logger().drain(logBuffer_, LOG_DRAIN_BATCH_SIZE);
+    for (size_t i = 0; i < count; i++) {
+      char line[LOG_LINE_SIZE];
+      formatLogEntry(logBuffer_[i], line, sizeof(line));
+      Serial.println(line);
+    }
+    dataStorage_->storeLogs(logBuffer_, count);
+  } while (count == LOG_DRAIN_BATCH_SIZE);
+
+  if (logger().dropped() != reportedLogDrops_) {
+    LOGE(LOG_ENTRIES_DROPPED, logger().dropped() - reportedLogDrops_);
+    reportedLogDrops_ = logger().dropped();
+  }
+}
+
+void BikeSense::sleepUntilDue() {
+  WakeTimer wake(MAX_SLEEP_MS);
+  wake.dueAfter(builtinLedTimer_, LED_BLINK_INTERVAL_MS);
+  if (!drainerStarted_ && queuedSamples() > 0) {
+    wake.dueAfter(drainTimer_, DRAIN_INTERVAL_MS);
+  }
+#if BIKESENSE_INSTRUMENTATION
+  wake.dueAfter(statsTimer_, STATS_INTERVAL_MS);
+#endif
+
+  switch (state_) {
+  case IDLE:
+    wake.dueAfter(wifiRetryTimer_, IDLE_WIFI_CHECK_INTERVAL_MS);
+    break;
+  case COLLECTING_DATA:
+    // New GPS data wakes us with its UART interrupt
+    wake.due(scheduler_.msUntilDue());
+    if (!DUAL_CORE) {
+      wake.dueAfter(wifiRetryTimer_, WIFI_RETRY_INTERVAL_MS);
+    }
+    break;
+  case NO_GPS:
+    break;
+  default:
+    return;
   }
 
-  return readings;
+  TIMING_START(timing, instruments().timing(TIMING_IDLE));
+  wake.sleep();
 }
 
-inline bool BikeSense::checkWifi() { return multi_.run() == WL_CONNECTED; }
+void BikeSense::beginRequest(const std::string &endpoint) {
+  // HTTPClient connects on its own if this fails or the server closes the
+  // connection later, the session's client counts that connection too
+  session_.connect();
+  http_.begin(session_.client(), (API_ENDPOINT + endpoint).c_str());
+}
+
+void BikeSense::logConnectionStats() {
+  const ConnectionStats &stats = session_.stats();
+  LOGI(LOG_CONNECTION_STATS, stats.requests, stats.connects, stats.connectMs);
+}
 
 int BikeSense::registerAndGetID(std::string payload, std::string endpoint) {
-  http_.begin((API_ENDPOINT + endpoint).c_str());
+  beginRequest(endpoint);
   http_.addHeader("Content-Type", "application/json");
   http_.addHeader("Authorization", API_TOKEN.c_str());
 
   const int nRetries = 5;
 
-  dataStorage_->logInfo("Posting " + payload + " to " + endpoint);
+  LOGI(LOG_REGISTERING, endpoint);
 
   int httpCode;
   for (int rt = 0; rt < nRetries; rt++) {
     httpCode = http_.POST(payload.c_str());
-    std::string msg = "Post code: " + std::to_string(httpCode) + " (attempt " +
-                      std::to_string(rt) + ")";
-    dataStorage_->logInfo(msg);
+    LOGD(LOG_POST_CODE, httpCode, rt);
     if (httpCode == HTTP_CODE_CREATED || httpCode == HTTP_CODE_OK)
       break;
   }
 
   if (httpCode != HTTP_CODE_OK && httpCode != HTTP_CODE_CREATED) {
-    std::string errorMsg = "Failed to register " + endpoint;
-    dataStorage_->logError(errorMsg);
-
-    std::string httpError = http_.errorToString(httpCode).c_str();
-    dataStorage_->logError(httpError);
+    LOGE(LOG_REGISTER_FAILED, endpoint);
+    LOGE(LOG_HTTP_ERROR, httpCode, http_.errorToString(httpCode).c_str());
 
     const String msg = http_.getString();
     if (msg != nullptr)
-      dataStorage_->logError(msg.c_str());
+      LOGE(LOG_SERVER_RESPONSE, msg.c_str());
 
     http_.end();
     return -1;
@@ -143,7 +269,7 @@ int BikeSense::registerAndGetID(std::string payload, std::string endpoint) {
 
   const String &response = http_.getString();
   JsonDocument doc;
-  deserializeJson(doc, response);
+  deserializeJson(doc, response.c_str());
   http_.end();
 
   return doc["id"];
@@ -151,7 +277,7 @@ int BikeSense::registerAndGetID(std::string payload, std::string endpoint) {
 
 int BikeSense::registerTripAndGetID() {
   if (!registered_) {
-    dataStorage_->logInfo("Trying to register bike and sensor unit");
+    LOGI(LOG_REGISTERING_DEVICE);
     std::string bikeCodePayload = "{\"code\": \"" + BIKE_CODE + "\"}";
     bikeId_ = registerAndGetID(bikeCodePayload, "/bike/register");
     std::string unitCodePayload = "{\"code\": \"" + UNIT_CODE + "\"}";
@@ -169,184 +295,802 @@ int BikeSense::registerTripAndGetID() {
   return registerAndGetID(tripPayload, "/trip/register");
 }
 
-int BikeSense::uploadData(const std::vector<std::string> &readings) {
-  std::string payload;
-  payload = "[";
+int BikeSense::fillPayload(int maxRecords) {
+  // Reuse the payload buffer across batches instead of growing a fresh
+  // string every time
+  payload_.clear();
+  payload_ += '[';
+
+  int records = 0;
+  RecordBatch batch;
+  while (records < maxRecords) {
+    // Views are only valid until the next call, so only ask for as many
+    // records as are sure to fit under the ceiling
+    const size_t room = MAX_UPLOAD_PAYLOAD_BYTES - payload_.size();
+    const int wanted = std::min<int>(maxRecords - records,
+                                     room / (maxSerializedRecordSize() + 1));
+    if (wanted == 0 || !dataStorage_->nextBatch(wanted, batch)) {
+      break;
+    }
+
+    for (const auto &record : batch) {
+      if (records++ > 0) {
+        payload_ += ',';
+      }
+      payload_.append(record.data(), record.size());
+    }
+  }
+
+  payload_ += ']';
+  return records;
+}
 
-  for (size_t i = 0; i < readings.size() - 1; i++) {
-    payload += readings[i] + ",";
+int BikeSense::postPayload() {
+  if (!compressUploads_) {
+    return http_.POST(reinterpret_cast<const uint8_t *>(payload_.data()),
+                      payload_.size());
   }
 
-  payload += readings[readings.size() - 1] + "]";
-  return http_.POST(payload.c_str());
+  // The compressor's window is too big for the stack
+  compressedPayload_.clear();
+  auto gzip = std::make_unique<GzipCompressor>(
+      [this](const char *data, size_t length) {
+        compressedPayload_.append(data, length);
+        return true;
+      });
+  gzip->write(payload_.data(), payload_.size());
+  gzip->finish();
+  INSTRUMENT(instruments().sampleHeap());
+
+  http_.addHeader("Content-Encoding", "gzip");
+  return http_.POST(
+      reinterpret_cast<const uint8_t *>(compressedPayload_.data()),
+      compressedPayload_.size());
 }
 
 int BikeSense::saveData(const SensorReading sensorData,
                         const SensorReading gpsData,
-                        const std::string timestamp) {
-  JsonDocument doc;
-  doc["timestamp"] = timestamp;
-  for (auto gps : gpsData.getMeasurements()) {
-    doc["gps_data"][gps.first] = gps.second;
+                        uint64_t timestampMs) {
+  TIMING_START(timing, instruments().timing(TIMING_SAVE_DATA));
+  // Only queue the sample here, storage writes happen in drainSamples
+  if (records_) {
+    records_->push({timestampMs, gpsData, sensorData});
+    return 0;
   }
-  for (auto meas : sensorData.getMeasurements()) {
-    doc[meas.first] = meas.second;
+  EncodedRecord encoded;
+  BinaryRecordFormat::encode({timestampMs, gpsData, sensorData},
+                             encoded.bytes);
+  samples_.push(encoded);
+
+  return 0;
+}
+
+void BikeSense::saveFix(const SensorReading sensorData,
+                        const SensorReading gpsData, uint64_t timestampMs) {
+  DataRecord kept;
+  if (simplifier_.add({timestampMs, gpsData, sensorData}, kept)) {
+    saveData(kept.sensorData, kept.gpsData, kept.timestampMs);
   }
+}
 
-  std::string json;
-  serializeJson(doc, json);
-  dataStorage_->store(json);
+void BikeSense::flushPending() {
+  DataRecord kept;
+  if (simplifier_.flush(kept)) {
+    saveData(kept.sensorData, kept.gpsData, kept.timestampMs);
+  }
+  saveAggregates(true);
+}
 
-  return 0;
+void BikeSense::saveAggregates(bool flush) {
+  // Each aggregate is placed where the window ended
+  SensorReading aggregate;
+  while (aggregator_.takeClosed(millis(), aggregate, flush)) {
+    saveData(aggregate, gps_->read(), gps_->timestampMs());
+  }
+}
+
+size_t BikeSense::queuedSamples() const {
+  return samples_.size() + (records_ ? records_->size() : 0);
 }
 
+uint32_t BikeSense::droppedSamples() const {
+  return samples_.dropped() + (records_ ? records_->dropped() : 0);
+}
+
+void BikeSense::drainSamples(bool force) {
+  if (!force && queuedSamples() < DRAIN_BATCH_SIZE &&
+      drainTimer_ < DRAIN_INTERVAL_MS) {
+    return;
+  }
+  std::lock_guard<CoreLock> lock(storageLock_);
+  drainTimer_ = 0;
+
+  DataRecord record;
+  while (records_ && records_->pop(record)) {
+    TIMING_START(timing, instruments().timing(TIMING_STORE));
+    if (!dataStorage_->store(record)) {
+      LOGE(LOG_STORE_FAILED, 1);
+    }
+  }
+
+  size_t count;
+  do {
+    count = 0;
+    while (count < DRAIN_BATCH_SIZE && samples_.pop(drainBuffer_[count])) {
+      count++;
+    }
+    if (count == 0) {
+      break;
+    }
+    TIMING_START(timing, instruments().timing(TIMING_STORE));
+    if (!dataStorage_->storeEncoded(drainBuffer_, count)) {
+      LOGE(LOG_STORE_FAILED, count);
+    }
+  } while (count == DRAIN_BATCH_SIZE);
+
+  if (droppedSamples() != reportedDrops_) {
+    LOGE(LOG_SAMPLES_DROPPED, droppedSamples() - reportedDrops_);
+    reportedDrops_ = droppedSamples();
+  }
+}
+
+void BikeSense::syncStorage() {
+  std::lock_guard<CoreLock> lock(storageLock_);
+  drainSamples(true);
+  dataStorage_->sync();
+}
+
+#if BIKESENSE_INSTRUMENTATION
+InstrumentCounters BikeSense::counters() const {
+  InstrumentCounters counters;
+  counters.droppedSamples = droppedSamples();
+  counters.droppedLogs = logger().dropped();
+  counters.gpsChecksumFailures = gps_->checksumFailures();
+  counters.gpsOverruns = gps_->overruns();
+  return counters;
+}
+
+void BikeSense::logStats() {
+  instruments().sampleHeap();
+  instruments().log(counters(), STATE_NAMES, std::size(STATE_NAMES));
+}
+
+void BikeSense::writeTripSummary(std::string &out) const {
+  instruments().writeSummary(counters(), STATE_NAMES, std::size(STATE_NAMES),
+                             out);
+}
+
+void BikeSense::postTripSummary(const UploadCheckpoint &checkpoint) {
+  // Goes as a batch of its own after the records, a lost summary doesn't
+  // fail the upload
+  payload_.assign(1, '[');
+  writeTripSummary(payload_);
+  payload_ += ']';
+
+  const int httpCode = postBatch(checkpoint.tripId, checkpoint.seq);
+  http_.end();
+  if (httpCode != HTTP_CODE_OK && httpCode != HTTP_CODE_CREATED) {
+    LOGE(LOG_SUMMARY_FAILED, httpCode);
+  }
+}
+#endif
+
 bool BikeSense::uploadAllSensorData() {
-  dataStorage_->logInfo("Sleeping for wifi shenanigans");
+  LOGI(LOG_WIFI_SETTLE);
   sleep_ms(3000);
 
-  http_.begin((API_ENDPOINT + "/check_health").c_str());
+  beginRequest("/check_health");
   int httpCode = http_.GET();
-  dataStorage_->logInfo(http_.errorToString(httpCode).c_str());
+  LOGI(LOG_HEALTH_CHECK, httpCode);
   http_.end();
 
-  dataStorage_->logInfo("Trying to register trip");
-  int tripId_ = registerTripAndGetID();
-  if (tripId_ == -1) {
-    dataStorage_->logError("Failed to register trip, aborting upload");
-    http_.end();
+  // Not before, the drainer on core 1 keeps writing while the WiFi settles
+  std::lock_guard<CoreLock> lock(storageLock_);
+  drainSamples(true);
+  if (!dataStorage_->seal()) {
+    LOGE(LOG_CURSOR_FAILED);
     return false;
   }
-  std::string msg = "Trip registered with id: " + std::to_string(tripId_);
-  dataStorage_->logInfo(msg);
 
-  dataStorage_->logInfo("Starting Bulk Data Upload");
-  int nUploads = 1;
-  retrievedData data;
-  while (data = dataStorage_->retrieve(UPLOAD_BATCH_SIZE), data.has_value()) {
-    http_.begin((API_ENDPOINT + "/trip/upload_data").c_str());
-    http_.addHeader("Content-Type", "application/json");
-    http_.addHeader("Authorization", API_TOKEN.c_str());
-    http_.addHeader("Trip-ID", String(tripId_).c_str());
+  // Every segment is a trip of its own and is deleted as soon as it made it,
+  // so a failure leaves only the rest of the backlog for next time
+  while (dataStorage_->openCursor()) {
+    bool uploaded = uploadSegment();
+    dataStorage_->closeCursor();
+    if (!uploaded) {
+      return false;
+    }
 
-    int httpCode = uploadData(data.value());
-    if (httpCode != HTTP_CODE_OK && httpCode != HTTP_CODE_CREATED) {
+    LOGI(LOG_UPLOAD_SUCCEEDED);
+    dataStorage_->clear();
+    INSTRUMENT(instruments().reset(counters()));
+    drainLogs();
+  }
 
-      std::string errorMsg =
-          "HTTP post failed after " + std::to_string(nUploads) + " batches";
-      std::string httpError = http_.errorToString(httpCode).c_str();
-      std::string response = http_.getString().c_str();
-      dataStorage_->logError(errorMsg);
-      dataStorage_->logError(httpError);
-      dataStorage_->logError(response);
+  return true;
+}
 
+bool BikeSense::uploadSegment() {
+  UploadCheckpoint checkpoint;
+  if (UPLOAD_MODE == BATCHED_UPLOAD && dataStorage_->loadProgress(checkpoint)) {
+    if (dataStorage_->seekCursor(checkpoint.offset)) {
+      LOGI(LOG_UPLOAD_RESUMED, checkpoint.tripId, checkpoint.seq);
+    } else {
+      LOGE(LOG_CHECKPOINT_MISMATCH);
+      checkpoint = UploadCheckpoint();
+      dataStorage_->openCursor();
+    }
+  }
+
+  if (checkpoint.tripId == -1) {
+    // Where a reset during the first batch resumes, 0 is not a record
+    // boundary in every format
+    checkpoint.offset = dataStorage_->cursorPosition();
+    LOGI(LOG_REGISTERING_TRIP);
+    checkpoint.tripId = registerTripAndGetID();
+    if (checkpoint.tripId == -1) {
+      LOGE(LOG_TRIP_REGISTER_FAILED);
       http_.end();
       return false;
     }
-    dataStorage_->logInfo("Batch " + std::to_string(nUploads) + " uploaded");
+    LOGI(LOG_TRIP_REGISTERED, checkpoint.tripId);
+  }
+
+  return UPLOAD_MODE == STREAMED_UPLOAD ? streamTripData(checkpoint.tripId)
+                                        : uploadBatches(checkpoint);
+}
+
+void BikeSense::saveCheckpoint(const UploadCheckpoint &checkpoint) {
+  if (!dataStorage_->saveProgress(checkpoint)) {
+    LOGE(LOG_CHECKPOINT_SAVE_FAILED);
+  }
+}
+
+bool BikeSense::uploadBatches(UploadCheckpoint &checkpoint) {
+  LOGI(LOG_BATCHED_UPLOAD_START, batchSizer_.size());
+
+  // A batch that was sent but never acknowledged goes again with the same
+  // records and sequence number, so the server can tell it's a retry
+  int batchSize =
+      checkpoint.pending > 0 ? checkpoint.pending : batchSizer_.size();
+  int records;
+  int goodSize = 0;
+  while ((records = fillPayload(batchSize)) > 0) {
+    // One write per batch: if the previous batch was acknowledged but this
+    // never gets saved, the previous one is just sent again
+    checkpoint.pending = records;
+    saveCheckpoint(checkpoint);
+
+    int httpCode;
+    unsigned long startMs;
+    TIMING_START(batchTiming, instruments().timing(TIMING_UPLOAD_BATCH));
+    for (int attempt = 1;; attempt++) {
+      startMs = millis();
+      httpCode = postBatch(checkpoint.tripId, checkpoint.seq);
+      if (httpCode == HTTP_CODE_UNSUPPORTED_MEDIA_TYPE && compressUploads_) {
+        LOGE(LOG_GZIP_REJECTED);
+        http_.end();
+        compressUploads_ = false;
+        startMs = millis();
+        httpCode = postBatch(checkpoint.tripId, checkpoint.seq);
+      }
+
+      if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_CREATED ||
+          attempt == MAX_BATCH_ATTEMPTS) {
+        break;
+      }
+
+      // Smaller batches from now on, this one is already read so it goes
+      // again as is
+      batchSizer_.onFailure();
+      LOGE(LOG_BATCH_RETRY, checkpoint.seq, httpCode);
+      http_.end();
+    }
+    TIMING_STOP(batchTiming);
+
+    if (httpCode != HTTP_CODE_OK && httpCode != HTTP_CODE_CREATED) {
+
+      LOGE(LOG_BATCH_FAILED, checkpoint.seq);
+      LOGE(LOG_HTTP_ERROR, httpCode, http_.errorToString(httpCode).c_str());
+      LOGE(LOG_SERVER_RESPONSE, http_.getString().c_str());
+
+      http_.end();
+      break;
+    }
     http_.end();
-    nUploads++;
+
+    const uint32_t latencyMs = millis() - startMs;
+    const size_t bytes =
+        compressUploads_ ? compressedPayload_.size() : payload_.size();
+    goodSize = batchSizer_.size();
+    batchSizer_.onSuccess(records, bytes, latencyMs);
+
+    LOGI(LOG_BATCH_UPLOADED, checkpoint.seq, records, bytes, latencyMs);
+    drainLogs();
+
+    checkpoint.offset = dataStorage_->cursorPosition();
+    checkpoint.seq++;
+    checkpoint.pending = 0;
+    batchSize = batchSizer_.size();
   }
 
+  if (goodSize > 0) {
+    dataStorage_->saveState(BATCH_SIZE_STATE, std::to_string(goodSize));
+  }
+  if (records == 0) {
+    INSTRUMENT(postTripSummary(checkpoint));
+  }
+  return records == 0;
+}
+
+int BikeSense::postBatch(int tripId, uint32_t seq) {
+  beginRequest("/trip/upload_data");
+  http_.addHeader("Content-Type", "application/json");
+  http_.addHeader("Authorization", API_TOKEN.c_str());
+  http_.addHeader("Trip-ID", String(tripId).c_str());
+  http_.addHeader("Batch-Seq", String(seq).c_str());
+
+  return postPayload();
+}
+
+bool BikeSense::streamTripData(int tripId) {
+  LOGI(LOG_STREAMED_UPLOAD_START);
+  unsigned long startMs = millis();
+
+  RecordBatch batch;
+  size_t index = 0;
+  RecordSource fromCursor = [&](std::string_view &record) {
+    if (index == batch.size()) {
+      if (!dataStorage_->nextBatch(UPLOAD_BATCH_SIZE, batch)) {
+        return false;
+      }
+      index = 0;
+    }
+    record = batch[index++];
+    return true;
+  };
+
+  int httpCode = streamRecords(tripId, fromCursor);
+  if (httpCode == HTTP_CODE_UNSUPPORTED_MEDIA_TYPE && compressUploads_) {
+    LOGE(LOG_GZIP_REJECTED);
+    compressUploads_ = false;
+    dataStorage_->closeCursor();
+    batch.clear();
+    index = 0;
+    httpCode = dataStorage_->openCursor() ? streamRecords(tripId, fromCursor)
+                                          : HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+
+  if (httpCode != HTTP_CODE_OK && httpCode != HTTP_CODE_CREATED) {
+    LOGE(LOG_STREAM_FAILED, streamRequest_.bytesSent());
+    LOGE(LOG_HTTP_ERROR, httpCode, http_.errorToString(httpCode).c_str());
+    LOGE(LOG_SERVER_RESPONSE, streamRequest_.response());
+    return false;
+  }
+
+  LOGI(LOG_STREAM_UPLOADED, streamRequest_.bytesSent(), millis() - startMs);
   return true;
 }
 
-void BikeSense::run() {
-  setup();
+int BikeSense::streamRecords(int tripId, const RecordSource &nextRecord) {
+  ChunkedRequest &request = streamRequest_;
+  request.begin("/trip/upload_data");
+  request.addHeader("Content-Type", "application/json");
+  request.addHeader("Authorization", API_TOKEN);
+  request.addHeader("Trip-ID", std::to_string(tripId));
+
+  // Allocated only for the upload, the window is too big for the stack
+  std::unique_ptr<GzipCompressor> gzip;
+  if (compressUploads_) {
+    request.addHeader("Content-Encoding", "gzip");
+    gzip = std::make_unique<GzipCompressor>(
+        [&request](const char *data, size_t length) {
+          return request.write(data, length);
+        });
+  }
 
-  elapsedMillis wifi_retry_timer_ = WIFI_RETRY_INTERVAL_MS;
-  elapsedMillis builtin_led_timer_ = 0;
+  auto send = [&](const char *data, size_t length) {
+    return gzip ? gzip->write(data, length) : request.write(data, length);
+  };
+
+  // The whole stream counts as one batch
+  TIMING_START(timing, instruments().timing(TIMING_UPLOAD_BATCH));
+  int httpCode = request.startPost();
+  if (httpCode == 0) {
+    INSTRUMENT(instruments().sampleHeap());
+
+    // The JSON array framing is added around the records as they stream
+    bool sent = send("[", 1);
+    bool first = true;
+    std::string_view record;
+    while (sent && nextRecord(record)) {
+      sent = (first || send(",", 1)) && send(record.data(), record.size());
+      first = false;
+    }
+#if BIKESENSE_INSTRUMENTATION
+    // The trip summary is the last element
+    if (sent) {
+      std::string summary;
+      writeTripSummary(summary);
+      sent = (first || send(",", 1)) && send(summary.data(), summary.size());
+    }
+#endif
+    send("]", 1);
 
-  const int LED_BLINK_INTERVAL_MS = 500;
-  bool builtin_led_state = false;
+    if (gzip) {
+      gzip->finish();
+      LOGD(LOG_COMPRESSED, gzip->inputSize(), gzip->outputSize());
+    }
+    httpCode = request.finish();
+  }
+  request.end();
 
-  bool logsDumped = false;
+  return httpCode;
+}
 
-  while (true) {
-    switch (state_) {
+void BikeSense::postEvent(UploaderEventType type) {
+  UploaderEvent event;
+  event.type = type;
+  uploaderEvents_.send(event);
+}
+
+void BikeSense::serviceUploader() {
+  UploaderEvent event;
+  while (uploaderEvents_.tryReceive(event)) {
+    switch (event.type) {
+    case UPLOADER_WIFI_CONNECTED:
+      startFeeding();
+      break;
 
-    case IDLE: {
-      led_->setColor(led_->BYTE_MAX, led_->BYTE_MAX, led_->BYTE_MAX);
-      if (!checkWifi()) {
-        state_ = COLLECTING_DATA;
-        dataStorage_->logInfo("Starting data collection for new trip");
+    case UPLOADER_DONE:
+      LOGI(LOG_UPLOAD_SUCCEEDED);
+      dataStorage_->clear();
+      INSTRUMENT(instruments().reset(counters()));
+      feedState_ = FEED_IDLE;
+      break;
+
+    case UPLOADER_FAILED:
+      LOGE(LOG_UPLOAD_KEPT);
+      dataStorage_->closeCursor();
+      if (feedState_ == FEED_RECORDS || feedState_ == FEED_END) {
+        feedState_ = FEED_END;
+        feedAborted_ = true;
+      } else {
+        feedState_ = FEED_IDLE;
       }
-    } break;
+      break;
+    }
+  }
+
+  feedRecords();
+}
 
-    case COLLECTING_DATA: {
-      gps_->update();
+void BikeSense::startFeeding() {
+  if (feedState_ != FEED_IDLE) {
+    return;
+  }
+
+  UploadCommand &command = feedCommand_;
+  drainSamples(true);
+  // The backlog goes first, what was stored since is sealed once it's
+  // empty. Sealing keeps the usual upload pace so that draining the backlog
+  // doesn't cut the current trip into tiny segments.
+  bool opened = dataStorage_->openCursor();
+  bool current = false;
+  if (!opened && sealTimer_ >= (unsigned long)WIFI_RETRY_INTERVAL_MS) {
+    sealTimer_ = 0;
+    opened = current = dataStorage_->seal() && dataStorage_->openCursor();
+  }
+  if (!opened || !dataStorage_->nextBatch(UPLOAD_BATCH_SIZE, feedBatch_)) {
+    dataStorage_->closeCursor();
+    command.type = UPLOAD_NOTHING;
+    uploadCommands_.send(command);
+    return;
+  }
 
-      if (!gps_->isValid() || gps_->isOld()) {
-        state_ = NO_GPS;
-        dataStorage_->logError("GPS signal lost");
+  command.type = current ? UPLOAD_CURRENT : UPLOAD_START;
+  uploadCommands_.send(command);
+  feedIndex_ = 0;
+  feedAborted_ = false;
+  feedState_ = FEED_RECORDS;
+}
+
+void BikeSense::feedRecords() {
+  UploadCommand &command = feedCommand_;
+
+  // Only hand over what fits in the queue, sampling must not wait on WiFi
+  while (feedState_ == FEED_RECORDS) {
+    if (feedIndex_ == feedBatch_.size()) {
+      if (!dataStorage_->nextBatch(UPLOAD_BATCH_SIZE, feedBatch_)) {
+        dataStorage_->closeCursor();
+        feedState_ = FEED_END;
         break;
       }
+      feedIndex_ = 0;
+    }
 
-      led_->setColor(0, led_->BYTE_MAX, 0);
-      // Wait for the GPS data to be updated
-      if (gps_->isUpdated()) {
-        saveData(readSensors(), gps_->read(), gps_->timeString());
-      }
+    const std::string_view &record = feedBatch_[feedIndex_];
+    if (record.size() > UploadCommand::MAX_RECORD_SIZE) {
+      LOGE(LOG_RECORD_TOO_LARGE);
+      feedIndex_++;
+      continue;
+    }
+
+    command.type = UPLOAD_RECORD;
+    command.length = record.size();
+    memcpy(command.data, record.data(), record.size());
+    if (!uploadCommands_.trySend(command)) {
+      return;
+    }
+    feedIndex_++;
+  }
+
+  if (feedState_ == FEED_END) {
+    command.type = UPLOAD_END;
+    if (uploadCommands_.trySend(command)) {
+      feedState_ = feedAborted_ ? FEED_IDLE : FEED_WAITING;
+    }
+  }
+}
+
+void BikeSense::runDrainer() {
+  while (true) {
+    stepDrainer();
+  }
+}
+
+void BikeSense::stepDrainer() {
+  drainerStarted_ = true;
+  drainSamples();
+  {
+    std::lock_guard<CoreLock> lock(storageLock_);
+    dataStorage_->poll();
+  }
+  drainLogs();
+  sleep_ms(DRAINER_INTERVAL_MS);
+}
+
+void BikeSense::runUploader() {
+  while (true) {
+    stepUploader();
+  }
+}
+
+void BikeSense::stepUploader() {
+  if (uploaderWifiTimer_ < (unsigned long)WIFI_RETRY_INTERVAL_MS) {
+    sleep_ms(WIFI_RETRY_INTERVAL_MS - uploaderWifiTimer_);
+    return;
+  }
+  uploaderWifiTimer_ = 0;
+
+  if (!checkWifi()) {
+    // Off on a new ride
+    rideTripId_ = -1;
+    return;
+  }
+
+  postEvent(UPLOADER_WIFI_CONNECTED);
+  uploadCommands_.receive(command_);
+  if (command_.type != UPLOAD_START && command_.type != UPLOAD_CURRENT) {
+    return;
+  }
+
+  endReceived_ = false;
+  session_.resetStats();
+  bool uploaded = uploadQueuedRecords(command_.type == UPLOAD_CURRENT);
+  logConnectionStats();
+  session_.close();
+  postEvent(uploaded ? UPLOADER_DONE : UPLOADER_FAILED);
+  // One segment per upload, go straight on with the rest of the backlog
+  if (uploaded) {
+    uploaderWifiTimer_ = WIFI_RETRY_INTERVAL_MS;
+  }
+
+  // Let the collecting core finish the hand-over before the next upload
+  while (!endReceived_) {
+    uploadCommands_.receive(command_);
+    endReceived_ = command_.type == UPLOAD_END;
+  }
+}
+
+bool BikeSense::uploadQueuedRecords(bool currentRide) {
+  LOGI(LOG_WIFI_CONNECTED, WiFi.SSID().c_str());
+  LOGI(LOG_UPLOAD_ENDPOINT, API_ENDPOINT);
+
+  // A docked bike keeps sampling and its data keeps being sealed, that's
+  // still the ride that ended here rather than a new trip every time
+  int tripId = currentRide ? rideTripId_ : leftoverTripId_;
+  if (tripId == -1) {
+    tripId = registerTripAndGetID();
+    if (tripId == -1) {
+      LOGE(LOG_TRIP_REGISTER_FAILED);
+      return false;
+    }
+    LOGI(LOG_TRIP_REGISTERED, tripId);
+    if (currentRide) {
+      rideTripId_ = tripId;
+    }
+  }
+
+  RecordSource fromQueue = [this](std::string_view &record) {
+    uploadCommands_.receive(command_);
+    if (command_.type != UPLOAD_RECORD) {
+      endReceived_ = true;
+      return false;
+    }
+    record = std::string_view(command_.data, command_.length);
+    return true;
+  };
+
+  int httpCode = streamRecords(tripId, fromQueue);
+  if (httpCode == HTTP_CODE_UNSUPPORTED_MEDIA_TYPE && compressUploads_) {
+    // Records were consumed already, the next upload goes uncompressed
+    LOGE(LOG_GZIP_REJECTED_NEXT);
+    compressUploads_ = false;
+  }
+
+  if (httpCode != HTTP_CODE_OK && httpCode != HTTP_CODE_CREATED) {
+    LOGE(LOG_STREAM_FAILED, streamRequest_.bytesSent());
+    LOGE(LOG_HTTP_ERROR, httpCode, http_.errorToString(httpCode).c_str());
+    if (currentRide) {
+      leftoverTripId_ = tripId;
+    }
+    return false;
+  }
+
+  if (!currentRide) {
+    leftoverTripId_ = -1;
+  }
+  LOGI(LOG_QUEUE_UPLOADED, streamRequest_.bytesSent());
+  return true;
+}
 
-      if (wifi_retry_timer_ < WIFI_RETRY_INTERVAL_MS) {
+void BikeSense::run() {
+  setup();
+  while (true) {
+    step();
+  }
+}
+
+void BikeSense::step() {
+  TIMING_START(loopTiming, instruments().loop(state_));
+  const BikeSenseStates startState = state_;
+
+  switch (state_) {
+
+  case IDLE: {
+    led_->setColor(led_->BYTE_MAX, led_->BYTE_MAX, led_->BYTE_MAX);
+    // With a core dedicated to uploads there is no reason to stop sampling
+    if (!DUAL_CORE) {
+      if (wifiRetryTimer_ < (unsigned long)IDLE_WIFI_CHECK_INTERVAL_MS) {
         break;
       }
-      wifi_retry_timer_ = 0;
+      wifiRetryTimer_ = 0;
+      if (checkWifi()) {
+        break;
+      }
+    }
+    state_ = COLLECTING_DATA;
+    LOGI(LOG_TRIP_STARTED);
+  } break;
+
+  case COLLECTING_DATA: {
+    TIMING_START(gpsTiming, instruments().timing(TIMING_GPS_UPDATE));
+    gps_->update();
+    TIMING_STOP(gpsTiming);
+
+    if (!gps_->isValid() || gps_->isOld()) {
+      state_ = NO_GPS;
+      LOGE(LOG_GPS_LOST);
+      flushPending();
+      syncStorage();
+      break;
+    }
+
+    led_->setColor(0, led_->BYTE_MAX, 0);
+    // Windows that are over go first, a reading taken as one ends starts
+    // the next
+    saveAggregates();
+    const SensorReading *fresh = scheduler_.poll();
+    if (fresh != nullptr) {
+      aggregator_.add(*fresh, millis());
+    }
+    // Each GPS fix produces a record with the latest value of every sensor
+    // that isn't aggregated
+    if (gps_->isUpdated()) {
+      saveFix(aggregator_.rawOnly(scheduler_.snapshot()), gps_->read(),
+              gps_->timestampMs());
+    }
 
-      Serial.println("Checking for known wifi connections");
-      if (checkWifi())
-        state_ = UPLOADING_DATA;
+    if (DUAL_CORE ||
+        wifiRetryTimer_ < (unsigned long)WIFI_RETRY_INTERVAL_MS) {
+      break;
+    }
+    wifiRetryTimer_ = 0;
 
-      Serial.printf("Wifi offline, retrying in %ds\n",
-                    WIFI_RETRY_INTERVAL_MS / 1000);
+    Serial.println("Checking for known wifi connections");
+    if (checkWifi()) {
+      state_ = UPLOADING_DATA;
+      flushPending();
+      syncStorage();
+    }
 
-    } break;
+    Serial.printf("Wifi offline, retrying in %ds\n",
+                  WIFI_RETRY_INTERVAL_MS / 1000);
 
-    case NO_GPS: {
-      gps_->update();
-      led_->setColor(led_->BYTE_MAX, led_->BYTE_MAX, 0);
-      if (gps_->isValid() && !gps_->isOld()) {
-        state_ = COLLECTING_DATA;
-        dataStorage_->logInfo("GPS signal acquired, resuming data collection");
-      }
+  } break;
 
-    } break;
+  case NO_GPS: {
+    TIMING_START(gpsTiming, instruments().timing(TIMING_GPS_UPDATE));
+    gps_->update();
+    TIMING_STOP(gpsTiming);
+    led_->setColor(led_->BYTE_MAX, led_->BYTE_MAX, 0);
+    if (gps_->isValid() && !gps_->isOld()) {
+      state_ = COLLECTING_DATA;
+      LOGI(LOG_GPS_ACQUIRED);
+    }
 
-    case UPLOADING_DATA: {
-      led_->setColor(0, 0, led_->BYTE_MAX);
+  } break;
 
-      std::string wifiMsg =
-          "Connected to WiFi: " + std::string(WiFi.SSID().c_str());
-      std::string endpointMsg = "Uploading data to " + API_ENDPOINT;
-      dataStorage_->logInfo(wifiMsg);
-      dataStorage_->logInfo(endpointMsg);
+  case UPLOADING_DATA: {
+    led_->setColor(0, 0, led_->BYTE_MAX);
 
-      int success = uploadAllSensorData();
-      if (success) {
-        state_ = IDLE;
-        dataStorage_->logInfo("Data upload successful, clearing storage");
-        dataStorage_->clear();
-      } else {
-        dataStorage_->logError("Failed to upload data, going into error mode");
-        state_ = ERROR;
-      }
-    } break;
+    LOGI(LOG_WIFI_CONNECTED, WiFi.SSID().c_str());
+    LOGI(LOG_UPLOAD_ENDPOINT, API_ENDPOINT);
 
-    // TODO: handle this better
-    case ERROR: {
-      led_->setColor(led_->BYTE_MAX, 0, 0);
-      dataStorage_->logError("Rebooting device due to error...");
-      rp2040.reboot();
-    } break;
+    session_.resetStats();
+    int success = uploadAllSensorData();
+    logConnectionStats();
+    session_.close();
+    if (success) {
+      state_ = IDLE;
+    } else {
+      LOGE(LOG_UPLOAD_FAILED);
+      state_ = ERROR;
     }
+  } break;
+
+  // TODO: handle this better
+  case ERROR: {
+    led_->setColor(led_->BYTE_MAX, 0, 0);
+    LOGE(LOG_REBOOTING);
+    drainLogs();
+    syncStorage();
+    rp2040.reboot();
+  } break;
+  }
 
-    // NOTE: Blink the builtin LED as a heartbeat indicator
-    if (builtin_led_timer_ > LED_BLINK_INTERVAL_MS) {
-      builtin_led_timer_ = 0;
-      builtin_led_state = !builtin_led_state;
-      digitalWrite(LED_BUILTIN, builtin_led_state);
+#if BIKESENSE_INSTRUMENTATION
+  if (statsTimer_ >= (unsigned long)STATS_INTERVAL_MS) {
+    statsTimer_ = 0;
+    logStats();
+  }
+#endif
+  // Once the drainer runs, the storage is written from the other core
+  if (!drainerStarted_) {
+    drainSamples();
+    {
+      std::lock_guard<CoreLock> lock(storageLock_);
+      dataStorage_->poll();
     }
+    drainLogs();
+  }
+
+  if (DUAL_CORE) {
+    serviceUploader();
+  }
+
+  // NOTE: Blink the builtin LED as a heartbeat indicator
+  if (builtinLedTimer_ >= (unsigned long)LED_BLINK_INTERVAL_MS) {
+    builtinLedTimer_ = 0;
+    builtinLedState_ = !builtinLedState_;
+    digitalWrite(LED_BUILTIN, builtinLedState_);
+  }
 
-    sleep_ms(1);
+  TIMING_STOP(loopTiming);
+  // A new state gets its first iteration straight away
+  if (state_ == startState) {
+    sleepUntilDue();
   }
 }
 
@@ -0,0 +1,117 @@
+#include "bufferedWriter.h"
+
+#include <Arduino.h>
+
+BufferedWriter::BufferedWriter(FlushPolicy policy) : policy_(policy) {}
+
+bool BufferedWriter::open(const char *path) {
+  close();
+
+  file_ = SD.open(path, FILE_WRITE);
+  if (!file_) {
+    return false;
+  }
+
+  path_ = path;
+  fileSize_ = file_.size();
+  used_ = 0;
+  pendingBytes_ = 0;
+  // Fill up the partial sector at the end of the file first so that every
+  // following block starts on a sector boundary
+  blockEnd_ = SECTOR_SIZE - fileSize_ % SECTOR_SIZE;
+
+  return true;
+}
+
+void BufferedWriter::close() {
+  if (!isOpen()) {
+    return;
+  }
+
+  sync();
+  file_.close();
+  path_ = nullptr;
+}
+
+bool BufferedWriter::isOpen() const { return path_ != nullptr; }
+
+bool BufferedWriter::writeBlock() {
+  if (used_ == 0) {
+    return true;
+  }
+
+  size_t written = file_.write(buffer_, used_);
+  stats_.blockWrites++;
+  stats_.bytesWritten += written;
+  fileSize_ += written;
+
+  bool ok = written == used_;
+  used_ = 0;
+  blockEnd_ = SECTOR_SIZE - fileSize_ % SECTOR_SIZE;
+  return ok;
+}
+
+bool BufferedWriter::write(const uint8_t *data, size_t length) {
+  if (!isOpen()) {
+    return false;
+  }
+
+  if (pendingBytes_ == 0) {
+    firstPendingMs_ = millis();
+  }
+  stats_.bytesRequested += length;
+  pendingBytes_ += length;
+
+  bool ok = true;
+  while (length > 0) {
+    size_t n = std::min(blockEnd_ - used_, length);
+    memcpy(buffer_ + used_, data, n);
+    used_ += n;
+    data += n;
+    length -= n;
+
+    if (used_ == blockEnd_) {
+      ok &= writeBlock();
+    }
+  }
+
+  if (pendingBytes_ >= policy_.maxPendingBytes ||
+      millis() - firstPendingMs_ >= policy_.maxPendingMs) {
+    ok &= sync();
+  }
+
+  return ok;
+}
+
+bool BufferedWriter::write(const char *data, size_t length) {
+  return write(reinterpret_cast<const uint8_t *>(data), length);
+}
+
+bool BufferedWriter::sync() {
+  if (!isOpen()) {
+    return false;
+  }
+
+  if (pendingBytes_ == 0) {
+    return true;
+  }
+
+  bool ok = writeBlock();
+  file_.flush();
+  stats_.syncs++;
+  pendingBytes_ = 0;
+
+  return ok;
+}
+
+bool BufferedWriter::poll() {
+  if (pendingBytes_ > 0 &&
+      millis() - firstPendingMs_ >= policy_.maxPendingMs) {
+    return sync();
+  }
+  return true;
+}
+
+size_t BufferedWriter::size() const { return fileSize_ + used_; }
+
+const WriterStats &BufferedWriter::stats() const { return stats_; }
@@ -0,0 +1,186 @@
+#include "chunkedRequest.h"
+
+#include <HTTPClient.h>
+
+ChunkedRequest::ChunkedRequest(HttpSession &session) : session_(session) {}
+
+void ChunkedRequest::begin(const std::string &apiPath) {
+  path_ = session_.path(apiPath);
+  headers_.clear();
+  response_.clear();
+  bytesSent_ = 0;
+  used_ = 0;
+  failed_ = false;
+}
+
+void ChunkedRequest::addHeader(const std::string &name,
+                               const std::string &value) {
+  headers_ += name + ": " + value + "\r\n";
+}
+
+int ChunkedRequest::startPost() {
+  if (!session_.connect()) {
+    return HTTPC_ERROR_CONNECTION_FAILED;
+  }
+
+  std::string head = "POST " + path_ + " HTTP/1.1\r\nHost: " +
+                     session_.hostHeader() +
+                     "\r\nTransfer-Encoding: chunked\r\n" + headers_ +
+                     "\r\n";
+  inProgress_ = true;
+  if (session_.client().write(head.data(), head.size()) != head.size()) {
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+
+  return 0;
+}
+
+bool ChunkedRequest::sendChunk() {
+  if (used_ == 0 || failed_) {
+    return !failed_;
+  }
+
+  char size[12];
+  int n = snprintf(size, sizeof(size), "%x\r\n", (unsigned)used_);
+  WiFiClient &client = session_.client();
+  failed_ = client.write(size, n) != (size_t)n ||
+            client.write(chunk_, used_) != used_ ||
+            client.write("\r\n", 2) != 2;
+
+  bytesSent_ += used_;
+  used_ = 0;
+  return !failed_;
+}
+
+bool ChunkedRequest::write(const char *data, size_t length) {
+  while (length > 0 && !failed_) {
+    size_t n = std::min(CHUNK_SIZE - used_, length);
+    memcpy(chunk_ + used_, data, n);
+    used_ += n;
+    data += n;
+    length -= n;
+
+    if (used_ == CHUNK_SIZE) {
+      sendChunk();
+    }
+  }
+
+  return !failed_;
+}
+
+bool ChunkedRequest::write(std::string_view data) {
+  return write(data.data(), data.size());
+}
+
+int ChunkedRequest::finish() {
+  if (!sendChunk() || session_.client().write("0\r\n\r\n", 5) != 5) {
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+
+  return readResponse();
+}
+
+// Keeps the beginning of the body around for the logs and reads the rest,
+// so the connection can carry the next request. A negative length reads
+// until the server closes. Returns false if the body was cut short.
+bool ChunkedRequest::readBody(long length) {
+  const size_t MAX_RESPONSE_SIZE = 256;
+  WiFiClient &client = session_.client();
+  char c;
+  while (length != 0 && client.readBytes(&c, 1) == 1) {
+    if (response_.size() < MAX_RESPONSE_SIZE) {
+      response_ += c;
+    }
+    if (length > 0) {
+      length--;
+    }
+  }
+  return length <= 0;
+}
+
+int ChunkedRequest::readResponse() {
+  WiFiClient &client = session_.client();
+
+  // Status line, e.g. "HTTP/1.1 201 Created"
+  String statusLine = client.readStringUntil('\n');
+  const char *status = strchr(statusLine.c_str(), ' ');
+  if (status == nullptr) {
+    // A late answer would be taken for the next request's
+    const int error = client.connected() ? HTTPC_ERROR_READ_TIMEOUT
+                                         : HTTPC_ERROR_CONNECTION_LOST;
+    inProgress_ = false;
+    session_.close();
+    return error;
+  }
+  int code = atoi(status + 1);
+
+  // Without a length the body only ends when the server closes
+  long contentLength = -1;
+  bool chunked = false;
+  bool keepAlive = true;
+  while (true) {
+    String header = client.readStringUntil('\n');
+    if (header.length() <= 1) {
+      break;
+    }
+    header.toLowerCase();
+    if (header.startsWith("content-length:")) {
+      contentLength = atol(header.c_str() + strlen("content-length:"));
+    } else if (header.startsWith("transfer-encoding:") &&
+               header.indexOf("chunked") >= 0) {
+      chunked = true;
+    } else if (header.startsWith("connection:") &&
+               header.indexOf("close") >= 0) {
+      keepAlive = false;
+    }
+  }
+
+  bool complete;
+  if ((code >= 100 && code < 200) || code == 204 || code == 304) {
+    // Never have a body, whatever the headers say
+    complete = true;
+  } else if (chunked) {
+    // Chunk sizes in hex, each chunk followed by CRLF, then trailers up to
+    // an empty line
+    complete = false;
+    while (true) {
+      String size = client.readStringUntil('\n');
+      if (size.length() == 0) {
+        break;
+      }
+      const long length = strtol(size.c_str(), nullptr, 16);
+      if (length == 0) {
+        String trailer;
+        do {
+          trailer = client.readStringUntil('\n');
+        } while (trailer.length() > 1);
+        complete = trailer.length() == 1;
+        break;
+      }
+      char crlf[2];
+      if (!readBody(length) || client.readBytes(crlf, 2) != 2) {
+        break;
+      }
+    }
+  } else {
+    complete = readBody(contentLength) && contentLength >= 0;
+  }
+
+  inProgress_ = false;
+  if (!keepAlive || !complete) {
+    session_.close();
+  }
+
+  return code;
+}
+
+void ChunkedRequest::end() {
+  if (inProgress_) {
+    session_.close();
+    inProgress_ = false;
+  }
+}
+
+size_t ChunkedRequest::bytesSent() const { return bytesSent_; }
+
+const std::string &ChunkedRequest::response() const { return response_; }
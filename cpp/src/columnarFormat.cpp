@@ -0,0 +1,444 @@
+#include "columnarFormat.h"
+
+#include <cstring>
+
+static const char MAGIC[ColumnarRecordFormat::MAGIC_SIZE] = {'B', 'S', 'C',
+                                                              '1'};
+
+static uint64_t getLE(const uint8_t *in, int nBytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < nBytes; i++) {
+    value |= (uint64_t)in[i] << (8 * i);
+  }
+  return value;
+}
+
+static void putLE(uint8_t *out, uint64_t value, int nBytes) {
+  for (int i = 0; i < nBytes; i++) {
+    out[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+static uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Latitude, longitude and altitude, which change a little on every fix
+static bool isXorDouble(const MeasurementInfo &info) {
+  return info.group == GROUP_GPS && info.type == FIELD_I32;
+}
+
+static uint64_t doubleBits(int32_t value) {
+  const double d = value;
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+static int32_t fromDoubleBits(uint64_t bits) {
+  double d;
+  memcpy(&d, &bits, sizeof(d));
+  return (int32_t)d;
+}
+
+// Integer slots sign-extended, so changes across zero stay small
+static int64_t slotValue(const MeasurementInfo &info, uint32_t raw) {
+  return info.type == FIELD_I32 ? (int64_t)(int32_t)raw : (int64_t)raw;
+}
+
+void BitWriter::write(uint64_t value, int nBits) {
+  while (nBits > 0) {
+    if (freeBits_ == 0) {
+      bytes_.push_back(0);
+      freeBits_ = 8;
+    }
+    const int n = nBits < freeBits_ ? nBits : freeBits_;
+    const uint8_t chunk = (value >> (nBits - n)) & ((1U << n) - 1);
+    bytes_.back() |= chunk << (freeBits_ - n);
+    freeBits_ -= n;
+    nBits -= n;
+  }
+}
+
+void BitWriter::writeVarint(uint64_t value) {
+  while (value >= 0x80) {
+    write((value & 0x7F) | 0x80, 8);
+    value >>= 7;
+  }
+  write(value, 8);
+}
+
+uint64_t BitReader::read(int nBits) {
+  if (positionBits_ + nBits > sizeBits_) {
+    fail();
+    return 0;
+  }
+
+  uint64_t value = 0;
+  while (nBits > 0) {
+    const int used = positionBits_ % 8;
+    const int n = nBits < 8 - used ? nBits : 8 - used;
+    const uint8_t byte = data_[positionBits_ / 8];
+    value = (value << n) | ((byte >> (8 - used - n)) & ((1U << n) - 1));
+    positionBits_ += n;
+    nBits -= n;
+  }
+  return value;
+}
+
+uint64_t BitReader::readVarint() {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    const uint64_t byte = read(8);
+    value |= (byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  fail();
+  return 0;
+}
+
+const std::vector<uint8_t> &ColumnarRecordFormat::header() {
+  static std::vector<uint8_t> header;
+  if (!header.empty()) {
+    return header;
+  }
+
+  header.assign(MAGIC, MAGIC + MAGIC_SIZE);
+  header.push_back(VERSION);
+  header.push_back(MEASUREMENT_COUNT);
+  header.push_back(BLOCK_SAMPLES);
+  BinaryRecordFormat::appendFields(header);
+
+  return header;
+}
+
+// Gorilla's XOR coding: 0 for a repeated value, 10 and the meaningful bits
+// if they fit the previous window, otherwise 11, 5 bits of leading zeros, 6
+// bits of length (0 for 64) and the meaningful bits
+void ColumnarEncoder::writeXor(BitWriter &out, XorState &state, uint64_t bits,
+                               int width) {
+  const uint64_t xored = bits ^ state.previous;
+  state.previous = bits;
+  if (xored == 0) {
+    out.writeBit(0);
+    return;
+  }
+  out.writeBit(1);
+
+  int leading = __builtin_clzll(xored) - (64 - width);
+  const int trailing = __builtin_ctzll(xored);
+  if (leading > 31) {
+    leading = 31;
+  }
+
+  if (state.leading >= 0 && leading >= state.leading &&
+      trailing >= state.trailing) {
+    out.writeBit(0);
+    out.write(xored >> state.trailing, width - state.leading - state.trailing);
+    return;
+  }
+
+  const int length = width - leading - trailing;
+  out.writeBit(1);
+  out.write(leading, 5);
+  out.write(length & 0x3F, 6);
+  out.write(xored >> trailing, length);
+  state.leading = leading;
+  state.trailing = trailing;
+}
+
+static uint64_t readXor(BitReader &in, uint64_t &previous, int &leading,
+                        int &trailing, int width) {
+  if (!in.readBit()) {
+    return previous;
+  }
+
+  if (in.readBit()) {
+    leading = in.read(5);
+    int length = in.read(6);
+    if (length == 0) {
+      length = 64;
+    }
+    trailing = width - leading - length;
+    if (trailing < 0) {
+      in.fail();
+      return previous;
+    }
+  } else if (leading < 0) {
+    // Reuses a window that was never sent
+    in.fail();
+    return previous;
+  }
+
+  previous ^= in.read(width - leading - trailing) << trailing;
+  return previous;
+}
+
+bool ColumnarEncoder::add(const uint8_t *record) {
+  const uint64_t timestamp = getLE(record, sizeof(uint64_t));
+  const uint32_t mask = getLE(record + sizeof(uint64_t), sizeof(uint32_t));
+  const RowLayout layout = BinaryRecordFormat::layout(mask);
+
+  // Delta-of-delta in ms: 0, 10 and 7 bits, 110 and 9 bits, 1110 and 12
+  // bits or 1111 and 64 bits, all zigzag coded. At a steady rate almost
+  // every timestamp is a single bit.
+  BitWriter &timestamps = columns_[0];
+  if (samples_ == 0) {
+    timestamps.write(timestamp, 64);
+  } else {
+    const int64_t delta = timestamp - previousTimestamp_;
+    const uint64_t dod = zigzag(delta - previousDelta_);
+    if (dod == 0) {
+      timestamps.writeBit(0);
+    } else if (dod < (1 << 7)) {
+      timestamps.write(0b10, 2);
+      timestamps.write(dod, 7);
+    } else if (dod < (1 << 9)) {
+      timestamps.write(0b110, 3);
+      timestamps.write(dod, 9);
+    } else if (dod < (1 << 12)) {
+      timestamps.write(0b1110, 4);
+      timestamps.write(dod, 12);
+    } else {
+      timestamps.write(0b1111, 4);
+      timestamps.write(dod, 64);
+    }
+    previousDelta_ = delta;
+  }
+  previousTimestamp_ = timestamp;
+
+  BitWriter &masks = columns_[1];
+  if (samples_ == 0) {
+    masks.write(mask, 32);
+  } else if (mask == previousMask_) {
+    masks.writeBit(0);
+  } else {
+    masks.writeBit(1);
+    masks.write(mask, 32);
+  }
+  previousMask_ = mask;
+
+  for (size_t i = 0; i < MEASUREMENT_COUNT; i++) {
+    const MeasurementInfo &info = MEASUREMENTS[i];
+    if (!(mask & (1UL << info.id))) {
+      continue;
+    }
+
+    BitWriter &column = columns_[2 + i];
+    FieldState &field = fields_[i];
+    const uint32_t raw = getLE(record + layout.slot[i], fieldSize(info.type));
+
+    if (isXorDouble(info)) {
+      const uint64_t bits = doubleBits(raw);
+      if (field.started) {
+        writeXor(column, field.xored, bits, 64);
+      } else {
+        column.write(bits, 64);
+        field.xored.previous = bits;
+      }
+    } else if (info.type == FIELD_F32) {
+      if (field.started) {
+        writeXor(column, field.xored, raw, 32);
+      } else {
+        column.write(raw, 32);
+        field.xored.previous = raw;
+      }
+    } else {
+      const int64_t change =
+          slotValue(info, raw) -
+          (field.started ? slotValue(info, field.previousRaw) : 0);
+      if (change == 0) {
+        column.writeBit(0);
+      } else {
+        column.writeBit(1);
+        column.writeVarint(zigzag(change));
+      }
+      field.previousRaw = raw;
+    }
+
+    const uint8_t age = record[layout.age[i]];
+    if (age == field.previousAge) {
+      column.writeBit(0);
+    } else {
+      column.writeBit(1);
+      column.write(age, 8);
+      field.previousAge = age;
+    }
+    field.started = true;
+  }
+
+  return ++samples_ >= ColumnarRecordFormat::BLOCK_SAMPLES;
+}
+
+static size_t varintSize(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+void ColumnarEncoder::finishBlock(std::vector<uint8_t> &out) {
+  if (samples_ == 0) {
+    return;
+  }
+
+  size_t payloadSize = 0;
+  for (const auto &column : columns_) {
+    payloadSize += varintSize(column.bytes().size()) + column.bytes().size();
+  }
+
+  // 64 samples with every field present and changing need under 20 kB
+  out.push_back(samples_);
+  out.push_back(payloadSize & 0xFF);
+  out.push_back(payloadSize >> 8);
+  for (auto &column : columns_) {
+    for (size_t size = column.bytes().size();; size >>= 7) {
+      out.push_back((size & 0x7F) | (size >= 0x80 ? 0x80 : 0));
+      if (size < 0x80) {
+        break;
+      }
+    }
+    out.insert(out.end(), column.bytes().begin(), column.bytes().end());
+    column.clear();
+  }
+
+  for (auto &field : fields_) {
+    field = FieldState();
+  }
+  samples_ = 0;
+  previousDelta_ = 0;
+  previousMask_ = 0;
+}
+
+bool ColumnarRecordFormat::blockInfo(const uint8_t *in, size_t &samples,
+                                     size_t &payloadSize) {
+  samples = in[0];
+  payloadSize = in[1] | (in[2] << 8);
+  return samples > 0 && samples <= BLOCK_SAMPLES && payloadSize > 0;
+}
+
+bool ColumnarRecordFormat::decodeBlock(const uint8_t *payload,
+                                       size_t payloadSize, size_t samples,
+                                       std::vector<EncodedRecord> &records) {
+  const uint8_t *columns[COLUMN_COUNT];
+  size_t columnSizes[COLUMN_COUNT];
+  size_t offset = 0;
+  for (size_t c = 0; c < COLUMN_COUNT; c++) {
+    size_t size = 0;
+    for (int shift = 0;; shift += 7) {
+      if (offset >= payloadSize || shift > 28) {
+        return false;
+      }
+      const uint8_t byte = payload[offset++];
+      size |= (size_t)(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        break;
+      }
+    }
+    if (size > payloadSize - offset) {
+      return false;
+    }
+    columns[c] = payload + offset;
+    columnSizes[c] = size;
+    offset += size;
+  }
+  if (offset != payloadSize) {
+    return false;
+  }
+
+  const size_t first = records.size();
+  records.resize(first + samples);
+  EncodedRecord *out = &records[first];
+  memset(out, 0, samples * sizeof(EncodedRecord));
+
+  BitReader timestamps(columns[0], columnSizes[0]);
+  BitReader masks(columns[1], columnSizes[1]);
+  uint64_t timestamp = 0;
+  int64_t delta = 0;
+  uint32_t mask = 0;
+  for (size_t s = 0; s < samples; s++) {
+    if (s == 0) {
+      timestamp = timestamps.read(64);
+      mask = masks.read(32);
+    } else {
+      uint64_t dod = 0;
+      if (!timestamps.readBit()) {
+        dod = 0;
+      } else if (!timestamps.readBit()) {
+        dod = timestamps.read(7);
+      } else if (!timestamps.readBit()) {
+        dod = timestamps.read(9);
+      } else if (!timestamps.readBit()) {
+        dod = timestamps.read(12);
+      } else {
+        dod = timestamps.read(64);
+      }
+      delta += unzigzag(dod);
+      timestamp += delta;
+      if (masks.readBit()) {
+        mask = masks.read(32);
+      }
+    }
+    putLE(out[s].bytes, timestamp, sizeof(uint64_t));
+    putLE(out[s].bytes + sizeof(uint64_t), mask, sizeof(uint32_t));
+  }
+  bool valid = !timestamps.failed() && !masks.failed();
+
+  for (size_t i = 0; i < MEASUREMENT_COUNT && valid; i++) {
+    const MeasurementInfo &info = MEASUREMENTS[i];
+    BitReader column(columns[2 + i], columnSizes[2 + i]);
+    bool started = false;
+    uint64_t previous = 0;
+    int leading = -1;
+    int trailing = 0;
+    uint8_t age = 0;
+
+    for (size_t s = 0; s < samples; s++) {
+      const uint32_t sampleMask = getLE(out[s].bytes + sizeof(uint64_t), 4);
+      if (!(sampleMask & (1UL << info.id))) {
+        continue;
+      }
+
+      uint32_t raw;
+      if (isXorDouble(info)) {
+        previous = started ? readXor(column, previous, leading, trailing, 64)
+                           : column.read(64);
+        raw = fromDoubleBits(previous);
+      } else if (info.type == FIELD_F32) {
+        previous = started ? readXor(column, previous, leading, trailing, 32)
+                           : column.read(32);
+        raw = previous;
+      } else {
+        int64_t value = started ? slotValue(info, previous) : 0;
+        if (column.readBit()) {
+          value += unzigzag(column.readVarint());
+        }
+        raw = value;
+        previous = raw;
+      }
+      // Aggregate rows are sparse, the mask says where everything goes
+      const RowLayout layout = BinaryRecordFormat::layout(sampleMask);
+      putLE(out[s].bytes + layout.slot[i], raw, fieldSize(info.type));
+
+      if (column.readBit()) {
+        age = column.read(8);
+      }
+      out[s].bytes[layout.age[i]] = age;
+      started = true;
+    }
+    valid = !column.failed();
+  }
+
+  if (!valid) {
+    records.resize(first);
+  }
+  return valid;
+}
@@ -0,0 +1,237 @@
+#include "dataRecord.h"
+#include "timestamp.h"
+
+#include <cmath>
+#include <cstring>
+
+// The number formatting follows ArduinoJson's TextFormatter and
+// decomposeFloat, so records come out byte for byte as they did when they
+// went through a JsonDocument. Doubles that are exact floats are printed
+// with float precision, as ArduinoJson stores them as floats.
+
+static const double POSITIVE_POWERS[] = {1e1,  1e2,  1e4,   1e8,  1e16,
+                                         1e32, 1e64, 1e128, 1e256};
+static const double NEGATIVE_POWERS[] = {1e-1,  1e-2,  1e-4,   1e-8,  1e-16,
+                                         1e-32, 1e-64, 1e-128, 1e-256};
+static const double NEGATIVE_POWERS_PLUS_ONE[] = {
+    1e0, 1e-1, 1e-3, 1e-7, 1e-15, 1e-31, 1e-63, 1e-127, 1e-255};
+
+// Brings value into [1e-5, 1e7) and returns the power of ten taken out
+static int16_t normalize(double &value) {
+  int16_t powersOf10 = 0;
+  int index = 8;
+  int bit = 1 << index;
+
+  if (value >= 1e7) {
+    for (; index >= 0; index--) {
+      if (value >= POSITIVE_POWERS[index]) {
+        value *= NEGATIVE_POWERS[index];
+        powersOf10 += bit;
+      }
+      bit >>= 1;
+    }
+  }
+
+  if (value > 0 && value <= 1e-5) {
+    for (; index >= 0; index--) {
+      if (value < NEGATIVE_POWERS_PLUS_ONE[index]) {
+        value *= POSITIVE_POWERS[index];
+        powersOf10 -= bit;
+      }
+      bit >>= 1;
+    }
+  }
+
+  return powersOf10;
+}
+
+static char *writeUnsigned(char *out, uint32_t value) {
+  char digits[10];
+  int count = 0;
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+
+  while (count > 0) {
+    *out++ = digits[--count];
+  }
+  return out;
+}
+
+static char *writeInteger(char *out, int32_t value) {
+  if (value < 0) {
+    *out++ = '-';
+  }
+  return writeUnsigned(out, value < 0 ? -(uint32_t)value : value);
+}
+
+size_t formatJsonNumber(double value, char *out) {
+  char *p = out;
+  if (std::isnan(value) || std::isinf(value)) {
+    memcpy(p, "null", 4);
+    return 4;
+  }
+
+  int8_t decimalPlaces = (double)(float)value == value ? 6 : 9;
+  if (value < 0) {
+    *p++ = '-';
+    value = -value;
+  }
+
+  uint32_t maxDecimalPart = decimalPlaces == 6 ? 1000000 : 1000000000;
+  int16_t exponent = normalize(value);
+
+  uint32_t integral = (uint32_t)value;
+  for (uint32_t tmp = integral; tmp >= 10; tmp /= 10) {
+    maxDecimalPart /= 10;
+    decimalPlaces--;
+  }
+
+  double remainder = (value - (double)integral) * (double)maxDecimalPart;
+  uint32_t decimal = (uint32_t)remainder;
+  remainder = remainder - (double)decimal;
+
+  // Round half up
+  decimal += (uint32_t)(remainder * 2);
+  if (decimal >= maxDecimalPart) {
+    decimal = 0;
+    integral++;
+    if (exponent && integral >= 10) {
+      exponent++;
+      integral = 1;
+    }
+  }
+
+  while (decimal % 10 == 0 && decimalPlaces > 0) {
+    decimal /= 10;
+    decimalPlaces--;
+  }
+
+  p = writeUnsigned(p, integral);
+  if (decimalPlaces > 0) {
+    *p++ = '.';
+    for (int i = decimalPlaces - 1; i >= 0; i--) {
+      p[i] = '0' + decimal % 10;
+      decimal /= 10;
+    }
+    p += decimalPlaces;
+  }
+
+  if (exponent) {
+    *p++ = 'e';
+    p = writeInteger(p, exponent);
+  }
+
+  return p - out;
+}
+
+static constexpr uint8_t keyLength(const char *key) {
+  uint8_t length = 0;
+  while (key[length] != '\0') {
+    length++;
+  }
+  return length;
+}
+
+struct KeyLengths {
+  uint8_t length[MEASUREMENT_COUNT];
+};
+
+static constexpr KeyLengths makeKeyLengths() {
+  KeyLengths keys = {};
+  for (const auto &info : MEASUREMENTS) {
+    keys.length[info.id] = keyLength(info.key);
+  }
+  return keys;
+}
+
+// Precomputed so keys are copied without scanning for their end
+static constexpr KeyLengths KEY_LENGTHS = makeKeyLengths();
+
+// Appends to a fixed buffer, remembering if anything did not fit
+class JsonWriter {
+  char *pos_;
+  char *const end_;
+  bool overflow_ = false;
+
+public:
+  JsonWriter(char *out, size_t size) : pos_(out), end_(out + size) {}
+
+  void raw(const char *text, size_t length) {
+    if (overflow_ || (size_t)(end_ - pos_) < length) {
+      overflow_ = true;
+      return;
+    }
+    memcpy(pos_, text, length);
+    pos_ += length;
+  }
+
+  void raw(char c) { raw(&c, 1); }
+
+  void member(bool &first, MeasurementId id, double value) {
+    raw(first ? "\"" : ",\"", first ? 1 : 2);
+    first = false;
+    raw(MEASUREMENTS[id].key, KEY_LENGTHS.length[id]);
+    raw("\":", 2);
+
+    char number[MAX_JSON_NUMBER_SIZE];
+    raw(number, formatJsonNumber(value, number));
+  }
+
+  char *position() const { return pos_; }
+  bool overflowed() const { return overflow_; }
+};
+
+size_t serializeRecord(const DataRecord &record, char *out, size_t size) {
+  JsonWriter json(out, size);
+
+  char timestamp[ISO8601_SIZE];
+  const size_t timestampLength = formatIso8601(record.timestampMs, timestamp);
+  json.raw("{\"timestamp\":\"", 14);
+  json.raw(timestamp, timestampLength);
+  json.raw('"');
+
+  // Members appear in the order they were added to the JsonDocument: the
+  // gps_data object goes where its first measurement was added
+  bool gpsWritten = record.gpsData.empty();
+  for (const auto &info : MEASUREMENTS) {
+    if (!gpsWritten && record.gpsData.has(info.id)) {
+      json.raw(",\"gps_data\":{", 13);
+      bool first = true;
+      for (const auto &gps : MEASUREMENTS) {
+        if (record.gpsData.has(gps.id)) {
+          json.member(first, gps.id, record.gpsData.value(gps.id));
+        }
+      }
+      json.raw('}');
+      gpsWritten = true;
+    }
+
+    if (record.sensorData.has(info.id) && info.group != GROUP_AGGREGATE) {
+      bool first = false;
+      json.member(first, info.id, record.sensorData.value(info.id));
+    }
+  }
+
+  bool first = true;
+  for (const auto &info : MEASUREMENTS) {
+    if (record.sensorData.has(info.id) && info.group == GROUP_AGGREGATE) {
+      if (first) {
+        json.raw(",\"aggregate\":{", 14);
+      }
+      json.member(first, info.id, record.sensorData.value(info.id));
+    }
+  }
+  if (!first) {
+    json.raw('}');
+  }
+  json.raw('}');
+
+  return json.overflowed() ? 0 : json.position() - out;
+}
+
+std::string serializeRecord(const DataRecord &record) {
+  char buffer[maxSerializedRecordSize()];
+  return std::string(buffer, serializeRecord(record, buffer, sizeof(buffer)));
+}
@@ -0,0 +1,214 @@
+#include "gzipCompressor.h"
+
+#include <cstring>
+
+static const uint16_t LENGTH_BASE[] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                       11, 13, 15, 17,  19,  23,  27,  31,
+                                       35, 43, 51, 59,  67,  83,  99,  115,
+                                       131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                       1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                       4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DISTANCE_BASE[] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,
+    65,  97,  129, 193, 257, 385,  513,  769,  1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DISTANCE_EXTRA[] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                         4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                         9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t length) {
+  // Half-byte table, small enough to not matter in flash
+  static const uint32_t TABLE[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+      0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+      0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = TABLE[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = TABLE[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+static inline uint32_t hash(const uint8_t *p) {
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761U) >> (32 - GzipCompressor::HASH_BITS);
+}
+
+GzipCompressor::GzipCompressor(ByteSink sink) : sink_(sink) {
+  memset(head_, 0, sizeof(head_));
+
+  // Header: magic, deflate, no flags, no mtime, no extra flags, unknown OS
+  const uint8_t header[] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+  for (uint8_t byte : header) {
+    putByte(byte);
+  }
+
+  // A single final block with fixed Huffman codes
+  putBits(1, 1);
+  putBits(1, 2);
+}
+
+void GzipCompressor::putByte(uint8_t byte) {
+  out_[outUsed_++] = byte;
+  if (outUsed_ == OUT_BUFFER_SIZE) {
+    flushOut();
+  }
+}
+
+void GzipCompressor::flushOut() {
+  if (outUsed_ > 0 && !failed_) {
+    failed_ = !sink_(out_, outUsed_);
+    outputSize_ += outUsed_;
+  }
+  outUsed_ = 0;
+}
+
+void GzipCompressor::putBits(uint32_t value, int nBits) {
+  bitBuffer_ |= value << bitCount_;
+  bitCount_ += nBits;
+  while (bitCount_ >= 8) {
+    putByte(bitBuffer_ & 0xFF);
+    bitBuffer_ >>= 8;
+    bitCount_ -= 8;
+  }
+}
+
+void GzipCompressor::putHuffman(uint32_t code, int nBits) {
+  // Huffman codes are packed starting from their most significant bit
+  uint32_t reversed = 0;
+  for (int i = 0; i < nBits; i++) {
+    reversed = (reversed << 1) | ((code >> i) & 1);
+  }
+  putBits(reversed, nBits);
+}
+
+void GzipCompressor::putLiteral(uint8_t literal) {
+  if (literal < 144) {
+    putHuffman(0x30 + literal, 8);
+  } else {
+    putHuffman(0x190 + literal - 144, 9);
+  }
+}
+
+void GzipCompressor::putMatch(size_t length, size_t distance) {
+  int lengthCode = 0;
+  while (lengthCode < 28 && LENGTH_BASE[lengthCode + 1] <= length) {
+    lengthCode++;
+  }
+
+  int symbol = 257 + lengthCode;
+  if (symbol < 280) {
+    putHuffman(symbol - 256, 7);
+  } else {
+    putHuffman(0xC0 + symbol - 280, 8);
+  }
+  putBits(length - LENGTH_BASE[lengthCode], LENGTH_EXTRA[lengthCode]);
+
+  int distanceCode = 0;
+  while (distanceCode < 29 && DISTANCE_BASE[distanceCode + 1] <= distance) {
+    distanceCode++;
+  }
+  putHuffman(distanceCode, 5);
+  putBits(distance - DISTANCE_BASE[distanceCode],
+          DISTANCE_EXTRA[distanceCode]);
+}
+
+void GzipCompressor::slide() {
+  memmove(buffer_, buffer_ + WINDOW_SIZE, BUFFER_SIZE - WINDOW_SIZE);
+  fill_ -= WINDOW_SIZE;
+  pos_ -= WINDOW_SIZE;
+
+  for (auto &entry : head_) {
+    entry = entry > WINDOW_SIZE ? entry - WINDOW_SIZE : 0;
+  }
+}
+
+void GzipCompressor::compress(bool flush) {
+  // Without flushing keep enough lookahead for the longest match
+  const size_t end = flush ? fill_ : (fill_ > MAX_MATCH ? fill_ - MAX_MATCH : 0);
+
+  while (pos_ < end) {
+    const size_t available = fill_ - pos_;
+    if (available < MIN_MATCH) {
+      putLiteral(buffer_[pos_++]);
+      continue;
+    }
+
+    const uint32_t h = hash(buffer_ + pos_);
+    const size_t candidate = head_[h];
+    head_[h] = pos_ + 1;
+
+    size_t length = 0;
+    if (candidate > 0 && pos_ - (candidate - 1) <= WINDOW_SIZE) {
+      const uint8_t *match = buffer_ + candidate - 1;
+      const uint8_t *current = buffer_ + pos_;
+      const size_t maxLength = available < MAX_MATCH ? available : MAX_MATCH;
+      while (length < maxLength && match[length] == current[length]) {
+        length++;
+      }
+    }
+
+    if (length < MIN_MATCH) {
+      putLiteral(buffer_[pos_++]);
+      continue;
+    }
+
+    putMatch(length, pos_ - (candidate - 1));
+
+    // Index the positions inside the match as well, while cheap to do
+    const size_t matchEnd = pos_ + length;
+    for (pos_++; pos_ < matchEnd; pos_++) {
+      if (fill_ - pos_ >= MIN_MATCH) {
+        head_[hash(buffer_ + pos_)] = pos_ + 1;
+      }
+    }
+  }
+}
+
+bool GzipCompressor::write(const char *data, size_t length) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+  crc_ = crc32Update(crc_, bytes, length);
+  inputSize_ += length;
+
+  while (length > 0 && !failed_) {
+    if (fill_ == BUFFER_SIZE) {
+      slide();
+    }
+
+    size_t n = BUFFER_SIZE - fill_ < length ? BUFFER_SIZE - fill_ : length;
+    memcpy(buffer_ + fill_, bytes, n);
+    fill_ += n;
+    bytes += n;
+    length -= n;
+
+    compress(false);
+  }
+
+  return !failed_;
+}
+
+bool GzipCompressor::finish() {
+  compress(true);
+
+  // End of block, then pad to a byte boundary
+  putHuffman(0, 7);
+  if (bitCount_ > 0) {
+    putBits(0, 8 - bitCount_);
+  }
+
+  for (uint32_t value : {crc_, inputSize_}) {
+    for (int i = 0; i < 4; i++) {
+      putByte((value >> (8 * i)) & 0xFF);
+    }
+  }
+
+  flushOut();
+  return !failed_;
+}
+
+uint32_t GzipCompressor::inputSize() const { return inputSize_; }
+
+size_t GzipCompressor::outputSize() const { return outputSize_; }
@@ -0,0 +1,69 @@
+#include "httpSession.h"
+
+HttpSession::HttpSession(int timeoutMs)
+    : TIMEOUT_MS(timeoutMs), plainClient_(stats_), secureClient_(stats_) {
+  secureClient_.setInsecure();
+  secureClient_.setSession(&tlsSession_);
+}
+
+bool HttpSession::begin(const std::string &baseUrl) {
+  close();
+  client_ = &plainClient_;
+  host_.clear();
+
+  size_t hostStart = baseUrl.find("://");
+  if (hostStart == std::string::npos) {
+    return false;
+  }
+
+  std::string scheme = baseUrl.substr(0, hostStart);
+  hostStart += 3;
+  if (scheme == "https") {
+    client_ = &secureClient_;
+    port_ = 443;
+  } else if (scheme == "http") {
+    client_ = &plainClient_;
+    port_ = 80;
+  } else {
+    return false;
+  }
+
+  size_t pathStart = baseUrl.find('/', hostStart);
+  basePath_ = pathStart == std::string::npos ? "" : baseUrl.substr(pathStart);
+  if (!basePath_.empty() && basePath_.back() == '/') {
+    basePath_.pop_back();
+  }
+  host_ = baseUrl.substr(hostStart, pathStart - hostStart);
+
+  size_t portStart = host_.find(':');
+  if (portStart != std::string::npos) {
+    port_ = std::stoi(host_.substr(portStart + 1));
+    host_ = host_.substr(0, portStart);
+  }
+
+  return true;
+}
+
+std::string HttpSession::hostHeader() const {
+  const uint16_t defaultPort = client_ == &secureClient_ ? 443 : 80;
+  if (port_ == defaultPort) {
+    return host_;
+  }
+  return host_ + ":" + std::to_string(port_);
+}
+
+bool HttpSession::connect() {
+  if (host_.empty()) {
+    return false;
+  }
+
+  stats_.requests++;
+  if (client_->connected()) {
+    return true;
+  }
+
+  client_->setTimeout(TIMEOUT_MS);
+  return client_->connect(host_.c_str(), port_);
+}
+
+void HttpSession::close() { client_->stop(); }
@@ -0,0 +1,158 @@
+#include "instrumentation.h"
+#include "logger.h"
+
+#if BIKESENSE_INSTRUMENTATION
+
+static const char *const TIMING_NAMES[TIMING_POINT_COUNT] = {
+    "gps_update",
+    "save_data",
+    "store",
+    "upload_batch",
+    "idle",
+};
+
+uint32_t LatencyHistogram::percentileUs(uint32_t percent) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  const uint64_t rank = ((uint64_t)count_ * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+    seen += buckets_[bucket];
+    if (seen >= rank) {
+      const uint32_t upper = bucket == 0 ? 0 : (1UL << bucket) - 1;
+      return upper < maxUs_ ? upper : maxUs_;
+    }
+  }
+  return maxUs_;
+}
+
+uint32_t Instruments::activeBasisPoints() const {
+  uint64_t activeUs = 0;
+  for (const auto &histogram : loops_) {
+    activeUs += histogram.totalUs();
+  }
+  const uint64_t totalUs = activeUs + timings_[TIMING_IDLE].totalUs();
+  return totalUs > 0 ? activeUs * 10000 / totalUs : 0;
+}
+
+void Instruments::sampleHeap() {
+  const int used = rp2040.getUsedHeap();
+  if (used > 0 && (uint32_t)used > heapPeak_) {
+    heapPeak_ = used;
+  }
+}
+
+void Instruments::reset(const InstrumentCounters &counters) {
+  for (auto &histogram : loops_) {
+    histogram.reset();
+  }
+  for (auto &histogram : timings_) {
+    histogram.reset();
+  }
+  for (auto &histogram : sensorReads_) {
+    histogram.reset();
+  }
+  heapPeak_ = 0;
+  baseline_ = counters;
+}
+
+InstrumentCounters
+Instruments::since(const InstrumentCounters &counters) const {
+  InstrumentCounters delta;
+  delta.droppedSamples = counters.droppedSamples - baseline_.droppedSamples;
+  delta.droppedLogs = counters.droppedLogs - baseline_.droppedLogs;
+  delta.gpsChecksumFailures =
+      counters.gpsChecksumFailures - baseline_.gpsChecksumFailures;
+  delta.gpsOverruns = counters.gpsOverruns - baseline_.gpsOverruns;
+  return delta;
+}
+
+static void logHistogram(const char *name, const LatencyHistogram &histogram) {
+  if (histogram.count() == 0) {
+    return;
+  }
+  LOGI(LOG_TIMING_STATS, name, histogram.count(), histogram.meanUs(),
+       histogram.percentileUs(99), histogram.maxUs());
+}
+
+void Instruments::log(const InstrumentCounters &counters,
+                      const char *const *stateNames, size_t stateCount) const {
+  for (size_t state = 0; state < stateCount && state < MAX_STATES; state++) {
+    logHistogram(stateNames[state], loops_[state]);
+  }
+  for (size_t point = 0; point < TIMING_POINT_COUNT; point++) {
+    logHistogram(TIMING_NAMES[point], timings_[point]);
+  }
+  for (size_t sensor = 0; sensor < MAX_SENSORS; sensor++) {
+    char name[16];
+    snprintf(name, sizeof(name), "sensor_%u", (unsigned)sensor);
+    logHistogram(name, sensorReads_[sensor]);
+  }
+
+  const InstrumentCounters delta = since(counters);
+  LOGI(LOG_COUNTER_STATS, delta.droppedSamples, delta.droppedLogs,
+       delta.gpsChecksumFailures, delta.gpsOverruns);
+  const uint32_t active = activeBasisPoints();
+  LOGI(LOG_ACTIVE_TIME, active / 100, active / 10 % 10, active % 10,
+       timings_[TIMING_IDLE].count());
+  if (heapPeak_ > 0) {
+    LOGI(LOG_HEAP_PEAK, heapPeak_);
+  }
+}
+
+static void appendHistogram(std::string &out, bool &first, const char *name,
+                            const LatencyHistogram &histogram) {
+  if (histogram.count() == 0) {
+    return;
+  }
+  char entry[96];
+  snprintf(entry, sizeof(entry), "%s\"%s\":[%lu,%lu,%lu,%lu]",
+           first ? "" : ",", name, (unsigned long)histogram.count(),
+           (unsigned long)histogram.meanUs(),
+           (unsigned long)histogram.percentileUs(99),
+           (unsigned long)histogram.maxUs());
+  out += entry;
+  first = false;
+}
+
+void Instruments::writeSummary(const InstrumentCounters &counters,
+                               const char *const *stateNames,
+                               size_t stateCount, std::string &out) const {
+  // Each timing is [calls, mean us, p99 us, max us]
+  out += "{\"trip_summary\":{\"timings_us\":{";
+  bool first = true;
+  for (size_t state = 0; state < stateCount && state < MAX_STATES; state++) {
+    appendHistogram(out, first, stateNames[state], loops_[state]);
+  }
+  for (size_t point = 0; point < TIMING_POINT_COUNT; point++) {
+    appendHistogram(out, first, TIMING_NAMES[point], timings_[point]);
+  }
+  for (size_t sensor = 0; sensor < MAX_SENSORS; sensor++) {
+    char name[16];
+    snprintf(name, sizeof(name), "sensor_%u", (unsigned)sensor);
+    appendHistogram(out, first, name, sensorReads_[sensor]);
+  }
+
+  const InstrumentCounters delta = since(counters);
+  const uint32_t active = activeBasisPoints();
+  char tail[192];
+  snprintf(tail, sizeof(tail),
+           "},\"active_percent\":%lu.%02lu,\"dropped_samples\":%lu,"
+           "\"dropped_logs\":%lu,\"gps_checksum_failures\":%lu,"
+           "\"gps_overruns\":%lu,\"heap_peak\":%lu}}",
+           (unsigned long)(active / 100), (unsigned long)(active % 100),
+           (unsigned long)delta.droppedSamples,
+           (unsigned long)delta.droppedLogs,
+           (unsigned long)delta.gpsChecksumFailures,
+           (unsigned long)delta.gpsOverruns, (unsigned long)heapPeak_);
+  out += tail;
+}
+
+Instruments &instruments() {
+  static Instruments instance;
+  return instance;
+}
+
+#endif
@@ -27,6 +27,6 @@ SensorReading LightSensor::read() {
   }
 
   return SensorReading()
-      .addMeasurement("luminosity", SI1145.ReadVisible()) // Visible light in lm
-      .addMeasurement("uv_level", (float)SI1145.ReadUV() / 100);
+      .addMeasurement(LUMINOSITY, SI1145.ReadVisible()) // Visible light in lm
+      .addMeasurement(UV_LEVEL, (float)SI1145.ReadUV() / 100);
 }
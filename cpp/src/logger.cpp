@@ -0,0 +1,111 @@
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+
+static const uint8_t MAGIC[] = {'B', 'S', 'L', '1'};
+static const char *LEVEL_NAMES[] = {"DEBUG", "INFO", "ERROR"};
+
+Logger &logger() {
+  static Logger instance;
+  return instance;
+}
+
+void Logger::push(const LogEntry &entry) {
+#ifdef ARDUINO_ARCH_RP2040
+  queues_[rp2040.cpuid()].push(entry);
+#else
+  std::lock_guard<std::mutex> lock(pushMutex_);
+  queues_[0].push(entry);
+#endif
+}
+
+size_t Logger::drain(LogEntry *entries, size_t maxEntries) {
+  size_t count = 0;
+  for (auto &queue : queues_) {
+    while (count < maxEntries && queue.pop(entries[count])) {
+      count++;
+    }
+  }
+  return count;
+}
+
+uint32_t Logger::dropped() const {
+  return queues_[0].dropped() + queues_[1].dropped();
+}
+
+const std::vector<uint8_t> &Logger::fileHeader() {
+  static std::vector<uint8_t> header;
+  if (!header.empty()) {
+    return header;
+  }
+
+  header.insert(header.end(), MAGIC, MAGIC + sizeof(MAGIC));
+  header.push_back(FILE_VERSION);
+  header.push_back(sizeof(LogEntry));
+  header.push_back(LOG_MESSAGE_COUNT & 0xFF);
+  header.push_back(LOG_MESSAGE_COUNT >> 8);
+
+  for (const auto &info : LOG_MESSAGES) {
+    const size_t length = strlen(info.format);
+    header.push_back(length);
+    header.insert(header.end(), info.format, info.format + length);
+  }
+
+  return header;
+}
+
+size_t formatLogEntry(const LogEntry &entry, char *buffer, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+
+  const char *level =
+      entry.level < LOG_LEVEL_NONE ? LEVEL_NAMES[entry.level] : "?";
+  int used = snprintf(buffer, size, "[%lu] [%s] ",
+                      (unsigned long)entry.timeMs, level);
+  size_t length = std::min<size_t>(std::max(used, 0), size - 1);
+
+  if (entry.message >= LOG_MESSAGE_COUNT) {
+    used = snprintf(buffer + length, size - length, "Unknown message %u",
+                    (unsigned)entry.message);
+    return std::min<size_t>(length + std::max(used, 0), size - 1);
+  }
+
+  size_t arg = 0;
+  for (const char *p = LOG_MESSAGES[entry.message].format;
+       *p != '\0' && length < size - 1; p++) {
+    if (*p != '%' || p[1] == '\0') {
+      buffer[length++] = *p;
+      continue;
+    }
+
+    char number[12];
+    const char *text = number;
+    const uint32_t value = arg < entry.argCount ? entry.args[arg] : 0;
+    switch (*++p) {
+    case 'd':
+      snprintf(number, sizeof(number), "%ld", (long)(int32_t)value);
+      arg++;
+      break;
+    case 'u':
+      snprintf(number, sizeof(number), "%lu", (unsigned long)value);
+      arg++;
+      break;
+    case 's':
+      text = entry.text;
+      break;
+    default:
+      number[0] = *p;
+      number[1] = '\0';
+      break;
+    }
+
+    while (*text != '\0' && length < size - 1) {
+      buffer[length++] = *text++;
+    }
+  }
+
+  buffer[length] = '\0';
+  return length;
+}
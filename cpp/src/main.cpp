@@ -8,6 +8,7 @@
 #include <mock.h>
 #include <noise.h>
 #include <sdCard.h>
+#include <ubxGps.h>
 
 #define SERIAL_BAUD 115200
 
@@ -22,6 +23,13 @@
 
 // #define LOCAL_TEST_MODE
 
+// Talk UBX to a u-blox 7 or newer receiver for 5 Hz fixes instead of NMEA
+// #define UBX_GPS
+
+// Upload from the second core, streaming each trip in one request, while
+// the first one keeps sampling
+// #define DUAL_CORE_UPLOAD
+
 #ifndef LOCAL_TEST_MODE
 #define API_ENDPOINT "http://10.227.103.175:8080/api/v1"
 #define API_TOKEN "NotARealToken"
@@ -46,20 +54,51 @@ void loop() {
   pico_get_unique_board_id_string(id, ID_LEN);
   digitalWrite(LED_BUILTIN, HIGH);
 
-  BikeSenseBuilder()
-      .addSensor(new MockSensor())
+  // BikeSense keeps references into the builder, so it has to stay alive
+  BikeSenseBuilder builder;
+  builder.addSensor(new MockSensor())
       .addSensor(new NoiseSensor())
       .addSensor(new LightSensor())
       .addSensor(new TempHumiditySensor())
+#ifdef UBX_GPS
+      .addGps(new UbxGps(5))
+#else
       .addGps(new Gps())
-      .addDataStorage(new SDCard())
+#endif
+      .addDataStorage(new SDCard(BINARY_RECORDS))
       .addLed(new InfoLed())
       .whoAmI(BIKE_CODE, id)
       .withApiConfig(API_TOKEN, API_ENDPOINT)
+#ifdef DUAL_CORE_UPLOAD
+      .withUploadMode(STREAMED_UPLOAD)
+      .withDualCore(true)
+#endif
+      // Noise stays raw, these barely move between fixes
+      .withAggregation(TEMPERATURE, 30000)
+      .withAggregation(HUMIDITY, 30000)
+      // GPS noise is a few metres, anything closer to the path is redundant
+      .withTrajectoryTolerance(5)
       .addNetwork(STASSID_DEFAULT, STAPSK_DEFAULT)
 #ifdef LOCAL_TEST_MODE
       .addNetwork(STASSID_TEST, STAPSK_TEST)
 #endif
-      .build()
-      .run();
+      ;
+
+  BikeSense *bikeSense = new BikeSense(builder.build());
+
+  // Core 1 runs the uploader or the storage writes on the same instance
+  rp2040.fifo.push(reinterpret_cast<uintptr_t>(bikeSense));
+  bikeSense->run();
+}
+
+void setup1() {}
+
+void loop1() {
+  uintptr_t instance = rp2040.fifo.pop();
+  BikeSense *bikeSense = reinterpret_cast<BikeSense *>(instance);
+#ifdef DUAL_CORE_UPLOAD
+  bikeSense->runUploader();
+#else
+  bikeSense->runDrainer();
+#endif
 }
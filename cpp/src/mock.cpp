@@ -7,33 +7,37 @@ void MockSensor::setup() { Serial.println("Mock sensor is setting up..."); }
 
 SensorReading MockSensor::read() {
   return SensorReading()
-      .addMeasurement("carbon_monoxide_level", 6)
-      .addMeasurement("polution_particles_ppm", 7);
+      .addMeasurement(CARBON_MONOXIDE_LEVEL, 6)
+      .addMeasurement(POLUTION_PARTICLES_PPM, 7);
 }
 
 void MockGps::setup() { Serial.println("Mock GPS is setting up..."); }
 
 SensorReading MockGps::read() {
   return SensorReading()
-      .addMeasurement("latitude", 8)
-      .addMeasurement("longitude", 9)
-      .addMeasurement("altitude", 10)
-      .addMeasurement("speed", 11)
-      .addMeasurement("course", 12)
-      .addMeasurement("satellites_in_use", 13)
-      .addMeasurement("fix_type", 14)
-      .addMeasurement("hdop", 15)
-      .addMeasurement("vdop", 16)
-      .addMeasurement("pdop", 17);
+      .addMeasurement(LATITUDE, 8)
+      .addMeasurement(LONGITUDE, 9)
+      .addMeasurement(ALTITUDE, 10)
+      .addMeasurement(SPEED, 11)
+      .addMeasurement(COURSE, 12)
+      .addMeasurement(SATELLITES_IN_USE, 13)
+      .addMeasurement(FIX_TYPE, 14)
+      .addMeasurement(HDOP, 15)
+      .addMeasurement(VDOP, 16)
+      .addMeasurement(PDOP, 17);
 }
 
+// 2024-01-01T00:00:00Z plus the time since boot
+uint64_t MockGps::timestampMs() { return 1704067200000ULL + millis(); }
+
 bool MockDataStorage::setup() {
   Serial.println("Mock data storage is setting up...");
   readings_ = std::vector<std::string>();
   return true;
 }
 
-bool MockDataStorage::store(const std::string reading) {
+bool MockDataStorage::store(const DataRecord &record) {
+  const std::string reading = serializeRecord(record);
   if (readings_.size() > 10) {
     readings_.erase(readings_.begin());
   }
@@ -42,17 +46,17 @@ bool MockDataStorage::store(const std::string reading) {
   return true;
 }
 
-retrievedData MockDataStorage::retrieve(int batchSize) {
-  if (readings_.size() == 0) {
-    return std::nullopt;
-  }
+bool MockDataStorage::openCursor() {
+  cursor_ = 0;
+  return true;
+}
 
-  std::vector<std::string> result;
-  for (int i = 0; i < batchSize; i++) {
-    if (readings_.size() > 0) {
-      result.push_back(readings_.back());
-      readings_.pop_back();
-    }
+bool MockDataStorage::nextBatch(int batchSize, RecordBatch &batch) {
+  batch.clear();
+  for (int i = 0; i < batchSize && cursor_ < readings_.size(); i++) {
+    batch.push_back(readings_[cursor_++]);
   }
-  return result;
+  return !batch.empty();
 }
+
+void MockDataStorage::closeCursor() {}
@@ -1,19 +1,34 @@
-#include "pico/time.h"
 #include <Arduino.h>
 #include <noise.h>
 #include <sensorReading.h>
 
-void NoiseSensor::setup() { pinMode(PIN, INPUT); }
+NoiseSensor::NoiseSensor(uint32_t leqWindowMs)
+    : LEQ_WINDOW_MS(leqWindowMs), capture_(PIN, SAMPLE_RATE_HZ),
+      leq_(SAMPLE_RATE_HZ * leqWindowMs / 1000) {}
 
-SensorReading NoiseSensor::read() {
-  for (int i = 0; i < mvAvgWindowSize; i++) {
-    mvAvgAccumulator += analogRead(PIN);
-    sleep_us(250);
+void NoiseSensor::setup() {
+  if (!capture_.begin()) {
+    Serial.println("Failed to start noise sensor capture");
   }
+}
 
-  int adcReading = mvAvgAccumulator / mvAvgWindowSize - ADC_BIAS;
-  int deltaDB = 20 * log10(adcReading / noiseADCReference);
-  int noiseDB = noiseDBReference + deltaDB;
+void NoiseSensor::update() {
+  // Blocks come in every 16ms, so this only does work now and then
+  const uint16_t *block;
+  while ((block = capture_.nextBlock()) != nullptr) {
+    leq_.addBlock(block, AdcCapture::BLOCK_SIZE);
+    if (leq_.windowComplete()) {
+      levelCentiDb_ = leq_.takeLeqCentiDb();
+      hasLevel_ = true;
+    }
+  }
+}
+
+SensorReading NoiseSensor::read() {
+  if (!hasLevel_) {
+    return SensorReading();
+  }
 
-  return SensorReading().addMeasurement("noise_level", noiseDB);
+  return SensorReading().addMeasurement(
+      NOISE_LEVEL, (levelCentiDb_ + CALIBRATION_CENTI_DB) / 100.0);
 }
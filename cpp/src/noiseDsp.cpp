@@ -0,0 +1,70 @@
+#include "noiseDsp.h"
+
+// log2(1 + i / 32) in Q16.16
+static const uint32_t LOG2_TABLE[33] = {
+    0,     2909,  5732,  8473,  11136, 13727, 16248, 18704, 21098,
+    23433, 25711, 27936, 30109, 32234, 34312, 36346, 38336, 40286,
+    42196, 44068, 45904, 47705, 49472, 51207, 52911, 54584, 56229,
+    57845, 59434, 60997, 62534, 64047, 65536};
+
+uint64_t blockEnergy(const uint16_t *samples, size_t count) {
+  if (count == 0) {
+    return 0;
+  }
+
+  // 12 bit samples, so squares fit in 32 bits
+  uint32_t sum = 0;
+  uint64_t sumSquares = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint32_t sample = samples[i];
+    sum += sample;
+    sumSquares += sample * sample;
+  }
+
+  // sum((x - mean)^2) = sum(x^2) - sum(x)^2 / n
+  const uint64_t dc = (uint64_t)sum * sum / count;
+  return sumSquares > dc ? sumSquares - dc : 0;
+}
+
+int32_t log2Q16(uint64_t x) {
+  int msb = 63;
+  while (!(x >> msb)) {
+    msb--;
+  }
+
+  // Top 16 bits below the leading one are the fraction
+  const uint32_t fraction =
+      msb >= 16 ? (uint32_t)(x >> (msb - 16)) & 0xFFFF
+                : (uint32_t)(x << (16 - msb)) & 0xFFFF;
+
+  // Interpolate between table entries, the table has 5 bits of index
+  const uint32_t index = fraction >> 11;
+  const uint32_t weight = fraction & 0x7FF;
+  const uint32_t interpolated =
+      LOG2_TABLE[index] +
+      (((LOG2_TABLE[index + 1] - LOG2_TABLE[index]) * weight) >> 11);
+
+  return (msb << 16) + interpolated;
+}
+
+int32_t energyToCentiDb(uint64_t energy, uint32_t samples) {
+  if (energy == 0 || samples == 0) {
+    return 0;
+  }
+
+  // 10 * log10(x) = 3.0103 * log2(x)
+  const int64_t log2Ratio = (int64_t)log2Q16(energy) - log2Q16(samples);
+  return (int32_t)((log2Ratio * 30103 / 100 + (1 << 15)) >> 16);
+}
+
+void LeqMeter::addBlock(const uint16_t *samples, size_t count) {
+  energy_ += blockEnergy(samples, count);
+  samples_ += count;
+}
+
+int32_t LeqMeter::takeLeqCentiDb() {
+  const int32_t level = energyToCentiDb(energy_, samples_);
+  energy_ = 0;
+  samples_ = 0;
+  return level;
+}
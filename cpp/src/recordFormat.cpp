@@ -0,0 +1,173 @@
+#include "recordFormat.h"
+
+#include <cmath>
+#include <cstring>
+
+static const char MAGIC[BinaryRecordFormat::MAGIC_SIZE] = {'B', 'S', 'R',
+                                                            '1'};
+
+static void putLE(uint8_t *&out, uint32_t value, int nBytes) {
+  for (int i = 0; i < nBytes; i++) {
+    *out++ = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+static uint32_t getLE(const uint8_t *&in, int nBytes) {
+  uint32_t value = 0;
+  for (int i = 0; i < nBytes; i++) {
+    value |= (uint32_t)(*in++) << (8 * i);
+  }
+  return value;
+}
+
+static void putString(std::vector<uint8_t> &out, const char *str) {
+  size_t len = strlen(str);
+  out.push_back(len);
+  out.insert(out.end(), str, str + len);
+}
+
+const std::vector<uint8_t> &BinaryRecordFormat::header() {
+  static std::vector<uint8_t> header;
+  if (!header.empty()) {
+    return header;
+  }
+
+  header.insert(header.end(), MAGIC, MAGIC + MAGIC_SIZE);
+  header.push_back(VERSION);
+  header.push_back(MEASUREMENT_COUNT);
+  header.push_back(recordSize() & 0xFF);
+  header.push_back(recordSize() >> 8);
+  appendFields(header);
+
+  return header;
+}
+
+void BinaryRecordFormat::appendFields(std::vector<uint8_t> &out) {
+  for (const auto &info : MEASUREMENTS) {
+    out.push_back(info.id);
+    out.push_back(info.group);
+    out.push_back(info.type);
+    out.push_back((uint8_t)info.scale);
+    putString(out, info.key);
+    putString(out, info.unit);
+  }
+}
+
+static RowLayout computeLayout(uint32_t mask) {
+  const bool sparse = BinaryRecordFormat::isSparse(mask);
+  RowLayout layout = {};
+  size_t offset = BinaryRecordFormat::ROW_HEADER_SIZE;
+  for (const auto &info : MEASUREMENTS) {
+    if (sparse ? (mask & (1UL << info.id)) : info.group != GROUP_AGGREGATE) {
+      layout.slot[info.id] = offset;
+      offset += fieldSize(info.type);
+    }
+  }
+  for (const auto &info : MEASUREMENTS) {
+    if (layout.slot[info.id] != 0) {
+      layout.age[info.id] = offset++;
+    }
+  }
+  layout.size = offset;
+  return layout;
+}
+
+RowLayout BinaryRecordFormat::layout(uint32_t mask) {
+  static const RowLayout dense = computeLayout(0);
+  return isSparse(mask) ? computeLayout(mask) : dense;
+}
+
+void BinaryRecordFormat::encode(const DataRecord &record, uint8_t *out) {
+  const SensorReading values = record.gpsData + record.sensorData;
+  uint32_t mask = values.presence();
+  for (const auto &info : MEASUREMENTS) {
+    if (values.has(info.id) && std::isnan(values.value(info.id))) {
+      mask &= ~(1UL << info.id);
+    }
+  }
+
+  // Sensor measurements a sparse row has no room for, last ones first
+  RowLayout row = layout(mask);
+  for (int id = MEASUREMENT_COUNT - 1; id >= 0 && row.size > recordSize();
+       id--) {
+    if (MEASUREMENTS[id].group == GROUP_SENSOR && (mask & (1UL << id))) {
+      mask &= ~(1UL << id);
+      row = layout(mask);
+    }
+  }
+
+  memset(out, 0, recordSize());
+  uint8_t *header = out;
+  putLE(header, record.timestampMs & 0xFFFFFFFF, 4);
+  putLE(header, record.timestampMs >> 32, 4);
+  putLE(header, mask, 4);
+
+  for (const auto &info : MEASUREMENTS) {
+    if (!(mask & (1UL << info.id))) {
+      continue;
+    }
+    uint8_t *slot = out + row.slot[info.id];
+    const int size = fieldSize(info.type);
+
+    const uint32_t age = (values.age(info.id) + AGE_UNIT_MS / 2) / AGE_UNIT_MS;
+    out[row.age[info.id]] = age > UINT8_MAX ? UINT8_MAX : age;
+
+    if (info.type == FIELD_F32) {
+      float f = values.value(info.id);
+      uint32_t bits;
+      memcpy(&bits, &f, sizeof(bits));
+      putLE(slot, bits, size);
+      continue;
+    }
+
+    double scaled =
+        std::round(values.value(info.id) * std::pow(10.0, -info.scale));
+    switch (info.type) {
+    case FIELD_U8:
+      scaled = std::fmin(std::fmax(scaled, 0), UINT8_MAX);
+      break;
+    case FIELD_U16:
+      scaled = std::fmin(std::fmax(scaled, 0), UINT16_MAX);
+      break;
+    default:
+      scaled = std::fmin(std::fmax(scaled, INT32_MIN), INT32_MAX);
+      break;
+    }
+    putLE(slot, (uint32_t)(int32_t)scaled, size);
+  }
+}
+
+DataRecord BinaryRecordFormat::decode(const uint8_t *in) {
+  DataRecord record;
+  const uint8_t *row = in;
+  record.timestampMs = getLE(in, 4);
+  record.timestampMs |= (uint64_t)getLE(in, 4) << 32;
+  const uint32_t mask = getLE(in, 4);
+  const RowLayout layout = BinaryRecordFormat::layout(mask);
+
+  for (const auto &info : MEASUREMENTS) {
+    if (!(mask & (1UL << info.id))) {
+      continue;
+    }
+    const uint8_t *slot = row + layout.slot[info.id];
+    const uint32_t raw = getLE(slot, fieldSize(info.type));
+
+    double value;
+    if (info.type == FIELD_F32) {
+      float f;
+      memcpy(&f, &raw, sizeof(f));
+      value = f;
+    } else if (info.type == FIELD_I32) {
+      value = (int32_t)raw / std::pow(10.0, -info.scale);
+    } else {
+      value = raw / std::pow(10.0, -info.scale);
+    }
+
+    SensorReading &target =
+        info.group == GROUP_GPS ? record.gpsData : record.sensorData;
+    target.addMeasurement(info.id, value);
+    target.setAge(info.id, row[layout.age[info.id]] * AGE_UNIT_MS);
+  }
+
+  return record;
+}
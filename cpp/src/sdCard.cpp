@@ -1,7 +1,23 @@
 #include "sdCard.h"
+#include "columnarFormat.h"
+#include "recordFormat.h"
 #include <SD.h>
 #include <SPI.h>
 
+#include <algorithm>
+#include <cstdio>
+
+// Indexed by StorageFormat
+static const char *const EXTENSIONS[] = {".txt", ".bin", ".bsc"};
+// Single data files of older firmware, picked up as segments
+static const char *const DATAFILES[] = {"Bikesense.txt", "Bikesense.bin",
+                                        "Bikesense.bsc"};
+static const char *const UPLOADFILES[] = {
+    "Bikesense_upload.txt", "Bikesense_upload.bin", "Bikesense_upload.bsc"};
+
+SDCard::SDCard(StorageFormat format, FlushPolicy flushPolicy)
+    : FORMAT(format), dataWriter_(flushPolicy), logWriter_(flushPolicy) {}
+
 bool SDCard::setup() {
   SPI.setRX(MISO_);
   SPI.setTX(MOSI_);
@@ -12,119 +28,791 @@ bool SDCard::setup() {
     return false;
   }
 
-  // TODO: is this right?
-  File logFile = SD.open(DATAFILE, FILE_WRITE);
+  if (!setupLogFile()) {
+    return false;
+  }
+
+  if (!loadManifest() || !openSegment() || !logWriter_.open(LOGFILE)) {
+    Serial.println("Error opening data files for writing!");
+    return false;
+  }
+
+  return true;
+}
+
+bool SDCard::setupLogFile() {
+  const std::vector<uint8_t> &header = Logger::fileHeader();
+
+  File logFile = SD.open(LOGFILE, FILE_WRITE);
   if (!logFile) {
     Serial.println("Error opening log file!");
     return false;
   }
 
-  if (logFile.size() > LOGFILE_MAX_SIZE && !logFile.truncate(0)) {
-    Serial.println("Error truncating log file!");
-    logFile.close();
-    return false;
+  // Logs from a firmware with other messages can't be expanded with this
+  // header, they are dropped along with logs over the size limit
+  std::vector<uint8_t> fileHeader(header.size());
+  bool matches = logFile.size() >= header.size() &&
+                 logFile.seek(0) &&
+                 logFile.read(fileHeader.data(), fileHeader.size()) ==
+                     (int)fileHeader.size() &&
+                 fileHeader == header;
+
+  if (!matches || logFile.size() > LOGFILE_MAX_SIZE) {
+    if (!logFile.truncate(0) || !logFile.seek(0) ||
+        logFile.write(header.data(), header.size()) != header.size()) {
+      Serial.println("Error truncating log file!");
+      logFile.close();
+      return false;
+    }
   }
 
   logFile.close();
-
   return true;
 }
 
-bool SDCard::store(const std::string data) {
-  File f = SD.open(DATAFILE, FILE_WRITE);
-  if (f) {
-    f.println(data.c_str());
-    Serial.println("Data stored successfully");
-  } else {
-    Serial.println("Error opening file for writing");
+const std::vector<uint8_t> &SDCard::fileHeader(StorageFormat format) {
+  return format == COLUMNAR_BLOCKS ? ColumnarRecordFormat::header()
+                                   : BinaryRecordFormat::header();
+}
+
+bool SDCard::hasCurrentHeader(File &f, StorageFormat format) {
+  const std::vector<uint8_t> &header = fileHeader(format);
+  std::vector<uint8_t> fileHeader(header.size());
+  return f.read(fileHeader.data(), fileHeader.size()) ==
+             (int)fileHeader.size() &&
+         fileHeader == header;
+}
+
+bool SDCard::setupBinaryDataFile(const char *path) {
+  const std::vector<uint8_t> &header = fileHeader(FORMAT);
+
+  File f = SD.open(path, FILE_READ);
+  if (f && f.size() > 0) {
+    bool matches = hasCurrentHeader(f, FORMAT);
+    f.close();
+    if (matches) {
+      return true;
+    }
+
+    // Written by a firmware with a different schema, keep it for the host
+    // decoder and start a new file
+    Serial.println("Data file schema mismatch, moving it aside");
+    if (!moveAside(path, FORMAT)) {
+      Serial.println("Error moving old data file!");
+      return false;
+    }
+  } else if (f) {
+    f.close();
+  }
+
+  f = SD.open(path, FILE_WRITE);
+  if (!f) {
+    Serial.println("Error creating data file!");
     return false;
   }
+  f.write(header.data(), header.size());
   f.close();
+
   return true;
 }
 
-retrievedData SDCard::retrieve(int batchSize) {
-  File f = SD.open(DATAFILE, FILE_READ);
-  if (!f) {
-    return std::nullopt;
+bool SDCard::moveAside(const char *path, StorageFormat format) {
+  // Every schema change leaves one more, none of them was uploaded
+  for (uint32_t n = 1;; n++) {
+    const std::string oldPath =
+        OLD_DATAFILE_PREFIX + std::to_string(n) + EXTENSIONS[format];
+    if (!SD.exists(oldPath.c_str())) {
+      return SD.rename(path, oldPath.c_str());
+    }
+  }
+}
+
+std::string SDCard::segmentPath(const Segment &segment) const {
+  return SEGMENT_PREFIX + std::to_string(segment.id) +
+         EXTENSIONS[segment.format];
+}
+
+size_t SDCard::emptySegmentSize(StorageFormat format) {
+  return format == JSON_LINES ? 0 : fileHeader(format).size();
+}
+
+bool SDCard::loadManifest() {
+  segments_.clear();
+
+  std::string manifest;
+  const bool listed = readFile(MANIFEST, manifest, MAX_MANIFEST_SIZE);
+  if (listed) {
+    for (const char *line = manifest.c_str(); *line != '\0';) {
+      unsigned long id, records, seq, offset;
+      int state, tripId, pending;
+      // Manifests without the format only listed segments of this one
+      int format = FORMAT;
+      if (sscanf(line, "%lu %d %lu %d %lu %lu %d %d", &id, &state, &records,
+                 &tripId, &seq, &offset, &pending, &format) >= 7 &&
+          state >= SEGMENT_OPEN && state <= SEGMENT_UPLOADING &&
+          format >= JSON_LINES && format <= COLUMNAR_BLOCKS) {
+        Segment segment = {(uint32_t)id, (SegmentState)state, (uint32_t)records,
+                           {tripId, (uint32_t)seq, (uint32_t)offset, pending},
+                           (StorageFormat)format};
+        segments_.push_back(segment);
+        nextSegmentId_ = std::max<uint32_t>(nextSegmentId_, id + 1);
+      }
+
+      const char *newline = strchr(line, '\n');
+      if (newline == nullptr) {
+        break;
+      }
+      line = newline + 1;
+    }
+  }
+  adoptSegmentFiles();
+
+  // Single files of older firmware, whatever format this one writes. The
+  // baseline one wrote JSON lines whatever it was built with. Upload files
+  // were cut off before the data files and go out first.
+  for (const char *const *legacy : {UPLOADFILES, DATAFILES}) {
+    for (int format = JSON_LINES; format <= COLUMNAR_BLOCKS; format++) {
+      Segment segment = {nextSegmentId_, SEGMENT_SEALED, 0, {},
+                         (StorageFormat)format};
+      if (SD.exists(legacy[format]) &&
+          SD.rename(legacy[format], segmentPath(segment).c_str())) {
+        segments_.push_back(segment);
+        nextSegmentId_++;
+      }
+    }
+  }
+
+  // Only the newest segment can still be written to, and only if it is in
+  // the format written now
+  for (auto &segment : segments_) {
+    if (segment.state == SEGMENT_OPEN &&
+        (&segment != &segments_.back() || segment.format != FORMAT)) {
+      segment.state = SEGMENT_SEALED;
+    }
   }
+  if (segments_.empty() || segments_.back().state != SEGMENT_OPEN) {
+    segments_.push_back({nextSegmentId_++, SEGMENT_OPEN, 0, {}, FORMAT});
+  }
+
+  return writeManifest();
+}
 
-  if (f.position() >= f.size()) {
-    lastReadPosition_ = 0;
-    this->logInfo("End of file reached, resetting read position");
-    return std::nullopt;
+// A manifest lost or left behind by a reset doesn't list every segment on
+// the card, the ones it misses still have to be uploaded
+void SDCard::adoptSegmentFiles() {
+  File root = SD.open("/");
+  if (!root || !root.isDirectory()) {
+    return;
   }
 
-  if (f.size() == 0) {
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    const std::string name = f.name();
+    const bool directory = f.isDirectory();
     f.close();
-    lastReadPosition_ = 0;
-    return std::nullopt;
+
+    const size_t prefix = strlen(SEGMENT_PREFIX);
+    if (directory || name.compare(0, prefix, SEGMENT_PREFIX) != 0) {
+      continue;
+    }
+    // Segments written in another format are uploaded all the same, their
+    // extension tells how to read them
+    Segment segment = {(uint32_t)strtoul(name.c_str() + prefix, nullptr, 10),
+                       SEGMENT_SEALED, 0, {}, JSON_LINES};
+    while (name != segmentPath(segment) && segment.format < COLUMNAR_BLOCKS) {
+      segment.format = (StorageFormat)(segment.format + 1);
+    }
+    if (name != segmentPath(segment)) {
+      LOGE(LOG_SEGMENT_FILE_UNKNOWN, name.c_str());
+      continue;
+    }
+    const bool known = std::any_of(
+        segments_.begin(), segments_.end(),
+        [&segment](const Segment &s) { return s.id == segment.id; });
+    if (!known) {
+      LOGE(LOG_SEGMENT_ADOPTED, (unsigned)segment.id);
+      segments_.push_back(segment);
+      nextSegmentId_ = std::max<uint32_t>(nextSegmentId_, segment.id + 1);
+    }
+  }
+  root.close();
+
+  std::sort(segments_.begin(), segments_.end(),
+            [](const Segment &a, const Segment &b) { return a.id < b.id; });
+}
+
+bool SDCard::writeManifest() {
+  std::string manifest;
+  for (const auto &segment : segments_) {
+    char line[64];
+    snprintf(line, sizeof(line), "%lu %d %lu %d %lu %lu %d %d\n",
+             (unsigned long)segment.id, segment.state,
+             (unsigned long)segment.records, segment.progress.tripId,
+             (unsigned long)segment.progress.seq,
+             (unsigned long)segment.progress.offset, segment.progress.pending,
+             segment.format);
+    manifest += line;
+  }
+
+  if (!writeFileAtomically(MANIFEST, manifest)) {
+    LOGE(LOG_MANIFEST_FAILED);
+    return false;
+  }
+  return true;
+}
+
+bool SDCard::openSegment() {
+  Segment &segment = segments_.back();
+  openPath_ = segmentPath(segment);
+
+  if (FORMAT != JSON_LINES && !setupBinaryDataFile(openPath_.c_str())) {
+    return false;
+  }
+  if (FORMAT == COLUMNAR_BLOCKS) {
+    // A block cut off by a reset would hide the ones appended after it
+    File f = SD.open(openPath_.c_str(), FILE_READ);
+    size_t end = 0;
+    segment.records = f ? scanBlocks(f, end) : 0;
+    const size_t size = f ? f.size() : 0;
+    f.close();
+    if (end < size) {
+      LOGE(LOG_BLOCK_TRUNCATED, size - end, segment.id);
+      f = SD.open(openPath_.c_str(), FILE_WRITE);
+      if (!f || !f.truncate(end)) {
+        Serial.println("Error truncating data file!");
+        return false;
+      }
+      f.close();
+    }
+  }
+  if (!dataWriter_.open(openPath_.c_str())) {
+    return false;
+  }
+
+  // Counts are only written with the manifest, binary ones can be redone
+  if (FORMAT == BINARY_RECORDS) {
+    segment.records = (dataWriter_.size() - emptySegmentSize(FORMAT)) /
+                      BinaryRecordFormat::recordSize();
+  }
+  return true;
+}
+
+Segment *SDCard::cursorSegment() {
+  for (auto &segment : segments_) {
+    if (segment.id == cursorSegment_ && segment.state != SEGMENT_OPEN) {
+      return &segment;
+    }
+  }
+  return nullptr;
+}
+
+bool SDCard::store(const DataRecord &record) {
+  bool stored;
+  if (FORMAT == BINARY_RECORDS) {
+    uint8_t encoded[BinaryRecordFormat::recordSize()];
+    BinaryRecordFormat::encode(record, encoded);
+    stored = dataWriter_.write(encoded, sizeof(encoded));
+  } else if (FORMAT == COLUMNAR_BLOCKS) {
+    uint8_t encoded[BinaryRecordFormat::recordSize()];
+    BinaryRecordFormat::encode(record, encoded);
+    stored = storeColumnar(encoded);
+  } else {
+    char line[maxSerializedRecordSize() + 1];
+    size_t length = serializeRecord(record, line, sizeof(line) - 1);
+    line[length++] = '\n';
+    stored = dataWriter_.write(line, length);
+  }
+
+  if (!stored) {
+    Serial.println("Error writing to data file");
+    return false;
+  }
+
+  segments_.back().records++;
+  Serial.println("Data stored successfully");
+  return true;
+}
+
+bool SDCard::storeEncoded(const EncodedRecord *records, size_t count) {
+  if (FORMAT == JSON_LINES) {
+    return DataStorageInterface::storeEncoded(records, count);
+  }
+
+  if (FORMAT == COLUMNAR_BLOCKS) {
+    bool stored = true;
+    for (size_t i = 0; i < count; i++) {
+      stored &= storeColumnar(records[i].bytes);
+    }
+    segments_.back().records += count;
+    return stored;
+  }
+
+  if (count == 0) {
+    return true;
+  }
+
+  if (!dataWriter_.write(records[0].bytes, count * sizeof(EncodedRecord))) {
+    Serial.println("Error writing to data file");
+    return false;
+  }
+
+  segments_.back().records += count;
+  return true;
+}
+
+bool SDCard::storeColumnar(const uint8_t *record) {
+  return !encoder_.add(record) || writeBlock();
+}
+
+bool SDCard::writeBlock() {
+  if (encoder_.samples() == 0) {
+    return true;
+  }
+
+  blockBuffer_.clear();
+  encoder_.finishBlock(blockBuffer_);
+  if (!dataWriter_.write(blockBuffer_.data(), blockBuffer_.size())) {
+    Serial.println("Error writing to data file");
+    return false;
+  }
+  return true;
+}
+
+uint32_t SDCard::scanBlocks(File &f, size_t &end) {
+  uint32_t records = 0;
+  uint8_t header[ColumnarRecordFormat::BLOCK_HEADER_SIZE];
+  size_t samples;
+  size_t payloadSize;
+
+  end = fileHeader(COLUMNAR_BLOCKS).size();
+  while (f.seek(end) && f.read(header, sizeof(header)) == sizeof(header) &&
+         ColumnarRecordFormat::blockInfo(header, samples, payloadSize) &&
+         end + sizeof(header) + payloadSize <= f.size()) {
+    end += sizeof(header) + payloadSize;
+    records += samples;
+  }
+  return records;
+}
+
+bool SDCard::seal() {
+  // The last block goes into the segment being sealed, even if it's short
+  writeBlock();
+  if (dataWriter_.size() <= emptySegmentSize(FORMAT)) {
+    return dataWriter_.sync();
+  }
+
+  if (segments_.size() >= MAX_SEGMENTS) {
+    LOGE(LOG_SEGMENT_LIMIT, segments_.back().id);
+    return dataWriter_.sync();
+  }
+
+  // The manifest goes first, a reset before the new file exists only leaves
+  // it to be created at boot
+  dataWriter_.close();
+  segments_.back().state = SEGMENT_SEALED;
+  segments_.push_back({nextSegmentId_++, SEGMENT_OPEN, 0, {}, FORMAT});
+  if (!writeManifest()) {
+    LOGE(LOG_SEAL_FAILED);
+    segments_.pop_back();
+    segments_.back().state = SEGMENT_OPEN;
+    openSegment();
+    return false;
   }
 
-  f.seek(lastReadPosition_);
-  std::vector<std::string> data;
-  for (int i = 0; i < batchSize; i++) {
-    if (f.available()) {
-      data.push_back(f.readStringUntil('\n').c_str());
+  return openSegment();
+}
+
+bool SDCard::openCursor() {
+  closeCursor();
+
+  while (segments_.size() > 1) {
+    Segment &segment = segments_.front();
+    const std::string path = segmentPath(segment);
+    const size_t emptySize = emptySegmentSize(segment.format);
+
+    readFile_ = SD.open(path.c_str(), FILE_READ);
+    if (readFile_ && readFile_.size() > emptySize &&
+        (segment.format == JSON_LINES ||
+         hasCurrentHeader(readFile_, segment.format))) {
+      if (segment.format == BINARY_RECORDS) {
+        segment.records = (readFile_.size() - emptySize) /
+                          BinaryRecordFormat::recordSize();
+      } else if (segment.format == COLUMNAR_BLOCKS) {
+        size_t end;
+        segment.records = scanBlocks(readFile_, end);
+        readFile_.seek(emptySize);
+      }
+
+      readStart_ = 0;
+      readEnd_ = 0;
+      discardLine_ = false;
+      decoded_.clear();
+      decodedNext_ = 0;
+      cursorOpen_ = true;
+      cursorSegment_ = segment.id;
+      cursorFormat_ = segment.format;
+      LOGI(LOG_SEGMENT_OPENED, segment.id, segment.records);
+      return true;
+    }
+
+    // Empty, gone, or written by a firmware with a different schema. The
+    // latter is kept for the host decoder.
+    if (readFile_) {
+      const bool empty = readFile_.size() <= emptySize;
+      readFile_.close();
+      if (empty) {
+        SD.remove(path.c_str());
+      } else {
+        LOGE(LOG_SEGMENT_UNREADABLE, segment.id);
+        moveAside(path.c_str(), segment.format);
+      }
     } else {
+      LOGE(LOG_SEGMENT_UNREADABLE, segment.id);
+    }
+    segments_.erase(segments_.begin());
+    writeManifest();
+  }
+
+  return false;
+}
+
+void SDCard::closeCursor() {
+  if (cursorOpen_) {
+    readFile_.close();
+    cursorOpen_ = false;
+    // A decoded block is several kB, only kept while uploading
+    decoded_.clear();
+    decoded_.shrink_to_fit();
+  }
+}
+
+size_t SDCard::cursorPosition() {
+  if (!cursorOpen_) {
+    return 0;
+  }
+
+  if (cursorFormat_ == COLUMNAR_BLOCKS) {
+    if (decodedNext_ < decoded_.size()) {
+      return decodedStart_ << POSITION_INDEX_BITS | decodedNext_;
+    }
+    return readFile_.position() << POSITION_INDEX_BITS;
+  }
+
+  // Binary batches are decoded into the buffer, nothing read ahead is left
+  if (cursorFormat_ == BINARY_RECORDS) {
+    return readFile_.position();
+  }
+  return readFile_.position() - (readEnd_ - readStart_);
+}
+
+bool SDCard::seekCursor(size_t position) {
+  if (cursorOpen_ && cursorFormat_ == COLUMNAR_BLOCKS) {
+    const size_t offset = position >> POSITION_INDEX_BITS;
+    const size_t index = position & ((1 << POSITION_INDEX_BITS) - 1);
+    if (offset < emptySegmentSize(COLUMNAR_BLOCKS) ||
+        offset > readFile_.size() || !readFile_.seek(offset)) {
+      return false;
+    }
+    decoded_.clear();
+    decodedNext_ = 0;
+    if (index > 0 && (!readBlock() || index > decoded_.size())) {
+      return false;
+    }
+    decodedNext_ = index;
+    return true;
+  }
+
+  if (!cursorOpen_ || position > readFile_.size()) {
+    return false;
+  }
+
+  if (cursorFormat_ == BINARY_RECORDS) {
+    const size_t headerSize = BinaryRecordFormat::header().size();
+    if (position < headerSize ||
+        (position - headerSize) % BinaryRecordFormat::recordSize() != 0) {
+      return false;
+    }
+  }
+
+  if (!readFile_.seek(position)) {
+    return false;
+  }
+  readStart_ = 0;
+  readEnd_ = 0;
+  discardLine_ = false;
+  return true;
+}
+
+bool SDCard::fillReadBuffer() {
+  if (readStart_ > 0) {
+    memmove(readBuffer_, readBuffer_ + readStart_, readEnd_ - readStart_);
+    readEnd_ -= readStart_;
+    readStart_ = 0;
+  }
+
+  if (readEnd_ == READ_BUFFER_SIZE) {
+    // A single line filled the whole buffer, it can't be a valid record
+    LOGE(LOG_RECORD_TOO_LONG);
+    discardLine_ = true;
+    readEnd_ = 0;
+  }
+
+  int n = readFile_.read(reinterpret_cast<uint8_t *>(readBuffer_) + readEnd_,
+                         READ_BUFFER_SIZE - readEnd_);
+  if (n <= 0) {
+    return false;
+  }
+
+  readEnd_ += n;
+  return true;
+}
+
+bool SDCard::nextBatch(int batchSize, RecordBatch &batch) {
+  batch.clear();
+  if (!cursorOpen_) {
+    return false;
+  }
+
+  if (cursorFormat_ == BINARY_RECORDS) {
+    return nextBinaryBatch(batchSize, batch);
+  }
+  if (cursorFormat_ == COLUMNAR_BLOCKS) {
+    return nextColumnarBatch(batchSize, batch);
+  }
+
+  // Views handed out by the previous batch are no longer in use
+  fillReadBuffer();
+
+  while ((int)batch.size() < batchSize) {
+    char *start = readBuffer_ + readStart_;
+    char *newline = (char *)memchr(start, '\n', readEnd_ - readStart_);
+
+    if (newline == nullptr) {
+      // Refilling moves the buffer contents, so stop at what we have
+      if (!batch.empty() || !fillReadBuffer()) {
+        break;
+      }
+      continue;
+    }
+
+    size_t length = newline - start;
+    readStart_ += length + 1;
+    if (length > 0 && start[length - 1] == '\r') {
+      length--;
+    }
+
+    if (discardLine_) {
+      discardLine_ = false;
+    } else if (length > 0) {
+      batch.emplace_back(start, length);
+    }
+  }
+
+  return !batch.empty();
+}
+
+bool SDCard::nextBinaryBatch(int batchSize, RecordBatch &batch) {
+  uint8_t encoded[BinaryRecordFormat::recordSize()];
+  readEnd_ = 0;
+
+  while ((int)batch.size() < batchSize) {
+    size_t position = readFile_.position();
+    if (readFile_.read(encoded, sizeof(encoded)) != (int)sizeof(encoded)) {
+      readFile_.seek(position);
+      break;
+    }
+
+    const size_t length =
+        serializeRecord(BinaryRecordFormat::decode(encoded),
+                        readBuffer_ + readEnd_, READ_BUFFER_SIZE - readEnd_);
+    if (length == 0) {
+      readFile_.seek(position);
       break;
     }
+
+    batch.emplace_back(readBuffer_ + readEnd_, length);
+    readEnd_ += length;
+  }
+
+  return !batch.empty();
+}
+
+bool SDCard::readBlock() {
+  decoded_.clear();
+  decodedNext_ = 0;
+  decodedStart_ = readFile_.position();
+
+  uint8_t header[ColumnarRecordFormat::BLOCK_HEADER_SIZE];
+  const int n = readFile_.read(header, sizeof(header));
+  if (n <= 0) {
+    return false;
   }
 
-  if (data.empty()) {
-    return std::nullopt;
+  size_t samples;
+  size_t payloadSize;
+  bool valid = n == sizeof(header) &&
+               ColumnarRecordFormat::blockInfo(header, samples, payloadSize);
+  if (valid) {
+    blockBuffer_.resize(payloadSize);
+    valid = readFile_.read(blockBuffer_.data(), payloadSize) ==
+                (int)payloadSize &&
+            ColumnarRecordFormat::decodeBlock(blockBuffer_.data(), payloadSize,
+                                              samples, decoded_);
   }
 
-  lastReadPosition_ = f.position();
-  f.close();
-  return data;
+  if (!valid) {
+    // Whatever follows can't be found without the block's size, the
+    // segment ends here
+    LOGE(LOG_BLOCK_CORRUPT, decodedStart_, cursorSegment_);
+    readFile_.seek(decodedStart_);
+  }
+  return valid;
+}
+
+bool SDCard::nextColumnarBatch(int batchSize, RecordBatch &batch) {
+  readEnd_ = 0;
+
+  while ((int)batch.size() < batchSize) {
+    if (decodedNext_ == decoded_.size() && !readBlock()) {
+      break;
+    }
+
+    const size_t length = serializeRecord(
+        BinaryRecordFormat::decode(decoded_[decodedNext_].bytes),
+        readBuffer_ + readEnd_, READ_BUFFER_SIZE - readEnd_);
+    if (length == 0) {
+      break;
+    }
+
+    batch.emplace_back(readBuffer_ + readEnd_, length);
+    readEnd_ += length;
+    decodedNext_++;
+  }
+
+  return !batch.empty();
 }
 
 bool SDCard::clear() {
-  if (SD.exists(DATAFILE)) {
-    SD.remove(DATAFILE);
-    return true;
+  closeCursor();
+
+  Segment *segment = cursorSegment();
+  if (segment == nullptr) {
+    return false;
   }
 
-  return false;
+  // A reset before the manifest is written leaves a missing segment, which
+  // openCursor drops
+  SD.remove(segmentPath(*segment).c_str());
+  segments_.erase(segments_.begin() + (segment - segments_.data()));
+  cursorSegment_ = 0;
+  return writeManifest();
 }
 
-bool SDCard::logInfo(const std::string message) {
-  std::string infoMsg =
-      "[" + std::to_string(millis()) + "] " + "[INFO] " + message;
-  Serial.println(infoMsg.c_str());
+bool SDCard::saveProgress(const UploadCheckpoint &checkpoint) {
+  Segment *segment = cursorSegment();
+  if (segment == nullptr) {
+    return false;
+  }
+
+  segment->progress = checkpoint;
+  segment->state =
+      checkpoint.tripId == -1 ? SEGMENT_SEALED : SEGMENT_UPLOADING;
+  return writeManifest();
+}
+
+bool SDCard::loadProgress(UploadCheckpoint &checkpoint) {
+  Segment *segment = cursorSegment();
+  if (segment == nullptr || segment->state != SEGMENT_UPLOADING) {
+    return false;
+  }
+
+  checkpoint = segment->progress;
+  return true;
+}
 
-  return log(infoMsg);
+bool SDCard::sync() {
+  // Short blocks cost some compression, but nothing stored is left in RAM
+  bool blockWritten = writeBlock();
+  bool dataSynced = dataWriter_.sync();
+  bool logSynced = logWriter_.sync();
+  return blockWritten && dataSynced && logSynced;
 }
 
-bool SDCard::logInfo(const std::string message, const std::string timestamp) {
-  std::string infoMsg = "[" + std::to_string(millis()) + "] [" + timestamp +
-                        "] [INFO] " + message;
-  return logInfo(infoMsg);
+bool SDCard::poll() {
+  // A columnar block still being filled is not the writer's, it is only
+  // written once full or on sync
+  bool dataSynced = dataWriter_.poll();
+  bool logSynced = logWriter_.poll();
+  return dataSynced && logSynced;
 }
 
-bool SDCard::logError(const std::string message) {
-  std::string errorMsg =
-      "[" + std::to_string(millis()) + "] " + "[ERROR] " + message;
-  Serial.println(errorMsg.c_str());
+bool SDCard::storeLogs(const LogEntry *entries, size_t count) {
+  bool stored = logWriter_.write(reinterpret_cast<const uint8_t *>(entries),
+                                 count * sizeof(LogEntry));
 
-  return log(errorMsg);
+  // Errors often precede a reboot, make sure they reach the card
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].level == LOG_LEVEL_ERROR) {
+      return logWriter_.sync() && stored;
+    }
+  }
+  return stored;
 }
 
-bool SDCard::logError(const std::string message, const std::string timestamp) {
-  std::string errorMsg = "[" + std::to_string(millis()) + "] [" + timestamp +
-                         "] [ERROR] " + message;
-  return logError(errorMsg);
+std::string SDCard::stateFile(const std::string &name) const {
+  return "Bikesense_" + name + ".state";
 }
 
-bool SDCard::log(const std::string message) {
-  Serial.println(message.c_str());
+bool SDCard::writeFileAtomically(const std::string &path,
+                                 const std::string &data) {
+  // Written next to the old file and swapped in, so a reset halfway
+  // through leaves one of the two readable
+  const std::string newPath = path + ".new";
 
-  File f = SD.open(LOGFILE, FILE_WRITE);
+  SD.remove(newPath.c_str());
+  File f = SD.open(newPath.c_str(), FILE_WRITE);
   if (!f) {
     return false;
   }
-  f.println(message.c_str());
+  bool written =
+      f.write((const uint8_t *)data.data(), data.size()) == data.size();
   f.close();
+  if (!written) {
+    // The old file is still whole, keep it
+    SD.remove(newPath.c_str());
+    return false;
+  }
+
+  SD.remove(path.c_str());
+  return SD.rename(newPath.c_str(), path.c_str());
+}
+
+bool SDCard::readFile(const std::string &path, std::string &data,
+                      size_t maxSize) {
+  File f = SD.open(path.c_str(), FILE_READ);
+  if (!f) {
+    // Reset between removing the old file and renaming the new one
+    f = SD.open((path + ".new").c_str(), FILE_READ);
+  }
+  if (!f) {
+    return false;
+  }
+
+  data.resize(std::min<size_t>(f.size(), maxSize));
+  int length = f.read((uint8_t *)&data[0], data.size());
+  f.close();
+  if (length < 0) {
+    return false;
+  }
+
+  data.resize(length);
   return true;
 }
+
+bool SDCard::saveState(const std::string &name, const std::string &value) {
+  return writeFileAtomically(stateFile(name), value);
+}
+
+bool SDCard::loadState(const std::string &name, std::string &value) {
+  return readFile(stateFile(name), value, MAX_STATE_SIZE);
+}
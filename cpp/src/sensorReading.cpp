@@ -1,49 +1,35 @@
 #include "sensorReading.h"
 
-SensorReading::SensorReading() {
-  measurements_ = std::unordered_map<std::string, double>();
-}
-
-SensorReading::SensorReading(
-    std::unordered_map<std::string, double> measurements) {
-  measurements_ = measurements;
-}
-
-SensorReading &SensorReading::addMeasurement(const std::string &measurementName,
-                                             double value) {
-  this->measurements_[measurementName] = value;
-  return *this;
-}
-
-const std::unordered_map<std::string, double> &
-SensorReading::getMeasurements() const {
-  return this->measurements_;
+std::optional<double> SensorReading::getMeasurement(MeasurementId id) const {
+  if (has(id)) {
+    return values_[id];
+  }
+  return std::nullopt;
 }
 
-std::optional<double>
-SensorReading::getMeasurement(const std::string &measurementName) const {
-  // The find method returns an iterator to the element if it is found,
-  // otherwise it returns an iterator to the end of the container
-  auto it = measurements_.find(measurementName);
-  if (it != measurements_.end()) {
-    return it->second;
+void SensorReading::setAge(uint32_t ageMs) {
+  for (int id = 0; id < MEASUREMENT_COUNT; id++) {
+    if (present_ & (1UL << id)) {
+      setAge((MeasurementId)id, ageMs);
+    }
   }
-  return std::nullopt;
 }
 
 SensorReading SensorReading::operator+(const SensorReading &other) const {
-  std::unordered_map<std::string, double> merged_measurements(measurements_);
-  // Insert all measurements from other, overwriting if keys exist
-  for (const auto &[measurementName, value] : other.measurements_) {
-    merged_measurements[measurementName] = value;
-  }
-  return SensorReading(merged_measurements);
+  SensorReading merged(*this);
+  merged += other;
+  return merged;
 }
 
 SensorReading &SensorReading::operator+=(const SensorReading &other) {
-  // Insert all measurements from other, overwriting if keys exist
-  for (const auto &[measurementName, value] : other.measurements_) {
-    measurements_[measurementName] = value;
+  // Take all measurements from other, overwriting if they exist
+  uint32_t remaining = other.present_;
+  for (int id = 0; remaining != 0; id++, remaining >>= 1) {
+    if (remaining & 1) {
+      values_[id] = other.values_[id];
+      ageMs_[id] = other.ageMs_[id];
+    }
   }
+  present_ |= other.present_;
   return *this;
 }
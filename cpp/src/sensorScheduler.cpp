@@ -0,0 +1,98 @@
+#include "sensorScheduler.h"
+#include "instrumentation.h"
+
+#include <algorithm>
+
+// True if time a is at or after time b, correct across millis() wrap around
+static bool reached(uint32_t a, uint32_t b) { return (int32_t)(a - b) >= 0; }
+
+SensorScheduler::SensorScheduler(const std::vector<SensorInterface *> &sensors,
+                                 Clock clock)
+    : CLOCK(clock) {
+  for (auto sensor : sensors) {
+    Channel channel;
+    channel.sensor = sensor;
+    channel.periodMs = sensor->periodMs();
+    channel.deadlineMs = sensor->deadlineMs();
+    channels_.push_back(channel);
+  }
+}
+
+void SensorScheduler::start() {
+  const uint32_t now = CLOCK();
+  for (auto &channel : channels_) {
+    channel.nextDueMs = now;
+  }
+}
+
+const SensorReading *SensorScheduler::poll() {
+  const uint32_t now = CLOCK();
+  Channel *next = nullptr;
+
+  for (auto &channel : channels_) {
+    channel.sensor->update();
+
+    if (!reached(now, channel.nextDueMs)) {
+      continue;
+    }
+    if (next == nullptr ||
+        reached(next->nextDueMs + next->deadlineMs,
+                channel.nextDueMs + channel.deadlineMs + 1)) {
+      next = &channel;
+    }
+  }
+
+  if (next == nullptr) {
+    return nullptr;
+  }
+
+  if (!reached(next->nextDueMs + next->deadlineMs, now)) {
+    deadlineMisses_++;
+  }
+
+  TIMING_START(readTiming, instruments().sensorRead(next - channels_.data()));
+  next->latest = next->sensor->read();
+  TIMING_STOP(readTiming);
+  next->lastReadMs = now;
+  next->hasReading = true;
+
+  // Keep the cadence, unless we fell a whole period behind
+  next->nextDueMs += next->periodMs;
+  if (reached(now, next->nextDueMs)) {
+    next->nextDueMs = now + next->periodMs;
+  }
+
+  return &next->latest;
+}
+
+uint32_t SensorScheduler::msUntilDue() const {
+  const uint32_t now = CLOCK();
+  uint32_t wait = UINT32_MAX;
+
+  for (const auto &channel : channels_) {
+    if (reached(now, channel.nextDueMs)) {
+      return 0;
+    }
+    wait = std::min(wait, channel.nextDueMs - now);
+  }
+
+  return wait;
+}
+
+SensorReading SensorScheduler::snapshot() const {
+  const uint32_t now = CLOCK();
+  SensorReading merged;
+
+  for (const auto &channel : channels_) {
+    const uint32_t age = now - channel.lastReadMs;
+    if (!channel.hasReading || age > channel.periodMs + channel.deadlineMs) {
+      continue;
+    }
+
+    SensorReading reading = channel.latest;
+    reading.setAge(age);
+    merged += reading;
+  }
+
+  return merged;
+}
@@ -12,11 +12,11 @@ SensorReading TempHumiditySensor::read() {
   dht.humidity().getEvent(&humidityEvent);
 
   if (!isnan(tempEvent.temperature)) {
-    reading.addMeasurement("temperature", tempEvent.temperature);
+    reading.addMeasurement(TEMPERATURE, tempEvent.temperature);
   }
 
   if (!isnan(humidityEvent.relative_humidity)) {
-    reading.addMeasurement("humidity", humidityEvent.relative_humidity);
+    reading.addMeasurement(HUMIDITY, humidityEvent.relative_humidity);
   }
 
   return reading;
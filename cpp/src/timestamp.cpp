@@ -0,0 +1,64 @@
+#include "timestamp.h"
+
+int32_t daysFromCivil(int y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  const int era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned yoe = (unsigned)(y - era * 400);
+  const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int32_t)doe - 719468;
+}
+
+void civilFromDays(int32_t z, int &y, unsigned &m, unsigned &d) {
+  z += 719468;
+  const int era = (z >= 0 ? z : z - 146096) / 146097;
+  const unsigned doe = (unsigned)(z - era * 146097);
+  const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned mp = (5 * doy + 2) / 153;
+  d = doy - (153 * mp + 2) / 5 + 1;
+  m = mp < 10 ? mp + 3 : mp - 9;
+  y = (int)yoe + era * 400 + (m <= 2);
+}
+
+uint64_t epochMsFromCivil(int year, unsigned month, unsigned day,
+                          unsigned hour, unsigned minute, unsigned second,
+                          unsigned millisecond) {
+  const int64_t seconds = (int64_t)daysFromCivil(year, month, day) * 86400 +
+                          hour * 3600 + minute * 60 + second;
+  return seconds * 1000 + millisecond;
+}
+
+static char *putDigits(char *out, uint32_t value, int digits) {
+  for (int i = digits - 1; i >= 0; i--) {
+    out[i] = '0' + value % 10;
+    value /= 10;
+  }
+  return out + digits;
+}
+
+size_t formatIso8601(uint64_t epochMs, char *out) {
+  // Split into days and second of day with 32-bit arithmetic where possible
+  const uint64_t epochSeconds = epochMs / 1000;
+  const int32_t days = (int32_t)(epochSeconds / 86400);
+  const uint32_t secondOfDay = (uint32_t)(epochSeconds % 86400);
+
+  int year;
+  unsigned month, day;
+  civilFromDays(days, year, month, day);
+
+  char *p = putDigits(out, year, 4);
+  *p++ = '-';
+  p = putDigits(p, month, 2);
+  *p++ = '-';
+  p = putDigits(p, day, 2);
+  *p++ = 'T';
+  p = putDigits(p, secondOfDay / 3600, 2);
+  *p++ = ':';
+  p = putDigits(p, secondOfDay / 60 % 60, 2);
+  *p++ = ':';
+  p = putDigits(p, secondOfDay % 60, 2);
+  *p++ = 'Z';
+  *p = '\0';
+  return p - out;
+}
@@ -0,0 +1,151 @@
+#include "trajectory.h"
+
+#include <cmath>
+#include <cstring>
+
+static constexpr double METRES_PER_DEGREE = 6371000.0 * M_PI / 180.0;
+
+static bool hasPosition(const SensorReading &gps) {
+  return gps.has(LATITUDE) && gps.has(LONGITUDE);
+}
+
+static float distanceToSegment(float x, float y, float endX, float endY) {
+  const float lengthSquared = endX * endX + endY * endY;
+  float t = 0;
+  if (lengthSquared > 0) {
+    t = std::fmin(std::fmax((x * endX + y * endY) / lengthSquared, 0.0f),
+                  1.0f);
+  }
+  return std::hypot(x - t * endX, y - t * endY);
+}
+
+float distanceToSegmentM(double latitude, double longitude, double aLatitude,
+                         double aLongitude, double bLatitude,
+                         double bLongitude) {
+  const double metresPerDegreeLongitude =
+      METRES_PER_DEGREE * std::cos(aLatitude * M_PI / 180.0);
+  return distanceToSegment(
+      (longitude - aLongitude) * metresPerDegreeLongitude,
+      (latitude - aLatitude) * METRES_PER_DEGREE,
+      (bLongitude - aLongitude) * metresPerDegreeLongitude,
+      (bLatitude - aLatitude) * METRES_PER_DEGREE);
+}
+
+// Levels in dB are averaged by their energy, 10 * log10 of the mean of
+// 10^(L / 10), so a loud moment isn't flattened by the quiet ones around it
+static bool isDecibels(int id) {
+  return strcmp(MEASUREMENTS[id].unit, "dB") == 0;
+}
+
+void TrajectorySimplifier::setAnchor(const SensorReading &gps) {
+  anchorLatitude_ = gps.value(LATITUDE);
+  anchorLongitude_ = gps.value(LONGITUDE);
+  metresPerDegreeLongitude_ =
+      METRES_PER_DEGREE * std::cos(anchorLatitude_ * M_PI / 180.0);
+  hasAnchor_ = true;
+  windowSize_ = 0;
+}
+
+TrajectorySimplifier::Point
+TrajectorySimplifier::project(const SensorReading &gps) const {
+  return {
+      (float)((gps.value(LONGITUDE) - anchorLongitude_) *
+              metresPerDegreeLongitude_),
+      (float)((gps.value(LATITUDE) - anchorLatitude_) * METRES_PER_DEGREE),
+  };
+}
+
+bool TrajectorySimplifier::fits(Point end) const {
+  for (size_t i = 0; i < windowSize_; i++) {
+    if (distanceToSegment(window_[i].x, window_[i].y, end.x, end.y) >
+        TOLERANCE_M) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void TrajectorySimplifier::fold(const DataRecord &fix) {
+  uint32_t remaining = fix.sensorData.presence();
+  for (int id = 0; remaining != 0; id++, remaining >>= 1) {
+    const MeasurementId measurement = (MeasurementId)id;
+    if (!(remaining & 1) || std::isnan(fix.sensorData.value(measurement))) {
+      continue;
+    }
+
+    // A sensor slower than the GPS shows up in several fixes with the same
+    // reading, count it once
+    Fold &fold = folds_[id];
+    const uint64_t readMs = fix.timestampMs - fix.sensorData.age(measurement);
+    if (fold.count > 0 && readMs == fold.readMs) {
+      continue;
+    }
+    const double value = fix.sensorData.value(measurement);
+    fold.count++;
+    fold.sum += isDecibels(id) ? std::pow(10.0, value / 10) : value;
+    fold.readMs = readMs;
+  }
+}
+
+void TrajectorySimplifier::take(DataRecord &kept) {
+  kept.timestampMs = candidate_.timestampMs;
+  kept.gpsData = candidate_.gpsData;
+  kept.sensorData = SensorReading();
+  for (int id = 0; id < MEASUREMENT_COUNT; id++) {
+    Fold &fold = folds_[id];
+    if (fold.count == 0) {
+      continue;
+    }
+    const double mean = fold.sum / fold.count;
+    kept.sensorData.addMeasurement(
+        (MeasurementId)id, isDecibels(id) ? 10 * std::log10(mean) : mean);
+    kept.sensorData.setAge((MeasurementId)id,
+                           kept.timestampMs - fold.readMs);
+    fold = Fold();
+  }
+}
+
+bool TrajectorySimplifier::add(const DataRecord &fix, DataRecord &kept) {
+  if (!enabled() || (!hasAnchor_ && hasPosition(fix.gpsData))) {
+    if (enabled()) {
+      setAnchor(fix.gpsData);
+    }
+    kept = fix;
+    return true;
+  }
+
+  // Without a position there is no shape to keep, only the readings
+  if (!hasPosition(fix.gpsData)) {
+    if (windowSize_ == 0) {
+      kept = fix;
+      return true;
+    }
+    fold(fix);
+    return false;
+  }
+
+  const Point point = project(fix.gpsData);
+  if (windowSize_ > 0 && (windowSize_ == MAX_WINDOW || !fits(point))) {
+    take(kept);
+    setAnchor(candidate_.gpsData);
+    window_[windowSize_++] = project(fix.gpsData);
+    candidate_ = fix;
+    fold(fix);
+    return true;
+  }
+
+  window_[windowSize_++] = point;
+  candidate_ = fix;
+  fold(fix);
+  return false;
+}
+
+bool TrajectorySimplifier::flush(DataRecord &kept) {
+  const bool held = windowSize_ > 0;
+  if (held) {
+    take(kept);
+  }
+  hasAnchor_ = false;
+  windowSize_ = 0;
+  return held;
+}
@@ -0,0 +1,284 @@
+#include "ubxGps.h"
+#include "timestamp.h"
+
+#include <Arduino.h>
+
+static const uint8_t SYNC_CHAR_1 = 0xB5;
+static const uint8_t SYNC_CHAR_2 = 0x62;
+
+static const uint8_t CLASS_NAV = 0x01;
+static const uint8_t NAV_DOP = 0x04;
+static const uint8_t NAV_PVT = 0x07;
+
+static const uint8_t CLASS_CFG = 0x06;
+static const uint8_t CFG_PRT = 0x00;
+static const uint8_t CFG_MSG = 0x01;
+static const uint8_t CFG_RATE = 0x08;
+
+// u-blox 7 sends 84 bytes of NAV-PVT, M8 and newer 92. Every field read
+// here is in the first 84.
+static const size_t NAV_PVT_MIN_LENGTH = 84;
+static const size_t NAV_DOP_LENGTH = 18;
+
+static uint16_t getU2(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t getU4(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static void putU2(uint8_t *p, uint16_t value) {
+  p[0] = value & 0xFF;
+  p[1] = value >> 8;
+}
+
+static void putU4(uint8_t *p, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+void UbxParser::checksum(uint8_t byte) {
+  ckA_ += byte;
+  ckB_ += ckA_;
+}
+
+bool UbxParser::feed(uint8_t byte) {
+  switch (state_) {
+  case SYNC_1:
+    if (byte == SYNC_CHAR_1) {
+      state_ = SYNC_2;
+    }
+    return false;
+
+  case SYNC_2:
+    state_ = byte == SYNC_CHAR_2   ? CLASS
+             : byte == SYNC_CHAR_1 ? SYNC_2
+                                   : SYNC_1;
+    ckA_ = ckB_ = 0;
+    return false;
+
+  case CLASS:
+    class_ = byte;
+    checksum(byte);
+    state_ = ID;
+    return false;
+
+  case ID:
+    id_ = byte;
+    checksum(byte);
+    state_ = LENGTH_1;
+    return false;
+
+  case LENGTH_1:
+    length_ = byte;
+    checksum(byte);
+    state_ = LENGTH_2;
+    return false;
+
+  case LENGTH_2:
+    length_ |= byte << 8;
+    checksum(byte);
+    received_ = 0;
+    if (length_ > MAX_PAYLOAD) {
+      // Not a message we read, resynchronize on the next frame
+      oversized_++;
+      state_ = SYNC_1;
+      return false;
+    }
+    state_ = length_ == 0 ? CHECKSUM_A : PAYLOAD;
+    return false;
+
+  case PAYLOAD:
+    payload_[received_++] = byte;
+    checksum(byte);
+    if (received_ == length_) {
+      state_ = CHECKSUM_A;
+    }
+    return false;
+
+  case CHECKSUM_A:
+    if (byte != ckA_) {
+      checksumFailures_++;
+      state_ = SYNC_1;
+      return false;
+    }
+    state_ = CHECKSUM_B;
+    return false;
+
+  case CHECKSUM_B:
+    state_ = SYNC_1;
+    if (byte != ckB_) {
+      checksumFailures_++;
+      return false;
+    }
+    frames_++;
+    return true;
+  }
+
+  return false;
+}
+
+bool decodeUbxNav(uint8_t messageClass, uint8_t messageId,
+                  const uint8_t *payload, size_t length,
+                  UbxNavSolution &solution) {
+  if (messageClass != CLASS_NAV) {
+    return false;
+  }
+
+  if (messageId == NAV_PVT && length >= NAV_PVT_MIN_LENGTH) {
+    solution.year = getU2(payload + 4);
+    solution.month = payload[6];
+    solution.day = payload[7];
+    solution.hour = payload[8];
+    solution.minute = payload[9];
+    solution.second = payload[10];
+    solution.dateValid = payload[11] & 0x01;
+    solution.timeValid = payload[11] & 0x02;
+    solution.nano = (int32_t)getU4(payload + 16);
+    solution.fixType = payload[20];
+    solution.fixOk = payload[21] & 0x01;
+    solution.satellites = payload[23];
+    solution.longitude = (int32_t)getU4(payload + 24);
+    solution.latitude = (int32_t)getU4(payload + 28);
+    solution.heightMsl = (int32_t)getU4(payload + 36);
+    solution.groundSpeed = (int32_t)getU4(payload + 60);
+    solution.heading = (int32_t)getU4(payload + 64);
+    solution.pdop = getU2(payload + 76);
+    return true;
+  }
+
+  if (messageId == NAV_DOP && length >= NAV_DOP_LENGTH) {
+    solution.vdop = getU2(payload + 10);
+    solution.hdop = getU2(payload + 12);
+    solution.hasDop = true;
+    return true;
+  }
+
+  return false;
+}
+
+// The measurement period is 1000 / NAV_RATE_HZ ms and must not be 0
+UbxGps::UbxGps(uint16_t navRateHz)
+    : NAV_RATE_HZ(navRateHz < 1 ? 1 : navRateHz > 1000 ? 1000 : navRateHz) {}
+
+void UbxGps::sendCommand(uint8_t messageClass, uint8_t messageId,
+                         const uint8_t *payload, uint16_t length) {
+  uint8_t header[6] = {SYNC_CHAR_1, SYNC_CHAR_2, messageClass, messageId};
+  putU2(header + 4, length);
+
+  uint8_t ckA = 0, ckB = 0;
+  for (int i = 2; i < 6; i++) {
+    ckA += header[i];
+    ckB += ckA;
+  }
+  for (int i = 0; i < length; i++) {
+    ckA += payload[i];
+    ckB += ckA;
+  }
+
+  Serial1.write(header, sizeof(header));
+  Serial1.write(payload, length);
+  Serial1.write(ckA);
+  Serial1.write(ckB);
+}
+
+void UbxGps::setup() {
+  Serial1.setFIFOSize(RX_BUFFER_SIZE);
+  Serial1.begin(DEFAULT_BAUD_RATE);
+
+  // UART1 at BAUD_RATE 8N1, UBX and NMEA in, UBX out
+  uint8_t port[20] = {1};
+  putU4(port + 4, 0x000008D0);
+  putU4(port + 8, BAUD_RATE);
+  putU2(port + 12, 0x0003);
+  putU2(port + 14, 0x0001);
+  sendCommand(CLASS_CFG, CFG_PRT, port, sizeof(port));
+  Serial1.flush();
+  // The receiver switches after the acknowledgement goes out
+  delay(100);
+
+  Serial1.end();
+  Serial1.begin(BAUD_RATE);
+
+  // Measurement period in ms, one solution per measurement, GPS time
+  uint8_t rate[6];
+  putU2(rate, 1000 / NAV_RATE_HZ);
+  putU2(rate + 2, 1);
+  putU2(rate + 4, 1);
+  sendCommand(CLASS_CFG, CFG_RATE, rate, sizeof(rate));
+
+  // One of each per solution on the current port
+  const uint8_t pvt[3] = {CLASS_NAV, NAV_PVT, 1};
+  sendCommand(CLASS_CFG, CFG_MSG, pvt, sizeof(pvt));
+  const uint8_t dop[3] = {CLASS_NAV, NAV_DOP, 1};
+  sendCommand(CLASS_CFG, CFG_MSG, dop, sizeof(dop));
+}
+
+void UbxGps::update() {
+  if (Serial1.overflow()) {
+    this->overruns_++;
+  }
+
+  int available = Serial1.available();
+  while (available-- > 0) {
+    if (!this->parser_.feed(Serial1.read())) {
+      continue;
+    }
+
+    const uint8_t messageId = this->parser_.messageId();
+    if (decodeUbxNav(this->parser_.messageClass(), messageId,
+                     this->parser_.payload(), this->parser_.length(),
+                     this->solution_) &&
+        messageId == NAV_PVT) {
+      this->lastSolutionMs_ = millis();
+      this->hasSolution_ = true;
+      this->updated_ = true;
+    }
+  }
+}
+
+bool UbxGps::isValid() {
+  return this->hasSolution_ && this->solution_.fixOk &&
+         this->solution_.fixType >= 2 && this->solution_.dateValid &&
+         this->solution_.timeValid;
+}
+
+bool UbxGps::isUpdated() { return this->updated_; }
+
+bool UbxGps::isOld() {
+  return millis() - this->lastSolutionMs_ > (unsigned long)MAX_READING_AGE_MS;
+}
+
+SensorReading UbxGps::read() {
+  const UbxNavSolution &s = this->solution_;
+  this->updated_ = false;
+
+  SensorReading gpsRead =
+      SensorReading()
+          .addMeasurement(LATITUDE, s.latitude / 1e7)
+          .addMeasurement(LONGITUDE, s.longitude / 1e7)
+          .addMeasurement(ALTITUDE, s.heightMsl / 1e3)
+          .addMeasurement(SPEED, s.groundSpeed * 3.6 / 1e3)
+          .addMeasurement(COURSE, s.heading / 1e5)
+          .addMeasurement(SATELLITES_IN_USE, s.satellites)
+          .addMeasurement(FIX_TYPE, s.fixType)
+          .addMeasurement(PDOP, s.pdop / 100.0);
+
+  if (s.hasDop) {
+    gpsRead.addMeasurement(HDOP, s.hdop / 100.0)
+        .addMeasurement(VDOP, s.vdop / 100.0);
+  }
+
+  return gpsRead;
+}
+
+uint64_t UbxGps::timestampMs() {
+  const UbxNavSolution &s = this->solution_;
+  // nano is the signed offset of the solution from the whole second
+  const int64_t fixMs =
+      (int64_t)epochMsFromCivil(s.year, s.month, s.day, s.hour, s.minute,
+                                s.second) +
+      s.nano / 1000000;
+  return fixMs + (millis() - this->lastSolutionMs_);
+}
@@ -0,0 +1,20 @@
+#include "wakeTimer.h"
+
+#include <Arduino.h>
+
+#ifdef ARDUINO_ARCH_RP2040
+#include <pico/time.h>
+#endif
+
+void WakeTimer::sleep() const {
+  if (waitMs_ == 0) {
+    return;
+  }
+
+#ifdef ARDUINO_ARCH_RP2040
+  // WFE with an alarm as the backstop, any interrupt wakes the core
+  best_effort_wfe_or_timeout(make_timeout_time_ms(waitMs_));
+#else
+  waitForInterrupt(waitMs_ * 1000ULL);
+#endif
+}
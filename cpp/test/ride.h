@@ -0,0 +1,136 @@
+#ifndef _TEST_RIDE_H_
+#define _TEST_RIDE_H_
+
+// Shared by the suites that run a whole device against the stand-ins in
+// lib/HostHal: a blank card, a receiver sending a fix every second and a
+// loop driven through the virtual clock.
+
+#include <bikesense.h>
+#include <gps.h>
+#include <mock.h>
+
+#include <Arduino.h>
+#include <SD.h>
+#include <WiFi.h>
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+
+static const char *const API_ENDPOINT = "http://localhost:8080/api/v1";
+
+class NullLed : public LedInterface {
+public:
+  void setup() override {}
+  void setColor(byte r, byte g, byte b) override {}
+};
+
+inline void freshCard() {
+  const std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "bikesense-test";
+  std::filesystem::remove_all(root);
+  SD.setRoot(root.string());
+  SD.begin(0);
+  SD.resetStats();
+  SD.setFlushStall(0);
+  SD.failWritesAfter(UINT64_MAX);
+}
+
+// Everything a test run shares with the previous one
+inline void resetHost() {
+  clearInterrupts();
+  Serial.setOutput(nullptr);
+  WiFi.setInRange(false);
+  loopbackServer = LoopbackServer();
+  freshCard();
+}
+
+inline void appendNmea(std::string &out, const char *body) {
+  uint8_t checksum = 0;
+  for (const char *c = body; *c != '\0'; c++) {
+    checksum ^= *c;
+  }
+  char sentence[128];
+  snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum);
+  out += sentence;
+}
+
+// GGA and RMC for the fix at the given second of a ride heading east from
+// 2024-05-01 08:00Z
+inline std::string nmeaFix(uint32_t second) {
+  const double latitude = 41.1780 + second * 2e-6;
+  const double longitude = 8.5980 - second * 5e-5; // west
+  const uint32_t timeOfDay = (8 * 3600 + second) % 86400;
+  const int hh = timeOfDay / 3600;
+  const int mm = timeOfDay / 60 % 60;
+  const int ss = timeOfDay % 60;
+
+  char lat[16];
+  char lng[16];
+  snprintf(lat, sizeof(lat), "%02d%07.4f", (int)latitude,
+           (latitude - (int)latitude) * 60);
+  snprintf(lng, sizeof(lng), "%03d%07.4f", (int)longitude,
+           (longitude - (int)longitude) * 60);
+
+  char body[112];
+  std::string out;
+  snprintf(body, sizeof(body),
+           "GPGGA,%02d%02d%02d.00,%s,N,%s,W,1,09,0.9,120.5,M,50.1,M,,", hh,
+           mm, ss, lat, lng);
+  appendNmea(out, body);
+  snprintf(body, sizeof(body),
+           "GPRMC,%02d%02d%02d.00,A,%s,N,%s,W,9.8,87.5,010524,,,A", hh, mm,
+           ss, lat, lng);
+  appendNmea(out, body);
+  return out;
+}
+
+// Sends a fix every second over Serial1 from start() on, like the receiver
+// whose UART interrupt wakes the loop
+class FixFeed {
+private:
+  unsigned long startMs_ = 0;
+  std::function<void()> send_;
+
+public:
+  uint32_t fixes = 0;
+
+  void start() {
+    startMs_ = millis();
+    send_ = [this]() {
+      const std::string fix = nmeaFix((millis() - startMs_) / 1000);
+      Serial1.inject(fix.data(), fix.size());
+      fixes++;
+      scheduleInterrupt(micros() + 1000000, send_);
+    };
+    scheduleInterrupt(micros(), send_);
+  }
+};
+
+// A device with the mock sensor and the NMEA receiver, uploading to the
+// stand-in server
+inline BikeSenseBuilder deviceBuilder(DataStorageInterface *storage) {
+  BikeSenseBuilder builder;
+  builder.addSensor(new MockSensor())
+      .addGps(new Gps())
+      .addDataStorage(storage)
+      .addLed(new NullLed())
+      .whoAmI("BSB1", "HOST")
+      .withApiConfig("HostToken", API_ENDPOINT)
+      .addNetwork("bikenet", "Bike123!");
+  return builder;
+}
+
+// Returns the number of loop iterations
+inline size_t stepFor(BikeSense &device, unsigned long ms) {
+  const unsigned long endMs = millis() + ms;
+  size_t steps = 0;
+  while (millis() < endMs) {
+    device.step();
+    steps++;
+  }
+  return steps;
+}
+
+#endif
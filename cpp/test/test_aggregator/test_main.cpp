@@ -0,0 +1,234 @@
+#include "../ride.h"
+
+#include <aggregator.h>
+
+#include <unity.h>
+
+#include <cmath>
+#include <vector>
+
+// Reads 1, 2, 3... every 250 ms
+class CountingSensor : public SensorInterface {
+public:
+  uint32_t reads = 0;
+
+  void setup() override {}
+  SensorReading read() override {
+    SensorReading reading;
+    reading.addMeasurement(TEMPERATURE, ++reads);
+    return reading;
+  }
+  uint32_t periodMs() const override { return 250; }
+};
+
+// Keeps the records the device stores, nothing to upload
+class RecordingStorage : public DataStorageInterface {
+public:
+  std::vector<DataRecord> records;
+
+  bool setup() override { return true; }
+  bool openCursor() override { return false; }
+  bool nextBatch(int batchSize, RecordBatch &batch) override { return false; }
+  void closeCursor() override {}
+  bool store(const DataRecord &record) override {
+    records.push_back(record);
+    return true;
+  }
+  bool clear() override { return true; }
+};
+
+static SensorReading reading(MeasurementId id, double value) {
+  SensorReading reading;
+  reading.addMeasurement(id, value);
+  return reading;
+}
+
+static void assertAggregate(const SensorReading &aggregate, MeasurementId id,
+                            double mean, uint32_t count, double min,
+                            double max, double stddev, double windowS) {
+  TEST_ASSERT_EQUAL_UINT32((1UL << id) | BinaryRecordFormat::aggregateMask(),
+                           aggregate.presence());
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, mean, aggregate.value(id));
+  TEST_ASSERT_EQUAL_DOUBLE(count, aggregate.value(AGGREGATE_COUNT));
+  TEST_ASSERT_EQUAL_DOUBLE(min, aggregate.value(AGGREGATE_MIN));
+  TEST_ASSERT_EQUAL_DOUBLE(max, aggregate.value(AGGREGATE_MAX));
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, stddev, aggregate.value(AGGREGATE_STDDEV));
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, windowS, aggregate.value(AGGREGATE_WINDOW));
+}
+
+void setUp() { resetHost(); }
+
+void tearDown() { clearInterrupts(); }
+
+void test_a_window_holds_the_statistics_of_its_readings() {
+  WindowedAggregator aggregator;
+  aggregator.setWindow(NOISE_LEVEL, 10000);
+  TEST_ASSERT_TRUE(aggregator.enabled());
+
+  const double values[] = {60, 62, 64, 70};
+  for (int i = 0; i < 4; i++) {
+    aggregator.add(reading(NOISE_LEVEL, values[i]), 1000 + i * 2500);
+  }
+
+  SensorReading aggregate;
+  TEST_ASSERT_FALSE(aggregator.takeClosed(10999, aggregate));
+  TEST_ASSERT_TRUE(aggregator.takeClosed(11000, aggregate));
+  // Deviations -4, -2, 0 and 6 from the mean of 64
+  assertAggregate(aggregate, NOISE_LEVEL, 64, 4, 60, 70, std::sqrt(56 / 4.0),
+                  10);
+  TEST_ASSERT_FALSE(aggregator.takeClosed(11000, aggregate));
+
+  // A single reading has no spread
+  aggregator.add(reading(NOISE_LEVEL, 58.5), 12000);
+  TEST_ASSERT_TRUE(aggregator.takeClosed(22000, aggregate));
+  assertAggregate(aggregate, NOISE_LEVEL, 58.5, 1, 58.5, 58.5, 0, 10);
+}
+
+void test_windows_end_before_the_reading_that_closes_them() {
+  WindowedAggregator aggregator;
+  aggregator.setWindow(TEMPERATURE, 10000);
+
+  // A reading every 2.5 s from 1 s on, taken in the device's order
+  std::vector<SensorReading> aggregates;
+  SensorReading aggregate;
+  for (uint32_t nowMs = 1000; nowMs <= 31000; nowMs += 2500) {
+    while (aggregator.takeClosed(nowMs, aggregate)) {
+      aggregates.push_back(aggregate);
+    }
+    aggregator.add(reading(TEMPERATURE, nowMs / 1000.0), nowMs);
+  }
+
+  // [1, 11), [11, 21) and [21, 31), four readings each
+  TEST_ASSERT_EQUAL_size_t(3, aggregates.size());
+  const double spread = std::sqrt((3.75 * 3.75 + 1.25 * 1.25) / 2);
+  assertAggregate(aggregates[0], TEMPERATURE, 4.75, 4, 1, 8.5, spread, 10);
+  assertAggregate(aggregates[1], TEMPERATURE, 14.75, 4, 11, 18.5, spread, 10);
+  assertAggregate(aggregates[2], TEMPERATURE, 24.75, 4, 21, 28.5, spread, 10);
+}
+
+void test_a_channel_without_readings_has_no_window() {
+  WindowedAggregator aggregator;
+  aggregator.setWindow(NOISE_LEVEL, 10000);
+  aggregator.setWindow(TEMPERATURE, 10000);
+
+  SensorReading both = reading(NOISE_LEVEL, 61);
+  both.addMeasurement(TEMPERATURE, NAN);
+  both.addMeasurement(HUMIDITY, 40);
+  aggregator.add(both, 0);
+  aggregator.add(reading(NOISE_LEVEL, 63), 5000);
+
+  SensorReading aggregate;
+  TEST_ASSERT_TRUE(aggregator.takeClosed(10000, aggregate));
+  assertAggregate(aggregate, NOISE_LEVEL, 62, 2, 61, 63, 1, 10);
+  TEST_ASSERT_FALSE(aggregator.takeClosed(10000, aggregate));
+
+  // Nothing during the gap, the next window starts with the next reading
+  TEST_ASSERT_FALSE(aggregator.takeClosed(40000, aggregate));
+  aggregator.add(reading(TEMPERATURE, 21.5), 43000);
+  TEST_ASSERT_FALSE(aggregator.takeClosed(52999, aggregate));
+  TEST_ASSERT_TRUE(aggregator.takeClosed(53000, aggregate));
+  assertAggregate(aggregate, TEMPERATURE, 21.5, 1, 21.5, 21.5, 0, 10);
+  TEST_ASSERT_FALSE(aggregator.takeClosed(53000, aggregate));
+}
+
+void test_raw_only_leaves_out_the_aggregated_channels() {
+  WindowedAggregator aggregator;
+  SensorReading both = reading(NOISE_LEVEL, 61);
+  both.addMeasurement(HUMIDITY, 40);
+  both.setAge(HUMIDITY, 1200);
+  TEST_ASSERT_FALSE(aggregator.enabled());
+  TEST_ASSERT_EQUAL_UINT32(both.presence(),
+                           aggregator.rawOnly(both).presence());
+
+  aggregator.setWindow(NOISE_LEVEL, 10000);
+  const SensorReading raw = aggregator.rawOnly(both);
+  TEST_ASSERT_EQUAL_UINT32(1UL << HUMIDITY, raw.presence());
+  TEST_ASSERT_EQUAL_DOUBLE(40, raw.value(HUMIDITY));
+  TEST_ASSERT_EQUAL_UINT32(1200, raw.age(HUMIDITY));
+
+  aggregator.setWindow(NOISE_LEVEL, 0);
+  TEST_ASSERT_FALSE(aggregator.enabled());
+  TEST_ASSERT_EQUAL_UINT32(both.presence(),
+                           aggregator.rawOnly(both).presence());
+}
+
+void test_a_flush_takes_every_open_window() {
+  WindowedAggregator aggregator;
+  aggregator.setWindow(NOISE_LEVEL, 10000);
+  aggregator.setWindow(TEMPERATURE, 30000);
+  aggregator.add(reading(NOISE_LEVEL, 60), 1000);
+  aggregator.add(reading(TEMPERATURE, 20), 2000);
+  aggregator.add(reading(NOISE_LEVEL, 64), 4000);
+  aggregator.add(reading(TEMPERATURE, 22), 6000);
+
+  SensorReading aggregate;
+  TEST_ASSERT_FALSE(aggregator.takeClosed(7500, aggregate));
+  TEST_ASSERT_TRUE(aggregator.takeClosed(7500, aggregate, true));
+  assertAggregate(aggregate, NOISE_LEVEL, 62, 2, 60, 64, 2, 6.5);
+  TEST_ASSERT_TRUE(aggregator.takeClosed(7500, aggregate, true));
+  assertAggregate(aggregate, TEMPERATURE, 21, 2, 20, 22, 1, 5.5);
+  TEST_ASSERT_FALSE(aggregator.takeClosed(7500, aggregate, true));
+}
+
+void test_a_ride_ends_with_the_flushed_window() {
+  CountingSensor *sensor = new CountingSensor();
+  RecordingStorage *storage = new RecordingStorage();
+  BikeSenseBuilder builder = deviceBuilder(storage);
+  builder.addSensor(sensor).withAggregation(TEMPERATURE, 2000);
+  BikeSense device = builder.build();
+  device.setup();
+  FixFeed feed;
+  feed.start();
+  stepFor(device, 10600);
+
+  // The receiver goes quiet, the fix is lost 5 s later and ends the ride
+  clearInterrupts();
+  stepFor(device, 10000);
+  const uint32_t reads = sensor->reads;
+  stepFor(device, 5000);
+  TEST_ASSERT_EQUAL_UINT32(reads, sensor->reads);
+
+  std::vector<SensorReading> aggregates;
+  for (const DataRecord &record : storage->records) {
+    if (record.sensorData.has(AGGREGATE_COUNT)) {
+      aggregates.push_back(record.sensorData);
+    } else {
+      TEST_ASSERT_FALSE(record.sensorData.has(TEMPERATURE));
+    }
+  }
+
+  // Eight readings of consecutive values per window. The last one is cut
+  // short by the fix lost at the wakeup after its last reading.
+  TEST_ASSERT_TRUE(aggregates.size() >= 3);
+  uint32_t first = 1;
+  for (size_t i = 0; i < aggregates.size(); i++) {
+    const uint32_t count = aggregates[i].value(AGGREGATE_COUNT);
+    const uint32_t last = first + count - 1;
+    const bool flushed = i == aggregates.size() - 1;
+    if (!flushed) {
+      TEST_ASSERT_EQUAL_UINT32(8, count);
+    }
+    TEST_ASSERT_EQUAL_DOUBLE((first + last) / 2.0,
+                             aggregates[i].value(TEMPERATURE));
+    TEST_ASSERT_EQUAL_DOUBLE(first, aggregates[i].value(AGGREGATE_MIN));
+    TEST_ASSERT_EQUAL_DOUBLE(last, aggregates[i].value(AGGREGATE_MAX));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3, std::sqrt((count * count - 1) / 12.0),
+                              aggregates[i].value(AGGREGATE_STDDEV));
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3, flushed ? 0.25 * count : 2,
+                              aggregates[i].value(AGGREGATE_WINDOW));
+    first = last + 1;
+  }
+  TEST_ASSERT_EQUAL_UINT32(reads, first - 1);
+  TEST_ASSERT_TRUE(aggregates.back().value(AGGREGATE_COUNT) < 8);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_a_window_holds_the_statistics_of_its_readings);
+  RUN_TEST(test_windows_end_before_the_reading_that_closes_them);
+  RUN_TEST(test_a_channel_without_readings_has_no_window);
+  RUN_TEST(test_raw_only_leaves_out_the_aggregated_channels);
+  RUN_TEST(test_a_flush_takes_every_open_window);
+  RUN_TEST(test_a_ride_ends_with_the_flushed_window);
+  return UNITY_END();
+}
@@ -0,0 +1,122 @@
+#include <bufferedWriter.h>
+
+#include <Arduino.h>
+#include <SD.h>
+#include <unity.h>
+
+#include <filesystem>
+
+static const char *PATH = "data.bin";
+
+void setUp() {
+  const std::filesystem::path root =
+      std::filesystem::temp_directory_path() / "bikesense-test";
+  std::filesystem::remove_all(root);
+  SD.setRoot(root.string());
+  SD.begin(0);
+  SD.resetStats();
+}
+
+void tearDown() {}
+
+static size_t sizeOnCard() {
+  File f = SD.open(PATH, FILE_READ);
+  return f ? f.size() : 0;
+}
+
+void test_writes_whole_sectors_only() {
+  BufferedWriter writer({100000, 100000});
+  TEST_ASSERT_TRUE(writer.open(PATH));
+
+  uint8_t data[300] = {};
+  TEST_ASSERT_TRUE(writer.write(data, sizeof(data)));
+  TEST_ASSERT_EQUAL_size_t(0, sizeOnCard());
+  TEST_ASSERT_TRUE(writer.write(data, sizeof(data)));
+  TEST_ASSERT_EQUAL_size_t(BufferedWriter::SECTOR_SIZE, sizeOnCard());
+  TEST_ASSERT_EQUAL_size_t(600, writer.size());
+
+  TEST_ASSERT_TRUE(writer.sync());
+  TEST_ASSERT_EQUAL_size_t(600, sizeOnCard());
+  TEST_ASSERT_EQUAL_UINT32(1, writer.stats().syncs);
+}
+
+void test_syncs_after_max_pending_bytes() {
+  BufferedWriter writer({64, 100000});
+  TEST_ASSERT_TRUE(writer.open(PATH));
+
+  uint8_t data[40] = {};
+  writer.write(data, sizeof(data));
+  TEST_ASSERT_EQUAL_UINT32(0, writer.stats().syncs);
+  writer.write(data, sizeof(data));
+  TEST_ASSERT_EQUAL_UINT32(1, writer.stats().syncs);
+  TEST_ASSERT_EQUAL_size_t(80, sizeOnCard());
+}
+
+void test_poll_syncs_old_writes_without_another_write() {
+  BufferedWriter writer({4096, 5000});
+  TEST_ASSERT_TRUE(writer.open(PATH));
+
+  uint8_t data[20] = {};
+  writer.write(data, sizeof(data));
+
+  advanceMicros(4999 * 1000ULL);
+  TEST_ASSERT_TRUE(writer.poll());
+  TEST_ASSERT_EQUAL_UINT32(0, writer.stats().syncs);
+  TEST_ASSERT_EQUAL_size_t(0, sizeOnCard());
+
+  advanceMicros(1000);
+  TEST_ASSERT_TRUE(writer.poll());
+  TEST_ASSERT_EQUAL_UINT32(1, writer.stats().syncs);
+  TEST_ASSERT_EQUAL_UINT32(1, SD.stats().flushes);
+  TEST_ASSERT_EQUAL_size_t(20, sizeOnCard());
+
+  // Nothing new to sync
+  advanceMicros(10000 * 1000ULL);
+  TEST_ASSERT_TRUE(writer.poll());
+  TEST_ASSERT_EQUAL_UINT32(1, writer.stats().syncs);
+}
+
+void test_poll_counts_from_the_oldest_unsynced_write() {
+  BufferedWriter writer({4096, 5000});
+  TEST_ASSERT_TRUE(writer.open(PATH));
+
+  uint8_t data[20] = {};
+  writer.write(data, sizeof(data));
+  advanceMicros(3000 * 1000ULL);
+  writer.write(data, sizeof(data));
+  advanceMicros(2000 * 1000ULL);
+
+  TEST_ASSERT_TRUE(writer.poll());
+  TEST_ASSERT_EQUAL_UINT32(1, writer.stats().syncs);
+  TEST_ASSERT_EQUAL_size_t(40, sizeOnCard());
+}
+
+void test_reopen_continues_on_sector_boundaries() {
+  {
+    BufferedWriter writer({100000, 100000});
+    TEST_ASSERT_TRUE(writer.open(PATH));
+    uint8_t data[100] = {};
+    writer.write(data, sizeof(data));
+    writer.close();
+  }
+  TEST_ASSERT_EQUAL_size_t(100, sizeOnCard());
+
+  BufferedWriter writer({100000, 100000});
+  TEST_ASSERT_TRUE(writer.open(PATH));
+  TEST_ASSERT_EQUAL_size_t(100, writer.size());
+  uint8_t data[BufferedWriter::SECTOR_SIZE - 100] = {};
+  writer.write(data, sizeof(data));
+  // The first block only fills up the partial sector
+  TEST_ASSERT_EQUAL_UINT32(1, writer.stats().blockWrites);
+  TEST_ASSERT_EQUAL_size_t(BufferedWriter::SECTOR_SIZE, sizeOnCard());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_writes_whole_sectors_only);
+  RUN_TEST(test_syncs_after_max_pending_bytes);
+  RUN_TEST(test_poll_syncs_old_writes_without_another_write);
+  RUN_TEST(test_poll_counts_from_the_oldest_unsynced_write);
+  RUN_TEST(test_reopen_continues_on_sector_boundaries);
+  return UNITY_END();
+}
@@ -0,0 +1,454 @@
+#include "../ride.h"
+
+#include <columnarFormat.h>
+#include <recordFormat.h>
+#include <sdCard.h>
+
+#include <unity.h>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+static const size_t HEADER_SIZE = ColumnarRecordFormat::header().size();
+static const int POSITION_INDEX_BITS = 8;
+
+static uint32_t nextRandom(uint32_t &seed) {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+// Random fields present, each drifting from the previous record or jumping
+// anywhere in its range, with clock jumps both ways
+static DataRecord randomRecord(uint32_t &seed, const DataRecord &previous) {
+  DataRecord record;
+  switch (nextRandom(seed) % 8) {
+  case 0:
+    record.timestampMs = nextRandom(seed) * 1000ULL;
+    break;
+  case 1:
+    record.timestampMs = previous.timestampMs - nextRandom(seed) % 5000;
+    break;
+  default:
+    record.timestampMs = previous.timestampMs + 1000 + nextRandom(seed) % 300;
+    break;
+  }
+
+  for (const auto &info : MEASUREMENTS) {
+    if (nextRandom(seed) % 5 == 0) {
+      continue;
+    }
+    const double unit = std::pow(10.0, info.scale);
+    const SensorReading &before =
+        info.group == GROUP_GPS ? previous.gpsData : previous.sensorData;
+    double value;
+    if (before.has(info.id) && nextRandom(seed) % 4 != 0) {
+      const int change = (int)(nextRandom(seed) % 21) - 10;
+      value = before.value(info.id) + change * unit;
+    } else if (info.type == FIELD_F32) {
+      uint32_t bits = nextRandom(seed);
+      float f;
+      memcpy(&f, &bits, sizeof(f));
+      value = std::isnan(f) ? 0 : f;
+    } else if (info.type == FIELD_I32) {
+      value = (int32_t)nextRandom(seed) * unit;
+    } else {
+      value = nextRandom(seed) % (info.type == FIELD_U8 ? 256 : 65536) * unit;
+    }
+
+    SensorReading &target =
+        info.group == GROUP_GPS ? record.gpsData : record.sensorData;
+    target.addMeasurement(info.id, value);
+    target.setAge(info.id, nextRandom(seed) % 4 == 0
+                               ? nextRandom(seed) % 30000
+                               : 0);
+  }
+  return record;
+}
+
+// A fix with sensor readings every second
+static DataRecord sample(uint32_t second) {
+  DataRecord record;
+  record.timestampMs = 1714550400000ULL + second * 1000ULL;
+  record.gpsData.addMeasurement(LATITUDE, 41.178 + second * 2e-6)
+      .addMeasurement(LONGITUDE, -8.598 + second * 5e-5)
+      .addMeasurement(SPEED, 18.2 + second % 10 * 0.1);
+  record.sensorData.addMeasurement(NOISE_LEVEL, 61.5 + second % 7)
+      .addMeasurement(TEMPERATURE, 21.4);
+  return record;
+}
+
+static std::vector<EncodedRecord> rowsOf(const std::vector<DataRecord> &trip) {
+  std::vector<EncodedRecord> rows(trip.size());
+  for (size_t i = 0; i < trip.size(); i++) {
+    BinaryRecordFormat::encode(trip[i], rows[i].bytes);
+  }
+  return rows;
+}
+
+// Blocks the way SDCard writes them, a short one at the end
+static std::vector<uint8_t> encode(const std::vector<EncodedRecord> &rows) {
+  std::vector<uint8_t> blocks;
+  ColumnarEncoder encoder;
+  for (const EncodedRecord &row : rows) {
+    if (encoder.add(row.bytes)) {
+      encoder.finishBlock(blocks);
+    }
+  }
+  encoder.finishBlock(blocks);
+  return blocks;
+}
+
+// Decodes the complete blocks, stopping at one that is cut off. False if a
+// block is malformed.
+static bool decode(const std::vector<uint8_t> &blocks,
+                   std::vector<EncodedRecord> &rows) {
+  size_t offset = 0;
+  size_t samples;
+  size_t payloadSize;
+  while (offset + ColumnarRecordFormat::BLOCK_HEADER_SIZE <= blocks.size()) {
+    const uint8_t *block = &blocks[offset];
+    offset += ColumnarRecordFormat::BLOCK_HEADER_SIZE;
+    if (!ColumnarRecordFormat::blockInfo(block, samples, payloadSize)) {
+      return false;
+    }
+    if (offset + payloadSize > blocks.size()) {
+      break;
+    }
+    if (!ColumnarRecordFormat::decodeBlock(&blocks[offset], payloadSize,
+                                           samples, rows)) {
+      return false;
+    }
+    offset += payloadSize;
+  }
+  return true;
+}
+
+static void assertSameRows(const std::vector<EncodedRecord> &expected,
+                           const std::vector<EncodedRecord> &actual,
+                           size_t count) {
+  TEST_ASSERT_TRUE(expected.size() >= count);
+  TEST_ASSERT_EQUAL_size_t(count, actual.size());
+  for (size_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL_MEMORY(expected[i].bytes, actual[i].bytes,
+                             sizeof(EncodedRecord));
+  }
+}
+
+static std::vector<DataRecord> samples(uint32_t count) {
+  std::vector<DataRecord> trip;
+  for (uint32_t second = 0; second < count; second++) {
+    trip.push_back(sample(second));
+  }
+  return trip;
+}
+
+// What the cursor hands out for a record, it went through the row format
+static std::string uploaded(const DataRecord &record) {
+  EncodedRecord row;
+  BinaryRecordFormat::encode(record, row.bytes);
+  return serializeRecord(BinaryRecordFormat::decode(row.bytes));
+}
+
+// Reads count records in batches of 8, checking them against the trip from
+// the given second on
+static void assertReads(SDCard &card, uint32_t from, uint32_t count) {
+  RecordBatch batch;
+  uint32_t second = from;
+  while (second < from + count) {
+    const int size = std::min<uint32_t>(8, from + count - second);
+    TEST_ASSERT_TRUE(card.nextBatch(size, batch));
+    TEST_ASSERT_EQUAL_size_t(size, batch.size());
+    for (std::string_view record : batch) {
+      TEST_ASSERT_EQUAL_STRING(uploaded(sample(second++)).c_str(),
+                               std::string(record).c_str());
+    }
+  }
+}
+
+// A sealed segment of the sample trip, three blocks of 64, 64 and 22
+static SDCard *cardWithTrip() {
+  SDCard *card = new SDCard(COLUMNAR_BLOCKS);
+  TEST_ASSERT_TRUE(card->setup());
+  for (uint32_t second = 0; second < 150; second++) {
+    TEST_ASSERT_TRUE(card->store(sample(second)));
+  }
+  TEST_ASSERT_TRUE(card->seal());
+  return card;
+}
+
+// File offset of each block of the sample trip in the segment
+static std::vector<size_t> blockOffsets() {
+  const std::vector<uint8_t> blocks = encode(rowsOf(samples(150)));
+  std::vector<size_t> offsets;
+  size_t samples;
+  size_t payloadSize;
+  for (size_t offset = 0; offset < blocks.size();
+       offset += ColumnarRecordFormat::BLOCK_HEADER_SIZE + payloadSize) {
+    TEST_ASSERT_TRUE(ColumnarRecordFormat::blockInfo(&blocks[offset], samples,
+                                                     payloadSize));
+    offsets.push_back(HEADER_SIZE + offset);
+  }
+  return offsets;
+}
+
+static size_t position(size_t offset, size_t index) {
+  return offset << POSITION_INDEX_BITS | index;
+}
+
+void setUp() { resetHost(); }
+
+void tearDown() {}
+
+void test_random_trips_round_trip() {
+  uint32_t seed = 2463534242;
+  for (int trip = 0; trip < 200; trip++) {
+    std::vector<DataRecord> records(1 + nextRandom(seed) % 300);
+    DataRecord previous = sample(trip);
+    for (DataRecord &record : records) {
+      record = previous = randomRecord(seed, previous);
+    }
+    const std::vector<EncodedRecord> rows = rowsOf(records);
+
+    std::vector<EncodedRecord> decoded;
+    TEST_ASSERT_TRUE(decode(encode(rows), decoded));
+    assertSameRows(rows, decoded, rows.size());
+  }
+}
+
+void test_blocks_hold_at_most_block_samples() {
+  const std::vector<EncodedRecord> rows = rowsOf(samples(150));
+  ColumnarEncoder encoder;
+  std::vector<uint8_t> blocks;
+  for (size_t i = 0; i < rows.size(); i++) {
+    const bool full = encoder.add(rows[i].bytes);
+    TEST_ASSERT_EQUAL((i + 1) % ColumnarRecordFormat::BLOCK_SAMPLES == 0,
+                      full);
+    if (full) {
+      encoder.finishBlock(blocks);
+      TEST_ASSERT_EQUAL_size_t(0, encoder.samples());
+    }
+  }
+  TEST_ASSERT_EQUAL_size_t(22, encoder.samples());
+  encoder.finishBlock(blocks);
+
+  // Each block decodes on its own
+  const std::vector<size_t> offsets = blockOffsets();
+  const size_t counts[] = {64, 64, 22};
+  TEST_ASSERT_EQUAL_size_t(3, offsets.size());
+  for (size_t b = 0; b < offsets.size(); b++) {
+    const uint8_t *block = &blocks[offsets[b] - HEADER_SIZE];
+    size_t samples;
+    size_t payloadSize;
+    TEST_ASSERT_TRUE(
+        ColumnarRecordFormat::blockInfo(block, samples, payloadSize));
+    TEST_ASSERT_EQUAL_size_t(counts[b], samples);
+
+    std::vector<EncodedRecord> decoded;
+    TEST_ASSERT_TRUE(ColumnarRecordFormat::decodeBlock(
+        block + ColumnarRecordFormat::BLOCK_HEADER_SIZE, payloadSize, samples,
+        decoded));
+    assertSameRows(std::vector<EncodedRecord>(rows.begin() + b * 64,
+                                              rows.end()),
+                   decoded, samples);
+  }
+}
+
+void test_a_cut_off_file_keeps_its_complete_blocks() {
+  const std::vector<EncodedRecord> rows = rowsOf(samples(150));
+  const std::vector<uint8_t> blocks = encode(rows);
+  const std::vector<size_t> offsets = blockOffsets();
+
+  for (size_t size = 0; size <= blocks.size(); size++) {
+    const std::vector<uint8_t> cut(blocks.begin(), blocks.begin() + size);
+    std::vector<EncodedRecord> decoded;
+    TEST_ASSERT_TRUE(decode(cut, decoded));
+
+    size_t complete = 0;
+    if (size == blocks.size()) {
+      complete = 150;
+    } else if (size >= offsets[2] - HEADER_SIZE) {
+      complete = 128;
+    } else if (size >= offsets[1] - HEADER_SIZE) {
+      complete = 64;
+    }
+    assertSameRows(rows, decoded, complete);
+  }
+}
+
+void test_malformed_block_headers_are_rejected() {
+  size_t samples;
+  size_t payloadSize;
+  const uint8_t noSamples[] = {0, 10, 0};
+  const uint8_t tooMany[] = {ColumnarRecordFormat::BLOCK_SAMPLES + 1, 10, 0};
+  const uint8_t noPayload[] = {5, 0, 0};
+  const uint8_t valid[] = {5, 0x2C, 0x01};
+  TEST_ASSERT_FALSE(ColumnarRecordFormat::blockInfo(noSamples, samples,
+                                                    payloadSize));
+  TEST_ASSERT_FALSE(
+      ColumnarRecordFormat::blockInfo(tooMany, samples, payloadSize));
+  TEST_ASSERT_FALSE(
+      ColumnarRecordFormat::blockInfo(noPayload, samples, payloadSize));
+  TEST_ASSERT_TRUE(ColumnarRecordFormat::blockInfo(valid, samples,
+                                                   payloadSize));
+  TEST_ASSERT_EQUAL_size_t(5, samples);
+  TEST_ASSERT_EQUAL_size_t(300, payloadSize);
+}
+
+void test_malformed_payloads_leave_the_records_as_they_were() {
+  const std::vector<EncodedRecord> rows = rowsOf(samples(20));
+  std::vector<uint8_t> block = encode(rows);
+  size_t samples;
+  size_t payloadSize;
+  TEST_ASSERT_TRUE(
+      ColumnarRecordFormat::blockInfo(block.data(), samples, payloadSize));
+  std::vector<uint8_t> payload(
+      block.begin() + ColumnarRecordFormat::BLOCK_HEADER_SIZE, block.end());
+
+  std::vector<EncodedRecord> decoded(1, rows[0]);
+  // Columns running past the payload, or not filling it
+  TEST_ASSERT_FALSE(ColumnarRecordFormat::decodeBlock(
+      payload.data(), payload.size() - 1, samples, decoded));
+  payload.push_back(0);
+  TEST_ASSERT_FALSE(ColumnarRecordFormat::decodeBlock(
+      payload.data(), payload.size(), samples, decoded));
+  payload.pop_back();
+  // More samples than the columns hold
+  TEST_ASSERT_FALSE(ColumnarRecordFormat::decodeBlock(
+      payload.data(), payload.size(), ColumnarRecordFormat::BLOCK_SAMPLES,
+      decoded));
+  // A column size that doesn't end
+  std::vector<uint8_t> endless(payload.size(), 0xFF);
+  TEST_ASSERT_FALSE(ColumnarRecordFormat::decodeBlock(
+      endless.data(), endless.size(), samples, decoded));
+  assertSameRows(rows, decoded, 1);
+
+  TEST_ASSERT_TRUE(ColumnarRecordFormat::decodeBlock(
+      payload.data(), payload.size(), samples, decoded));
+  TEST_ASSERT_EQUAL_size_t(21, decoded.size());
+}
+
+void test_positions_pack_the_block_offset_and_index() {
+  std::unique_ptr<SDCard> card(cardWithTrip());
+  const std::vector<size_t> offsets = blockOffsets();
+
+  TEST_ASSERT_TRUE(card->openCursor());
+  TEST_ASSERT_EQUAL_size_t(position(offsets[0], 0), card->cursorPosition());
+  assertReads(*card, 0, 3);
+  TEST_ASSERT_EQUAL_size_t(position(offsets[0], 3), card->cursorPosition());
+
+  // A block read to its end points at the next one
+  assertReads(*card, 3, 61);
+  TEST_ASSERT_EQUAL_size_t(position(offsets[1], 0), card->cursorPosition());
+  assertReads(*card, 64, 70);
+  TEST_ASSERT_EQUAL_size_t(position(offsets[2], 6), card->cursorPosition());
+  assertReads(*card, 134, 16);
+  RecordBatch batch;
+  TEST_ASSERT_FALSE(card->nextBatch(8, batch));
+}
+
+void test_a_resume_lands_mid_block() {
+  std::unique_ptr<SDCard> card(cardWithTrip());
+  const std::vector<size_t> offsets = blockOffsets();
+
+  TEST_ASSERT_TRUE(card->openCursor());
+  assertReads(*card, 0, 70);
+  const size_t resumeAt = card->cursorPosition();
+  TEST_ASSERT_EQUAL_size_t(position(offsets[1], 6), resumeAt);
+  card->closeCursor();
+
+  // Like an upload picking up after a reboot
+  card.reset();
+  card.reset(new SDCard(COLUMNAR_BLOCKS));
+  TEST_ASSERT_TRUE(card->setup());
+  TEST_ASSERT_TRUE(card->openCursor());
+  TEST_ASSERT_TRUE(card->seekCursor(resumeAt));
+  TEST_ASSERT_EQUAL_size_t(resumeAt, card->cursorPosition());
+  assertReads(*card, 70, 80);
+
+  // Back to the start of a block and to the end of the segment
+  TEST_ASSERT_TRUE(card->seekCursor(position(offsets[2], 0)));
+  assertReads(*card, 128, 22);
+  TEST_ASSERT_TRUE(card->seekCursor(position(offsets[0], 64)));
+  assertReads(*card, 64, 8);
+  TEST_ASSERT_TRUE(card->seekCursor(position(offsets[2], 22)));
+  RecordBatch batch;
+  TEST_ASSERT_FALSE(card->nextBatch(8, batch));
+}
+
+void test_positions_outside_the_blocks_are_refused() {
+  std::unique_ptr<SDCard> card(cardWithTrip());
+  const std::vector<size_t> offsets = blockOffsets();
+  TEST_ASSERT_FALSE(card->seekCursor(position(offsets[0], 0)));
+
+  TEST_ASSERT_TRUE(card->openCursor());
+  TEST_ASSERT_FALSE(card->seekCursor(position(HEADER_SIZE - 1, 0)));
+  TEST_ASSERT_FALSE(card->seekCursor(position(offsets[1], 65)));
+  TEST_ASSERT_FALSE(card->seekCursor(position(offsets[2], 23)));
+  TEST_ASSERT_FALSE(card->seekCursor(position(offsets[1] + 1, 3)));
+  TEST_ASSERT_FALSE(card->seekCursor(position(1 << 20, 0)));
+
+  TEST_ASSERT_TRUE(card->seekCursor(position(offsets[1], 10)));
+  assertReads(*card, 74, 8);
+}
+
+void test_a_corrupt_block_ends_the_segment() {
+  std::unique_ptr<SDCard> card(cardWithTrip());
+  const std::vector<size_t> offsets = blockOffsets();
+  {
+    std::fstream f(SD.hostPath("Bikesense_seg1.bsc"),
+                   std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(offsets[1]);
+    f.put(0); // no samples
+  }
+
+  TEST_ASSERT_TRUE(card->openCursor());
+  assertReads(*card, 0, 64);
+  RecordBatch batch;
+  TEST_ASSERT_FALSE(card->nextBatch(8, batch));
+  TEST_ASSERT_EQUAL_size_t(position(offsets[1], 0), card->cursorPosition());
+  TEST_ASSERT_FALSE(card->seekCursor(position(offsets[1], 3)));
+}
+
+void test_a_block_cut_off_by_a_reset_is_dropped_at_boot() {
+  {
+    SDCard card(COLUMNAR_BLOCKS);
+    TEST_ASSERT_TRUE(card.setup());
+    for (uint32_t second = 0; second < 100; second++) {
+      TEST_ASSERT_TRUE(card.store(sample(second)));
+    }
+    TEST_ASSERT_TRUE(card.sync());
+  }
+  const std::string path = SD.hostPath("Bikesense_seg1.bsc");
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 5);
+
+  SDCard card(COLUMNAR_BLOCKS);
+  TEST_ASSERT_TRUE(card.setup());
+  TEST_ASSERT_EQUAL_size_t(blockOffsets()[1],
+                           std::filesystem::file_size(path));
+
+  // Appended after the first block, not hidden behind the cut-off one
+  for (uint32_t second = 64; second < 80; second++) {
+    TEST_ASSERT_TRUE(card.store(sample(second)));
+  }
+  TEST_ASSERT_TRUE(card.seal());
+  TEST_ASSERT_TRUE(card.openCursor());
+  assertReads(card, 0, 80);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_random_trips_round_trip);
+  RUN_TEST(test_blocks_hold_at_most_block_samples);
+  RUN_TEST(test_a_cut_off_file_keeps_its_complete_blocks);
+  RUN_TEST(test_malformed_block_headers_are_rejected);
+  RUN_TEST(test_malformed_payloads_leave_the_records_as_they_were);
+  RUN_TEST(test_positions_pack_the_block_offset_and_index);
+  RUN_TEST(test_a_resume_lands_mid_block);
+  RUN_TEST(test_positions_outside_the_blocks_are_refused);
+  RUN_TEST(test_a_corrupt_block_ends_the_segment);
+  RUN_TEST(test_a_block_cut_off_by_a_reset_is_dropped_at_boot);
+  return UNITY_END();
+}
@@ -0,0 +1,196 @@
+#include "../ride.h"
+
+#include <sdCard.h>
+
+#include <unity.h>
+
+#include <set>
+#include <vector>
+
+// The collecting loop runs on core 0, which is this thread. Core 1 runs the
+// uploader, or the storage writes when core 0 uploads.
+class DualCoreDevice {
+private:
+  BikeSenseBuilder builder_;
+  std::unique_ptr<BikeSense> device_;
+
+public:
+  DualCoreDevice(bool uploader = true)
+      : builder_(deviceBuilder(new SDCard(BINARY_RECORDS))) {
+    if (uploader) {
+      builder_.withUploadMode(STREAMED_UPLOAD).withDualCore(true);
+    }
+    device_.reset(new BikeSense(builder_.build()));
+    device_->setup();
+    BikeSense *device = device_.get();
+    if (uploader) {
+      startCore1([device]() { device->stepUploader(); });
+    } else {
+      startCore1([device]() { device->stepDrainer(); });
+    }
+  }
+
+  ~DualCoreDevice() {
+    // The uploader may be waiting for records
+    while (!stopCore1()) {
+      device_->step();
+    }
+  }
+
+  BikeSense &device() { return *device_; }
+};
+
+// Trip-ID of every upload, in order
+static std::vector<std::string> uploadTrips;
+// Stopped in tearDown, a failed assertion skips the rest of the test
+static std::unique_ptr<DualCoreDevice> dualCore;
+
+void setUp() {
+  resetHost();
+  uploadTrips.clear();
+  loopbackServer.onRequest =
+      [](const std::string &path,
+         const std::map<std::string, std::string> &headers,
+         const std::string &body) {
+        auto it = headers.find("trip-id");
+        if (path.find("/trip/upload_data") != std::string::npos &&
+            it != headers.end()) {
+          uploadTrips.push_back(it->second);
+        }
+      };
+}
+
+void tearDown() {
+  // The feed is gone, no more fixes while core 1 stops
+  clearInterrupts();
+  dualCore.reset();
+}
+
+void test_a_docked_bike_keeps_adding_to_the_trip_of_its_ride() {
+  dualCore.reset(new DualCoreDevice());
+  FixFeed feed;
+  feed.start();
+
+  stepFor(dualCore->device(), 5 * 60000);
+  WiFi.setInRange(true);
+  stepFor(dualCore->device(), 5 * 60000);
+
+  // The ride and the docked time after it went up in several uploads
+  TEST_ASSERT_GREATER_THAN(3, uploadTrips.size());
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.trips);
+  for (const std::string &trip : uploadTrips) {
+    TEST_ASSERT_EQUAL_STRING(uploadTrips[0].c_str(), trip.c_str());
+  }
+  // Sampling went on during the uploads, only what was stored since the
+  // last one is left on the card
+  TEST_ASSERT_LESS_OR_EQUAL(feed.fixes, loopbackServer.stats.records);
+  TEST_ASSERT_GREATER_OR_EQUAL(feed.fixes - 70, loopbackServer.stats.records);
+}
+
+void test_leaving_the_dock_starts_a_new_trip() {
+  dualCore.reset(new DualCoreDevice());
+  FixFeed feed;
+  feed.start();
+
+  for (int ride = 0; ride < 2; ride++) {
+    WiFi.setInRange(false);
+    stepFor(dualCore->device(), 5 * 60000);
+    WiFi.setInRange(true);
+    stepFor(dualCore->device(), 3 * 60000);
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(2, loopbackServer.stats.trips);
+  const std::set<std::string> trips(uploadTrips.begin(), uploadTrips.end());
+  TEST_ASSERT_EQUAL_size_t(2, trips.size());
+  // Uploads of one ride are never interleaved with the other's
+  size_t changes = 0;
+  for (size_t i = 1; i < uploadTrips.size(); i++) {
+    changes += uploadTrips[i] != uploadTrips[i - 1];
+  }
+  TEST_ASSERT_EQUAL_size_t(1, changes);
+}
+
+// Rides through card stalls longer than the UART's receive ring lasts, then
+// docks and uploads from core 0. Returns the fixes sent during the ride.
+static uint32_t rideThroughCardStalls(BikeSense &device) {
+  FixFeed feed;
+  feed.start();
+  SD.setFlushStall(8000);
+  stepFor(device, 3 * 60000);
+  SD.setFlushStall(0);
+  clearInterrupts();
+
+  WiFi.setInRange(true);
+  stepFor(device, 120000);
+  return feed.fixes;
+}
+
+void test_card_stalls_on_core_0_lose_fixes() {
+  BikeSenseBuilder builder = deviceBuilder(new SDCard(BINARY_RECORDS));
+  BikeSense device = builder.build();
+  device.setup();
+  const uint32_t fixes = rideThroughCardStalls(device);
+
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.trips);
+  TEST_ASSERT_LESS_THAN(fixes - 10, loopbackServer.stats.records);
+}
+
+void test_card_stalls_on_core_1_leave_the_gps_alone() {
+  dualCore.reset(new DualCoreDevice(false));
+  const uint32_t fixes = rideThroughCardStalls(dualCore->device());
+
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.trips);
+  TEST_ASSERT_LESS_OR_EQUAL(fixes, loopbackServer.stats.records);
+  TEST_ASSERT_GREATER_OR_EQUAL(fixes - 2, loopbackServer.stats.records);
+}
+
+// What the device printed so far, the drainer prints every log it writes
+static FILE *serialOutput;
+
+static std::string printed() {
+  fflush(serialOutput);
+  std::string text(ftell(serialOutput), '\0');
+  rewind(serialOutput);
+  text.resize(fread(&text[0], 1, text.size(), serialOutput));
+  return text;
+}
+
+static bool settleLoggedAtHealthCheck;
+
+void test_core_1_writes_while_the_wifi_settles() {
+  dualCore.reset(new DualCoreDevice(false));
+  serialOutput = tmpfile();
+  Serial.setOutput(serialOutput);
+  settleLoggedAtHealthCheck = false;
+  loopbackServer.onRequest =
+      [](const std::string &path,
+         const std::map<std::string, std::string> &headers,
+         const std::string &body) {
+        if (path.find("/check_health") != std::string::npos) {
+          settleLoggedAtHealthCheck =
+              printed().find("Sleeping for wifi") != std::string::npos;
+        }
+      };
+
+  // Docked during the ride, core 0 uploads and core 1 keeps the storage
+  FixFeed feed;
+  feed.start();
+  stepFor(dualCore->device(), 20000);
+  WiFi.setInRange(true);
+  stepFor(dualCore->device(), 40000);
+  Serial.setOutput(nullptr);
+  fclose(serialOutput);
+
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.trips);
+  TEST_ASSERT_TRUE(settleLoggedAtHealthCheck);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_a_docked_bike_keeps_adding_to_the_trip_of_its_ride);
+  RUN_TEST(test_leaving_the_dock_starts_a_new_trip);
+  RUN_TEST(test_card_stalls_on_core_0_lose_fixes);
+  RUN_TEST(test_card_stalls_on_core_1_leave_the_gps_alone);
+  RUN_TEST(test_core_1_writes_while_the_wifi_settles);
+  return UNITY_END();
+}
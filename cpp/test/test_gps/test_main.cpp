@@ -0,0 +1,146 @@
+#include "../ride.h"
+
+#include <unity.h>
+
+#include <algorithm>
+
+// 2024-05-01 08:00Z, where the fixes of ride.h start
+static const uint64_t RIDE_START_MS = 1714550400000ULL;
+
+static void injectAll(const std::string &bytes) {
+  TEST_ASSERT_EQUAL_size_t(bytes.size(),
+                           Serial1.inject(bytes.data(), bytes.size()));
+}
+
+void setUp() {
+  resetHost();
+  // Empty the ring whatever the last test left in it
+  while (Serial1.available() > 0) {
+    Serial1.read();
+  }
+  Serial1.overflow();
+}
+
+void tearDown() {}
+
+void test_every_sentence_in_the_ring_is_parsed_in_one_update() {
+  Gps gps;
+  gps.setup();
+  std::string bytes;
+  for (uint32_t second = 0; second < 5; second++) {
+    bytes += nmeaFix(second);
+  }
+  injectAll(bytes);
+
+  gps.update();
+  TEST_ASSERT_EQUAL_INT(0, Serial1.available());
+  TEST_ASSERT_EQUAL_UINT32(10, gps.sentences());
+  TEST_ASSERT_EQUAL_UINT32(0, gps.checksumFailures());
+  TEST_ASSERT_TRUE(gps.isValid());
+  TEST_ASSERT_TRUE(gps.isUpdated());
+  TEST_ASSERT_EQUAL_UINT64(RIDE_START_MS + 4000, gps.timestampMs());
+}
+
+void test_a_sentence_split_across_updates_is_parsed_once_complete() {
+  Gps gps;
+  gps.setup();
+  const std::string fix = nmeaFix(0);
+  const size_t half = fix.size() / 3;
+  injectAll(fix.substr(0, half));
+  gps.update();
+  TEST_ASSERT_EQUAL_UINT32(0, gps.sentences());
+
+  injectAll(fix.substr(half));
+  gps.update();
+  TEST_ASSERT_EQUAL_UINT32(2, gps.sentences());
+  TEST_ASSERT_TRUE(gps.isValid());
+}
+
+void test_the_fix_is_read_back() {
+  Gps gps;
+  gps.setup();
+  injectAll(nmeaFix(100));
+  gps.update();
+
+  const SensorReading fix = gps.read();
+  TEST_ASSERT_DOUBLE_WITHIN(2e-6, 41.1780 + 100 * 2e-6, fix.value(LATITUDE));
+  TEST_ASSERT_DOUBLE_WITHIN(2e-6, -(8.5980 - 100 * 5e-5),
+                            fix.value(LONGITUDE));
+  TEST_ASSERT_EQUAL_DOUBLE(120.5, fix.value(ALTITUDE));
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, 9.8 * 1.852, fix.value(SPEED));
+  TEST_ASSERT_EQUAL_DOUBLE(87.5, fix.value(COURSE));
+  TEST_ASSERT_EQUAL_DOUBLE(9, fix.value(SATELLITES_IN_USE));
+  TEST_ASSERT_EQUAL_DOUBLE(0.9, fix.value(HDOP));
+}
+
+void test_the_timestamp_advances_with_the_age_of_the_fix() {
+  Gps gps;
+  gps.setup();
+  injectAll(nmeaFix(30));
+  gps.update();
+  delay(700);
+  TEST_ASSERT_EQUAL_UINT64(RIDE_START_MS + 30000 + 700, gps.timestampMs());
+  TEST_ASSERT_FALSE(gps.isOld());
+  delay(6000);
+  TEST_ASSERT_TRUE(gps.isOld());
+}
+
+void test_corrupted_sentences_are_counted_and_skipped() {
+  Gps gps;
+  gps.setup();
+  std::string fix = nmeaFix(0);
+  fix[10] = fix[10] == '1' ? '2' : '1';
+  injectAll(fix);
+  gps.update();
+  TEST_ASSERT_EQUAL_UINT32(1, gps.checksumFailures());
+  TEST_ASSERT_EQUAL_UINT32(1, gps.sentences());
+  TEST_ASSERT_FALSE(gps.isValid());
+}
+
+void test_a_full_ring_counts_an_overrun() {
+  Gps gps;
+  gps.setup();
+  std::string bytes;
+  for (uint32_t second = 0; bytes.size() < 1100; second++) {
+    bytes += nmeaFix(second);
+  }
+  const size_t kept = Serial1.inject(bytes.data(), bytes.size());
+  TEST_ASSERT_LESS_THAN(bytes.size(), kept);
+
+  gps.update();
+  TEST_ASSERT_EQUAL_UINT32(1, gps.overruns());
+  gps.update();
+  TEST_ASSERT_EQUAL_UINT32(1, gps.overruns());
+}
+
+void test_parsing_does_not_touch_the_heap() {
+  Gps gps;
+  gps.setup();
+  injectAll(nmeaFix(0));
+  gps.update();
+
+  // The test and the stand-in UART allocate, only the parsing is measured
+  size_t peakGrowth = 0;
+  for (uint32_t second = 1; second < 120; second++) {
+    injectAll(nmeaFix(second));
+    const size_t used = usedHeap();
+    resetPeakHeap();
+    gps.update();
+    gps.read();
+    peakGrowth = std::max(peakGrowth, peakHeap() - used);
+  }
+  TEST_ASSERT_EQUAL_UINT32(2 * 120, gps.sentences());
+  TEST_ASSERT_EQUAL_size_t(0, peakGrowth);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_sentence_in_the_ring_is_parsed_in_one_update);
+  RUN_TEST(test_a_sentence_split_across_updates_is_parsed_once_complete);
+  RUN_TEST(test_the_fix_is_read_back);
+  RUN_TEST(test_the_timestamp_advances_with_the_age_of_the_fix);
+  RUN_TEST(test_corrupted_sentences_are_counted_and_skipped);
+  RUN_TEST(test_a_full_ring_counts_an_overrun);
+  RUN_TEST(test_parsing_does_not_touch_the_heap);
+  return UNITY_END();
+}
@@ -0,0 +1,329 @@
+#include "../ride.h"
+
+#include <dataRecord.h>
+#include <gzipCompressor.h>
+#include <sdCard.h>
+
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+// Just enough of RFC 1951 to read what GzipCompressor writes: stored and
+// fixed-Huffman blocks
+class Inflater {
+private:
+  const std::string &in_;
+  size_t bytePos_;
+  int bitPos_ = 0;
+
+  uint32_t bits(int n) {
+    uint32_t value = 0;
+    for (int i = 0; i < n; i++) {
+      if (bytePos_ >= in_.size()) {
+        failed = true;
+        return 0;
+      }
+      value |= ((uint8_t)in_[bytePos_] >> bitPos_ & 1) << i;
+      if (++bitPos_ == 8) {
+        bitPos_ = 0;
+        bytePos_++;
+      }
+    }
+    return value;
+  }
+
+  // Huffman codes are stored most significant bit first
+  uint32_t code(int n) {
+    uint32_t value = 0;
+    for (int i = 0; i < n; i++) {
+      value = value << 1 | bits(1);
+    }
+    return value;
+  }
+
+  int literalLength() {
+    uint32_t c = code(7);
+    if (c <= 0x17) {
+      return 256 + c;
+    }
+    c = c << 1 | bits(1);
+    if (c >= 0x30 && c <= 0xBF) {
+      return c - 0x30;
+    }
+    if (c >= 0xC0 && c <= 0xC7) {
+      return 280 + c - 0xC0;
+    }
+    c = c << 1 | bits(1);
+    return 144 + c - 0x190;
+  }
+
+public:
+  bool failed = false;
+
+  Inflater(const std::string &in, size_t start) : in_(in), bytePos_(start) {}
+
+  size_t position() const { return bytePos_ + (bitPos_ > 0); }
+
+  std::string inflate() {
+    static const uint16_t LENGTH_BASE[] = {
+        3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+        31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t LENGTH_EXTRA[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                           1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                           4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t DISTANCE_BASE[] = {
+        1,   2,   3,   4,   5,   7,    9,    13,   17,   25,
+        33,  49,  65,  97,  129, 193,  257,  385,  513,  769,
+        1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+
+    std::string out;
+    bool last = false;
+    while (!last && !failed) {
+      last = bits(1);
+      const uint32_t type = bits(2);
+      if (type == 0) {
+        if (bitPos_ > 0) {
+          bitPos_ = 0;
+          bytePos_++;
+        }
+        const uint32_t length = bits(16);
+        bits(16);
+        for (uint32_t i = 0; i < length && !failed; i++) {
+          out += (char)bits(8);
+        }
+        continue;
+      }
+      if (type != 1) {
+        failed = true;
+        break;
+      }
+
+      while (!failed) {
+        const int symbol = literalLength();
+        if (symbol < 256) {
+          out += (char)symbol;
+          continue;
+        }
+        if (symbol == 256) {
+          break;
+        }
+        if (symbol > 285) {
+          failed = true;
+          break;
+        }
+        const int lengthCode = symbol - 257;
+        const size_t length =
+            LENGTH_BASE[lengthCode] + bits(LENGTH_EXTRA[lengthCode]);
+        const uint32_t distanceCode = code(5);
+        if (distanceCode > 29) {
+          failed = true;
+          break;
+        }
+        const int extra = distanceCode < 4 ? 0 : distanceCode / 2 - 1;
+        const size_t distance = DISTANCE_BASE[distanceCode] + bits(extra);
+        if (distance > out.size()) {
+          failed = true;
+          break;
+        }
+        for (size_t i = 0; i < length; i++) {
+          out += out[out.size() - distance];
+        }
+      }
+    }
+    return out;
+  }
+};
+
+static uint32_t crc32(const std::string &data) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (unsigned char c : data) {
+    crc ^= c;
+    for (int i = 0; i < 8; i++) {
+      crc = crc >> 1 ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
+static uint32_t readLe32(const std::string &data, size_t at) {
+  uint32_t value = 0;
+  for (int i = 3; i >= 0; i--) {
+    value = value << 8 | (uint8_t)data[at + i];
+  }
+  return value;
+}
+
+// Checks the gzip framing and returns the decompressed member
+static std::string gunzip(const std::string &gz) {
+  TEST_ASSERT_GREATER_OR_EQUAL(18, gz.size());
+  TEST_ASSERT_EQUAL_HEX8(0x1F, (uint8_t)gz[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x8B, (uint8_t)gz[1]);
+  TEST_ASSERT_EQUAL_HEX8(8, (uint8_t)gz[2]); // deflate
+  TEST_ASSERT_EQUAL_HEX8(0, (uint8_t)gz[3]); // no optional fields
+
+  Inflater inflater(gz, 10);
+  const std::string out = inflater.inflate();
+  TEST_ASSERT_FALSE(inflater.failed);
+  TEST_ASSERT_EQUAL_size_t(gz.size(), inflater.position() + 8);
+  TEST_ASSERT_EQUAL_UINT32(crc32(out), readLe32(gz, gz.size() - 8));
+  TEST_ASSERT_EQUAL_UINT32(out.size(), readLe32(gz, gz.size() - 4));
+  return out;
+}
+
+static std::string compress(const std::string &data, size_t pieceSize) {
+  std::string out;
+  GzipCompressor gzip([&out](const char *bytes, size_t length) {
+    out.append(bytes, length);
+    return true;
+  });
+  for (size_t at = 0; at < data.size(); at += pieceSize) {
+    TEST_ASSERT_TRUE(gzip.write(data.data() + at,
+                                std::min(pieceSize, data.size() - at)));
+  }
+  TEST_ASSERT_TRUE(gzip.finish());
+  TEST_ASSERT_EQUAL_UINT32(data.size(), gzip.inputSize());
+  TEST_ASSERT_EQUAL_size_t(out.size(), gzip.outputSize());
+  return out;
+}
+
+// A JSON array of records like a batched upload sends
+static std::string tripJson(int records) {
+  std::string json = "[";
+  for (int i = 0; i < records; i++) {
+    DataRecord record;
+    record.timestampMs = 1714550400000ULL + i * 1000ULL;
+    record.gpsData.addMeasurement(LATITUDE, 41.1780 + i * 1e-5)
+        .addMeasurement(LONGITUDE, -8.5980 + i * 2e-5)
+        .addMeasurement(ALTITUDE, 120.5 + (i % 40) * 0.25)
+        .addMeasurement(SPEED, 18.2 + (i % 10) * 0.1)
+        .addMeasurement(SATELLITES_IN_USE, 9);
+    record.sensorData.addMeasurement(CARBON_MONOXIDE_LEVEL, 6)
+        .addMeasurement(NOISE_LEVEL, 61.7 + (i % 7))
+        .addMeasurement(TEMPERATURE, 21.4);
+    if (i > 0) {
+      json += ',';
+    }
+    json += serializeRecord(record);
+  }
+  return json + "]";
+}
+
+void setUp() { resetHost(); }
+
+void tearDown() { clearInterrupts(); }
+
+void test_empty_input_round_trips() {
+  TEST_ASSERT_EQUAL_STRING("", gunzip(compress("", 1)).c_str());
+}
+
+void test_trip_json_round_trips_and_compresses() {
+  const std::string json = tripJson(500);
+  TEST_ASSERT_GREATER_THAN(4 * GzipCompressor::WINDOW_SIZE, json.size());
+
+  const std::string gz = compress(json, json.size());
+  TEST_ASSERT_TRUE(gunzip(gz) == json);
+  // Keys, timestamps and coordinates repeat from record to record
+  TEST_ASSERT_LESS_THAN(json.size() / 4, gz.size());
+}
+
+void test_output_does_not_depend_on_write_sizes() {
+  const std::string json = tripJson(200);
+  const std::string whole = compress(json, json.size());
+  TEST_ASSERT_TRUE(compress(json, 1) == whole);
+  TEST_ASSERT_TRUE(compress(json, 97) == whole);
+  TEST_ASSERT_TRUE(compress(json, GzipCompressor::WINDOW_SIZE + 1) == whole);
+}
+
+void test_incompressible_input_grows_by_at_most_an_eighth() {
+  std::string data;
+  uint32_t seed = 12345;
+  for (int i = 0; i < 20000; i++) {
+    seed = seed * 1103515245 + 12345;
+    data += (char)(seed >> 16);
+  }
+
+  const std::string gz = compress(data, 1000);
+  TEST_ASSERT_TRUE(gunzip(gz) == data);
+  // Literals 144-255 take 9 bits
+  TEST_ASSERT_LESS_OR_EQUAL(data.size() * 9 / 8 + 32, gz.size());
+}
+
+void test_long_runs_use_the_longest_matches() {
+  const std::string data(100000, 'a');
+  const std::string gz = compress(data, 4096);
+  TEST_ASSERT_TRUE(gunzip(gz) == data);
+  TEST_ASSERT_LESS_THAN(1000, gz.size());
+}
+
+void test_a_failing_sink_fails_the_stream() {
+  size_t calls = 0;
+  GzipCompressor gzip([&calls](const char *data, size_t length) {
+    calls++;
+    return false;
+  });
+  const std::string json = tripJson(100);
+  bool written = gzip.write(json.data(), json.size());
+  TEST_ASSERT_FALSE(written && gzip.finish());
+  TEST_ASSERT_GREATER_THAN(0, calls);
+}
+
+// The server refuses gzip, uploads go again uncompressed and nothing is lost
+static void checkFallback(UploadMode mode) {
+  loopbackServer.acceptGzip = false;
+  uint32_t gzipUploads = 0;
+  uint32_t plainUploads = 0;
+  loopbackServer.onRequest =
+      [&](const std::string &path,
+          const std::map<std::string, std::string> &headers,
+          const std::string &body) {
+        if (path.find("/trip/upload_data") == std::string::npos) {
+          return;
+        }
+        auto it = headers.find("content-encoding");
+        if (it != headers.end() && it->second == "gzip") {
+          gzipUploads++;
+        } else {
+          plainUploads++;
+        }
+      };
+
+  BikeSenseBuilder builder = deviceBuilder(new SDCard(BINARY_RECORDS));
+  builder.withUploadMode(mode).withCompression(true);
+  BikeSense device = builder.build();
+  device.setup();
+
+  FixFeed feed;
+  feed.start();
+  stepFor(device, 90000);
+  clearInterrupts();
+  WiFi.setInRange(true);
+  stepFor(device, 120000);
+
+  TEST_ASSERT_EQUAL_UINT32(1, gzipUploads);
+  TEST_ASSERT_GREATER_THAN(0, plainUploads);
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.trips);
+  TEST_ASSERT_LESS_OR_EQUAL(feed.fixes, loopbackServer.stats.records);
+  TEST_ASSERT_GREATER_OR_EQUAL(feed.fixes - 2, loopbackServer.stats.records);
+}
+
+void test_batched_upload_falls_back_to_plain_json() {
+  checkFallback(BATCHED_UPLOAD);
+}
+
+void test_streamed_upload_falls_back_to_plain_json() {
+  checkFallback(STREAMED_UPLOAD);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_input_round_trips);
+  RUN_TEST(test_trip_json_round_trips_and_compresses);
+  RUN_TEST(test_output_does_not_depend_on_write_sizes);
+  RUN_TEST(test_incompressible_input_grows_by_at_most_an_eighth);
+  RUN_TEST(test_long_runs_use_the_longest_matches);
+  RUN_TEST(test_a_failing_sink_fails_the_stream);
+  RUN_TEST(test_batched_upload_falls_back_to_plain_json);
+  RUN_TEST(test_streamed_upload_falls_back_to_plain_json);
+  return UNITY_END();
+}
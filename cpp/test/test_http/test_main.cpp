@@ -0,0 +1,188 @@
+#include "../ride.h"
+
+#include <bikesense.h>
+#include <chunkedRequest.h>
+#include <httpSession.h>
+
+#include <HTTPClient.h>
+#include <unity.h>
+
+static const char *API_URL = "http://localhost:8080/api/v1";
+
+// Streams a small upload over the session, returns the status
+static int upload(ChunkedRequest &request) {
+  request.begin("/trip/upload_data");
+  request.addHeader("Trip-ID", "1");
+  int code = request.startPost();
+  if (code != 0) {
+    return code;
+  }
+  request.write("[{\"timestamp\":\"2024-05-01T08:00:00Z\"}]");
+  return request.finish();
+}
+
+void setUp() {
+  resetHost();
+  WiFi.mode(WIFI_STA);
+  WiFi.join("bikenet");
+  WiFi.setInRange(true);
+}
+
+void tearDown() { WiFi.setInRange(false); }
+
+void test_requests_share_one_connection() {
+  HttpSession session(5000);
+  TEST_ASSERT_TRUE(session.begin(API_URL));
+  ChunkedRequest request(session);
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_INT(201, upload(request));
+    TEST_ASSERT_EQUAL_STRING("{}", request.response().c_str());
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(3, loopbackServer.stats.uploads);
+  TEST_ASSERT_EQUAL_UINT32(3, loopbackServer.stats.records);
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.connects);
+  TEST_ASSERT_EQUAL_UINT32(1, session.stats().connects);
+  TEST_ASSERT_EQUAL_UINT32(3, session.stats().requests);
+}
+
+void test_a_chunked_answer_is_read_to_its_end() {
+  loopbackServer.chunkedUploadAnswers = true;
+  loopbackServer.uploadStatus = 500;
+  HttpSession session(5000);
+  session.begin(API_URL);
+  ChunkedRequest request(session);
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_INT(500, upload(request));
+    TEST_ASSERT_EQUAL_STRING("{}", request.response().c_str());
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.connects);
+}
+
+void test_answers_without_a_body_keep_the_connection() {
+  HttpSession session(5000);
+  session.begin(API_URL);
+  ChunkedRequest request(session);
+
+  // 204 has no length, 304 the length of a body it does not send
+  loopbackServer.uploadStatus = 204;
+  TEST_ASSERT_EQUAL_INT(204, upload(request));
+  TEST_ASSERT_EQUAL_STRING("", request.response().c_str());
+  loopbackServer.uploadStatus = 304;
+  TEST_ASSERT_EQUAL_INT(304, upload(request));
+  TEST_ASSERT_EQUAL_STRING("", request.response().c_str());
+  loopbackServer.uploadStatus = 201;
+  TEST_ASSERT_EQUAL_INT(201, upload(request));
+
+  TEST_ASSERT_EQUAL_UINT32(3, loopbackServer.stats.uploads);
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.connects);
+}
+
+void test_connections_opened_by_http_client_are_counted() {
+  HttpSession session(5000);
+  session.begin(API_URL);
+  HTTPClient http;
+  const String healthUrl = (std::string(API_URL) + "/check_health").c_str();
+
+  TEST_ASSERT_TRUE(session.connect());
+  http.begin(session.client(), healthUrl);
+  TEST_ASSERT_EQUAL_INT(200, http.GET());
+  http.end();
+
+  // The server went away between requests, HTTPClient reconnects by itself
+  session.client().stop();
+  http.begin(session.client(), healthUrl);
+  TEST_ASSERT_EQUAL_INT(200, http.GET());
+  http.end();
+
+  TEST_ASSERT_EQUAL_UINT32(2, loopbackServer.stats.connects);
+  TEST_ASSERT_EQUAL_UINT32(2, session.stats().connects);
+}
+
+void test_a_reply_slower_than_a_second_arrives() {
+  loopbackServer.replyDelayMs = 1500;
+  HttpSession session(BikeSense::DEFAULT_HTTP_TIMEOUT_MS);
+  session.begin(API_URL);
+  ChunkedRequest request(session);
+  const unsigned long startMs = millis();
+  TEST_ASSERT_EQUAL_INT(201, upload(request));
+  TEST_ASSERT_EQUAL_STRING("{}", request.response().c_str());
+  TEST_ASSERT_TRUE(millis() - startMs >= 1500);
+
+  HTTPClient http;
+  http.setTimeout(BikeSense::DEFAULT_HTTP_TIMEOUT_MS);
+  http.begin(session.client(),
+             (std::string(API_URL) + "/check_health").c_str());
+  TEST_ASSERT_EQUAL_INT(200, http.GET());
+  http.end();
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.connects);
+}
+
+void test_a_reply_after_the_timeout_is_not_taken_for_the_next() {
+  loopbackServer.replyDelayMs = 1500;
+  HttpSession session(1000);
+  session.begin(API_URL);
+  ChunkedRequest request(session);
+  TEST_ASSERT_EQUAL_INT(HTTPC_ERROR_READ_TIMEOUT, upload(request));
+
+  // The late answer went with the connection, the next one gets its own
+  loopbackServer.replyDelayMs = 0;
+  loopbackServer.uploadStatus = 500;
+  TEST_ASSERT_EQUAL_INT(500, upload(request));
+  TEST_ASSERT_EQUAL_UINT32(2, loopbackServer.stats.connects);
+}
+
+void test_a_failed_connection_is_counted() {
+  WiFi.setInRange(false);
+  HttpSession session(5000);
+  session.begin(API_URL);
+  ChunkedRequest request(session);
+  TEST_ASSERT_EQUAL_INT(HTTPC_ERROR_CONNECTION_FAILED, upload(request));
+  TEST_ASSERT_EQUAL_UINT32(1, session.stats().connects);
+  TEST_ASSERT_EQUAL_UINT32(0, loopbackServer.stats.connects);
+}
+
+void test_the_host_header_names_a_port_that_is_not_the_default() {
+  std::vector<std::string> hosts;
+  loopbackServer.onRequest =
+      [&hosts](const std::string &path,
+               const std::map<std::string, std::string> &headers,
+               const std::string &body) {
+        auto it = headers.find("host");
+        hosts.push_back(it == headers.end() ? "" : it->second);
+      };
+
+  for (const char *url : {API_URL, "http://localhost/api/v1",
+                          "https://localhost:443/api/v1"}) {
+    HttpSession session(5000);
+    TEST_ASSERT_TRUE(session.begin(url));
+    ChunkedRequest request(session);
+    TEST_ASSERT_EQUAL_INT(201, upload(request));
+
+    HTTPClient http;
+    http.begin(session.client(), (std::string(url) + "/check_health").c_str());
+    TEST_ASSERT_EQUAL_INT(200, http.GET());
+    http.end();
+    session.close();
+  }
+
+  TEST_ASSERT_EQUAL_size_t(6, hosts.size());
+  TEST_ASSERT_EQUAL_STRING("localhost:8080", hosts[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("localhost:8080", hosts[1].c_str());
+  for (size_t i = 2; i < hosts.size(); i++) {
+    TEST_ASSERT_EQUAL_STRING("localhost", hosts[i].c_str());
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_requests_share_one_connection);
+  RUN_TEST(test_a_chunked_answer_is_read_to_its_end);
+  RUN_TEST(test_answers_without_a_body_keep_the_connection);
+  RUN_TEST(test_connections_opened_by_http_client_are_counted);
+  RUN_TEST(test_a_reply_slower_than_a_second_arrives);
+  RUN_TEST(test_a_reply_after_the_timeout_is_not_taken_for_the_next);
+  RUN_TEST(test_a_failed_connection_is_counted);
+  RUN_TEST(test_the_host_header_names_a_port_that_is_not_the_default);
+  return UNITY_END();
+}
@@ -0,0 +1,196 @@
+#include "../ride.h"
+
+#include <instrumentation.h>
+#include <sdCard.h>
+
+#include <unity.h>
+
+#include <string>
+
+// Built twice: by env:native with the probes, and by
+// env:native_uninstrumented with -DBIKESENSE_INSTRUMENTATION=0
+
+// Bodies of the trip summaries the server saw
+static std::vector<std::string> summaries;
+
+static void dock(BikeSense &device) {
+  WiFi.setInRange(true);
+  stepFor(device, 60000);
+  WiFi.setInRange(false);
+}
+
+void setUp() {
+  resetHost();
+  summaries.clear();
+  loopbackServer.onRequest =
+      [](const std::string &path,
+         const std::map<std::string, std::string> &headers,
+         const std::string &body) {
+        if (body.find("trip_summary") != std::string::npos) {
+          summaries.push_back(body);
+        }
+      };
+}
+
+void tearDown() { clearInterrupts(); }
+
+#if BIKESENSE_INSTRUMENTATION
+
+void test_histograms_keep_totals_and_buckets() {
+  LatencyHistogram histogram;
+  TEST_ASSERT_EQUAL_UINT32(0, histogram.percentileUs(99));
+
+  for (uint32_t us : {0u, 3u, 100u, 120u, 900u}) {
+    histogram.record(us);
+  }
+  TEST_ASSERT_EQUAL_UINT32(5, histogram.count());
+  TEST_ASSERT_EQUAL_UINT64(1123, histogram.totalUs());
+  TEST_ASSERT_EQUAL_UINT32(224, histogram.meanUs());
+  TEST_ASSERT_EQUAL_UINT32(900, histogram.maxUs());
+  // 0 has a bucket of its own, 3 is in [2, 4), 100 and 120 in [64, 128)
+  TEST_ASSERT_EQUAL_UINT32(0, histogram.percentileUs(20));
+  TEST_ASSERT_EQUAL_UINT32(3, histogram.percentileUs(40));
+  TEST_ASSERT_EQUAL_UINT32(127, histogram.percentileUs(80));
+  // Never more than the longest one
+  TEST_ASSERT_EQUAL_UINT32(900, histogram.percentileUs(99));
+
+  histogram.record(UINT32_MAX);
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, histogram.maxUs());
+  TEST_ASSERT_EQUAL_UINT64(1123ULL + UINT32_MAX, histogram.totalUs());
+
+  histogram.reset();
+  TEST_ASSERT_EQUAL_UINT32(0, histogram.count());
+  TEST_ASSERT_EQUAL_UINT64(0, histogram.totalUs());
+}
+
+void test_probes_time_their_scope() {
+  LatencyHistogram histogram;
+  {
+    TIMING_START(timing, histogram);
+    advanceMicros(250);
+  }
+  {
+    TIMING_START(timing, histogram);
+    advanceMicros(100);
+    TIMING_STOP(timing);
+    // Stopped once, the end of the scope doesn't count again
+    advanceMicros(1000);
+  }
+  TEST_ASSERT_EQUAL_UINT32(2, histogram.count());
+  TEST_ASSERT_EQUAL_UINT64(350, histogram.totalUs());
+
+  int evaluated = 0;
+  INSTRUMENT(evaluated++);
+  TEST_ASSERT_EQUAL_INT(1, evaluated);
+}
+
+void test_the_summary_adds_up_the_timings() {
+  Instruments stats;
+  InstrumentCounters counters;
+  counters.droppedSamples = 5;
+  counters.droppedLogs = 2;
+  stats.reset(counters);
+
+  // 600 us active in the loop, 2400 us asleep
+  for (uint32_t us : {100u, 200u, 300u}) {
+    stats.loop(1).record(us);
+    stats.timing(TIMING_IDLE).record(800);
+  }
+  stats.timing(TIMING_STORE).record(40);
+  stats.timing(TIMING_STORE).record(60);
+  stats.sensorRead(0).record(70);
+  TEST_ASSERT_EQUAL_UINT32(2000, stats.activeBasisPoints());
+
+  counters.droppedSamples = 8;
+  counters.gpsOverruns = 1;
+  const char *const STATES[] = {"idle", "collecting"};
+  std::string out;
+  stats.writeSummary(counters, STATES, 2, out);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"trip_summary\":{\"timings_us\":{\"collecting\":[3,200,300,300],"
+      "\"store\":[2,50,60,60],\"idle\":[3,800,800,800],"
+      "\"sensor_0\":[1,70,70,70]},\"active_percent\":20.00,"
+      "\"dropped_samples\":3,\"dropped_logs\":0,\"gps_checksum_failures\":0,"
+      "\"gps_overruns\":1,\"heap_peak\":0}}",
+      out.c_str());
+
+  stats.reset(counters);
+  out.clear();
+  stats.writeSummary(counters, STATES, 2, out);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"trip_summary\":{\"timings_us\":{},\"active_percent\":0.00,"
+      "\"dropped_samples\":0,\"dropped_logs\":0,\"gps_checksum_failures\":0,"
+      "\"gps_overruns\":0,\"heap_peak\":0}}",
+      out.c_str());
+}
+
+void test_a_ride_is_either_looping_or_asleep() {
+  BikeSenseBuilder builder = deviceBuilder(new SDCard(BINARY_RECORDS));
+  BikeSense device = builder.build();
+  device.setup();
+  instruments().reset(InstrumentCounters());
+  const unsigned long startUs = micros();
+  FixFeed feed;
+  feed.start();
+  stepFor(device, 30000);
+  clearInterrupts();
+
+  uint64_t loopUs = 0;
+  uint32_t loops = 0;
+  for (size_t state = 0; state < Instruments::MAX_STATES; state++) {
+    loopUs += instruments().loop(state).totalUs();
+    loops += instruments().loop(state).count();
+  }
+  const LatencyHistogram &idle = instruments().timing(TIMING_IDLE);
+  TEST_ASSERT_EQUAL_UINT64(micros() - startUs, loopUs + idle.totalUs());
+  TEST_ASSERT_TRUE(loops >= idle.count());
+  TEST_ASSERT_EQUAL_UINT32(
+      loopUs * 10000 / (loopUs + idle.totalUs()),
+      instruments().activeBasisPoints());
+
+  // Every trip reports once
+  dock(device);
+  TEST_ASSERT_EQUAL_size_t(1, summaries.size());
+}
+
+#else
+
+void test_probes_compile_to_nothing() {
+  // Neither instruments() nor the histogram types exist to the linker in
+  // this build, the arguments must be gone along with the probes
+  int evaluated = 0;
+  TIMING_START(timing, instruments().timing((evaluated++, TIMING_STORE)));
+  INSTRUMENT(instruments().reset(InstrumentCounters()); evaluated++);
+  TIMING_STOP(timing);
+  TEST_ASSERT_EQUAL_INT(0, evaluated);
+}
+
+void test_a_ride_reports_no_summary() {
+  BikeSenseBuilder builder = deviceBuilder(new SDCard(BINARY_RECORDS));
+  BikeSense device = builder.build();
+  device.setup();
+  FixFeed feed;
+  feed.start();
+  stepFor(device, 30000);
+  clearInterrupts();
+
+  dock(device);
+  TEST_ASSERT_GREATER_THAN(0, loopbackServer.stats.uploads);
+  TEST_ASSERT_EQUAL_size_t(0, summaries.size());
+}
+
+#endif
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+#if BIKESENSE_INSTRUMENTATION
+  RUN_TEST(test_histograms_keep_totals_and_buckets);
+  RUN_TEST(test_probes_time_their_scope);
+  RUN_TEST(test_the_summary_adds_up_the_timings);
+  RUN_TEST(test_a_ride_is_either_looping_or_asleep);
+#else
+  RUN_TEST(test_probes_compile_to_nothing);
+  RUN_TEST(test_a_ride_reports_no_summary);
+#endif
+  return UNITY_END();
+}
@@ -0,0 +1,124 @@
+#include <dataRecord.h>
+#include <timestamp.h>
+
+#include <unity.h>
+
+#include <cmath>
+#include <string>
+
+static std::string formatted(double value) {
+  char out[MAX_JSON_NUMBER_SIZE];
+  return std::string(out, formatJsonNumber(value, out));
+}
+
+struct Golden {
+  double value;
+  const char *json;
+};
+
+// serializeRecord replaced a JsonDocument, its output must not have changed.
+// These were written out by hand from ArduinoJson 7 and are the only
+// reference: nine decimals for doubles, six for doubles that are exact
+// floats, exponents outside [1e-5, 1e7), no NaN
+static const Golden NUMBERS[] = {
+    {0, "0"},
+    {-0.0, "0"},
+    {0.5, "0.5"},
+    {-3.25, "-3.25"},
+    {0.15625, "0.15625"},
+    {41.178, "41.178"},
+    {41.1780123, "41.1780123"},
+    {-8.5980123, "-8.5980123"},
+    {61.7, "61.7"},
+    {0.1, "0.1"},
+    {(float)0.1, "0.1"},
+    {(float)-8.598, "-8.598"},
+    {(float)3.14159274, "3.141593"},
+    {1.0 / 3, "0.333333333"},
+    {2.0 / 3, "0.666666667"},
+    {0.9999999999, "1"},
+    {0.000123, "0.000123"},
+    {1.5e-5, "0.000015"},
+    {1e-5, "1e-5"},
+    {3e-7, "3e-7"},
+    {9999999.5, "9999999.5"},
+    {1e7, "1e7"},
+    {12345678.9, "1.23456789e7"},
+    {16777216, "1.677722e7"},
+    {4294967295.0, "4.294967295e9"},
+    {NAN, "null"},
+    {INFINITY, "null"},
+    {-INFINITY, "null"},
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_numbers_match_the_goldens() {
+  for (const Golden &golden : NUMBERS) {
+    TEST_ASSERT_EQUAL_STRING(golden.json, formatted(golden.value).c_str());
+  }
+}
+
+void test_a_full_record_matches_the_golden() {
+  DataRecord record;
+  record.timestampMs = epochMsFromCivil(2024, 2, 29, 23, 59, 59, 999);
+  record.gpsData.addMeasurement(LATITUDE, 41.1780123)
+      .addMeasurement(LONGITUDE, -8.598)
+      .addMeasurement(SPEED, 18.15)
+      .addMeasurement(SATELLITES_IN_USE, 9);
+  record.sensorData.addMeasurement(NOISE_LEVEL, 61.7)
+      .addMeasurement(TEMPERATURE, NAN)
+      .addMeasurement(HUMIDITY, 40.5)
+      .addMeasurement(AGGREGATE_COUNT, 12)
+      .addMeasurement(AGGREGATE_WINDOW, 1.5);
+
+  const std::string expected =
+      "{\"timestamp\":\"2024-02-29T23:59:59Z\","
+      "\"gps_data\":{\"latitude\":41.1780123,\"longitude\":-8.598,"
+      "\"speed\":18.15,\"satellites_in_use\":9},"
+      "\"noise_level\":61.7,\"temperature\":null,\"humidity\":40.5,"
+      "\"aggregate\":{\"count\":12,\"window\":1.5}}";
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), serializeRecord(record).c_str());
+}
+
+void test_absent_groups_are_left_out() {
+  DataRecord record;
+  record.timestampMs = 0;
+  TEST_ASSERT_EQUAL_STRING("{\"timestamp\":\"1970-01-01T00:00:00Z\"}",
+                           serializeRecord(record).c_str());
+
+  record.sensorData.addMeasurement(LUMINOSITY, 300);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"timestamp\":\"1970-01-01T00:00:00Z\",\"luminosity\":300}",
+      serializeRecord(record).c_str());
+
+  DataRecord gpsOnly;
+  gpsOnly.timestampMs = 1714550400000ULL;
+  gpsOnly.gpsData.addMeasurement(PDOP, 1.35);
+  TEST_ASSERT_EQUAL_STRING("{\"timestamp\":\"2024-05-01T08:00:00Z\","
+                           "\"gps_data\":{\"pdop\":1.35}}",
+                           serializeRecord(gpsOnly).c_str());
+}
+
+void test_a_record_that_does_not_fit_is_not_written() {
+  DataRecord record;
+  record.timestampMs = 0;
+  record.sensorData.addMeasurement(NOISE_LEVEL, 61.7);
+  const std::string json = serializeRecord(record);
+
+  char out[64];
+  TEST_ASSERT_EQUAL_size_t(json.size(),
+                           serializeRecord(record, out, json.size()));
+  TEST_ASSERT_EQUAL_size_t(0, serializeRecord(record, out, json.size() - 1));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_numbers_match_the_goldens);
+  RUN_TEST(test_a_full_record_matches_the_golden);
+  RUN_TEST(test_absent_groups_are_left_out);
+  RUN_TEST(test_a_record_that_does_not_fit_is_not_written);
+  return UNITY_END();
+}
@@ -0,0 +1,168 @@
+#include <noiseDsp.h>
+
+#include <unity.h>
+
+#include <cmath>
+#include <vector>
+
+static const uint32_t SAMPLE_RATE_HZ = 16000;
+static const size_t BLOCK_SIZE = 256;
+static const uint16_t MID_SCALE = 2048;
+
+// count samples of a sine around mid-scale, rounded to ADC counts like the
+// 12 bit converter would
+static std::vector<uint16_t> tone(double amplitude, double frequencyHz,
+                                  size_t count, uint16_t offset = MID_SCALE) {
+  std::vector<uint16_t> samples(count);
+  for (size_t i = 0; i < count; i++) {
+    const double phase = 2 * M_PI * frequencyHz * i / SAMPLE_RATE_HZ;
+    samples[i] = (uint16_t)std::lround(offset + amplitude * std::sin(phase));
+  }
+  return samples;
+}
+
+// Level of a sine of this amplitude, relative to an RMS of one count
+static double sineDb(double amplitude) {
+  return 20 * std::log10(amplitude / std::sqrt(2.0));
+}
+
+// 10 * log10 of the mean squared deviation, in hundredths of a dB
+static double referenceCentiDb(const std::vector<uint16_t> &samples) {
+  double mean = 0;
+  for (uint16_t sample : samples) {
+    mean += sample;
+  }
+  mean /= samples.size();
+  double energy = 0;
+  for (uint16_t sample : samples) {
+    energy += (sample - mean) * (sample - mean);
+  }
+  return 1000 * std::log10(energy / samples.size());
+}
+
+// Feeds samples block by block, like the DMA capture does
+static void feed(LeqMeter &meter, const std::vector<uint16_t> &samples) {
+  for (size_t at = 0; at < samples.size(); at += BLOCK_SIZE) {
+    meter.addBlock(samples.data() + at,
+                   std::min(BLOCK_SIZE, samples.size() - at));
+  }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_log2_is_exact_at_powers_of_two() {
+  for (int bit = 0; bit < 63; bit++) {
+    TEST_ASSERT_EQUAL_INT32(bit << 16, log2Q16(1ULL << bit));
+  }
+}
+
+void test_log2_follows_the_reference() {
+  uint64_t x = 3;
+  while (x < (1ULL << 62)) {
+    const double expected = std::log2((double)x) * 65536;
+    TEST_ASSERT_DOUBLE_WITHIN(0.0002 * 65536, expected, log2Q16(x));
+    x = x * 7 / 3 + 1;
+  }
+}
+
+void test_centi_db_follows_the_reference() {
+  const uint32_t samples = 4000;
+  for (uint64_t energy = 1; energy < (1ULL << 50); energy = energy * 5 + 3) {
+    const double expected = 1000 * std::log10((double)energy / samples);
+    TEST_ASSERT_DOUBLE_WITHIN(1, expected, energyToCentiDb(energy, samples));
+  }
+}
+
+void test_dc_has_no_energy() {
+  const std::vector<uint16_t> dc(BLOCK_SIZE, 3000);
+  TEST_ASSERT_EQUAL_UINT64(0, blockEnergy(dc.data(), dc.size()));
+  TEST_ASSERT_EQUAL_UINT64(0, blockEnergy(dc.data(), 0));
+}
+
+void test_square_wave_energy_is_exact() {
+  std::vector<uint16_t> square(BLOCK_SIZE);
+  for (size_t i = 0; i < square.size(); i++) {
+    square[i] = i % 8 < 4 ? MID_SCALE + 100 : MID_SCALE - 100;
+  }
+  TEST_ASSERT_EQUAL_UINT64(BLOCK_SIZE * 100 * 100,
+                           blockEnergy(square.data(), square.size()));
+}
+
+void test_sine_tones_read_their_rms_level() {
+  const double amplitudes[] = {10, 100, 707, 2000};
+  const double frequencies[] = {125, 1000, 4000};
+  for (double amplitude : amplitudes) {
+    for (double frequency : frequencies) {
+      const std::vector<uint16_t> samples =
+          tone(amplitude, frequency, SAMPLE_RATE_HZ / 4);
+      LeqMeter meter(samples.size());
+      feed(meter, samples);
+      TEST_ASSERT_TRUE(meter.windowComplete());
+      const int32_t level = meter.takeLeqCentiDb();
+      TEST_ASSERT_DOUBLE_WITHIN(1, referenceCentiDb(samples), level);
+      // Rounding to counts bends the quietest tone a little
+      TEST_ASSERT_DOUBLE_WITHIN(amplitude < 100 ? 15 : 2,
+                                100 * sineDb(amplitude), level);
+    }
+  }
+}
+
+void test_doubling_the_amplitude_adds_six_db() {
+  LeqMeter meter(SAMPLE_RATE_HZ);
+  feed(meter, tone(300, 1000, SAMPLE_RATE_HZ));
+  const int32_t quiet = meter.takeLeqCentiDb();
+  feed(meter, tone(600, 1000, SAMPLE_RATE_HZ));
+  const int32_t loud = meter.takeLeqCentiDb();
+  TEST_ASSERT_INT32_WITHIN(2, 602, loud - quiet);
+}
+
+void test_the_offset_of_the_microphone_does_not_matter() {
+  LeqMeter centred(SAMPLE_RATE_HZ);
+  feed(centred, tone(500, 1000, SAMPLE_RATE_HZ));
+  LeqMeter offset(SAMPLE_RATE_HZ);
+  feed(offset, tone(500, 1000, SAMPLE_RATE_HZ, 1200));
+  TEST_ASSERT_EQUAL_INT32(centred.takeLeqCentiDb(), offset.takeLeqCentiDb());
+}
+
+void test_leq_averages_energy_not_decibels() {
+  // Half a window loud, half quiet: the mean energy is dominated by the
+  // loud half, nowhere near the mean of the two levels
+  const double loud = 1000;
+  const double quiet = 10;
+  LeqMeter meter(SAMPLE_RATE_HZ);
+  feed(meter, tone(loud, 1000, SAMPLE_RATE_HZ / 2));
+  TEST_ASSERT_FALSE(meter.windowComplete());
+  feed(meter, tone(quiet, 1000, SAMPLE_RATE_HZ / 2));
+  TEST_ASSERT_TRUE(meter.windowComplete());
+
+  const double expected =
+      10 * std::log10((loud * loud + quiet * quiet) / 2 / 2);
+  TEST_ASSERT_DOUBLE_WITHIN(5, 100 * expected, meter.takeLeqCentiDb());
+}
+
+void test_taking_the_level_starts_a_new_window() {
+  LeqMeter meter(BLOCK_SIZE);
+  feed(meter, tone(1000, 1000, BLOCK_SIZE));
+  TEST_ASSERT_TRUE(meter.windowComplete());
+  TEST_ASSERT_GREATER_THAN(0, meter.takeLeqCentiDb());
+  TEST_ASSERT_FALSE(meter.windowComplete());
+  // Silence reads as 0
+  TEST_ASSERT_EQUAL_INT32(0, meter.takeLeqCentiDb());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_log2_is_exact_at_powers_of_two);
+  RUN_TEST(test_log2_follows_the_reference);
+  RUN_TEST(test_centi_db_follows_the_reference);
+  RUN_TEST(test_dc_has_no_energy);
+  RUN_TEST(test_square_wave_energy_is_exact);
+  RUN_TEST(test_sine_tones_read_their_rms_level);
+  RUN_TEST(test_doubling_the_amplitude_adds_six_db);
+  RUN_TEST(test_the_offset_of_the_microphone_does_not_matter);
+  RUN_TEST(test_leq_averages_energy_not_decibels);
+  RUN_TEST(test_taking_the_level_starts_a_new_window);
+  return UNITY_END();
+}
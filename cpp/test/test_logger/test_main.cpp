@@ -0,0 +1,222 @@
+#include "../ride.h"
+
+#include <logger.h>
+#include <sdCard.h>
+
+#include <unity.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static std::vector<LogEntry> drainAll() {
+  std::vector<LogEntry> entries(Logger::QUEUE_SIZE * 2);
+  entries.resize(logger().drain(entries.data(), entries.size()));
+  return entries;
+}
+
+static std::string format(const LogEntry &entry) {
+  char line[128];
+  formatLogEntry(entry, line, sizeof(line));
+  return line;
+}
+
+static uint32_t getLE(const std::string &data, size_t offset, size_t size) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < size; i++) {
+    value |= (uint32_t)(uint8_t)data[offset + i] << (8 * i);
+  }
+  return value;
+}
+
+// Expands a log file with the formats in its own header, the way
+// scripts/expand_logs.py does
+static std::vector<std::string> expandLogFile(const char *path) {
+  std::ifstream in(SD.hostPath(path), std::ios::binary);
+  const std::string data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  TEST_ASSERT_TRUE(data.size() >= 8);
+  TEST_ASSERT_EQUAL_STRING("BSL1", data.substr(0, 4).c_str());
+  TEST_ASSERT_EQUAL_UINT32(Logger::FILE_VERSION, getLE(data, 4, 1));
+  const size_t entrySize = getLE(data, 5, 1);
+  TEST_ASSERT_EQUAL_size_t(sizeof(LogEntry), entrySize);
+
+  std::vector<std::string> formats(getLE(data, 6, 2));
+  size_t offset = 8;
+  for (std::string &format : formats) {
+    const size_t length = getLE(data, offset, 1);
+    format = data.substr(offset + 1, length);
+    offset += 1 + length;
+  }
+
+  const char *LEVELS[] = {"DEBUG", "INFO", "ERROR"};
+  std::vector<std::string> lines;
+  for (; offset + entrySize <= data.size(); offset += entrySize) {
+    const uint32_t message = getLE(data, offset + 4, 2);
+    const uint32_t level = getLE(data, offset + 6, 1);
+    const uint32_t argCount = getLE(data, offset + 7, 1);
+    const std::string text = data.substr(offset + 24).c_str();
+    TEST_ASSERT_TRUE(message < formats.size());
+    TEST_ASSERT_TRUE(level < 3);
+
+    std::string line = "[" + std::to_string(getLE(data, offset, 4)) + "] [" +
+                       LEVELS[level] + "] ";
+    uint32_t arg = 0;
+    const std::string &format = formats[message];
+    for (size_t i = 0; i < format.size(); i++) {
+      if (format[i] != '%') {
+        line += format[i];
+        continue;
+      }
+      const char spec = format[++i];
+      const uint32_t value =
+          arg < argCount ? getLE(data, offset + 8 + 4 * arg, 4) : 0;
+      if (spec == 's') {
+        line += text;
+      } else if (spec == 'd') {
+        line += std::to_string((int32_t)value);
+        arg++;
+      } else {
+        line += std::to_string(value);
+        arg++;
+      }
+    }
+    lines.push_back(line);
+  }
+  TEST_ASSERT_EQUAL_size_t(data.size(), offset);
+  return lines;
+}
+
+void setUp() {
+  resetHost();
+  drainAll();
+}
+
+void tearDown() { clearInterrupts(); }
+
+void test_entries_below_the_level_are_compiled_out() {
+  TEST_ASSERT_EQUAL_INT(LOG_LEVEL_INFO, BIKESENSE_LOG_LEVEL);
+
+  // Arguments of a filtered entry aren't even evaluated
+  int evaluated = 0;
+  LOGD(LOG_POST_CODE, ++evaluated, 1);
+  TEST_ASSERT_EQUAL_INT(0, evaluated);
+  TEST_ASSERT_EQUAL_size_t(0, drainAll().size());
+
+  LOGI(LOG_POST_CODE, ++evaluated, 1);
+  LOGE(LOG_POST_CODE, ++evaluated, 2);
+  const std::vector<LogEntry> entries = drainAll();
+  TEST_ASSERT_EQUAL_INT(2, evaluated);
+  TEST_ASSERT_EQUAL_size_t(2, entries.size());
+  TEST_ASSERT_EQUAL_UINT8(LOG_LEVEL_INFO, entries[0].level);
+  TEST_ASSERT_EQUAL_UINT8(LOG_LEVEL_ERROR, entries[1].level);
+}
+
+void test_arguments_are_kept_as_words_and_one_text() {
+  LOGE(LOG_HTTP_ERROR, -11, "read Timeout");
+  LOGI(LOG_TIMING_STATS, std::string("gps_update"), 120u, 35u, 90u,
+       4000000000u);
+  logger().log(LOG_LEVEL_INFO, LOG_BLOCK_CORRUPT, 1, 2, 3, 4, 5);
+  LOGI(LOG_WIFI_CONNECTED,
+       "a network name much longer than the forty bytes of text");
+
+  const std::vector<LogEntry> entries = drainAll();
+  TEST_ASSERT_EQUAL_size_t(4, entries.size());
+
+  const LogEntry &http = entries[0];
+  TEST_ASSERT_EQUAL_UINT32(millis(), http.timeMs);
+  const std::string at = "[" + std::to_string(millis()) + "] ";
+  TEST_ASSERT_EQUAL_UINT16(LOG_HTTP_ERROR, http.message);
+  TEST_ASSERT_EQUAL_UINT8(1, http.argCount);
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFFFF5, http.args[0]);
+  TEST_ASSERT_EQUAL_STRING("read Timeout", http.text);
+  TEST_ASSERT_EQUAL_STRING(
+      (at + "[ERROR] HTTP error -11: read Timeout").c_str(),
+      format(http).c_str());
+
+  TEST_ASSERT_EQUAL_UINT8(4, entries[1].argCount);
+  TEST_ASSERT_EQUAL_STRING((at + "[INFO] gps_update: 120 calls, mean 35 us, "
+                                 "p99 under 90 us, max 4000000000 us")
+                               .c_str(),
+                           format(entries[1]).c_str());
+
+  // Words past the fourth are dropped, text past 39 bytes is cut
+  TEST_ASSERT_EQUAL_UINT8(LogEntry::MAX_ARGS, entries[2].argCount);
+  TEST_ASSERT_EQUAL_UINT32(4, entries[2].args[3]);
+  TEST_ASSERT_EQUAL_STRING("a network name much longer than the for",
+                           entries[3].text);
+}
+
+void test_formatting_stops_at_the_buffer() {
+  LOGE(LOG_HTTP_ERROR, 404, "not found");
+  LogEntry entry = drainAll()[0];
+  entry.timeMs = 0;
+
+  char line[16];
+  TEST_ASSERT_EQUAL_size_t(15, formatLogEntry(entry, line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("[0] [ERROR] HTT", line);
+
+  entry.message = LOG_MESSAGE_COUNT;
+  char unknown[64];
+  formatLogEntry(entry, unknown, sizeof(unknown));
+  TEST_ASSERT_EQUAL_STRING(
+      ("[0] [ERROR] Unknown message " + std::to_string(LOG_MESSAGE_COUNT))
+          .c_str(),
+      unknown);
+}
+
+void test_a_full_queue_drops_its_oldest_entries() {
+  const uint32_t dropped = logger().dropped();
+  for (uint32_t i = 0; i < Logger::QUEUE_SIZE + 8; i++) {
+    LOGE(LOG_SEGMENT_ADOPTED, i);
+  }
+  TEST_ASSERT_EQUAL_UINT32(dropped + 8, logger().dropped());
+
+  const std::vector<LogEntry> entries = drainAll();
+  TEST_ASSERT_EQUAL_size_t(Logger::QUEUE_SIZE, entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT32(8 + i, entries[i].args[0]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(dropped + 8, logger().dropped());
+}
+
+void test_the_card_log_expands_to_what_was_logged() {
+  SDCard *card = new SDCard(BINARY_RECORDS);
+  BikeSense device = deviceBuilder(card).build();
+  device.setup();
+  stepFor(device, 1000);
+  TEST_ASSERT_TRUE(card->sync());
+  const size_t before = expandLogFile("Bikesense_Logs.bin").size();
+
+  // Logged faster than the loop drains, the drop is logged as well
+  for (uint32_t i = 0; i < Logger::QUEUE_SIZE + 8; i++) {
+    LOGE(LOG_SEGMENT_ADOPTED, i);
+  }
+  const std::string at = "[" + std::to_string(millis()) + "] [ERROR] ";
+  stepFor(device, 2000);
+  TEST_ASSERT_TRUE(card->sync());
+
+  const std::vector<std::string> lines = expandLogFile("Bikesense_Logs.bin");
+  TEST_ASSERT_TRUE(lines.size() >= before + Logger::QUEUE_SIZE + 1);
+  for (uint32_t i = 0; i < Logger::QUEUE_SIZE; i++) {
+    TEST_ASSERT_EQUAL_STRING(
+        (at + "Segment " + std::to_string(8 + i) +
+         " was missing from the manifest")
+            .c_str(),
+        lines[before + i].c_str());
+  }
+  TEST_ASSERT_TRUE(lines[before + Logger::QUEUE_SIZE].find(
+                       "[ERROR] Log queue overflowed, 8 entries dropped") !=
+                   std::string::npos);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_entries_below_the_level_are_compiled_out);
+  RUN_TEST(test_arguments_are_kept_as_words_and_one_text);
+  RUN_TEST(test_formatting_stops_at_the_buffer);
+  RUN_TEST(test_a_full_queue_drops_its_oldest_entries);
+  RUN_TEST(test_the_card_log_expands_to_what_was_logged);
+  return UNITY_END();
+}
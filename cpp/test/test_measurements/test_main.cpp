@@ -0,0 +1,248 @@
+#include <measurements.h>
+#include <recordFormat.h>
+#include <sensorReading.h>
+
+#include <unity.h>
+
+#include <cmath>
+#include <cstring>
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_table_is_indexed_by_id() {
+  for (int id = 0; id < MEASUREMENT_COUNT; id++) {
+    TEST_ASSERT_EQUAL_INT(id, MEASUREMENTS[id].id);
+  }
+}
+
+void test_keys_are_unique_and_units_set() {
+  for (int a = 0; a < MEASUREMENT_COUNT; a++) {
+    TEST_ASSERT_GREATER_THAN(0, strlen(MEASUREMENTS[a].key));
+    TEST_ASSERT_NOT_NULL(MEASUREMENTS[a].unit);
+    for (int b = a + 1; b < MEASUREMENT_COUNT; b++) {
+      TEST_ASSERT_FALSE(strcmp(MEASUREMENTS[a].key, MEASUREMENTS[b].key) ==
+                        0);
+    }
+  }
+}
+
+void test_only_integer_fields_are_scaled() {
+  for (const auto &info : MEASUREMENTS) {
+    if (info.type == FIELD_F32) {
+      TEST_ASSERT_EQUAL_INT(0, info.scale);
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(0, info.scale);
+  }
+}
+
+void test_readings_start_empty() {
+  SensorReading reading;
+  TEST_ASSERT_TRUE(reading.empty());
+  TEST_ASSERT_EQUAL_UINT32(0, reading.presence());
+  for (int id = 0; id < MEASUREMENT_COUNT; id++) {
+    TEST_ASSERT_FALSE(reading.has((MeasurementId)id));
+    TEST_ASSERT_FALSE(reading.getMeasurement((MeasurementId)id).has_value());
+  }
+}
+
+void test_every_slot_keeps_its_value() {
+  SensorReading reading;
+  for (int id = 0; id < MEASUREMENT_COUNT; id++) {
+    reading.addMeasurement((MeasurementId)id, id * 1.5 - 3);
+  }
+
+  TEST_ASSERT_EQUAL_UINT32((1UL << MEASUREMENT_COUNT) - 1, reading.presence());
+  for (int id = 0; id < MEASUREMENT_COUNT; id++) {
+    TEST_ASSERT_TRUE(reading.has((MeasurementId)id));
+    TEST_ASSERT_EQUAL_DOUBLE(id * 1.5 - 3, reading.value((MeasurementId)id));
+    TEST_ASSERT_EQUAL_DOUBLE(id * 1.5 - 3,
+                             *reading.getMeasurement((MeasurementId)id));
+  }
+}
+
+void test_merging_takes_the_other_side() {
+  SensorReading gps;
+  gps.addMeasurement(LATITUDE, 41.178).addMeasurement(SPEED, 12.5);
+  gps.setAge(300);
+  SensorReading sensors;
+  sensors.addMeasurement(SPEED, 14).addMeasurement(NOISE_LEVEL, 61.7);
+
+  const SensorReading merged = gps + sensors;
+  TEST_ASSERT_EQUAL_UINT32(gps.presence() | sensors.presence(),
+                           merged.presence());
+  TEST_ASSERT_EQUAL_DOUBLE(41.178, merged.value(LATITUDE));
+  TEST_ASSERT_EQUAL_UINT16(300, merged.age(LATITUDE));
+  TEST_ASSERT_EQUAL_DOUBLE(14, merged.value(SPEED));
+  TEST_ASSERT_EQUAL_UINT16(0, merged.age(SPEED));
+  TEST_ASSERT_EQUAL_DOUBLE(61.7, merged.value(NOISE_LEVEL));
+  // The left side is left alone
+  TEST_ASSERT_EQUAL_DOUBLE(12.5, gps.value(SPEED));
+  TEST_ASSERT_FALSE(gps.has(NOISE_LEVEL));
+}
+
+void test_ages_saturate() {
+  SensorReading reading;
+  reading.addMeasurement(TEMPERATURE, 21).addMeasurement(HUMIDITY, 40);
+  reading.setAge(100000);
+  TEST_ASSERT_EQUAL_UINT16(UINT16_MAX, reading.age(TEMPERATURE));
+  reading.setAge(HUMIDITY, 1234);
+  TEST_ASSERT_EQUAL_UINT16(1234, reading.age(HUMIDITY));
+  // Only present measurements get an age
+  TEST_ASSERT_EQUAL_UINT16(0, reading.age(NOISE_LEVEL));
+}
+
+// A value every field can hold, in range and on its scale
+static double sampleValue(const MeasurementInfo &info) {
+  switch (info.type) {
+  case FIELD_U8:
+    return 9;
+  case FIELD_U16:
+    return 123 * std::pow(10.0, info.scale);
+  case FIELD_I32:
+    return -12345678 * std::pow(10.0, info.scale);
+  default:
+    return 0.15625; // exact as a float
+  }
+}
+
+// Encodes the record and checks every measurement of it comes back
+static void assertRoundTrip(const DataRecord &record) {
+  EncodedRecord encoded;
+  BinaryRecordFormat::encode(record, encoded.bytes);
+  const DataRecord decoded = BinaryRecordFormat::decode(encoded.bytes);
+
+  TEST_ASSERT_EQUAL_UINT64(record.timestampMs, decoded.timestampMs);
+  TEST_ASSERT_EQUAL_UINT32(record.gpsData.presence(),
+                           decoded.gpsData.presence());
+  TEST_ASSERT_EQUAL_UINT32(record.sensorData.presence(),
+                           decoded.sensorData.presence());
+  for (const auto &info : MEASUREMENTS) {
+    const SensorReading &target =
+        info.group == GROUP_GPS ? decoded.gpsData : decoded.sensorData;
+    if (!target.has(info.id)) {
+      continue;
+    }
+    TEST_ASSERT_DOUBLE_WITHIN(std::pow(10.0, info.scale) / 2,
+                              sampleValue(info), target.value(info.id));
+    TEST_ASSERT_EQUAL_UINT16(1200, target.age(info.id));
+  }
+}
+
+void test_binary_records_round_trip_every_field() {
+  DataRecord record;
+  record.timestampMs = 1714550400123ULL;
+  for (const auto &info : MEASUREMENTS) {
+    if (info.group == GROUP_AGGREGATE) {
+      continue;
+    }
+    SensorReading &target =
+        info.group == GROUP_GPS ? record.gpsData : record.sensorData;
+    target.addMeasurement(info.id, sampleValue(info));
+    target.setAge(info.id, 1200);
+  }
+  assertRoundTrip(record);
+
+  // An aggregate record: a position, the mean and its statistics
+  DataRecord aggregate;
+  aggregate.timestampMs = 1714550400123ULL;
+  aggregate.gpsData = record.gpsData;
+  for (const auto &info : MEASUREMENTS) {
+    if (info.group == GROUP_AGGREGATE || info.id == TEMPERATURE) {
+      aggregate.sensorData.addMeasurement(info.id, sampleValue(info));
+      aggregate.sensorData.setAge(info.id, 1200);
+    }
+  }
+  assertRoundTrip(aggregate);
+}
+
+void test_aggregate_rows_only_hold_their_fields() {
+  TEST_ASSERT_EQUAL_size_t(77, BinaryRecordFormat::recordSize());
+
+  DataRecord record;
+  record.timestampMs = 1;
+  record.gpsData.addMeasurement(LATITUDE, 41.1780123);
+  record.sensorData.addMeasurement(HUMIDITY, 40.5)
+      .addMeasurement(AGGREGATE_COUNT, 30)
+      .addMeasurement(AGGREGATE_WINDOW, 30);
+
+  EncodedRecord encoded;
+  BinaryRecordFormat::encode(record, encoded.bytes);
+  const uint32_t mask = record.sensorData.presence() | 1UL << LATITUDE;
+  const RowLayout layout = BinaryRecordFormat::layout(mask);
+  TEST_ASSERT_EQUAL_UINT8(BinaryRecordFormat::ROW_HEADER_SIZE,
+                          layout.slot[LATITUDE]);
+  TEST_ASSERT_EQUAL_UINT8(layout.slot[LATITUDE] + 4, layout.slot[HUMIDITY]);
+  TEST_ASSERT_EQUAL_UINT8(0, layout.slot[LONGITUDE]);
+  TEST_ASSERT_EQUAL_UINT8(0, layout.slot[AGGREGATE_MIN]);
+  TEST_ASSERT_EQUAL_UINT8(BinaryRecordFormat::ROW_HEADER_SIZE + 12 + 4,
+                          layout.size);
+  for (size_t i = layout.size; i < BinaryRecordFormat::recordSize(); i++) {
+    TEST_ASSERT_EQUAL_UINT8(0, encoded.bytes[i]);
+  }
+
+  // More sensor measurements than a row holds, the last ones go
+  for (const auto &info : MEASUREMENTS) {
+    if (info.group != GROUP_GPS) {
+      record.sensorData.addMeasurement(info.id, sampleValue(info));
+    } else {
+      record.gpsData.addMeasurement(info.id, sampleValue(info));
+    }
+  }
+  BinaryRecordFormat::encode(record, encoded.bytes);
+  const DataRecord decoded = BinaryRecordFormat::decode(encoded.bytes);
+  TEST_ASSERT_EQUAL_UINT32(record.gpsData.presence(),
+                           decoded.gpsData.presence());
+  TEST_ASSERT_TRUE(decoded.sensorData.has(CARBON_MONOXIDE_LEVEL));
+  TEST_ASSERT_TRUE(decoded.sensorData.has(AGGREGATE_WINDOW));
+  TEST_ASSERT_FALSE(decoded.sensorData.has(HUMIDITY));
+}
+
+void test_binary_records_drop_absent_and_nan_values() {
+  DataRecord record;
+  record.timestampMs = 1;
+  record.gpsData.addMeasurement(LATITUDE, 41.1780123);
+  record.sensorData.addMeasurement(NOISE_LEVEL, NAN)
+      .addMeasurement(TEMPERATURE, 21.5);
+
+  EncodedRecord encoded;
+  BinaryRecordFormat::encode(record, encoded.bytes);
+  const DataRecord decoded = BinaryRecordFormat::decode(encoded.bytes);
+
+  TEST_ASSERT_EQUAL_UINT32(1UL << LATITUDE, decoded.gpsData.presence());
+  TEST_ASSERT_EQUAL_UINT32(1UL << TEMPERATURE, decoded.sensorData.presence());
+  TEST_ASSERT_DOUBLE_WITHIN(1e-7, 41.1780123, decoded.gpsData.value(LATITUDE));
+  TEST_ASSERT_EQUAL_DOUBLE(21.5, decoded.sensorData.value(TEMPERATURE));
+}
+
+void test_binary_records_clamp_out_of_range_values() {
+  DataRecord record;
+  record.timestampMs = 1;
+  record.gpsData.addMeasurement(SATELLITES_IN_USE, 300)
+      .addMeasurement(SPEED, -4);
+
+  EncodedRecord encoded;
+  BinaryRecordFormat::encode(record, encoded.bytes);
+  const DataRecord decoded = BinaryRecordFormat::decode(encoded.bytes);
+
+  TEST_ASSERT_EQUAL_DOUBLE(UINT8_MAX,
+                           decoded.gpsData.value(SATELLITES_IN_USE));
+  TEST_ASSERT_EQUAL_DOUBLE(0, decoded.gpsData.value(SPEED));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_table_is_indexed_by_id);
+  RUN_TEST(test_keys_are_unique_and_units_set);
+  RUN_TEST(test_only_integer_fields_are_scaled);
+  RUN_TEST(test_readings_start_empty);
+  RUN_TEST(test_every_slot_keeps_its_value);
+  RUN_TEST(test_merging_takes_the_other_side);
+  RUN_TEST(test_ages_saturate);
+  RUN_TEST(test_binary_records_round_trip_every_field);
+  RUN_TEST(test_aggregate_rows_only_hold_their_fields);
+  RUN_TEST(test_binary_records_drop_absent_and_nan_values);
+  RUN_TEST(test_binary_records_clamp_out_of_range_values);
+  return UNITY_END();
+}
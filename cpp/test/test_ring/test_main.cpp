@@ -0,0 +1,110 @@
+#include <ringBuffer.h>
+
+#include <unity.h>
+
+#include <atomic>
+#include <thread>
+
+// The producer and the consumer are real threads here, not the turn-taking
+// cores of lib/HostHal, so they do race
+static const uint32_t ITEMS = 1000000;
+static const size_t CAPACITY = 8;
+
+// check lets the consumer tell a copy torn by the producer
+struct Item {
+  uint32_t seq;
+  uint32_t check;
+};
+
+struct Consumed {
+  uint32_t items = 0;
+  uint32_t torn = 0;
+  uint32_t outOfOrder = 0;
+};
+
+static Consumed stress(SpscRing<Item, CAPACITY> &ring, bool &allPushed) {
+  std::atomic<bool> done{false};
+  Consumed consumed;
+
+  std::thread consumer([&ring, &done, &consumed]() {
+    Item item;
+    int64_t last = -1;
+    while (true) {
+      // Read done first, anything pushed before it was set is in the ring
+      const bool finished = done;
+      if (!ring.pop(item)) {
+        if (finished) {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+      consumed.items++;
+      consumed.torn += item.check != ~item.seq;
+      consumed.outOfOrder += (int64_t)item.seq <= last;
+      last = item.seq;
+    }
+  });
+
+  allPushed = true;
+  for (uint32_t seq = 0; seq < ITEMS; seq++) {
+    allPushed &= ring.push({seq, ~seq});
+  }
+  done = true;
+  consumer.join();
+  return consumed;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_drop_oldest_hands_out_every_kept_item_once_and_in_order() {
+  static SpscRing<Item, CAPACITY> ring(DROP_OLDEST);
+  bool allPushed;
+  const Consumed consumed = stress(ring, allPushed);
+
+  TEST_ASSERT_EQUAL_UINT32(ITEMS, ring.pushed());
+  TEST_ASSERT_EQUAL_UINT32(ITEMS, consumed.items + ring.dropped());
+  TEST_ASSERT_EQUAL_UINT32(0, consumed.torn);
+  TEST_ASSERT_EQUAL_UINT32(0, consumed.outOfOrder);
+  TEST_ASSERT_EQUAL_size_t(0, ring.size());
+  TEST_ASSERT_LESS_OR_EQUAL(CAPACITY, ring.highWater());
+  TEST_ASSERT_EQUAL(ring.dropped() == 0, allPushed);
+}
+
+void test_drop_newest_never_overwrites() {
+  static SpscRing<Item, CAPACITY> ring(DROP_NEWEST);
+  bool allPushed;
+  const Consumed consumed = stress(ring, allPushed);
+
+  TEST_ASSERT_EQUAL_UINT32(ITEMS, ring.pushed() + ring.dropped());
+  TEST_ASSERT_EQUAL_UINT32(ring.pushed(), consumed.items);
+  TEST_ASSERT_EQUAL_UINT32(0, consumed.torn);
+  TEST_ASSERT_EQUAL_UINT32(0, consumed.outOfOrder);
+  TEST_ASSERT_EQUAL_size_t(0, ring.size());
+  TEST_ASSERT_LESS_OR_EQUAL(CAPACITY, ring.highWater());
+}
+
+void test_a_full_ring_keeps_the_newest_items() {
+  SpscRing<Item, CAPACITY> ring(DROP_OLDEST);
+  for (uint32_t seq = 0; seq < 3 * CAPACITY; seq++) {
+    ring.push({seq, ~seq});
+  }
+
+  Item item;
+  for (uint32_t seq = 2 * CAPACITY; seq < 3 * CAPACITY; seq++) {
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(seq, item.seq);
+  }
+  TEST_ASSERT_FALSE(ring.pop(item));
+  TEST_ASSERT_EQUAL_UINT32(2 * CAPACITY, ring.dropped());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_drop_oldest_hands_out_every_kept_item_once_and_in_order);
+  RUN_TEST(test_drop_newest_never_overwrites);
+  RUN_TEST(test_a_full_ring_keeps_the_newest_items);
+  return UNITY_END();
+}
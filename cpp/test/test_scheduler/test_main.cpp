@@ -0,0 +1,186 @@
+#include <sensorScheduler.h>
+
+#include <unity.h>
+
+#include <vector>
+
+// Simulated millis(), the scheduler only sees time move when a test moves it
+static uint32_t nowMs;
+
+static unsigned long simulatedClock() { return nowMs; }
+
+// Reports its id under NOISE_LEVEL and takes readCostMs of the loop's time
+class FakeSensor : public SensorInterface {
+private:
+  const uint32_t PERIOD_MS;
+  const uint32_t DEADLINE_MS;
+  const double ID;
+
+public:
+  uint32_t readCostMs = 0;
+  std::vector<uint32_t> readsAt;
+
+  FakeSensor(double id, uint32_t periodMs, uint32_t deadlineMs)
+      : PERIOD_MS(periodMs), DEADLINE_MS(deadlineMs), ID(id) {}
+
+  void setup() override {}
+  SensorReading read() override {
+    readsAt.push_back(nowMs);
+    nowMs += readCostMs;
+    SensorReading reading;
+    reading.addMeasurement(NOISE_LEVEL, ID);
+    return reading;
+  }
+  uint32_t periodMs() const override { return PERIOD_MS; }
+  uint32_t deadlineMs() const override { return DEADLINE_MS; }
+};
+
+// Polls every stepMs until endMs, like a loop woken on a fixed tick
+static void runUntil(SensorScheduler &scheduler, uint32_t endMs,
+                     uint32_t stepMs = 1) {
+  while ((int32_t)(endMs - nowMs) > 0) {
+    scheduler.poll();
+    nowMs += stepMs;
+  }
+}
+
+void setUp() { nowMs = 10000; }
+
+void tearDown() {}
+
+void test_each_sensor_keeps_its_own_period() {
+  FakeSensor fast(1, 100, 50);
+  FakeSensor slow(2, 1000, 500);
+  SensorScheduler scheduler({&fast, &slow}, simulatedClock);
+  scheduler.start();
+  const uint32_t startMs = nowMs;
+  runUntil(scheduler, startMs + 10000);
+
+  TEST_ASSERT_EQUAL_size_t(100, fast.readsAt.size());
+  TEST_ASSERT_EQUAL_size_t(10, slow.readsAt.size());
+  // No drift: every read is on the sensor's cadence, one read per poll may
+  // push the other sensor back by a millisecond
+  for (size_t i = 0; i < slow.readsAt.size(); i++) {
+    TEST_ASSERT_UINT32_WITHIN(1, startMs + 1000 * i, slow.readsAt[i]);
+  }
+  for (size_t i = 0; i < fast.readsAt.size(); i++) {
+    TEST_ASSERT_UINT32_WITHIN(1, startMs + 100 * i, fast.readsAt[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.deadlineMisses());
+}
+
+void test_one_read_per_poll_earliest_deadline_first() {
+  FakeSensor relaxed(1, 1000, 900);
+  FakeSensor urgent(2, 1000, 10);
+  SensorScheduler scheduler({&relaxed, &urgent}, simulatedClock);
+  scheduler.start();
+
+  const SensorReading *first = scheduler.poll();
+  TEST_ASSERT_NOT_NULL(first);
+  TEST_ASSERT_EQUAL_DOUBLE(2, first->value(NOISE_LEVEL));
+  const SensorReading *second = scheduler.poll();
+  TEST_ASSERT_NOT_NULL(second);
+  TEST_ASSERT_EQUAL_DOUBLE(1, second->value(NOISE_LEVEL));
+  TEST_ASSERT_NULL(scheduler.poll());
+}
+
+// The sensor with the earliest deadline goes first and blocks the loop for
+// readCostMs
+static uint32_t missesBehind(uint32_t readCostMs) {
+  FakeSensor blocking(1, 1000, 5);
+  FakeSensor tight(2, 1000, 20);
+  blocking.readCostMs = readCostMs;
+  SensorScheduler scheduler({&blocking, &tight}, simulatedClock);
+  scheduler.start();
+  runUntil(scheduler, nowMs + 5000);
+  TEST_ASSERT_EQUAL_size_t(5, tight.readsAt.size());
+  return scheduler.deadlineMisses();
+}
+
+void test_a_slow_read_makes_the_next_one_miss_its_deadline() {
+  TEST_ASSERT_EQUAL_UINT32(0, missesBehind(10));
+  TEST_ASSERT_EQUAL_UINT32(5, missesBehind(50));
+}
+
+void test_falling_a_period_behind_skips_instead_of_bursting() {
+  FakeSensor sensor(1, 100, 50);
+  SensorScheduler scheduler({&sensor}, simulatedClock);
+  scheduler.start();
+  const uint32_t startMs = nowMs;
+  scheduler.poll();
+
+  // The loop was held up for 1 s
+  nowMs += 1000;
+  TEST_ASSERT_NOT_NULL(scheduler.poll());
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler.deadlineMisses());
+  TEST_ASSERT_NULL(scheduler.poll());
+  TEST_ASSERT_EQUAL_UINT32(100, scheduler.msUntilDue());
+
+  runUntil(scheduler, startMs + 1000 + 1000);
+  // One catch-up read, then back on a 100 ms cadence from it
+  TEST_ASSERT_EQUAL_size_t(2 + 9, sensor.readsAt.size());
+  TEST_ASSERT_EQUAL_UINT32(startMs + 1000 + 900, sensor.readsAt.back());
+}
+
+void test_ms_until_due_follows_the_earliest_sensor() {
+  FakeSensor a(1, 300, 100);
+  FakeSensor b(2, 500, 100);
+  SensorScheduler scheduler({&a, &b}, simulatedClock);
+  scheduler.start();
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.msUntilDue());
+  scheduler.poll();
+  scheduler.poll();
+  TEST_ASSERT_EQUAL_UINT32(300, scheduler.msUntilDue());
+  nowMs += 120;
+  TEST_ASSERT_EQUAL_UINT32(180, scheduler.msUntilDue());
+  nowMs += 180;
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.msUntilDue());
+}
+
+void test_snapshot_ages_readings_and_leaves_stale_ones_out() {
+  FakeSensor sensor(7, 1000, 200);
+  SensorScheduler scheduler({&sensor}, simulatedClock);
+  TEST_ASSERT_TRUE(scheduler.snapshot().empty());
+
+  scheduler.start();
+  scheduler.poll();
+  nowMs += 450;
+  SensorReading snapshot = scheduler.snapshot();
+  TEST_ASSERT_TRUE(snapshot.has(NOISE_LEVEL));
+  TEST_ASSERT_EQUAL_DOUBLE(7, snapshot.value(NOISE_LEVEL));
+  TEST_ASSERT_EQUAL_UINT16(450, snapshot.age(NOISE_LEVEL));
+
+  // Not read again within period plus deadline
+  nowMs += 1200 - 450;
+  TEST_ASSERT_TRUE(scheduler.snapshot().has(NOISE_LEVEL));
+  nowMs += 1;
+  TEST_ASSERT_TRUE(scheduler.snapshot().empty());
+}
+
+void test_millis_wrap_around_keeps_the_cadence() {
+  nowMs = UINT32_MAX - 2500;
+  FakeSensor sensor(1, 1000, 500);
+  SensorScheduler scheduler({&sensor}, simulatedClock);
+  scheduler.start();
+  const uint32_t startMs = nowMs;
+  runUntil(scheduler, startMs + 6000);
+
+  TEST_ASSERT_EQUAL_size_t(6, sensor.readsAt.size());
+  for (size_t i = 0; i < sensor.readsAt.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(startMs + 1000 * i),
+                             sensor.readsAt[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.deadlineMisses());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_each_sensor_keeps_its_own_period);
+  RUN_TEST(test_one_read_per_poll_earliest_deadline_first);
+  RUN_TEST(test_a_slow_read_makes_the_next_one_miss_its_deadline);
+  RUN_TEST(test_falling_a_period_behind_skips_instead_of_bursting);
+  RUN_TEST(test_ms_until_due_follows_the_earliest_sensor);
+  RUN_TEST(test_snapshot_ages_readings_and_leaves_stale_ones_out);
+  RUN_TEST(test_millis_wrap_around_keeps_the_cadence);
+  return UNITY_END();
+}
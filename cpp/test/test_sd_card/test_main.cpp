@@ -0,0 +1,213 @@
+#include "../ride.h"
+
+#include <sdCard.h>
+
+#include <unity.h>
+
+#include <filesystem>
+
+static DataRecord sample(uint32_t second) {
+  DataRecord record;
+  record.timestampMs = 1714550400000ULL + second * 1000ULL;
+  record.gpsData.addMeasurement(LATITUDE, 41.178 + second * 2e-6)
+      .addMeasurement(LONGITUDE, -8.598);
+  record.sensorData.addMeasurement(NOISE_LEVEL, 61.5);
+  return record;
+}
+
+// Seals the open segment and counts the records the cursor hands out,
+// clearing every segment it read
+static uint32_t recordsOnCard(SDCard &card) {
+  TEST_ASSERT_TRUE(card.seal());
+  uint32_t records = 0;
+  while (card.openCursor()) {
+    RecordBatch batch;
+    while (card.nextBatch(50, batch)) {
+      records += batch.size();
+    }
+    TEST_ASSERT_TRUE(card.clear());
+  }
+  return records;
+}
+
+static bool leftoverNewFiles() {
+  for (const auto &entry :
+       std::filesystem::directory_iterator(SD.hostPath("/"))) {
+    if (entry.path().extension() == ".new") {
+      return true;
+    }
+  }
+  return false;
+}
+
+void setUp() { resetHost(); }
+
+void tearDown() { SD.failWritesAfter(UINT64_MAX); }
+
+void test_an_interrupted_state_write_keeps_the_old_value() {
+  SDCard card(BINARY_RECORDS);
+  TEST_ASSERT_TRUE(card.setup());
+  TEST_ASSERT_TRUE(card.saveState("batch_size", "40"));
+
+  SD.failWritesAfter(1);
+  TEST_ASSERT_FALSE(card.saveState("batch_size", "120"));
+  SD.failWritesAfter(UINT64_MAX);
+
+  std::string value;
+  TEST_ASSERT_TRUE(card.loadState("batch_size", value));
+  TEST_ASSERT_EQUAL_STRING("40", value.c_str());
+  TEST_ASSERT_FALSE(leftoverNewFiles());
+
+  TEST_ASSERT_TRUE(card.saveState("batch_size", "120"));
+  TEST_ASSERT_TRUE(card.loadState("batch_size", value));
+  TEST_ASSERT_EQUAL_STRING("120", value.c_str());
+}
+
+void test_an_interrupted_manifest_write_keeps_the_segments() {
+  {
+    SDCard card(BINARY_RECORDS);
+    TEST_ASSERT_TRUE(card.setup());
+    for (uint32_t second = 0; second < 30; second++) {
+      TEST_ASSERT_TRUE(card.store(sample(second)));
+    }
+    TEST_ASSERT_TRUE(card.seal());
+    for (uint32_t second = 30; second < 50; second++) {
+      TEST_ASSERT_TRUE(card.store(sample(second)));
+    }
+    TEST_ASSERT_TRUE(card.sync());
+
+    // Sealing again has to write the manifest, the card gives out on it
+    SD.failWritesAfter(0);
+    TEST_ASSERT_FALSE(card.seal());
+    SD.failWritesAfter(UINT64_MAX);
+  }
+
+  // The next boot still finds both segments
+  SDCard card(BINARY_RECORDS);
+  TEST_ASSERT_TRUE(card.setup());
+  TEST_ASSERT_FALSE(leftoverNewFiles());
+  TEST_ASSERT_EQUAL_UINT32(50, recordsOnCard(card));
+}
+
+// Keeps only the last line of the manifest, the open segment
+static void forgetSealedSegments() {
+  File f = SD.open("Bikesense_manifest.txt", FILE_READ);
+  std::string manifest(f.size(), '\0');
+  f.read((uint8_t *)&manifest[0], manifest.size());
+  f.close();
+  manifest.pop_back();
+  manifest = manifest.substr(manifest.rfind('\n') + 1) + "\n";
+
+  SD.remove("Bikesense_manifest.txt");
+  f = SD.open("Bikesense_manifest.txt", FILE_WRITE);
+  f.write((const uint8_t *)manifest.data(), manifest.size());
+  f.close();
+}
+
+static void adoptsMissingSegments(StorageFormat written, StorageFormat format,
+                                  bool lostManifest) {
+  resetHost();
+  {
+    SDCard card(written);
+    TEST_ASSERT_TRUE(card.setup());
+    for (uint32_t second = 0; second < 30; second++) {
+      TEST_ASSERT_TRUE(card.store(sample(second)));
+    }
+    TEST_ASSERT_TRUE(card.seal());
+    for (uint32_t second = 30; second < 50; second++) {
+      TEST_ASSERT_TRUE(card.store(sample(second)));
+    }
+    TEST_ASSERT_TRUE(card.sync());
+  }
+  if (lostManifest) {
+    TEST_ASSERT_TRUE(SD.remove("Bikesense_manifest.txt"));
+  } else {
+    forgetSealedSegments();
+  }
+
+  SDCard card(format);
+  TEST_ASSERT_TRUE(card.setup());
+  TEST_ASSERT_EQUAL_UINT32(50, recordsOnCard(card));
+}
+
+void test_segments_missing_from_the_manifest_are_adopted() {
+  for (StorageFormat format : {BINARY_RECORDS, COLUMNAR_BLOCKS, JSON_LINES}) {
+    adoptsMissingSegments(format, format, false);
+    adoptsMissingSegments(format, format, true);
+  }
+}
+
+void test_segments_of_another_format_are_adopted() {
+  // Flashed with a build writing another format after losing the manifest
+  adoptsMissingSegments(BINARY_RECORDS, COLUMNAR_BLOCKS, true);
+  adoptsMissingSegments(COLUMNAR_BLOCKS, JSON_LINES, true);
+  adoptsMissingSegments(JSON_LINES, BINARY_RECORDS, true);
+
+  // Anything else with the prefix is left alone
+  File f = SD.open("Bikesense_seg7.dat", FILE_WRITE);
+  f.write((const uint8_t *)"x", 1);
+  f.close();
+  SDCard card(BINARY_RECORDS);
+  TEST_ASSERT_TRUE(card.setup());
+  TEST_ASSERT_EQUAL_UINT32(0, recordsOnCard(card));
+  TEST_ASSERT_TRUE(SD.exists("Bikesense_seg7.dat"));
+}
+
+// Writes lines of the given seconds the way the baseline firmware did
+static void writeBaselineFile(const char *path, uint32_t from, uint32_t to) {
+  File f = SD.open(path, FILE_WRITE);
+  for (uint32_t second = from; second < to; second++) {
+    const std::string line = serializeRecord(sample(second)) + "\n";
+    f.write((const uint8_t *)line.data(), line.size());
+  }
+  f.close();
+}
+
+void test_baseline_files_are_read_as_json_on_a_binary_card() {
+  writeBaselineFile("Bikesense_upload.txt", 0, 20);
+  writeBaselineFile("Bikesense.txt", 20, 35);
+
+  SDCard card(BINARY_RECORDS);
+  TEST_ASSERT_TRUE(card.setup());
+  TEST_ASSERT_FALSE(SD.exists("Bikesense.txt"));
+  TEST_ASSERT_FALSE(SD.exists("Bikesense_upload.txt"));
+  for (uint32_t second = 35; second < 50; second++) {
+    TEST_ASSERT_TRUE(card.store(sample(second)));
+  }
+  TEST_ASSERT_TRUE(card.seal());
+
+  // Oldest first, every record as it was written
+  uint32_t second = 0;
+  while (card.openCursor()) {
+    RecordBatch batch;
+    while (card.nextBatch(8, batch)) {
+      for (std::string_view record : batch) {
+        TEST_ASSERT_EQUAL_STRING(serializeRecord(sample(second++)).c_str(),
+                                 std::string(record).c_str());
+      }
+    }
+    TEST_ASSERT_TRUE(card.clear());
+  }
+  TEST_ASSERT_EQUAL_UINT32(50, second);
+  TEST_ASSERT_FALSE(SD.exists("Bikesense_old1.txt"));
+
+  // The manifest remembers the format of the segments still on the card
+  writeBaselineFile("Bikesense.txt", 50, 60);
+  {
+    SDCard rebooted(BINARY_RECORDS);
+    TEST_ASSERT_TRUE(rebooted.setup());
+  }
+  SDCard rebooted(BINARY_RECORDS);
+  TEST_ASSERT_TRUE(rebooted.setup());
+  TEST_ASSERT_EQUAL_UINT32(10, recordsOnCard(rebooted));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_an_interrupted_state_write_keeps_the_old_value);
+  RUN_TEST(test_an_interrupted_manifest_write_keeps_the_segments);
+  RUN_TEST(test_segments_missing_from_the_manifest_are_adopted);
+  RUN_TEST(test_segments_of_another_format_are_adopted);
+  RUN_TEST(test_baseline_files_are_read_as_json_on_a_binary_card);
+  return UNITY_END();
+}
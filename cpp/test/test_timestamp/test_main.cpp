@@ -0,0 +1,142 @@
+#include <timestamp.h>
+
+#include <unity.h>
+
+#include <ctime>
+
+// The C library's calendar is the reference: timegm and gmtime_r are
+// proleptic Gregorian UTC on a 64-bit time_t
+static int64_t referenceSeconds(int year, unsigned month, unsigned day,
+                                unsigned hour = 0, unsigned minute = 0,
+                                unsigned second = 0) {
+  struct tm civil = {};
+  civil.tm_year = year - 1900;
+  civil.tm_mon = month - 1;
+  civil.tm_mday = day;
+  civil.tm_hour = hour;
+  civil.tm_min = minute;
+  civil.tm_sec = second;
+  return timegm(&civil);
+}
+
+static const int32_t SECONDS_PER_DAY = 86400;
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_every_day_from_1900_to_2200_matches_the_reference() {
+  const int32_t first = referenceSeconds(1900, 1, 1) / SECONDS_PER_DAY;
+  const int32_t last = referenceSeconds(2200, 12, 31) / SECONDS_PER_DAY;
+  for (int32_t days = first; days <= last; days++) {
+    const time_t seconds = (time_t)days * SECONDS_PER_DAY;
+    struct tm civil;
+    gmtime_r(&seconds, &civil);
+
+    int year;
+    unsigned month, day;
+    civilFromDays(days, year, month, day);
+    TEST_ASSERT_EQUAL_INT(civil.tm_year + 1900, year);
+    TEST_ASSERT_EQUAL_UINT(civil.tm_mon + 1, month);
+    TEST_ASSERT_EQUAL_UINT(civil.tm_mday, day);
+    TEST_ASSERT_EQUAL_INT32(days, daysFromCivil(year, month, day));
+  }
+}
+
+void test_month_ends_roll_over() {
+  const unsigned lastDay[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  const int years[] = {1999, 2023, 2025};
+  for (int year : years) {
+    for (unsigned month = 1; month <= 12; month++) {
+      const int32_t end = daysFromCivil(year, month, lastDay[month - 1]);
+      const int32_t next = month == 12 ? daysFromCivil(year + 1, 1, 1)
+                                       : daysFromCivil(year, month + 1, 1);
+      TEST_ASSERT_EQUAL_INT32(end + 1, next);
+    }
+  }
+}
+
+void test_leap_days_follow_the_gregorian_rule() {
+  // Divisible by 4, except centuries not divisible by 400
+  const int leap[] = {1904, 1996, 2000, 2024, 2028, 2400};
+  const int common[] = {1900, 2023, 2100, 2200, 2300};
+  for (int year : leap) {
+    TEST_ASSERT_EQUAL_INT32(daysFromCivil(year, 2, 28) + 2,
+                            daysFromCivil(year, 3, 1));
+    int y;
+    unsigned month, day;
+    civilFromDays(daysFromCivil(year, 2, 28) + 1, y, month, day);
+    TEST_ASSERT_EQUAL_UINT(2, month);
+    TEST_ASSERT_EQUAL_UINT(29, day);
+  }
+  for (int year : common) {
+    TEST_ASSERT_EQUAL_INT32(daysFromCivil(year, 2, 28) + 1,
+                            daysFromCivil(year, 3, 1));
+  }
+  TEST_ASSERT_EQUAL_INT32(366, daysFromCivil(2025, 1, 1) -
+                                   daysFromCivil(2024, 1, 1));
+  TEST_ASSERT_EQUAL_INT32(365, daysFromCivil(2101, 1, 1) -
+                                   daysFromCivil(2100, 1, 1));
+}
+
+void test_epoch_ms_matches_the_reference_at_boundaries() {
+  struct Case {
+    int year;
+    unsigned month, day, hour, minute, second;
+  };
+  const Case cases[] = {
+      {1970, 1, 1, 0, 0, 0},     {1999, 12, 31, 23, 59, 59},
+      {2000, 1, 1, 0, 0, 0},     {2000, 2, 29, 12, 30, 15},
+      {2024, 2, 29, 23, 59, 59}, {2024, 3, 1, 0, 0, 0},
+      {2024, 4, 30, 23, 59, 59}, {2024, 5, 1, 8, 0, 0},
+      {2038, 1, 19, 3, 14, 8},   {2100, 2, 28, 23, 59, 59},
+      {2100, 3, 1, 0, 0, 0},
+  };
+  for (const Case &c : cases) {
+    const int64_t seconds =
+        referenceSeconds(c.year, c.month, c.day, c.hour, c.minute, c.second);
+    TEST_ASSERT_EQUAL_UINT64((uint64_t)seconds * 1000,
+                             epochMsFromCivil(c.year, c.month, c.day, c.hour,
+                                              c.minute, c.second));
+    TEST_ASSERT_EQUAL_UINT64((uint64_t)seconds * 1000 + 999,
+                             epochMsFromCivil(c.year, c.month, c.day, c.hour,
+                                              c.minute, c.second, 999));
+  }
+}
+
+void test_formatting_matches_the_reference() {
+  for (int64_t seconds = 0; seconds < referenceSeconds(2101, 1, 1);
+       seconds += 7 * SECONDS_PER_DAY + 3601 * 5 + 17) {
+    const time_t t = seconds;
+    struct tm civil;
+    gmtime_r(&t, &civil);
+    char expected[ISO8601_SIZE];
+    strftime(expected, sizeof(expected), "%Y-%m-%dT%H:%M:%SZ", &civil);
+
+    char out[ISO8601_SIZE];
+    const uint64_t epochMs = (uint64_t)seconds * 1000 + 999;
+    TEST_ASSERT_EQUAL_size_t(ISO8601_SIZE - 1, formatIso8601(epochMs, out));
+    TEST_ASSERT_EQUAL_STRING(expected, out);
+  }
+}
+
+void test_formatting_truncates_milliseconds_at_midnight() {
+  char out[ISO8601_SIZE];
+  formatIso8601(epochMsFromCivil(2024, 2, 29, 23, 59, 59, 999), out);
+  TEST_ASSERT_EQUAL_STRING("2024-02-29T23:59:59Z", out);
+  formatIso8601(epochMsFromCivil(2024, 2, 29, 23, 59, 59, 999) + 1, out);
+  TEST_ASSERT_EQUAL_STRING("2024-03-01T00:00:00Z", out);
+  formatIso8601(epochMsFromCivil(2024, 12, 31, 23, 59, 59, 999) + 1, out);
+  TEST_ASSERT_EQUAL_STRING("2025-01-01T00:00:00Z", out);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_day_from_1900_to_2200_matches_the_reference);
+  RUN_TEST(test_month_ends_roll_over);
+  RUN_TEST(test_leap_days_follow_the_gregorian_rule);
+  RUN_TEST(test_epoch_ms_matches_the_reference_at_boundaries);
+  RUN_TEST(test_formatting_matches_the_reference);
+  RUN_TEST(test_formatting_truncates_milliseconds_at_midnight);
+  return UNITY_END();
+}
@@ -0,0 +1,67 @@
+#include <trajectory.h>
+
+#include <unity.h>
+
+#include <cmath>
+
+// A fix heading north in a straight line, so the simplifier holds it back
+static DataRecord fix(uint32_t second, double noiseDb, double temperature) {
+  DataRecord record;
+  record.timestampMs = 1714550400000ULL + second * 1000ULL;
+  record.gpsData.addMeasurement(LATITUDE, 41.178 + second * 1e-5)
+      .addMeasurement(LONGITUDE, -8.598);
+  record.sensorData.addMeasurement(NOISE_LEVEL, noiseDb)
+      .addMeasurement(TEMPERATURE, temperature);
+  return record;
+}
+
+// Feeds the fixes and returns the one the line through them is kept as
+static DataRecord keptAfter(const DataRecord *fixes, size_t count) {
+  TrajectorySimplifier simplifier(5);
+  DataRecord kept;
+  TEST_ASSERT_TRUE(simplifier.add(fix(0, 0, 0), kept));
+  for (size_t i = 0; i < count; i++) {
+    TEST_ASSERT_FALSE(simplifier.add(fixes[i], kept));
+  }
+  TEST_ASSERT_TRUE(simplifier.flush(kept));
+  return kept;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_decibels_are_averaged_by_energy() {
+  const DataRecord fixes[] = {fix(1, 60, 20), fix(2, 80, 22), fix(3, 60, 20),
+                              fix(4, 80, 22)};
+  const DataRecord kept = keptAfter(fixes, 4);
+
+  // 80 dB carries a hundred times the energy of 60 dB
+  const double energyMean = 10 * std::log10((1e6 + 1e8) / 2);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, energyMean,
+                            kept.sensorData.value(NOISE_LEVEL));
+  TEST_ASSERT_DOUBLE_WITHIN(0.01, 77.03, kept.sensorData.value(NOISE_LEVEL));
+}
+
+void test_linear_values_keep_the_arithmetic_mean() {
+  const DataRecord fixes[] = {fix(1, 60, 20), fix(2, 80, 22), fix(3, 60, 20),
+                              fix(4, 80, 23)};
+  const DataRecord kept = keptAfter(fixes, 4);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, 21.25, kept.sensorData.value(TEMPERATURE));
+}
+
+void test_a_steady_level_stays_put() {
+  const DataRecord fixes[] = {fix(1, 71.5, 20), fix(2, 71.5, 20),
+                              fix(3, 71.5, 20)};
+  const DataRecord kept = keptAfter(fixes, 3);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, 71.5, kept.sensorData.value(NOISE_LEVEL));
+  TEST_ASSERT_EQUAL_UINT64(fixes[2].timestampMs, kept.timestampMs);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_decibels_are_averaged_by_energy);
+  RUN_TEST(test_linear_values_keep_the_arithmetic_mean);
+  RUN_TEST(test_a_steady_level_stays_put);
+  return UNITY_END();
+}
@@ -0,0 +1,218 @@
+#include "../ride.h"
+
+#include <ubxGps.h>
+
+#include <unity.h>
+
+#include <cstdio>
+#include <vector>
+
+// 2024-05-01 08:00:05.250Z
+static const uint64_t FIX_MS = 1714550405250ULL;
+
+static void putU2(std::vector<uint8_t> &p, size_t at, uint16_t value) {
+  p[at] = value & 0xFF;
+  p[at + 1] = value >> 8;
+}
+
+static void putU4(std::vector<uint8_t> &p, size_t at, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    p[at + i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+// A NAV-PVT payload as the receiver sends it, length bytes long
+static std::vector<uint8_t> navPvt(size_t length) {
+  std::vector<uint8_t> p(length, 0);
+  putU2(p, 4, 2024);
+  p[6] = 5;
+  p[7] = 1;
+  p[8] = 8;
+  p[9] = 0;
+  p[10] = 5;
+  p[11] = 0x03;                      // date and time valid
+  putU4(p, 16, 250000000);           // nano
+  p[20] = 3;                         // 3D fix
+  p[21] = 0x01;                      // gnssFixOk
+  p[23] = 11;                        // satellites
+  putU4(p, 24, (uint32_t)-85980000); // lon, 1e-7 deg
+  putU4(p, 28, 411780000);           // lat
+  putU4(p, 36, 120500);              // hMSL, mm
+  putU4(p, 60, 5042);                // gSpeed, mm/s
+  putU4(p, 64, 8750000);             // headMot, 1e-5 deg
+  putU2(p, 76, 135);                 // pDOP
+  return p;
+}
+
+static std::vector<uint8_t> navDop() {
+  std::vector<uint8_t> p(18, 0);
+  putU2(p, 10, 142); // vDOP
+  putU2(p, 12, 87);  // hDOP
+  return p;
+}
+
+static std::string frame(uint8_t messageClass, uint8_t messageId,
+                         const std::vector<uint8_t> &payload) {
+  std::vector<uint8_t> bytes = {0xB5, 0x62, messageClass, messageId, 0, 0};
+  putU2(bytes, 4, payload.size());
+  bytes.insert(bytes.end(), payload.begin(), payload.end());
+  uint8_t ckA = 0, ckB = 0;
+  for (size_t i = 2; i < bytes.size(); i++) {
+    ckA += bytes[i];
+    ckB += ckA;
+  }
+  bytes.push_back(ckA);
+  bytes.push_back(ckB);
+  return std::string(bytes.begin(), bytes.end());
+}
+
+static void inject(const std::string &bytes) {
+  TEST_ASSERT_EQUAL_size_t(bytes.size(),
+                           Serial1.inject(bytes.data(), bytes.size()));
+}
+
+void setUp() {
+  resetHost();
+  while (Serial1.available() > 0) {
+    Serial1.read();
+  }
+  Serial1.overflow();
+}
+
+void tearDown() { Serial1.setOutput(nullptr); }
+
+static void assertCannedFix(UbxGps &gps) {
+  TEST_ASSERT_TRUE(gps.isValid());
+  TEST_ASSERT_TRUE(gps.isUpdated());
+  TEST_ASSERT_EQUAL_UINT64(FIX_MS, gps.timestampMs());
+
+  const SensorReading fix = gps.read();
+  TEST_ASSERT_FALSE(gps.isUpdated());
+  TEST_ASSERT_EQUAL_DOUBLE(41.178, fix.value(LATITUDE));
+  TEST_ASSERT_EQUAL_DOUBLE(-8.598, fix.value(LONGITUDE));
+  TEST_ASSERT_EQUAL_DOUBLE(120.5, fix.value(ALTITUDE));
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, 5.042 * 3.6, fix.value(SPEED));
+  TEST_ASSERT_EQUAL_DOUBLE(87.5, fix.value(COURSE));
+  TEST_ASSERT_EQUAL_DOUBLE(11, fix.value(SATELLITES_IN_USE));
+  TEST_ASSERT_EQUAL_DOUBLE(3, fix.value(FIX_TYPE));
+  TEST_ASSERT_EQUAL_DOUBLE(1.35, fix.value(PDOP));
+}
+
+void test_a_canned_m8_frame_is_decoded() {
+  UbxGps gps;
+  gps.setup();
+  inject(frame(0x01, 0x07, navPvt(92)));
+  gps.update();
+
+  TEST_ASSERT_EQUAL_UINT32(1, gps.frames());
+  assertCannedFix(gps);
+}
+
+void test_the_shorter_frame_of_a_ublox_7_is_decoded() {
+  UbxGps gps;
+  gps.setup();
+  inject(frame(0x01, 0x07, navPvt(84)));
+  gps.update();
+  assertCannedFix(gps);
+}
+
+void test_a_truncated_frame_is_ignored() {
+  UbxNavSolution solution;
+  const std::vector<uint8_t> payload = navPvt(83);
+  TEST_ASSERT_FALSE(
+      decodeUbxNav(0x01, 0x07, payload.data(), payload.size(), solution));
+  TEST_ASSERT_EQUAL_UINT16(0, solution.year);
+
+  UbxGps gps;
+  gps.setup();
+  inject(frame(0x01, 0x07, payload));
+  gps.update();
+  TEST_ASSERT_EQUAL_UINT32(1, gps.frames());
+  TEST_ASSERT_FALSE(gps.isValid());
+  TEST_ASSERT_FALSE(gps.isUpdated());
+}
+
+void test_dop_is_added_once_received() {
+  UbxGps gps;
+  gps.setup();
+  inject(frame(0x01, 0x07, navPvt(92)));
+  gps.update();
+  TEST_ASSERT_FALSE(gps.read().has(HDOP));
+
+  inject(frame(0x01, 0x04, navDop()) + frame(0x01, 0x07, navPvt(92)));
+  gps.update();
+  const SensorReading fix = gps.read();
+  TEST_ASSERT_EQUAL_DOUBLE(0.87, fix.value(HDOP));
+  TEST_ASSERT_EQUAL_DOUBLE(1.42, fix.value(VDOP));
+}
+
+void test_a_bad_checksum_drops_the_frame() {
+  UbxGps gps;
+  gps.setup();
+  std::string bytes = frame(0x01, 0x07, navPvt(92));
+  bytes[30] ^= 0x10;
+  // Resynchronizes on the next frame
+  inject(bytes + frame(0x01, 0x07, navPvt(92)));
+  gps.update();
+  TEST_ASSERT_EQUAL_UINT32(1, gps.checksumFailures());
+  TEST_ASSERT_EQUAL_UINT32(1, gps.frames());
+  assertCannedFix(gps);
+}
+
+void test_an_oversized_frame_is_skipped() {
+  UbxParser parser;
+  const std::string bytes =
+      frame(0x01, 0x07, std::vector<uint8_t>(UbxParser::MAX_PAYLOAD + 1)) +
+      frame(0x01, 0x04, navDop());
+  uint32_t complete = 0;
+  for (char byte : bytes) {
+    complete += parser.feed(byte);
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, parser.oversized());
+  TEST_ASSERT_EQUAL_UINT32(1, complete);
+  TEST_ASSERT_EQUAL_UINT8(0x04, parser.messageId());
+}
+
+// Measurement period of the CFG-RATE command setup() sends
+static uint16_t configuredPeriodMs(uint16_t navRateHz) {
+  FILE *out = tmpfile();
+  Serial1.setOutput(out);
+  UbxGps gps(navRateHz);
+  gps.setup();
+  Serial1.setOutput(nullptr);
+
+  std::vector<uint8_t> sent(ftell(out));
+  rewind(out);
+  TEST_ASSERT_EQUAL_size_t(sent.size(),
+                           fread(sent.data(), 1, sent.size(), out));
+  fclose(out);
+
+  for (size_t i = 0; i + 8 <= sent.size(); i++) {
+    if (sent[i] == 0xB5 && sent[i + 1] == 0x62 && sent[i + 2] == 0x06 &&
+        sent[i + 3] == 0x08) {
+      return sent[i + 6] | (sent[i + 7] << 8);
+    }
+  }
+  TEST_FAIL_MESSAGE("no CFG-RATE sent");
+  return 0;
+}
+
+void test_the_navigation_rate_sets_the_measurement_period() {
+  TEST_ASSERT_EQUAL_UINT16(200, configuredPeriodMs(5));
+  TEST_ASSERT_EQUAL_UINT16(100, configuredPeriodMs(10));
+  // Clamped rather than divided by zero
+  TEST_ASSERT_EQUAL_UINT16(1000, configuredPeriodMs(0));
+  TEST_ASSERT_EQUAL_UINT16(1, configuredPeriodMs(5000));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_a_canned_m8_frame_is_decoded);
+  RUN_TEST(test_the_shorter_frame_of_a_ublox_7_is_decoded);
+  RUN_TEST(test_a_truncated_frame_is_ignored);
+  RUN_TEST(test_dop_is_added_once_received);
+  RUN_TEST(test_a_bad_checksum_drops_the_frame);
+  RUN_TEST(test_an_oversized_frame_is_skipped);
+  RUN_TEST(test_the_navigation_rate_sets_the_measurement_period);
+  return UNITY_END();
+}
@@ -0,0 +1,231 @@
+#include "../ride.h"
+
+#include <sdCard.h>
+
+#include <unity.h>
+
+#include <algorithm>
+#include <vector>
+
+// Records and headers of every upload the server saw
+struct Upload {
+  uint32_t records;
+  bool chunked;
+  bool gzip;
+  std::string tripId;
+};
+
+static std::vector<Upload> uploads;
+
+static uint32_t countRecords(const std::string &body) {
+  uint32_t count = 0;
+  for (size_t at = body.find("{\"timestamp\""); at != std::string::npos;
+       at = body.find("{\"timestamp\"", at + 1)) {
+    count++;
+  }
+  return count;
+}
+
+void setUp() {
+  resetHost();
+  uploads.clear();
+  loopbackServer.onRequest =
+      [](const std::string &path,
+         const std::map<std::string, std::string> &headers,
+         const std::string &body) {
+        if (path.find("/trip/upload_data") == std::string::npos) {
+          return;
+        }
+        auto header = [&headers](const char *name) {
+          auto it = headers.find(name);
+          return it == headers.end() ? std::string() : it->second;
+        };
+        uploads.push_back({countRecords(body),
+                           header("transfer-encoding") == "chunked",
+                           header("content-encoding") == "gzip",
+                           header("trip-id")});
+      };
+}
+
+void tearDown() { clearInterrupts(); }
+
+// Rides for rideMs with WiFi out of range, then docks until the trip is
+// uploaded. Returns the records stored during the ride.
+static uint32_t rideAndDock(BikeSense &device, unsigned long rideMs) {
+  device.setup();
+  FixFeed feed;
+  feed.start();
+  stepFor(device, rideMs);
+  clearInterrupts();
+
+  WiFi.setInRange(true);
+  stepFor(device, 120000);
+  WiFi.setInRange(false);
+  return feed.fixes;
+}
+
+void test_builder_defaults_upload_in_batches() {
+  BikeSenseBuilder builder = deviceBuilder(new SDCard(BINARY_RECORDS));
+  BikeSense device = builder.build();
+  const uint32_t fixes = rideAndDock(device, 60000);
+
+  TEST_ASSERT_GREATER_THAN(2, uploads.size());
+  TEST_ASSERT_EQUAL_UINT32(BikeSense::DEFAULT_UPLOAD_BATCH_SIZE,
+                           uploads[0].records);
+  for (const Upload &upload : uploads) {
+    TEST_ASSERT_FALSE(upload.chunked);
+    TEST_ASSERT_FALSE(upload.gzip);
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.trips);
+  // Every request of the dock goes over one keep-alive connection
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.connects);
+  // A fix may still be on its way when the ride ends
+  TEST_ASSERT_LESS_OR_EQUAL(fixes, loopbackServer.stats.records);
+  TEST_ASSERT_GREATER_OR_EQUAL(fixes - 2, loopbackServer.stats.records);
+}
+
+void test_builder_options_reach_the_device() {
+  BikeSenseBuilder builder = deviceBuilder(new SDCard(BINARY_RECORDS));
+  builder.withUploadMode(STREAMED_UPLOAD).withCompression(true);
+  BikeSense device = builder.build();
+  rideAndDock(device, 60000);
+
+  TEST_ASSERT_EQUAL_size_t(1, uploads.size());
+  TEST_ASSERT_TRUE(uploads[0].chunked);
+  TEST_ASSERT_TRUE(uploads[0].gzip);
+}
+
+// Heap used on top of what the device held when it docked, while it
+// streamed a ride of rideMs
+static size_t streamedUploadHeap(unsigned long rideMs, uint32_t &records) {
+  BikeSenseBuilder builder = deviceBuilder(new SDCard(BINARY_RECORDS));
+  builder.withUploadMode(STREAMED_UPLOAD);
+  BikeSense device = builder.build();
+  device.setup();
+
+  FixFeed feed;
+  feed.start();
+  stepFor(device, rideMs);
+  clearInterrupts();
+
+  const size_t dockedHeap = usedHeap();
+  resetPeakHeap();
+  WiFi.setInRange(true);
+  stepFor(device, 120000);
+  WiFi.setInRange(false);
+
+  records = loopbackServer.stats.records;
+  TEST_ASSERT_EQUAL_size_t(1, uploads.size());
+  TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.connects);
+  TEST_ASSERT_GREATER_OR_EQUAL(feed.fixes - 2, records);
+  return peakHeap() - dockedHeap;
+}
+
+void test_streamed_upload_heap_does_not_grow_with_the_trip() {
+  uint32_t shortRecords;
+  const size_t shortHeap = streamedUploadHeap(2 * 60000, shortRecords);
+  setUp();
+  uint32_t longRecords;
+  const size_t longHeap = streamedUploadHeap(20 * 60000, longRecords);
+
+  TEST_ASSERT_GREATER_THAN(5 * shortRecords, longRecords);
+  TEST_ASSERT_GREATER_THAN(0, shortHeap);
+  // Buffers are sized by the batch and the chunk, not by the trip
+  TEST_ASSERT_LESS_OR_EQUAL(shortHeap + 1024, longHeap);
+  TEST_ASSERT_LESS_THAN(32 * 1024, longHeap);
+}
+
+// Most decimals of any latitude uploaded during a ride stored as format
+static size_t latitudeDecimals(StorageFormat format) {
+  std::string bodies;
+  loopbackServer.onRequest =
+      [&bodies](const std::string &path,
+                const std::map<std::string, std::string> &headers,
+                const std::string &body) {
+        if (path.find("/trip/upload_data") != std::string::npos) {
+          bodies += body;
+        }
+      };
+
+  BikeSenseBuilder builder = deviceBuilder(new SDCard(format));
+  BikeSense device = builder.build();
+  rideAndDock(device, 60000);
+  TEST_ASSERT_GREATER_THAN(0, loopbackServer.stats.records);
+
+  size_t decimals = 0;
+  for (size_t at = bodies.find("\"latitude\":"); at != std::string::npos;
+       at = bodies.find("\"latitude\":", at + 1)) {
+    const size_t dot = bodies.find('.', at);
+    const size_t end = bodies.find_first_not_of("0123456789", dot + 1);
+    decimals = std::max(decimals, end - dot - 1);
+  }
+  return decimals;
+}
+
+void test_json_lines_store_samples_as_taken() {
+  // The binary layout keeps 7 decimals of a coordinate, the receiver gives
+  // more
+  TEST_ASSERT_LESS_OR_EQUAL(7, latitudeDecimals(BINARY_RECORDS));
+  setUp();
+  TEST_ASSERT_GREATER_THAN(7, latitudeDecimals(JSON_LINES));
+}
+
+// Rides, then docks with the server failing every upload and resets the
+// device once the first batch was sent, before it gives up. Returns the
+// fixes of that ride.
+static uint32_t resetDuringFirstBatch(StorageFormat format) {
+  loopbackServer.uploadStatus = 500;
+  BikeSenseBuilder builder = deviceBuilder(new SDCard(format));
+  BikeSense device = builder.build();
+  device.setup();
+  FixFeed feed;
+  feed.start();
+  stepFor(device, 60000);
+  clearInterrupts();
+
+  WiFi.setInRange(true);
+  // The step after the failed upload would reboot, which ends the run
+  while (loopbackServer.stats.uploads == 0) {
+    device.step();
+  }
+  WiFi.setInRange(false);
+  loopbackServer.uploadStatus = 201;
+  return feed.fixes;
+}
+
+void test_a_reset_during_the_first_batch_resumes_the_trip() {
+  const StorageFormat formats[] = {BINARY_RECORDS, COLUMNAR_BLOCKS};
+  for (StorageFormat format : formats) {
+    setUp();
+    const uint32_t firstRide = resetDuringFirstBatch(format);
+    TEST_ASSERT_EQUAL_UINT32(1, loopbackServer.stats.trips);
+    const std::string tripId = uploads.front().tripId;
+    uploads.clear();
+
+    // Booted on the same card, the device idles at the dock and uploads
+    // the backlog with its next ride
+    BikeSenseBuilder builder = deviceBuilder(new SDCard(format));
+    BikeSense device = builder.build();
+    const uint32_t secondRide = rideAndDock(device, 60000);
+
+    uint32_t resumed = 0;
+    for (const Upload &upload : uploads) {
+      resumed += upload.tripId == tripId ? upload.records : 0;
+    }
+    // The interrupted segment is not registered again
+    TEST_ASSERT_EQUAL_UINT32(2, loopbackServer.stats.trips);
+    TEST_ASSERT_EQUAL_UINT32(firstRide, resumed);
+    TEST_ASSERT_EQUAL_UINT32(firstRide + secondRide,
+                             loopbackServer.stats.records);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_builder_defaults_upload_in_batches);
+  RUN_TEST(test_builder_options_reach_the_device);
+  RUN_TEST(test_streamed_upload_heap_does_not_grow_with_the_trip);
+  RUN_TEST(test_json_lines_store_samples_as_taken);
+  RUN_TEST(test_a_reset_during_the_first_batch_resumes_the_trip);
+  return UNITY_END();
+}
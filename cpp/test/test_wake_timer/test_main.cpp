@@ -0,0 +1,157 @@
+#include "../ride.h"
+
+#include <sdCard.h>
+#include <wakeTimer.h>
+
+#include <unity.h>
+
+#include <vector>
+
+// Read every 250 ms, remembers when
+class TimedSensor : public SensorInterface {
+public:
+  std::vector<unsigned long> readsAt;
+
+  void setup() override {}
+  SensorReading read() override {
+    readsAt.push_back(millis());
+    SensorReading reading;
+    reading.addMeasurement(NOISE_LEVEL, 61.5);
+    return reading;
+  }
+  uint32_t periodMs() const override { return 250; }
+};
+
+// Steps the device for ms and returns the virtual time of each wakeup
+static std::vector<unsigned long> wakeupsFor(BikeSense &device,
+                                             unsigned long ms) {
+  std::vector<unsigned long> wakeups;
+  const unsigned long endMs = millis() + ms;
+  while (millis() < endMs) {
+    device.step();
+    wakeups.push_back(millis());
+  }
+  return wakeups;
+}
+
+void setUp() { resetHost(); }
+
+void tearDown() { clearInterrupts(); }
+
+void test_the_earliest_deadline_sets_the_wait() {
+  WakeTimer wake(1000);
+  TEST_ASSERT_EQUAL_UINT32(1000, wake.waitMs());
+  wake.due(300);
+  wake.dueAfter(100, 500);
+  TEST_ASSERT_EQUAL_UINT32(300, wake.waitMs());
+  wake.dueAfter(900, 1000);
+  TEST_ASSERT_EQUAL_UINT32(100, wake.waitMs());
+  wake.due(200);
+  TEST_ASSERT_EQUAL_UINT32(100, wake.waitMs());
+
+  // Overdue counts as due now
+  wake.dueAfter(1200, 1000);
+  TEST_ASSERT_EQUAL_UINT32(0, wake.waitMs());
+
+  WakeTimer capped(1000);
+  capped.due(5000);
+  capped.dueAfter(0, 30000);
+  TEST_ASSERT_EQUAL_UINT32(1000, capped.waitMs());
+}
+
+void test_a_sleep_lasts_until_the_deadline() {
+  const unsigned long startUs = micros();
+  const uint64_t idleUs = idleMicros();
+  WakeTimer wake(1000);
+  wake.due(250);
+  wake.sleep();
+  TEST_ASSERT_EQUAL_UINT32(startUs + 250000, micros());
+  TEST_ASSERT_EQUAL_UINT64(idleUs + 250000, idleMicros());
+
+  WakeTimer due(1000);
+  due.due(0);
+  due.sleep();
+  TEST_ASSERT_EQUAL_UINT32(startUs + 250000, micros());
+}
+
+void test_an_interrupt_ends_the_sleep_early() {
+  std::vector<unsigned long> handledAt;
+  const unsigned long startUs = micros();
+  scheduleInterrupt(startUs + 40000, [&]() { handledAt.push_back(micros()); });
+  scheduleInterrupt(startUs + 400000,
+                    [&]() { handledAt.push_back(micros()); });
+
+  WakeTimer wake(250);
+  wake.sleep();
+  TEST_ASSERT_EQUAL_UINT32(startUs + 40000, micros());
+  TEST_ASSERT_EQUAL_size_t(1, handledAt.size());
+
+  // The second one is after the deadline, the sleep times out first
+  wake.sleep();
+  TEST_ASSERT_EQUAL_UINT32(startUs + 290000, micros());
+  TEST_ASSERT_EQUAL_size_t(1, handledAt.size());
+
+  WakeTimer longer(1000);
+  longer.sleep();
+  TEST_ASSERT_EQUAL_UINT32(startUs + 400000, micros());
+  TEST_ASSERT_EQUAL_size_t(2, handledAt.size());
+}
+
+void test_an_idle_device_wakes_for_the_heartbeat() {
+  BikeSense device = deviceBuilder(new SDCard(BINARY_RECORDS)).build();
+  device.setup();
+  stepFor(device, 1000);
+
+  // No fix, nothing but the LED every 500 ms and the WiFi check on one of
+  // those
+  const unsigned long startMs = millis();
+  const std::vector<unsigned long> wakeups = wakeupsFor(device, 10000);
+  TEST_ASSERT_EQUAL_size_t(20, wakeups.size());
+  for (size_t i = 0; i < wakeups.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT32(startMs + (i + 1) * 500, wakeups[i]);
+  }
+}
+
+void test_a_ride_wakes_only_for_its_deadlines() {
+  TimedSensor *sensor = new TimedSensor();
+  BikeSenseBuilder builder = deviceBuilder(new SDCard(BINARY_RECORDS));
+  builder.addSensor(sensor);
+  BikeSense device = builder.build();
+  device.setup();
+  FixFeed feed;
+  feed.start();
+  stepFor(device, 5000);
+
+  const unsigned long startMs = millis();
+  const size_t readsBefore = sensor->readsAt.size();
+  const std::vector<unsigned long> wakeups = wakeupsFor(device, 10000);
+
+  // Sensor reads every 250 ms, the LED every 500 and a fix every second,
+  // which may take a second iteration when it lands with a read
+  unsigned long lastMs = startMs;
+  for (unsigned long wakeMs : wakeups) {
+    TEST_ASSERT_TRUE(wakeMs >= lastMs);
+    TEST_ASSERT_TRUE(wakeMs - lastMs <= 250);
+    TEST_ASSERT_EQUAL_UINT32(0, (wakeMs - startMs) % 250);
+    lastMs = wakeMs;
+  }
+  TEST_ASSERT_TRUE(wakeups.size() >= 40);
+  TEST_ASSERT_TRUE(wakeups.size() <= 50);
+
+  // Every read started at its deadline, none late
+  TEST_ASSERT_EQUAL_size_t(40, sensor->readsAt.size() - readsBefore);
+  for (size_t i = readsBefore + 1; i < sensor->readsAt.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT32(250,
+                             sensor->readsAt[i] - sensor->readsAt[i - 1]);
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_the_earliest_deadline_sets_the_wait);
+  RUN_TEST(test_a_sleep_lasts_until_the_deadline);
+  RUN_TEST(test_an_interrupt_ends_the_sleep_early);
+  RUN_TEST(test_an_idle_device_wakes_for_the_heartbeat);
+  RUN_TEST(test_a_ride_wakes_only_for_its_deadlines);
+  return UNITY_END();
+}